@@ -10,22 +10,27 @@
 
 #include "assert.h"
 #include "trace.h"
+#include "config.h"
 
 /* application specific definitions */
 #define configUSE_PREEMPTION          1
 #define configUSE_IDLE_HOOK           0
-#define configUSE_TICK_HOOK           0
+#define configUSE_TICK_HOOK           USE_RUN_STATS
 #define configCPU_CLOCK_HZ            ((unsigned long)72000000)
 #define configTICK_RATE_HZ            ((TickType_t)1000)
 #define configMAX_PRIORITIES          (5)
 #define configMINIMAL_STACK_SIZE      ((unsigned short)128)
-#define configTOTAL_HEAP_SIZE         ((size_t)(25 * 1024))
+/* all kernel objects are static, heap is dropped by linker when unused */
+#define configSUPPORT_STATIC_ALLOCATION    1
+#define configSUPPORT_DYNAMIC_ALLOCATION   0
+#define configTOTAL_HEAP_SIZE         ((size_t)(1 * 1024))
 #define configMAX_TASK_NAME_LEN       (16)
-#define configUSE_TRACE_FACILITY      0
+#define configUSE_TRACE_FACILITY      USE_RUN_STATS
+#define configGENERATE_RUN_TIME_STATS USE_RUN_STATS
 #define configUSE_16_BIT_TICKS        0
 #define configIDLE_SHOULD_YIELD       1
 #define configUSE_MUTEXES             1
-#define configUSE_TIMERS              1
+#define configUSE_TIMERS              0
 
 
 /* Co-routine definitions. */
@@ -43,17 +48,26 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelayUntil                 0
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_uxTaskGetStackHighWaterMark     1
-
-/* Software timer definitions. */
-#define configTIMER_TASK_PRIORITY       (tskIDLE_PRIORITY + 1)
-#define configTIMER_QUEUE_LENGTH        32
-#define configTIMER_TASK_STACK_DEPTH    (configMINIMAL_STACK_SIZE * 2)
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_xTaskGetSchedulerState          1
 
 /* value can be 0(highest) to 15(lowest)*/
 #define configKERNEL_INTERRUPT_PRIORITY                 (15)
 #define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY    (10)
 
 
+/* run time statistics, counter is driven by core cycle counter */
+#if USE_RUN_STATS
+extern void stats_timer_init(void);
+extern uint32_t stats_counter(void);
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()    stats_timer_init()
+#define portGET_RUN_TIME_COUNTER_VALUE()            stats_counter()
+#if configSUPPORT_DYNAMIC_ALLOCATION
+extern void stats_heap_update(size_t free);
+#define traceMALLOC(pvAddress, uiSize)              stats_heap_update(xPortGetFreeHeapSize())
+#endif
+#endif
+
 #ifdef __DEBUG
 extern void assert_failed(const char *file, const char *line, const char *exp);
 #define STR(x) VAL(x)
@@ -11,6 +11,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "serial.h"
 #include "global.h"
 #include "dbgserial.h"
@@ -22,6 +23,8 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[altimeter]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_ALTIMETER
 
 typedef struct
 {
@@ -65,6 +68,17 @@ extern parameters_t board_parameter;
 /* serial handle */
 static serial *g_serial = NULL;
 
+/* floor height band, sorted by height */
+typedef struct
+{
+    uint16_t low;
+    uint16_t high;
+    floor_t floor;
+} height_band_t;
+
+static height_band_t height_bands[MAX_TOTAL_FLOOR_NUM];
+static uint16_t band_num = 0;
+
 static uint32_t bin2hex(const uint8_t *data, uint8_t len)
 {
     uint32_t hex_data = 0;
@@ -149,28 +163,61 @@ static bool msg2tof(const uint8_t *data, uint8_t len)
  * @param[in] height: floor height
  * @return floor
  */
-uint8_t altimeter_get_height_floor(uint16_t height)
+floor_t altimeter_get_height_floor(uint16_t height)
 {
-    //TRACE("get height floor: %d-%d\r\n", height, board_parameter.threshold);
-    uint16_t floor_height_high, floor_height_low;
-    for (uint8_t i = 0; i < MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1); ++i)
+    uint16_t low = 0;
+    uint16_t high = band_num;
+    while (low < high)
     {
-        if (0 != board_parameter.floor_height[i].height)
+        uint16_t mid = (low + high) / 2;
+        if (height <= height_bands[mid].low)
         {
-            floor_height_high = board_parameter.floor_height[i].height + board_parameter.threshold;
-            floor_height_low = board_parameter.floor_height[i].height - board_parameter.threshold;
-            //TRACE("floor %d-%d-%d\r\n", board_parameter.floor_height[i].floor, floor_height_low, floor_height_high);
-
-            if ((height > floor_height_low) && (height < floor_height_high))
-            {
-                return board_parameter.floor_height[i].floor;
-            }
+            high = mid;
+        }
+        else if (height >= height_bands[mid].high)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            return height_bands[mid].floor;
         }
     }
 
     return INVALID_FLOOR;
 }
 
+/**
+ * @brief rebuild height band index from floor height table and threshold
+ */
+void altimeter_apply_param(void)
+{
+    vTaskSuspendAll();
+    band_num = 0;
+    for (uint16_t i = 0; i < MAX_TOTAL_FLOOR_NUM; ++i)
+    {
+        uint16_t height = board_parameter.floor_height[i].height;
+        if (0 == height)
+        {
+            continue;
+        }
+
+        /** insert sorted */
+        uint16_t pos = band_num;
+        while ((pos > 0) && (height_bands[pos - 1].high > height + board_parameter.threshold))
+        {
+            height_bands[pos] = height_bands[pos - 1];
+            pos --;
+        }
+        height_bands[pos].low = (height > board_parameter.threshold) ?
+                                (height - board_parameter.threshold) : 0;
+        height_bands[pos].high = height + board_parameter.threshold;
+        height_bands[pos].floor = board_parameter.floor_height[i].floor;
+        band_num ++;
+    }
+    xTaskResumeAll();
+}
+
 /**
  * @brief altimeter receive distance task
  * @param pvParameters - task parameter
@@ -182,8 +229,8 @@ static void vAltimeter(void *pvParameters)
     uint8_t *pdata = recv_data;
     char data = 0;
     uint8_t len = 0;
-    uint8_t floor_cur = 0;
-    uint8_t floor_prev = 0;
+    floor_t floor_cur = 0;
+    floor_t floor_prev = 0;
     /** end with 0d 0a */
     for (;;)
     {
@@ -232,6 +279,10 @@ static void vAltimeter(void *pvParameters)
     }
 }
 
+/* altimeter task memory */
+static StaticTask_t altimeter_task;
+static StackType_t altimeter_stack[ALTIMETER_STACK_SIZE];
+
 /**
  * @brief initialize altimeter
  */
@@ -246,8 +297,9 @@ bool altimeter_init(void)
     }
     serial_set_baudrate(g_serial, Baudrate_115200);
     serial_open(g_serial);
-    xTaskCreate(vAltimeter, "altimeter", ALTIMETER_STACK_SIZE, g_serial,
-                ALTIMETER_PRIORITY, NULL);
+    altimeter_apply_param();
+    xTaskCreateStatic(vAltimeter, "altimeter", ALTIMETER_STACK_SIZE, g_serial,
+                      ALTIMETER_PRIORITY, altimeter_stack, &altimeter_task);
     return TRUE;
 }
 
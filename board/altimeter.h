@@ -15,6 +15,7 @@ BEGIN_DECLS
 
 bool altimeter_init(void);
 uint32_t altimeter_get_distance(void);
+void altimeter_apply_param(void);
 
 END_DECLS
 
@@ -10,10 +10,9 @@
 #include "altimeter_calc.h"
 #include "altimeter.h"
 #include "FreeRTOS.h"
-#include "semphr.h"
-#include "queue.h"
 #include "task.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "serial.h"
 #include "global.h"
 #include "dbgserial.h"
@@ -22,14 +21,18 @@
 #include "protocol_param.h"
 #include "elevator.h"
 #include "floormap.h"
+#include "boardmap.h"
+#include "mailbox.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[altimeter_calc]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_ALTIMETER
 
 extern parameters_t board_parameter;
 static calc_action_t calc_action = CALC_STOP;
-static xQueueHandle xQueueCalc = NULL;
-#define ALTIMETER_IDLE_INTERVAL    (200 / portTICK_PERIOD_MS)
+/* calculate floor is posted to calculate task mailbox */
+static TaskHandle_t xCalcTask = NULL;
 
 
 /**
@@ -37,10 +40,10 @@ static xQueueHandle xQueueCalc = NULL;
  * @param[in] floor: floor number
  * @param[in] height: floor height
  */
-static uint16_t update_floor_height(uint8_t floor, uint32_t height)
+static uint16_t update_floor_height(floor_t floor, uint32_t height)
 {
     uint16_t ret = 0;
-    for (uint8_t i = 0; i < MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1); ++i)
+    for (uint16_t i = 0; i < MAX_TOTAL_FLOOR_NUM; ++i)
     {
         if (board_parameter.floor_height[i].floor == floor)
         {
@@ -57,6 +60,7 @@ static uint16_t update_floor_height(uint8_t floor, uint32_t height)
             TRACE("update floor height: %d-%d(cm)", floor, board_parameter.floor_height[i].height);
         }
     }
+    altimeter_apply_param();
 
     return ret;
 }
@@ -67,44 +71,43 @@ static uint16_t update_floor_height(uint8_t floor, uint32_t height)
  */
 static void vAltimeterCalc(void *pvParameters)
 {
-    uint8_t floor = 1;
+    uint32_t value = 0;
+    floor_t floor = 1;
     uint16_t average_height = 0;
     uint32_t distance = 0;
     for (;;)
     {
-        if (CALC_START == calc_action)
+        /** floor posted when calculation stopped is dropped */
+        if (mailbox_wait(&value, portMAX_DELAY) && (CALC_START == calc_action))
         {
-            if (xQueueReceive(xQueueCalc, &floor, portMAX_DELAY))
-            {
-                distance = altimeter_get_distance();
-                average_height = update_floor_height(floor, distance);
+            floor = (floor_t)(uint16_t)value;
+            distance = altimeter_get_distance();
+            average_height = update_floor_height(floor, distance);
 
-                notify_calc(floor, average_height, distance / 10);
-            }
-        }
-        else
-        {
-            vTaskDelay(ALTIMETER_IDLE_INTERVAL);
+            notify_calc(floor, average_height, distance / 10);
         }
     }
 }
 
+/* calculate task memory */
+static StaticTask_t calc_task;
+static StackType_t calc_stack[ALTIMETER_CALC_STACK_SIZE];
+
 /**
  * @brief initialize altimeter
  */
 bool altimeter_calc_init(void)
 {
     TRACE("initialize altimeter calculate....\r\n");
-    xQueueCalc = xQueueCreate(1, 1);
-    xTaskCreate(vAltimeterCalc, "altimeter_calc", ALTIMETER_CALC_STACK_SIZE,
-                NULL, ALTIMETER_CALC_PRIORITY, NULL);
+    xCalcTask = xTaskCreateStatic(vAltimeterCalc, "altimeter_calc", ALTIMETER_CALC_STACK_SIZE,
+                                  NULL, ALTIMETER_CALC_PRIORITY, calc_stack, &calc_task);
     return TRUE;
 }
 
-void altimeter_calc_once(uint8_t floor)
+void altimeter_calc_once(floor_t floor)
 {
     TRACE("calculate once: %d\r\n", floor);
-    xQueueOverwrite(xQueueCalc, &floor);
+    mailbox_post(xCalcTask, (uint16_t)floor);
 }
 
 bool altimeter_calc_run(calc_action_t action)
@@ -113,27 +116,25 @@ bool altimeter_calc_run(calc_action_t action)
     calc_action = action;
     if (CALC_STOP == action)
     {
-        param_store_floor_height(MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1),
-                                 board_parameter.floor_height);
-
-        TRACE("rebooting...\r\n");
-        SCB_SystemReset();
+        /** height index already follows calculation, only store it */
+        param_store_floor_height(MAX_TOTAL_FLOOR_NUM, board_parameter.floor_height);
+        param_sync();
     }
     else
     {
         /** clear all floor height first */
-        for (uint8_t i = 0; i < MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1); ++i)
+        for (uint16_t i = 0; i < MAX_TOTAL_FLOOR_NUM; ++i)
         {
-            board_parameter.floor_height[i].floor = i + 1;
+            board_parameter.floor_height[i].floor = floor_offset(board_parameter.start_floor, i);
             board_parameter.floor_height[i].height = 0;
         }
 
         uint16_t average_height = 0;
         uint32_t distance = 0;
         distance = altimeter_get_distance();
-        average_height = update_floor_height(1, distance);
-        notify_calc(1, average_height, distance / 10);
-        elev_go(2);
+        average_height = update_floor_height(board_parameter.start_floor, distance);
+        notify_calc(board_parameter.start_floor, average_height, distance / 10);
+        elev_go(floor_offset(board_parameter.start_floor, 1));
     }
     return TRUE;
 }
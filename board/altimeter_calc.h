@@ -10,6 +10,7 @@
 
 #ifdef __MASTER
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
@@ -23,7 +24,7 @@ typedef enum
 bool altimeter_calc_init(void);
 bool altimeter_calc_run(calc_action_t action);
 bool altimeter_is_calculating(void);
-void altimeter_calc_once(uint8_t floor);
+void altimeter_calc_once(floor_t floor);
 uint16_t alitmeter_floor_height(void);
 
 END_DECLS
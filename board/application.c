@@ -11,6 +11,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "license.h"
 #include "parameter.h"
 #include "boardmap.h"
@@ -28,10 +29,15 @@
 #endif
 #include "led_status.h"
 #include "expand.h"
+#include "protocol_expand.h"
 #include "diagnosis.h"
+#include "timewheel.h"
+#include "dbgserial.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[app]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_APP
 
 #ifdef __MASTER
 #define VERSION  ("v1.1.6.3")
@@ -40,7 +46,37 @@
 #endif
 
 parameters_t board_parameter;
+/** modules initialized with parameter */
+static bool app_running = FALSE;
+/** maps rebuilt when applying parameter */
+static boardmap_t board_shadow[MAX_BOARD_NUM];
+#ifdef __MASTER
+static floor_t floor_shadow[MAX_TOTAL_FLOOR_NUM];
+#endif
 
+/* kernel idle task memory */
+static StaticTask_t idle_task;
+static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+
+/**
+ * @brief fix parameter values not usable directly
+ * @param param - parameter to fix
+ */
+static void app_fix_param(parameters_t *param)
+{
+    /** floor 0 does not exist, treat as floor 1 */
+    if (0 == param->start_floor)
+    {
+        param->start_floor = 1;
+    }
+#ifdef __MASTER
+    param->bt_name[BT_NAME_MAX_LEN] = '\0';
+    if ((0xff == param->bt_name[0]) || ('\0' == param->bt_name[0]))
+    {
+        strcpy((char *)param->bt_name, "HC-08");
+    }
+#endif
+}
 
 /**
  * @brief start system
@@ -56,12 +92,18 @@ void ApplicationStartup()
 #endif
     TRACE("version = %s\r\n", VERSION);
 
-    diagnosis_init();
+    if (!dbg_trace_init())
+    {
+        TRACE("start trace task failed, trace is sent directly\r\n");
+    }
 
+    timewheel_init();
     if (!param_init())
     {
         TRACE("startup application failed!\r\n");
     }
+    trace_level_init();
+    diagnosis_init();
 
     /** initialize license */
     if (!license_init())
@@ -75,16 +117,12 @@ void ApplicationStartup()
     if (is_param_setted())
     {
         board_parameter = param_get();
+        app_fix_param(&board_parameter);
         boardmap_add(board_parameter.id_board, START_KEY, board_parameter.start_floor,
                      MAX_FLOOR_NUM, 0);
 #ifdef __MASTER
         floormap_update();
-
-        if ((0xff == board_parameter.bt_name[0]) ||
-            ('\0' == board_parameter.bt_name[0]))
-        {
-            strcpy((char *)board_parameter.bt_name, "HC-08");
-        }
+        expand_registry_restore();
 #endif
         keyctl_init();
 #ifdef __MASTER
@@ -103,9 +141,106 @@ void ApplicationStartup()
         led_monitor_init();
         elev_init();
         expand_init();
+        app_running = TRUE;
     }
 
 END:
     /* Start the scheduler. */
     vTaskStartScheduler();
 }
+
+/**
+ * @brief provide idle task memory, called by scheduler
+ * @param ppxIdleTaskTCBBuffer - task control block
+ * @param ppxIdleTaskStackBuffer - task stack
+ * @param pulIdleTaskStackSize - task stack depth
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer,
+                                   StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize)
+{
+    *ppxIdleTaskTCBBuffer = &idle_task;
+    *ppxIdleTaskStackBuffer = idle_stack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/**
+ * @brief check if modules are running with parameter
+ */
+bool app_is_running(void)
+{
+    return app_running;
+}
+
+/**
+ * @brief apply changed parameter without reboot
+ * @param param - new parameter
+ * @return TRUE: applied FALSE: reboot required
+ */
+bool app_apply_param(const parameters_t *param)
+{
+    if (!app_running || (param->id_board != board_parameter.id_board))
+    {
+        return FALSE;
+    }
+#ifdef __MASTER
+    /** tasks created depend on calculation type */
+    if (param->calc_type != board_parameter.calc_type)
+    {
+        return FALSE;
+    }
+    bool bt_changed = (0 != memcmp(param->bt_name, board_parameter.bt_name,
+                                   BT_NAME_MAX_LEN + 1));
+#else
+    /** start floor is announced to master when registering */
+    floor_t start_floor = (0 == param->start_floor) ? 1 : param->start_floor;
+    if (start_floor != board_parameter.start_floor)
+    {
+        return FALSE;
+    }
+#endif
+
+    TRACE("apply parameter...\r\n");
+    /**
+     * maps are rebuilt outside scheduler suspension and only copied inside, so
+     * tasks see either old or new parameter and maps, never a mix, maps are
+     * rebuilt again if boardmap changed meanwhile
+     */
+    bool committed = FALSE;
+    while (!committed)
+    {
+        uint32_t version = boardmap_build_param(board_shadow, param->id_board,
+                                                param->start_floor);
+#ifdef __MASTER
+        floormap_build(board_shadow, floor_shadow);
+#endif
+        vTaskSuspendAll();
+        committed = boardmap_commit(board_shadow, version);
+        if (committed)
+        {
+            board_parameter = *param;
+            app_fix_param(&board_parameter);
+#ifdef __MASTER
+            floormap_commit(floor_shadow);
+#endif
+        }
+        xTaskResumeAll();
+    }
+    boardmap_dump();
+
+#ifdef __MASTER
+    floormap_dump();
+    if (CALC_ALTIMETER == board_parameter.calc_type)
+    {
+        /** height bands are rebuilt under its own scheduler suspension */
+        altimeter_apply_param();
+    }
+    elev_apply_param();
+    if (bt_changed)
+    {
+        bt_set_name((const char *)board_parameter.bt_name);
+    }
+#endif
+
+    return TRUE;
+}
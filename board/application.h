@@ -9,10 +9,13 @@
 #define _APPLICATION_H_
 
 #include "types.h"
+#include "parameter.h"
 
 BEGIN_DECLS
 
 void ApplicationStartup();
+bool app_is_running(void);
+bool app_apply_param(const parameters_t *param);
 
 END_DECLS
 
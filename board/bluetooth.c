@@ -12,6 +12,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "serial.h"
 #include "global.h"
 #include "dbgserial.h"
@@ -23,6 +24,8 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[bt]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_BT
 
 extern parameters_t board_parameter;
 /* serial handle */
@@ -36,6 +39,11 @@ static serial *g_serial = NULL;
  */
 static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
 {
+    if (!TRACE_ON(TRACE_LEVEL_DUMP))
+    {
+        return ;
+    }
+
     if (dir)
     {
         TRACE("send data: ");
@@ -44,14 +52,7 @@ static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
     {
         TRACE("recv data: ");
     }
-    for (int i = 0; i < len; ++i)
-    {
-        dbg_putchar("0123456789abcdef"[data[i] >> 4]);
-        dbg_putchar("0123456789abcdef"[data[i] & 0x0f]);
-        dbg_putchar(' ');
-    }
-    dbg_putchar('\r');
-    dbg_putchar('\n');
+    dbg_dump(data, len);
 }
 #endif
 
@@ -125,6 +126,10 @@ static void vBluetooth(void *pvParameters)
     }
 }
 
+/* bluetooth task memory */
+static StaticTask_t bt_task;
+static StackType_t bt_stack[BLUETOOTH_STACK_SIZE];
+
 /**
  * @brief initialize protocol
  * @return init status
@@ -139,8 +144,8 @@ bool bt_init(void)
         return FALSE;
     }
     serial_open(g_serial);
-    xTaskCreate(vBluetooth, "bluetooth", BLUETOOTH_STACK_SIZE, g_serial,
-                BLUETOOTH_PRIORITY, NULL);
+    xTaskCreateStatic(vBluetooth, "bluetooth", BLUETOOTH_STACK_SIZE, g_serial,
+                      BLUETOOTH_PRIORITY, bt_stack, &bt_task);
 
     return TRUE;
 }
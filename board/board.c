@@ -12,9 +12,12 @@
 #include "pinconfig.h"
 #include "dbgserial.h"
 #include "trace.h"
+#include "trace_level.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE   "[board]"
+#undef __TRACE_ID
+#define __TRACE_ID       TRACE_ID_BOARD
 
 static void clock_init(void);
 
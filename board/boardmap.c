@@ -5,9 +5,13 @@
 *
 * See the COPYING file for the terms of usage and distribution.
 */
+#include <string.h>
 #include "boardmap.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "parameter.h"
 #include "global.h"
 #include "expand.h"
@@ -16,10 +20,46 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[board_info]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_BOARDMAP
 
 extern parameters_t board_parameter;
 boardmap_t boardmaps[MAX_BOARD_NUM];
+/* bumped on every boardmap change, shadow built before change is stale */
+static uint32_t boardmap_version = 0;
 
+/**
+ * @brief convert floor to continuous position, floor 0 does not exist
+ * @param floor - floor number
+ * @return floor position
+ */
+static int16_t floor_to_pos(floor_t floor)
+{
+    return (floor > 0) ? (floor - 1) : floor;
+}
+
+/**
+ * @brief move floor by specified steps, floor 0 is skipped
+ * @param floor - start floor
+ * @param steps - floor steps, negative means move down
+ * @return destination floor
+ */
+floor_t floor_offset(floor_t floor, int16_t steps)
+{
+    int16_t pos = floor_to_pos(floor) + steps;
+    return (pos >= 0) ? (pos + 1) : pos;
+}
+
+/**
+ * @brief get floor steps between two floors, floor 0 is skipped
+ * @param from - start floor
+ * @param to - end floor
+ * @return floor steps, negative means to is below from
+ */
+int16_t floor_distance(floor_t from, floor_t to)
+{
+    return floor_to_pos(to) - floor_to_pos(from);
+}
 
 #ifdef __MASTER
 /**
@@ -54,22 +94,44 @@ bool boardmap_is_board_id_exists(uint8_t id_board)
 
     return FALSE;
 }
+
+/**
+ * @brief get specified board start floor
+ * @param[in] id_board: board id
+ * @return board start floor, INVALID_FLOOR means board does not exist
+ */
+floor_t boardmap_get_start_floor(uint8_t id_board)
+{
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        if ((0 != id_board) && (id_board == boardmaps[i].id_board))
+        {
+            return boardmaps[i].start_floor;
+        }
+    }
+
+    return INVALID_FLOOR;
+}
 #endif
 
 /**
  * @brief sort boardmap
+ * @param maps - boardmap to sort
  */
-static void boardmap_sort(void)
+static void boardmap_sort(boardmap_t *maps)
 {
     for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
     {
         for (uint8_t j = 0; j < MAX_BOARD_NUM - i - 1; ++j)
         {
-            if (boardmaps[j].start_floor > boardmaps[j + 1].start_floor)
+            /** empty board always placed at end */
+            if (((0 == maps[j].id_board) && (0 != maps[j + 1].id_board)) ||
+                ((0 != maps[j + 1].id_board) &&
+                 (maps[j].start_floor > maps[j + 1].start_floor)))
             {
-                boardmap_t temp_map = boardmaps[j];
-                boardmaps[j] = boardmaps[j + 1];
-                boardmaps[j + 1] = temp_map;
+                boardmap_t temp_map = maps[j];
+                maps[j] = maps[j + 1];
+                maps[j + 1] = temp_map;
             }
         }
     }
@@ -83,6 +145,11 @@ static void boardmap_sort(void)
  */
 static void dump_message(void)
 {
+    if (!TRACE_ON(TRACE_LEVEL_DUMP))
+    {
+        return ;
+    }
+
     TRACE("boardmap: \r\n");
 
     for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
@@ -100,8 +167,10 @@ static void dump_message(void)
             dbg_putchar(' ');
 
             dbg_putstring("start floor: ", 13);
-            dbg_putchar("0123456789abcdef"[(uint8_t)(boardmaps[i].start_floor) >> 4]);
-            dbg_putchar("0123456789abcdef"[(uint8_t)(boardmaps[i].start_floor) & 0x0f]);
+            dbg_putchar("0123456789abcdef"[((uint16_t)(boardmaps[i].start_floor) >> 12) & 0x0f]);
+            dbg_putchar("0123456789abcdef"[((uint16_t)(boardmaps[i].start_floor) >> 8) & 0x0f]);
+            dbg_putchar("0123456789abcdef"[((uint16_t)(boardmaps[i].start_floor) >> 4) & 0x0f]);
+            dbg_putchar("0123456789abcdef"[(uint16_t)(boardmaps[i].start_floor) & 0x0f]);
             dbg_putchar(' ');
 
             dbg_putstring("floor num: ", 11);
@@ -117,7 +186,7 @@ static void dump_message(void)
 /**
  * @param add new board to board map
  */
-bool boardmap_add(uint8_t id_board, uint8_t start_key, char start_floor,
+bool boardmap_add(uint8_t id_board, uint8_t start_key, floor_t start_floor,
                   uint8_t floor_num, uint16_t led_status)
 {
     for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
@@ -136,7 +205,8 @@ bool boardmap_add(uint8_t id_board, uint8_t start_key, char start_floor,
             }
             boardmaps[i].floor_num = floor_num;
             boardmaps[i].led_status = led_status;
-            boardmap_sort();
+            boardmap_sort(boardmaps);
+            boardmap_version ++;
 #if DUMP_BOARDMAP
             dump_message();
 #endif
@@ -147,27 +217,53 @@ bool boardmap_add(uint8_t id_board, uint8_t start_key, char start_floor,
     return FALSE;
 }
 
+#ifdef __MASTER
+/**
+ * @brief remove board from board map
+ * @param[in] id_board: board id
+ * @return TRUE if board removed
+ */
+bool boardmap_remove(uint8_t id_board)
+{
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        if ((0 != id_board) && (id_board == boardmaps[i].id_board))
+        {
+            boardmaps[i].id_board = 0;
+            boardmap_sort(boardmaps);
+            boardmap_version ++;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+#endif
+
 /**
  * @brief convert floor to key
  * @param floor - floor number
  * @return key number, 0xff means error happened
  */
-uint8_t boardmap_floor_to_key(uint8_t floor)
+uint8_t boardmap_floor_to_key(floor_t floor)
 {
     if (0 == floor)
     {
         return INVALID_KEY;
     }
 
-    uint8_t start_floor, end_floor;
+    int16_t steps;
     uint8_t key = INVALID_KEY;
     for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
     {
-        start_floor = boardmaps[i].start_floor;
-        end_floor = boardmaps[i].start_floor + boardmaps[i].floor_num;
-        if ((floor >= start_floor) && (floor <= end_floor))
+        if (0 == boardmaps[i].id_board)
         {
-            key = floor - start_floor;
+            continue;
+        }
+        steps = floor_distance(boardmaps[i].start_floor, floor);
+        if ((steps >= 0) && (steps < boardmaps[i].floor_num))
+        {
+            key = (uint8_t)steps;
             key += boardmaps[i].start_key;
             break;
         }
@@ -179,11 +275,11 @@ uint8_t boardmap_floor_to_key(uint8_t floor)
 /**
  * @brief convert key to floor
  * @param floor - floor number
- * @return floor number, 0x7f means error happened
+ * @return floor number, INVALID_FLOOR means error happened
  */
-uint8_t boardmap_key_to_floor(uint8_t id_board, uint8_t key)
+floor_t boardmap_key_to_floor(uint8_t id_board, uint8_t key)
 {
-    uint8_t floor = INVALID_FLOOR;
+    floor_t floor = INVALID_FLOOR;
     for (int i = 0; i < MAX_BOARD_NUM; ++i)
     {
         if (id_board == boardmaps[i].id_board)
@@ -191,7 +287,7 @@ uint8_t boardmap_key_to_floor(uint8_t id_board, uint8_t key)
             if ((key < boardmaps[i].start_key + boardmaps[i].floor_num) &&
                 (key >= boardmaps[i].start_key))
             {
-                floor = boardmaps[i].start_floor + key - boardmaps[i].start_key;
+                floor = floor_offset(boardmaps[i].start_floor, key - boardmaps[i].start_key);
             }
             break;
         }
@@ -205,7 +301,7 @@ uint8_t boardmap_key_to_floor(uint8_t id_board, uint8_t key)
  * @param floor - floor number
  * @return board id, 0xff means error happened
  */
-uint8_t boardmap_get_floor_board_id(uint8_t floor)
+uint8_t boardmap_get_floor_board_id(floor_t floor)
 {
     if (0 == floor)
     {
@@ -213,12 +309,15 @@ uint8_t boardmap_get_floor_board_id(uint8_t floor)
     }
 
     uint8_t id_board = ID_BOARD_INVALID;
-    uint8_t start_floor, end_floor;
+    int16_t steps;
     for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
     {
-        start_floor = boardmaps[i].start_floor;
-        end_floor = boardmaps[i].start_floor + boardmaps[i].floor_num;
-        if ((floor >= start_floor) && (floor <= end_floor))
+        if (0 == boardmaps[i].id_board)
+        {
+            continue;
+        }
+        steps = floor_distance(boardmaps[i].start_floor, floor);
+        if ((steps >= 0) && (steps < boardmaps[i].floor_num))
         {
             id_board = boardmaps[i].id_board;
             break;
@@ -240,6 +339,7 @@ void boardmap_update_led_status(uint8_t id_board, uint16_t led_status)
         if (id_board == boardmaps[i].id_board)
         {
             boardmaps[i].led_status = led_status;
+            boardmap_version ++;
         }
     }
 }
@@ -261,3 +361,59 @@ uint16_t boardmap_get_led_status(uint8_t id_board)
 
     return 0xffff;
 }
+
+/**
+ * @brief build boardmap with new own board start floor into shadow
+ * @param[out] shadow - boardmap built
+ * @param id_board - own board id
+ * @param start_floor - new own board start floor
+ * @return boardmap version shadow is built from
+ */
+uint32_t boardmap_build_param(boardmap_t *shadow, uint8_t id_board,
+                              floor_t start_floor)
+{
+    taskENTER_CRITICAL();
+    memcpy(shadow, boardmaps, sizeof(boardmaps));
+    uint32_t version = boardmap_version;
+    taskEXIT_CRITICAL();
+
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        if (id_board == shadow[i].id_board)
+        {
+            shadow[i].start_floor = (0 == start_floor) ? 1 : start_floor;
+            boardmap_sort(shadow);
+            break;
+        }
+    }
+
+    return version;
+}
+
+/**
+ * @brief replace boardmap with shadow, called with scheduler suspended
+ * @param shadow - boardmap built by boardmap_build_param
+ * @param version - boardmap version shadow is built from
+ * @return FALSE if boardmap changed after shadow built
+ */
+bool boardmap_commit(const boardmap_t *shadow, uint32_t version)
+{
+    if (version != boardmap_version)
+    {
+        return FALSE;
+    }
+
+    memcpy(boardmaps, shadow, sizeof(boardmaps));
+    boardmap_version ++;
+    return TRUE;
+}
+
+/**
+ * @brief dump boardmap
+ */
+void boardmap_dump(void)
+{
+#if DUMP_BOARDMAP
+    dump_message();
+#endif
+}
@@ -18,22 +18,30 @@ typedef struct
     /** 0 means empty */
     uint8_t id_board;
     uint8_t start_key;
-    uint8_t start_floor;
+    floor_t start_floor;
     uint8_t floor_num;
     uint16_t led_status;
 } boardmap_t;
 extern boardmap_t boardmaps[MAX_BOARD_NUM];
 
-bool boardmap_add(uint8_t id_board, uint8_t start_key, char start_floor,
+floor_t floor_offset(floor_t floor, int16_t steps);
+int16_t floor_distance(floor_t from, floor_t to);
+bool boardmap_add(uint8_t id_board, uint8_t start_key, floor_t start_floor,
                   uint8_t floor_num, uint16_t led_status);
-uint8_t boardmap_floor_to_key(uint8_t floor);
-uint8_t boardmap_key_to_floor(uint8_t id_board, uint8_t key);
-uint8_t boardmap_get_floor_board_id(uint8_t floor);
+uint8_t boardmap_floor_to_key(floor_t floor);
+floor_t boardmap_key_to_floor(uint8_t id_board, uint8_t key);
+uint8_t boardmap_get_floor_board_id(floor_t floor);
 void boardmap_update_led_status(uint8_t id_board, uint16_t led_status);
 uint16_t boardmap_get_led_status(uint8_t id_board);
+uint32_t boardmap_build_param(boardmap_t *shadow, uint8_t id_board,
+                              floor_t start_floor);
+bool boardmap_commit(const boardmap_t *shadow, uint32_t version);
+void boardmap_dump(void);
 #ifdef __MASTER
 bool boardmap_is_board_id_exists(uint8_t id_board);
 uint8_t boardmap_opendoor_key(void);
+bool boardmap_remove(uint8_t id_board);
+floor_t boardmap_get_start_floor(uint8_t id_board);
 #endif
 
 END_DECLS
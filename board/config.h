@@ -8,6 +8,8 @@
 #ifndef _CONFIG_H_
 #define _CONFIG_H_
 
+#include "types.h"
+
 #define USE_SIMPLE_LICENSE      0
 
 #define CAN_REMAP               0
@@ -25,10 +27,23 @@
 
 #define LOOP_BACK_TEST          0
 #define USE_SPEED_100K          1
+/** fram on hardware i2c1 with dma, bit-bang is the fallback */
+#define USE_I2C_HARDWARE        1
+/** trace recorded to ram ring, formatted and sent by trace task */
+#define USE_ASYNC_TRACE         1
+/** trace sent as binary token frames, decode with tool/logdecode, need async trace */
+#define USE_TOKEN_TRACE         0
+/** task run time, stack, heap and interrupt time statistics */
+#define USE_RUN_STATS           1
 
 #ifdef __MASTER
+/** board and floor capacity, can be overridden by project defines */
+#ifndef MAX_EXPAND_FLOOR_NUM
 #define MAX_EXPAND_FLOOR_NUM    16
+#endif
+#ifndef MAX_BOARD_NUM
 #define MAX_BOARD_NUM           6
+#endif
 #define USE_KEY_OPEN0           0
 #if USE_KEY_OPEN0
 #define START_KEY               1
@@ -40,16 +55,22 @@
 #define EXPAND_START_KEY        0
 #define PARAM_PWD_LEN           4
 #define BT_NAME_MAX_LEN         16
+#define MAX_TOTAL_FLOOR_NUM     (MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1))
 #else
 #define MAX_BOARD_NUM           1
 #define MAX_FLOOR_NUM           16
 #define START_KEY               0
+#define MAX_TOTAL_FLOOR_NUM     MAX_FLOOR_NUM
 #endif
 
+/** floor number, negative means basement, floor 0 does not exist */
+typedef int16_t floor_t;
+
 #define INVALID_FLOOR           0
 #define INVALID_KEY             0xff
 
 #define ID_BOARD_MASTER         0x01
 #define ID_BOARD_INVALID        0xff
+#define ID_BOARD_BROADCAST      0xff
 
 #endif /** _CONFIG_H_ */
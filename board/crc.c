@@ -61,15 +61,16 @@ static const uint8_t map_low[] =
 };
 
 /**
- * @brief calculate crc16 value
+ * @brief continue crc16 calculation
+ * @param crc - crc value of previous data
  * @param data - data to calculate
  * @param len - data length
  * @return calculated value
  */
-uint16_t crc16(const uint8_t *data, uint8_t len)
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t len)
 {
-    uint8_t high = 0xFF;
-    uint8_t low = 0xFF;
+    uint8_t high = (uint8_t)(crc >> 8);
+    uint8_t low = (uint8_t)(crc & 0xff);
     int index;
 
     while (len--)
@@ -81,3 +82,14 @@ uint16_t crc16(const uint8_t *data, uint8_t len)
 
     return (uint16_t)(high << 8 | low);
 }
+
+/**
+ * @brief calculate crc16 value
+ * @param data - data to calculate
+ * @param len - data length
+ * @return calculated value
+ */
+uint16_t crc16(const uint8_t *data, uint8_t len)
+{
+    return crc16_update(0xffff, data, len);
+}
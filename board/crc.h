@@ -13,6 +13,7 @@
 BEGIN_DECLS
 
 uint16_t crc16(const uint8_t *data, uint8_t len);
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t len);
 
 END_DECLS
 
@@ -11,8 +11,116 @@
 #include "stm32f10x_cfg.h"
 #include "dbgserial.h"
 #include "global.h"
+#include "config.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
+#include "stats.h"
+
+#if USE_ASYNC_TRACE
+/** ring size in words */
+#define TRACE_RING_SIZE          256
+/** max arguments recorded, arguments are 32-bit int or string */
+#define TRACE_MAX_ARGS           6
+/** max characters copied for each string argument */
+#define TRACE_STR_MAX            31
+/** formatted output buffer, token frame holds all string arguments */
+#if USE_TOKEN_TRACE
+#define TRACE_OUT_SIZE           224
+#else
+#define TRACE_OUT_SIZE           128
+#endif
+/** max bytes in one raw or hex record, hex takes 3 characters each byte */
+#define TRACE_RAW_MAX            64
+#define TRACE_HEX_MAX            (TRACE_OUT_SIZE / 3)
+/** trace ring check interval */
+#define TRACE_INTERVAL           (20 / portTICK_PERIOD_MS)
+/** usart3 tx dma channel */
+#define TRACE_DMA_CHANNEL        DMA1_Channel2
+
+/* record type */
+#define RECORD_NONE              0
+#define RECORD_TRACE             1
+#define RECORD_RAW               2
+#define RECORD_HEX               3
+#define RECORD_PAD               4
+
+#if USE_TOKEN_TRACE
+/**
+ * token frame, decoded by tool/logdecode with firmware image:
+ * sync(0xa0) | type, fields, xor of all bytes before
+ * trace: tick delta, format address, module address distance from format,
+ *        arguments, string argument is length and characters, others zigzag
+ * raw/hex: length, data
+ * drop: dropped record number
+ * numbers are varint, address is offset from TOKEN_BASE, frame never starts
+ * with ascii so text sent before scheduler started can be mixed
+ */
+#define TOKEN_SYNC               0xa0
+#define TOKEN_DROP               5
+#define TOKEN_BASE               0x08000000
+#endif
+
+/* record head, type is written last to publish record */
+typedef struct
+{
+    volatile uint8_t type;
+    /** argument number of trace, byte number of raw and hex */
+    uint8_t count;
+    /** record size in words including head */
+    uint16_t size;
+} record_head_t;
+
+/* trace record, arguments are followed by copied strings */
+typedef struct
+{
+    record_head_t head;
+    const char *module;
+    const char *fmt;
+#if USE_TOKEN_TRACE
+    TickType_t tick;
+#endif
+    /** bit set if argument is string offset in string area */
+    uint32_t str_mask;
+    uint32_t args[0];
+} trace_record_t;
+
+#define WORDS(bytes)             (((bytes) + 3) / 4)
+#define HEAD_WORDS               WORDS(sizeof(record_head_t))
+#define TRACE_HEAD_WORDS         WORDS(sizeof(trace_record_t))
+
+static uint32_t ring[TRACE_RING_SIZE];
+/** free running word index, reserved by producers and released by trace task */
+static volatile uint32_t ring_head = 0;
+static volatile uint32_t ring_tail = 0;
+static volatile uint32_t dropped = 0;
+static TaskHandle_t xTraceTask = NULL;
+static StaticTask_t trace_task;
+static StackType_t trace_stack[TRACE_STACK_SIZE];
+static char out[TRACE_OUT_SIZE];
+#endif
+
+/**
+ * @brief put char and wait transmit
+ * @param data - data to put
+ */
+static void dbg_putchar_wait(char data)
+{
+    USART_WriteData_Wait(USART3, data);
+}
+
+/**
+ * @brief put string and wait transmit
+ * @param string - string to put
+ * @param length - string length
+ */
+static void dbg_putstring_wait(const char *string, uint32_t length)
+{
+    while (length--)
+    {
+        dbg_putchar_wait(*string++);
+    }
+}
 
 /**
  * @brief init debug serial port
@@ -29,13 +137,106 @@ void dbg_serial_setup(void)
     USART_Enable(USART3, TRUE);
 }
 
+#if USE_ASYNC_TRACE
+/**
+ * @brief check if output goes through trace task
+ * @return TRUE if trace task is running
+ */
+static __INLINE bool dbg_async(void)
+{
+    return (NULL != xTraceTask) &&
+           (taskSCHEDULER_NOT_STARTED != xTaskGetSchedulerState());
+}
+
+/**
+ * @brief reserve record in ring, can be called from any context, interrupt
+ *        is masked only while moving ring head
+ * @param size - record size in words
+ * @return record position, NULL if ring full
+ */
+static uint32_t *dbg_reserve(uint16_t size)
+{
+    uint32_t *record = NULL;
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t pos = ring_head % TRACE_RING_SIZE;
+    uint32_t contiguous = TRACE_RING_SIZE - pos;
+    uint32_t need = (size > contiguous) ? (contiguous + size) : size;
+    if (ring_head - ring_tail + need <= TRACE_RING_SIZE)
+    {
+        if (size > contiguous)
+        {
+            /* skip ring end */
+            record_head_t *pad = (record_head_t *)&ring[pos];
+            pad->count = 0;
+            pad->size = (uint16_t)contiguous;
+            pad->type = RECORD_PAD;
+            pos = 0;
+        }
+        record = &ring[pos];
+        ((record_head_t *)record)->type = RECORD_NONE;
+        ((record_head_t *)record)->size = size;
+        ring_head += need;
+    }
+    else
+    {
+        dropped ++;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    return record;
+}
+
+/**
+ * @brief publish reserved record
+ * @param record - record to publish
+ * @param type - record type
+ * @param count - record count
+ */
+static __INLINE void dbg_publish(uint32_t *record, uint8_t type, uint8_t count)
+{
+    ((record_head_t *)record)->count = count;
+    ((record_head_t *)record)->type = type;
+}
+
+/**
+ * @brief record raw or hex data
+ * @param type - record type
+ * @param data - data to record
+ * @param length - data length
+ */
+static void dbg_record_data(uint8_t type, const uint8_t *data, uint32_t length)
+{
+    uint8_t max = (RECORD_HEX == type) ? TRACE_HEX_MAX : TRACE_RAW_MAX;
+    while (length > 0)
+    {
+        uint8_t count = (length > max) ? max : (uint8_t)length;
+        uint32_t *record = dbg_reserve(HEAD_WORDS + WORDS(count));
+        if (NULL == record)
+        {
+            return ;
+        }
+        memcpy(record + HEAD_WORDS, data, count);
+        dbg_publish(record, type, count);
+        data += count;
+        length -= count;
+    }
+}
+#endif
+
 /**
  * @brief put char
  * @param data - data to put
  */
 void dbg_putchar(char data)
 {
-    USART_WriteData_Wait(USART3, data);
+#if USE_ASYNC_TRACE
+    if (dbg_async())
+    {
+        dbg_record_data(RECORD_RAW, (const uint8_t *)&data, 1);
+        return ;
+    }
+#endif
+    dbg_putchar_wait(data);
 }
 
 /**
@@ -45,39 +246,434 @@ void dbg_putchar(char data)
  */
 void dbg_putstring(const char *string, uint32_t length)
 {
-    const char *pNext = string;
-    while (length--)
+#if USE_ASYNC_TRACE
+    if (dbg_async())
+    {
+        dbg_record_data(RECORD_RAW, (const uint8_t *)string, length);
+        return ;
+    }
+#endif
+    dbg_putstring_wait(string, length);
+}
+
+/**
+ * @brief put data in hex, bytes are separated by space and ended with new line
+ * @param data - data to put
+ * @param length - data length
+ */
+void dbg_dump(const uint8_t *data, uint32_t length)
+{
+#if USE_ASYNC_TRACE
+    if (dbg_async())
+    {
+        dbg_record_data(RECORD_HEX, data, length);
+        dbg_record_data(RECORD_RAW, (const uint8_t *)"\r\n", 2);
+        return ;
+    }
+#endif
+    for (uint32_t i = 0; i < length; ++i)
     {
-        dbg_putchar(*pNext++);
+        dbg_putchar_wait("0123456789abcdef"[data[i] >> 4]);
+        dbg_putchar_wait("0123456789abcdef"[data[i] & 0x0f]);
+        dbg_putchar_wait(' ');
     }
+    dbg_putstring_wait("\r\n", 2);
 }
 
 
 #ifdef __DEBUG
 void assert_failed(const char *file, const char *line, const char *exp)
 {
-    dbg_putstring("assert failed: ", 15);
-    dbg_putstring(file, strlen(file));
-    dbg_putstring(":", 1);
-    dbg_putstring(line, strlen(line));
-    dbg_putstring("(", 1);
-    dbg_putstring(exp, strlen(exp));
-    dbg_putstring(")\n", 2);
+    dbg_putstring_wait("assert failed: ", 15);
+    dbg_putstring_wait(file, strlen(file));
+    dbg_putstring_wait(":", 1);
+    dbg_putstring_wait(line, strlen(line));
+    dbg_putstring_wait("(", 1);
+    dbg_putstring_wait(exp, strlen(exp));
+    dbg_putstring_wait(")\n", 2);
     while (1);
 }
 #endif
 
 #ifdef __ENABLE_TRACE
+#if USE_ASYNC_TRACE
+/**
+ * @brief record trace, format string and module must be constant, arguments
+ *        are 32-bit values, string arguments are copied
+ * @param module - trace module
+ * @param fmt - format string
+ * @param argptr - arguments
+ */
+static void dbg_record_trace(const char *module, const char *fmt, va_list argptr)
+{
+    uint32_t args[TRACE_MAX_ARGS];
+    const char *strs[TRACE_MAX_ARGS];
+    uint8_t lens[TRACE_MAX_ARGS];
+    uint8_t argc = 0;
+    uint16_t str_len = 0;
+
+    /* collect arguments, formatting is deferred to trace task */
+    for (const char *p = fmt; ('\0' != *p) && (argc < TRACE_MAX_ARGS); ++p)
+    {
+        if ('%' != *p)
+        {
+            continue;
+        }
+        p++;
+        while (('\0' != *p) && (NULL != strchr("-+ #0123456789.lh", *p)))
+        {
+            p++;
+        }
+        if ('\0' == *p)
+        {
+            break;
+        }
+        if ('%' == *p)
+        {
+            continue;
+        }
+
+        strs[argc] = NULL;
+        if ('s' == *p)
+        {
+            const char *str = va_arg(argptr, const char *);
+            size_t len = strlen(str);
+            strs[argc] = str;
+            lens[argc] = (len > TRACE_STR_MAX) ? TRACE_STR_MAX : (uint8_t)len;
+            str_len += lens[argc] + 1;
+        }
+        else
+        {
+            args[argc] = va_arg(argptr, uint32_t);
+        }
+        argc ++;
+    }
+
+    uint32_t *record = dbg_reserve(TRACE_HEAD_WORDS + argc + WORDS(str_len));
+    if (NULL == record)
+    {
+        return ;
+    }
+
+    trace_record_t *trace = (trace_record_t *)record;
+    char *pstr = (char *)(trace->args + argc);
+    trace->module = module;
+    trace->fmt = fmt;
+#if USE_TOKEN_TRACE
+    trace->tick = xTaskGetTickCountFromISR();
+#endif
+    trace->str_mask = 0;
+    for (uint8_t i = 0; i < argc; ++i)
+    {
+        if (NULL == strs[i])
+        {
+            trace->args[i] = args[i];
+        }
+        else
+        {
+            trace->str_mask |= (1 << i);
+            trace->args[i] = (uint32_t)(pstr - (char *)(trace->args + argc));
+            memcpy(pstr, strs[i], lens[i]);
+            pstr[lens[i]] = '\0';
+            pstr += lens[i] + 1;
+        }
+    }
+    dbg_publish(record, RECORD_TRACE, argc);
+}
+#endif
+
 void trace(const char *module, const char *fmt, ...)
 {
-    char buf[80];
     va_list argptr;
-    int cnt;
     va_start(argptr, fmt);
-    cnt = vsprintf(buf, fmt, argptr);
+#if USE_ASYNC_TRACE
+    if (dbg_async())
+    {
+        dbg_record_trace(module, fmt, argptr);
+        va_end(argptr);
+        return ;
+    }
+#endif
+    char buf[80];
+    int cnt = vsnprintf(buf, sizeof(buf), fmt, argptr);
     va_end(argptr);
-    dbg_putstring(module, strlen(module));
-    dbg_putchar(' ');
-    dbg_putstring(buf, cnt);
+    if (cnt > (int)sizeof(buf) - 1)
+    {
+        cnt = sizeof(buf) - 1;
+    }
+    dbg_putstring_wait(module, strlen(module));
+    dbg_putchar_wait(' ');
+    dbg_putstring_wait(buf, cnt);
 }
 #endif
+
+#if USE_ASYNC_TRACE
+/**
+ * @brief send formatted output through dma and wait complete
+ * @param length - output length
+ */
+static void dbg_send(uint16_t length)
+{
+    if (0 == length)
+    {
+        return ;
+    }
+
+    DMA_Config config;
+    DMA_StructInit(&config);
+    config.periphAddr = USART_DataAddress(USART3);
+    config.memAddr = (uint32_t)out;
+    config.count = length;
+    config.direction = DMA_DIR_PeriphDst;
+    config.priority = DMA_Priority_Low;
+
+    DMA_Enable(TRACE_DMA_CHANNEL, FALSE);
+    DMA_ClearFlag(TRACE_DMA_CHANNEL, DMA_FLAG_GL);
+    DMA_Setup(TRACE_DMA_CHANNEL, &config);
+    DMA_EnableInt(TRACE_DMA_CHANNEL, DMA_IT_TC, TRUE);
+    DMA_Enable(TRACE_DMA_CHANNEL, TRUE);
+
+    /* 115200 baud sends more than 10 bytes every millisecond */
+    ulTaskNotifyTake(pdTRUE, (length / 10 + 10) / portTICK_PERIOD_MS);
+    DMA_Enable(TRACE_DMA_CHANNEL, FALSE);
+}
+
+#if USE_TOKEN_TRACE
+/**
+ * @brief put varint into output buffer
+ * @param pos - output position
+ * @param val - value to put
+ * @return next position
+ */
+static uint16_t dbg_put_varint(uint16_t pos, uint32_t val)
+{
+    while (val >= 0x80)
+    {
+        out[pos++] = (char)((val & 0x7f) | 0x80);
+        val >>= 7;
+    }
+    out[pos++] = (char)val;
+    return pos;
+}
+
+/**
+ * @brief put signed value as zigzag varint
+ * @param pos - output position
+ * @param val - value to put
+ * @return next position
+ */
+static uint16_t dbg_put_zigzag(uint16_t pos, int32_t val)
+{
+    return dbg_put_varint(pos, ((uint32_t)val << 1) ^ (uint32_t)(val >> 31));
+}
+
+/**
+ * @brief put data with length into output buffer
+ * @param pos - output position
+ * @param data - data to put
+ * @param len - data length
+ * @return next position
+ */
+static uint16_t dbg_put_data(uint16_t pos, const void *data, uint8_t len)
+{
+    pos = dbg_put_varint(pos, len);
+    memcpy(out + pos, data, len);
+    return pos + len;
+}
+
+/**
+ * @brief finish token frame
+ * @param pos - frame end
+ * @return frame length
+ */
+static uint16_t dbg_token_end(uint16_t pos)
+{
+    uint8_t check = 0;
+    for (uint16_t i = 0; i < pos; ++i)
+    {
+        check ^= (uint8_t)out[i];
+    }
+    out[pos++] = (char)check;
+    return pos;
+}
+
+/**
+ * @brief encode record into token frame
+ * @param record - record to encode
+ * @return frame length
+ */
+static uint16_t dbg_encode(const uint32_t *record)
+{
+    static TickType_t last_tick = 0;
+    const record_head_t *head = (const record_head_t *)record;
+    uint16_t pos = 0;
+    if ((RECORD_NONE == head->type) || (RECORD_PAD == head->type))
+    {
+        return 0;
+    }
+
+    out[pos++] = (char)(TOKEN_SYNC | head->type);
+    if (RECORD_TRACE == head->type)
+    {
+        const trace_record_t *trace = (const trace_record_t *)record;
+        const char *str_base = (const char *)(trace->args + head->count);
+        pos = dbg_put_varint(pos, trace->tick - last_tick);
+        last_tick = trace->tick;
+        /* literals of one file are placed together, module is close to format */
+        pos = dbg_put_varint(pos, (uint32_t)trace->fmt - TOKEN_BASE);
+        pos = dbg_put_zigzag(pos, (int32_t)((uint32_t)trace->module - (uint32_t)trace->fmt));
+        for (uint8_t i = 0; i < head->count; ++i)
+        {
+            if (0 != (trace->str_mask & (1 << i)))
+            {
+                const char *str = str_base + trace->args[i];
+                pos = dbg_put_data(pos, str, (uint8_t)strlen(str));
+            }
+            else
+            {
+                pos = dbg_put_zigzag(pos, (int32_t)trace->args[i]);
+            }
+        }
+    }
+    else
+    {
+        pos = dbg_put_data(pos, record + HEAD_WORDS, head->count);
+    }
+
+    return dbg_token_end(pos);
+}
+#else
+/**
+ * @brief format record into output buffer
+ * @param record - record to format
+ * @return output length
+ */
+static uint16_t dbg_format(const uint32_t *record)
+{
+
+    const record_head_t *head = (const record_head_t *)record;
+    const uint8_t *data = (const uint8_t *)(record + HEAD_WORDS);
+    int cnt = 0;
+    switch (head->type)
+    {
+    case RECORD_TRACE:
+    {
+        const trace_record_t *trace = (const trace_record_t *)record;
+        const char *str_base = (const char *)(trace->args + head->count);
+        uint32_t args[TRACE_MAX_ARGS] = {0};
+        for (uint8_t i = 0; i < head->count; ++i)
+        {
+            args[i] = (0 != (trace->str_mask & (1 << i))) ?
+                      (uint32_t)(str_base + trace->args[i]) : trace->args[i];
+        }
+        cnt = snprintf(out, TRACE_OUT_SIZE, "%s ", trace->module);
+        if (cnt < TRACE_OUT_SIZE)
+        {
+            /* all recorded arguments are 32-bit values */
+            cnt += snprintf(out + cnt, TRACE_OUT_SIZE - cnt, trace->fmt,
+                            args[0], args[1], args[2], args[3], args[4], args[5]);
+        }
+        if (cnt > TRACE_OUT_SIZE - 1)
+        {
+            cnt = TRACE_OUT_SIZE - 1;
+        }
+        break;
+    }
+    case RECORD_RAW:
+        memcpy(out, data, head->count);
+        cnt = head->count;
+        break;
+    case RECORD_HEX:
+        for (uint8_t i = 0; (i < head->count) && (cnt + 3 <= TRACE_OUT_SIZE); ++i)
+        {
+            out[cnt++] = "0123456789abcdef"[data[i] >> 4];
+            out[cnt++] = "0123456789abcdef"[data[i] & 0x0f];
+            out[cnt++] = ' ';
+        }
+        break;
+    default:
+        break;
+    }
+
+    return (uint16_t)cnt;
+}
+#endif
+
+/**
+ * @brief trace task, format records and send
+ * @param pvParameters - task parameter
+ */
+static void vTrace(void *pvParameters)
+{
+    UNUSED(pvParameters);
+    uint32_t lost = 0;
+    for (;;)
+    {
+        while (ring_tail != ring_head)
+        {
+            const uint32_t *record = &ring[ring_tail % TRACE_RING_SIZE];
+            const record_head_t *head = (const record_head_t *)record;
+            if (RECORD_NONE == head->type)
+            {
+                /* producer still writing */
+                break;
+            }
+
+#if USE_TOKEN_TRACE
+            uint16_t length = dbg_encode(record);
+#else
+            uint16_t length = dbg_format(record);
+#endif
+            ring_tail += head->size;
+            dbg_send(length);
+        }
+
+        if (lost != dropped)
+        {
+#if USE_TOKEN_TRACE
+            out[0] = (char)(TOKEN_SYNC | TOKEN_DROP);
+            int cnt = dbg_token_end(dbg_put_varint(1, dropped - lost));
+#else
+            int cnt = snprintf(out, TRACE_OUT_SIZE, "[trace] %d records dropped\r\n",
+                               (int)(dropped - lost));
+#endif
+            lost = dropped;
+            dbg_send((uint16_t)cnt);
+        }
+
+        vTaskDelay(TRACE_INTERVAL);
+    }
+}
+
+/**
+ * @brief usart3 transmit dma interrupt
+ */
+void DMAChannel2_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t start = stats_isr_begin();
+    DMA_ClearFlag(TRACE_DMA_CHANNEL, DMA_FLAG_GL);
+    if (NULL != xTraceTask)
+    {
+        vTaskNotifyGiveFromISR(xTraceTask, &xHigherPriorityTaskWoken);
+    }
+    stats_isr_end(STATS_ISR_TRACE_DMA, start);
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+#endif
+
+/**
+ * @brief start trace task, output before scheduler started is sent directly
+ * @return init status
+ */
+bool dbg_trace_init(void)
+{
+#if USE_ASYNC_TRACE
+    USART_EnableDMATX(USART3, TRUE);
+    NVIC_Config nvicConfig = {DMAChannel2_IRQChannel, USART3_DMA_PRIORITY, 0, TRUE};
+    NVIC_Init(&nvicConfig);
+    xTraceTask = xTaskCreateStatic(vTrace, "trace", TRACE_STACK_SIZE, NULL,
+                                   TRACE_PRIORITY, trace_stack, &trace_task);
+#endif
+    return TRUE;
+}
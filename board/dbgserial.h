@@ -15,6 +15,8 @@ BEGIN_DECLS
 void dbg_serial_setup(void);
 void dbg_putchar(char data);
 void dbg_putstring(const char *string, uint32_t length);
+void dbg_dump(const uint8_t *data, uint32_t length);
+bool dbg_trace_init(void);
 
 END_DECLS
 
@@ -5,30 +5,163 @@
 *
 * See the COPYING file for the terms of usage and distribution.
 */
+#include <string.h>
 #include "diagnosis.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32f10x_cfg.h"
+#include "stm32f10x_map.h"
+#include "cm3_core.h"
+#include "parameter.h"
+#include "crc.h"
 #include "trace.h"
+#include "trace_level.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[diagnosis]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_DIAGNOSIS
 
-bool diagnosis_init(void)
+/** fault record kept in ram until next startup */
+typedef struct
 {
-    TRACE("initialize diagnosis system...\r\n");
-    return TRUE;
+    uint32_t magic;
+    uint16_t check;
+    fault_record_t record;
+} fault_ram_t;
+
+#define FAULT_MAGIC          0x464c5430
+/** stm32f103xC sram end */
+#define SRAM_END             (SRAM_BASE + 48 * 1024)
+/** r0, r1, r2, r3, r12, lr, pc, xpsr */
+#define FAULT_FRAME_LEN      8
+/** EXC_RETURN bits */
+#define EXC_RETURN_PSP       (1 << 2)
+#define EXC_RETURN_THREAD    (1 << 3)
+
+static __no_init fault_ram_t fault_ram;
+
+static const char *const exception_name[] =
+{
+    "fault",
+    "fault",
+    "nmi",
+    "hardfault",
+    "memfault",
+    "busfault",
+    "usagefault",
+};
+
+/**
+ * @brief check if address range is inside sram, stack pointer may be broken
+ *        when fault happens, reading outside sram in fault handler locks up
+ * @param addr - start address
+ * @param len - range length
+ * @return TRUE if inside sram
+ */
+static bool is_sram(uint32_t addr, uint32_t len)
+{
+    return ((0 == (addr & 0x03)) && (addr >= SRAM_BASE) && (addr <= SRAM_END - len));
 }
 
-void dump_register(void)
+/**
+ * @brief check fault record left by last reset
+ * @return TRUE if record is valid
+ */
+static bool is_fault_valid(void)
 {
+    return ((FAULT_MAGIC == fault_ram.magic) &&
+            (fault_ram.check == crc16_update(0xffff, (const uint8_t *)&fault_ram.record,
+                                             sizeof(fault_record_t))));
 }
 
-void HardFaultException(void)
+/**
+ * @brief initialize diagnosis, move fault record left by last reset to fram,
+ *        parameter must be initialized first
+ * @return init status
+ */
+bool diagnosis_init(void)
 {
-    TRACE("hardfault happened!\r\n");
-    dump_register();
+    TRACE("initialize diagnosis system...\r\n");
+    /* report fault by its own handler instead of escalating to hardfault */
+    SCB_EnableException(SCB_Exception_MemMangeFault, TRUE);
+    SCB_EnableException(SCB_Exception_BusFault, TRUE);
+    SCB_EnableException(SCB_Exception_UsageFault, TRUE);
+
+    if (is_fault_valid())
+    {
+        const fault_record_t *record = &fault_ram.record;
+        const char *name = "fault";
+        if (record->exception < sizeof(exception_name) / sizeof(exception_name[0]))
+        {
+            name = exception_name[record->exception];
+        }
+        TRACE("last reset by %s in \"%s\": pc = 0x%08x, lr = 0x%08x, cfsr = 0x%08x, "
+              "hfsr = 0x%08x\r\n", name, (const char *)record->task, record->pc,
+              record->lr, record->cfsr, record->hfsr);
+        if (!param_store_fault(record))
+        {
+            TRACE("save fault record failed!\r\n");
+        }
+    }
+    fault_ram.magic = 0;
+
+    return TRUE;
 }
 
-void BusFaultException(void)
+/**
+ * @brief capture fault into no-init ram and reset, called by fault entry
+ * @param frame - stacked frame
+ * @param exc_return - EXC_RETURN value of fault exception
+ */
+void diagnosis_fault(const uint32_t *frame, uint32_t exc_return)
 {
-    TRACE("busfault happened!\r\n");
-    dump_register();
+    fault_record_t *record = &fault_ram.record;
+    memset(record, 0, sizeof(fault_record_t));
+
+    record->exception = (uint8_t)__get_IPSR();
+    record->exc_return = exc_return;
+    record->sp = (uint32_t)frame;
+    record->cfsr = SCB_GetUsageFaultDetail() | SCB_GetBusFaultDetail() |
+                   SCB_GetMemFaultDetail();
+    record->hfsr = SCB_GetHardFaultDetail();
+    record->mmfar = SCB_GetMemFaultAddress();
+    record->bfar = SCB_GetBusFaultAddress();
+
+    if (is_sram((uint32_t)frame, FAULT_FRAME_LEN * 4))
+    {
+        record->r0 = frame[0];
+        record->r1 = frame[1];
+        record->r2 = frame[2];
+        record->r3 = frame[3];
+        record->r12 = frame[4];
+        record->lr = frame[5];
+        record->pc = frame[6];
+        record->xpsr = frame[7];
+
+        const uint32_t *stack = frame + FAULT_FRAME_LEN;
+        for (uint8_t i = 0; (i < FAULT_STACK_NUM) &&
+             is_sram((uint32_t)(stack + i), 4); ++i)
+        {
+            record->stack[i] = stack[i];
+        }
+    }
+
+    /* only tasks run on process stack */
+    if (0 != (exc_return & EXC_RETURN_PSP))
+    {
+        strncpy((char *)record->task, pcTaskGetName(NULL), FAULT_TASK_NAME_LEN - 1);
+    }
+    else if (0 == (exc_return & EXC_RETURN_THREAD))
+    {
+        strncpy((char *)record->task, "isr", FAULT_TASK_NAME_LEN - 1);
+    }
+    else
+    {
+        strncpy((char *)record->task, "main", FAULT_TASK_NAME_LEN - 1);
+    }
+
+    fault_ram.check = crc16_update(0xffff, (const uint8_t *)record, sizeof(fault_record_t));
+    fault_ram.magic = FAULT_MAGIC;
+    SCB_SystemReset();
 }
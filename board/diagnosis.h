@@ -13,6 +13,7 @@
 BEGIN_DECLS
 
 bool diagnosis_init(void);
+void diagnosis_fault(const uint32_t *frame, uint32_t exc_return);
 
 END_DECLS
 
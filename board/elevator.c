@@ -8,9 +8,8 @@
 #include "elevator.h"
 #include "FreeRTOS.h"
 #include "task.h"
-#include "semphr.h"
-#include "queue.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "led_status.h"
 #include "protocol.h"
 #include "keyctl.h"
@@ -20,130 +19,153 @@
 #include "global.h"
 #include "switch_monitor.h"
 #include "expand.h"
+#include "expand_health.h"
 #include "protocol_expand.h"
 #include "parameter.h"
+#include "timewheel.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[elev]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_ELEV
 
 extern parameters_t board_parameter;
 #ifdef __MASTER
 /* elevator current floor */
-static uint8_t elev_cur_floor = 1;
+static floor_t elev_cur_floor = 1;
 
 static bool hold_door = FALSE;
-static uint8_t hold_cnt = 0;
 
 /* elevator state */
 static elev_run_state run_state = run_stop;
 static elev_work_state work_state = work_idle;
 #endif
 
-/* key press queue */
-static xQueueHandle xQueueFloor = NULL;
+/**
+ * key requested by elev_go, key pressed now, and released key waiting for
+ * relay to drop, accessed in critical section
+ */
+#define KEY_NONE              0xff
+#define KEY_PRESS_TIME        (500 / portTICK_PERIOD_MS)
+#define KEY_RELEASE_GAP       (100 / portTICK_PERIOD_MS)
+static uint8_t go_key = KEY_NONE;
+static uint8_t held_key = KEY_NONE;
+static bool key_gap = FALSE;
+static timewheel_timer_t key_timer;
 #ifdef __MASTER
-static xQueueHandle xArriveQueue = NULL;
-static xSemaphoreHandle xNotifySemaphore = NULL;
-#define MAX_CHECK_CNT 5
+#define CHECKIN_DELAY         (100 / portTICK_PERIOD_MS)
+static timewheel_timer_t checkin_timer;
+
+/** door is closed if hold is not cancelled in time */
+#define HOLD_TIMEOUT          (16000 / portTICK_PERIOD_MS)
+static timewheel_timer_t hold_timer;
+
+/** arrive is sent again until robot acks */
+#if WAIT_TO_SEND_ARRIVE
+#define ARRIVE_DELAY          (2500 / portTICK_PERIOD_MS)
+#else
+#define ARRIVE_DELAY          (500 / portTICK_PERIOD_MS)
 #endif
+#define ARRIVE_RETRY_INTERVAL (500 / portTICK_PERIOD_MS)
+#define MAX_CHECK_CNT 5
+static floor_t arrive_floor = 0;
+static uint8_t arrive_cnt = 0;
+static timewheel_timer_t arrive_timer;
 
-#ifdef __MASTER
 /**
- * @brief elevator task
- * @param pvParameters - task parameters
+ * @brief door hold timeout
+ * @param pvParameters - timer parameters
  */
 static void vElevHold(void *pvParameters)
 {
-    for (;;)
+    if (hold_door)
     {
-        if (hold_door)
+        hold_door = FALSE;
+        keyctl_release(boardmap_opendoor_key());
+    }
+}
+
+/**
+ * @brief check if checkin floor is already arrived after key released
+ * @param pvParameters - timer parameters
+ */
+static void vElevCheckin(void *pvParameters)
+{
+    floor_t checkin_floor = robot_checkin_get();
+    if (DEFAULT_CHECKIN != checkin_floor)
+    {
+        if ((checkin_floor == elev_cur_floor) &&
+            (!is_led_on(checkin_floor)))
         {
-            hold_cnt ++;
-            if (hold_cnt > 15)
-            {
-                hold_door = FALSE;
-                hold_cnt = 0;
-                keyctl_release(boardmap_opendoor_key());
-            }
+            /* already arrive */
+            elev_arrived(checkin_floor);
         }
-
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 }
 #endif
 
 /**
- * @brief elevator task
- * @param pvParameters - task parameters
+ * @brief release pressed key, requested key is pressed after release gap
+ * @param pvParameters - timer parameters
  */
-static void vElevControl(void *pvParameters)
+static void vElevKey(void *pvParameters)
 {
-    uint8_t key = 0;
-    for (;;)
+    taskENTER_CRITICAL();
+    uint8_t release = held_key;
+    uint8_t press = KEY_NONE;
+    if (KEY_NONE == release)
     {
-        if (xQueueReceive(xQueueFloor, &key, portMAX_DELAY))
-        {
-            keyctl_press(key);
-            vTaskDelay(500 / portTICK_PERIOD_MS);
-            keyctl_release(key);
+        press = go_key;
+        go_key = KEY_NONE;
+    }
+    held_key = press;
+    key_gap = (KEY_NONE != release);
+    taskEXIT_CRITICAL();
+
+    if (KEY_NONE != release)
+    {
+        keyctl_release(release);
 #ifdef __MASTER
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-            uint8_t checkin_floor = robot_checkin_get();
-            if (DEFAULT_CHECKIN != checkin_floor)
-            {
-                if ((checkin_floor == elev_cur_floor) &&
-                    (!is_led_on(checkin_floor)))
-                {
-                    /* already arrive */
-                    elev_arrived(checkin_floor);
-                }
-            }
+        timewheel_start_once(&checkin_timer, CHECKIN_DELAY);
 #endif
-        }
+        timewheel_start_once(&key_timer, KEY_RELEASE_GAP);
+    }
+
+    if (KEY_NONE != press)
+    {
+        keyctl_press(press);
+        timewheel_start_once(&key_timer, KEY_PRESS_TIME);
     }
 }
 
 #ifdef __MASTER
 /**
- * @brief elevator task
- * @param pvParameters - task parameters
+ * @brief send arrive to robot until acked
+ * @param pvParameters - timer parameters
  */
 static void vElevArrive(void *pvParameters)
 {
-    uint8_t err_cnt = 0;
-    char floor = 0;
     robot_wn_type_t wn_type = ROBOT_WN;
-    for (;;)
+    if (DEFAULT_CHECKIN == robot_checkin_get())
     {
-        err_cnt = 0;
-        if (xQueueReceive(xArriveQueue, &floor, portMAX_DELAY))
-        {
-            if (DEFAULT_CHECKIN != robot_checkin_get())
-            {
-#if WAIT_TO_SEND_ARRIVE
-                /** wait 2 senond to see whether really arrived */
-                vTaskDelay(2000 / portTICK_PERIOD_MS);
-                if (elev_cur_floor == floor)
-                {
-#endif
-                    /** really arrived */
-                    while (pdTRUE != xSemaphoreTake(xNotifySemaphore,
-                                                    500 / portTICK_PERIOD_MS))
-                    {
-                        err_cnt ++;
-                        if (err_cnt > MAX_CHECK_CNT)
-                        {
-                            robot_checkin_reset();
-                            break;
-                        }
-                        notify_arrive(floor, &wn_type);
-                    }
+        return ;
+    }
 #if WAIT_TO_SEND_ARRIVE
-                }
+    /** see whether really arrived */
+    if ((0 == arrive_cnt) && (elev_cur_floor != arrive_floor))
+    {
+        return ;
+    }
 #endif
-            }
-        }
+
+    arrive_cnt ++;
+    if (arrive_cnt > MAX_CHECK_CNT)
+    {
+        robot_checkin_reset();
+        return ;
     }
+    notify_arrive(arrive_floor, &wn_type);
+    timewheel_start_once(&arrive_timer, ARRIVE_RETRY_INTERVAL);
 }
 
 /**
@@ -154,7 +176,7 @@ static void vElevArrive(void *pvParameters)
 void arrive_hook(const uint8_t *data, uint8_t len)
 {
     robot_checkin_reset();
-    xSemaphoreGive(xNotifySemaphore);
+    timewheel_stop(&arrive_timer);
 }
 #endif
 
@@ -165,19 +187,12 @@ void arrive_hook(const uint8_t *data, uint8_t len)
 bool elev_init(void)
 {
     TRACE("initialize elevator...\r\n");
-    xQueueFloor = xQueueCreate(1, 1);
+    timewheel_timer_init(&key_timer, vElevKey, NULL);
 #ifdef __MASTER
-    xArriveQueue = xQueueCreate(1, 1);
-    xNotifySemaphore = xSemaphoreCreateBinary();
+    timewheel_timer_init(&checkin_timer, vElevCheckin, NULL);
+    timewheel_timer_init(&hold_timer, vElevHold, NULL);
+    timewheel_timer_init(&arrive_timer, vElevArrive, NULL);
     register_arrive_cb(arrive_hook);
-    xTaskCreate(vElevHold, "elvhold", ELEV_STACK_SIZE, NULL,
-                ELEV_PRIORITY, NULL);
-#endif
-    xTaskCreate(vElevControl, "elvctl", ELEV_STACK_SIZE, NULL,
-                ELEV_PRIORITY, NULL);
-#ifdef __MASTER
-    xTaskCreate(vElevArrive, "elvarrive", ELEV_STACK_SIZE, NULL,
-                ELEV_PRIORITY, NULL);
     /** release opendoor key */
     uint8_t key = boardmap_opendoor_key();
     if (1 == board_parameter.opendoor_polar)
@@ -193,7 +208,7 @@ bool elev_init(void)
  * @brief elevator going floor
  * @param floor - going floor
  */
-void elev_go(uint8_t floor)
+void elev_go(floor_t floor)
 {
     TRACE("elevator go floor: %d\r\n", floor);
     uint8_t id_board = boardmap_get_floor_board_id(floor);
@@ -203,13 +218,25 @@ void elev_go(uint8_t floor)
         {
             /** self control */
             uint8_t key = boardmap_floor_to_key(floor);
-            xQueueOverwrite(xQueueFloor, &key);
+            taskENTER_CRITICAL();
+            bool idle = (KEY_NONE == held_key) && (KEY_NONE == go_key) && !key_gap;
+            go_key = key;
+            taskEXIT_CRITICAL();
+            /** pressed key is released first, and pressed after release gap */
+            if (idle)
+            {
+                timewheel_start_once(&key_timer, 0);
+            }
         }
 #ifdef __MASTER
-        else
+        else if (expand_health_is_alive(id_board))
         {
             expand_elev_go(id_board, floor);
         }
+        else
+        {
+            TRACE("board %d is dead, floor %d unreachable\r\n", id_board, floor);
+        }
 #endif
     }
 }
@@ -219,7 +246,7 @@ void elev_go(uint8_t floor)
  * @brief indicate elevator arrive
  * @param floor - arrive floor
  */
-void elev_arrived(uint8_t floor)
+void elev_arrived(floor_t floor)
 {
     if (work_robot == work_state)
     {
@@ -228,7 +255,9 @@ void elev_arrived(uint8_t floor)
             if (elev_cur_floor == floor)
             {
                 TRACE("floor arrive: %d\r\n", floor);
-                xQueueOverwrite(xArriveQueue, &floor);
+                arrive_floor = floor;
+                arrive_cnt = 0;
+                timewheel_start_once(&arrive_timer, ARRIVE_DELAY);
             }
         }
     }
@@ -247,8 +276,8 @@ void elev_hold_open(bool flag)
         if (switch_arrive == switch_get_status())
         {
 #endif
-            hold_cnt = 0;
             hold_door = TRUE;
+            timewheel_start_once(&hold_timer, HOLD_TIMEOUT);
             if (0 == board_parameter.opendoor_polar)
             {
                 keyctl_press(key);
@@ -266,7 +295,7 @@ void elev_hold_open(bool flag)
         if (hold_door)
         {
             hold_door = FALSE;
-            hold_cnt = 0;
+            timewheel_stop(&hold_timer);
             if (0 == board_parameter.opendoor_polar)
             {
                 keyctl_release(key);
@@ -279,12 +308,29 @@ void elev_hold_open(bool flag)
     }
 }
 
+/**
+ * @brief drive opendoor key again after door polarity changed
+ */
+void elev_apply_param(void)
+{
+    uint8_t key = boardmap_opendoor_key();
+    bool press = (0 == board_parameter.opendoor_polar) ? hold_door : !hold_door;
+    if (press)
+    {
+        keyctl_press(key);
+    }
+    else
+    {
+        keyctl_release(key);
+    }
+}
+
 /**
  * @brief set elevator physical floor
  * @param[in] cur_floor: current physical floor
  * @param[in] prev_floor: previous physical floor
  */
-void elev_set_floor(uint8_t cur_floor, uint8_t prev_floor)
+void elev_set_floor(floor_t cur_floor, floor_t prev_floor)
 {
     elev_cur_floor = cur_floor;
     TRACE("set elevator floor: current = %d, previous = %d\r\n", cur_floor, prev_floor);
@@ -321,10 +367,10 @@ void elev_set_floor(uint8_t cur_floor, uint8_t prev_floor)
  */
 void elev_decrease(void)
 {
-    uint8_t prev_floor = elev_cur_floor;
-    if (elev_cur_floor > 1)
+    floor_t prev_floor = elev_cur_floor;
+    if (elev_cur_floor > board_parameter.start_floor)
     {
-        elev_cur_floor --;
+        elev_cur_floor = floor_offset(elev_cur_floor, -1);
     }
     elev_set_floor(elev_cur_floor, prev_floor);
 }
@@ -334,13 +380,11 @@ void elev_decrease(void)
  */
 void elev_increase(void)
 {
-    uint8_t prev_floor = elev_cur_floor;
-    if (elev_cur_floor < board_parameter.total_floor)
+    floor_t prev_floor = elev_cur_floor;
+    if (floor_distance(board_parameter.start_floor, elev_cur_floor) <
+        (int16_t)board_parameter.total_floor - 1)
     {
-        if (elev_cur_floor < 0xff)
-        {
-            elev_cur_floor ++;
-        }
+        elev_cur_floor = floor_offset(elev_cur_floor, 1);
     }
     elev_set_floor(elev_cur_floor, prev_floor);
 }
@@ -376,7 +420,7 @@ void elevator_set_state_work(elev_work_state state)
  * @brief get elevator current floor
  * @return elevator current floor
  */
-uint8_t elev_floor(void)
+floor_t elev_floor(void)
 {
     return elev_cur_floor;
 }
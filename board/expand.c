@@ -9,26 +9,29 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
-#include "timers.h"
+#include "semphr.h"
+#include "timewheel.h"
 #include "expand.h"
 #include "stm32f10x_cfg.h"
 #include "global.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "parameter.h"
 #include "protocol_expand.h"
+#include "expand_tp.h"
+#include "expand_health.h"
+#include "timesync.h"
+#include "expand_fw.h"
 #include "boardmap.h"
 #include "config.h"
 #include "dbgserial.h"
+#include "stats.h"
 
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[EXPAND]"
-
-typedef struct
-{
-    uint8_t len;
-    uint8_t data[8];
-} expand_data;
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_EXPAND
 
 extern parameters_t board_parameter;
 
@@ -42,11 +45,122 @@ typedef enum
 } register_status_t;
 static register_status_t register_status = REGISTER_FAIL;
 #define REGISTER_INTERVAL         (2000 / portTICK_PERIOD_MS)
+/** listen time of each bitrate when detecting */
+#define DETECT_INTERVAL           (250 / portTICK_PERIOD_MS)
+/** bitrate is detected again if master lost */
+#define MASTER_LOST_TIMEOUT       (5000 / portTICK_PERIOD_MS)
+/**
+ * listen only node can not acknowledge, if no other node acknowledges master
+ * frames, master retransmits and every frame ends with error flag at ack
+ * delimiter, which is seen as form error only when bitrate matches, wrong
+ * bitrate mostly gives stuff and crc errors, so bus is joined without frame
+ * received only if exactly one bitrate of a full cycle sees form errors only
+ */
+#define DETECT_FORM_ERR_MIN       3
+static bool bitrate_detecting = FALSE;
+static uint32_t detect_rx_cnt = 0;
+static volatile uint16_t detect_form_err = 0;
+static volatile uint16_t detect_other_err = 0;
+/** bitrates listened in this cycle, and bitrates seeing form errors only */
+static uint8_t detect_listened = 0;
+static uint8_t detect_form_num = 0;
+static can_bitrate_t detect_form_bitrate = CAN_BITRATE_COUNT;
+static TickType_t master_tick = 0;
 #endif
 
-#define EXPAND_QUEUE_LEN   8
+#ifdef __MASTER
+/** master notify bitrate periodically, expand boards detect bitrate with it */
+#define BITRATE_NOTIFY_INTERVAL   (1000 / portTICK_PERIOD_MS)
+#define BITRATE_NOTIFY_REPEAT     3
+#endif
+/** bitrate switch delay, unit is 100ms */
+#define BITRATE_SWITCH_DELAY      5
+
+/** timing based on 36MHz APB1 clock */
+typedef struct
+{
+    uint8_t sjw;
+    uint8_t bs1;
+    uint8_t bs2;
+    uint16_t prescaler;
+} can_timing_t;
+
+static const can_timing_t can_timings[CAN_BITRATE_COUNT] =
+{
+    {CAN_SJW_1tq, CAN_BS1_14tq, CAN_BS2_3tq, 100},  /** 20k */
+    {CAN_SJW_1tq, CAN_BS1_7tq, CAN_BS2_2tq, 36},    /** 100k */
+    {CAN_SJW_1tq, CAN_BS1_13tq, CAN_BS2_4tq, 16},   /** 125k */
+    {CAN_SJW_1tq, CAN_BS1_13tq, CAN_BS2_4tq, 8},    /** 250k */
+    {CAN_SJW_1tq, CAN_BS1_13tq, CAN_BS2_4tq, 4},    /** 500k */
+    {CAN_SJW_1tq, CAN_BS1_13tq, CAN_BS2_4tq, 2},    /** 1M */
+};
+
+static can_bitrate_t can_bitrate = CAN_BITRATE_DEFAULT;
+static can_bitrate_t pending_bitrate = CAN_BITRATE_DEFAULT;
+static timewheel_timer_t switch_timer;
+
+/** receive pool, filled by interrupt and released by receive task in order,
+    length must be power of 2 */
+#define EXPAND_RX_POOL_LEN       16
 static xQueueHandle xExpandRecvQueue = NULL;
-static xQueueHandle xExpandSendQueue = NULL;
+static CAN_RxMsg rx_pool[EXPAND_RX_POOL_LEN];
+/** local time when frame received */
+static uint64_t rx_stamps[EXPAND_RX_POOL_LEN];
+static uint64_t rx_cur_stamp = 0;
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+
+/** waiter of frame sent immediately, completion is given from transmit
+    interrupt */
+typedef struct
+{
+    bool used;
+    volatile uint8_t status;
+    xSemaphoreHandle xDone;
+} expand_tx_waiter_t;
+
+/** transmit frame, waiter is given when frame sent */
+typedef struct
+{
+    uint32_t id;
+    uint8_t len;
+    uint8_t data[8];
+    expand_tx_waiter_t *waiter;
+    /** get local time when frame sent */
+    bool stamp;
+} expand_frame_t;
+
+/**
+ * extended can id:
+ * bit 24-25: message class, lower value wins arbitration, high goes to fifo1
+ * bit 8-15: destination board id, ID_BOARD_BROADCAST means all boards
+ * bit 0-7: source board id
+ */
+#define EXPAND_PRIO_SHIFT        24
+#define EXPAND_PRIO_MASK         ((uint32_t)0x03 << EXPAND_PRIO_SHIFT)
+#define EXPAND_DST_SHIFT         8
+#define EXPAND_DST_MASK          ((uint32_t)0xff << EXPAND_DST_SHIFT)
+#define EXPAND_ID_BOARD_MASK     0xff
+#define CAN_TX_MAILBOX_NUM       3
+#define EXPAND_TX_QUEUE_LEN      16
+#define EXPAND_TX_TIMEOUT        (100 / portTICK_PERIOD_MS)
+#define EXPAND_TX_OK             0x01
+#define EXPAND_TX_FAIL           0x02
+/** tasks sending immediately at the same time */
+#define EXPAND_TX_WAITER_NUM     4
+
+/** software transmit queue, sorted by can id, protected by critical section */
+static expand_frame_t tx_frames[EXPAND_TX_QUEUE_LEN];
+static uint8_t tx_count = 0;
+static expand_tx_waiter_t tx_waiters[EXPAND_TX_WAITER_NUM];
+static expand_tx_waiter_t *tx_mailbox_waiter[CAN_TX_MAILBOX_NUM];
+static bool tx_mailbox_stamp[CAN_TX_MAILBOX_NUM];
+static uint64_t tx_stamp = 0;
+static bool tx_stamp_valid = FALSE;
+#ifdef __MASTER
+static uint8_t tx_mailbox_dst[CAN_TX_MAILBOX_NUM];
+#endif
+static expand_stats_t expand_stats;
 
 #if DUMP_EXPAND
 /**
@@ -56,6 +170,11 @@ static xQueueHandle xExpandSendQueue = NULL;
  */
 static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
 {
+    if (!TRACE_ON(TRACE_LEVEL_DUMP))
+    {
+        return ;
+    }
+
     if (dir)
     {
         TRACE("send data: ");
@@ -64,14 +183,7 @@ static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
     {
         TRACE("recv data: ");
     }
-    for (int i = 0; i < len; ++i)
-    {
-        dbg_putchar("0123456789abcdef"[data[i] >> 4]);
-        dbg_putchar("0123456789abcdef"[data[i] & 0x0f]);
-        dbg_putchar(' ');
-    }
-    dbg_putchar('\r');
-    dbg_putchar('\n');
+    dbg_dump(data, len);
 }
 #endif
 
@@ -84,137 +196,497 @@ static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
  */
 static void register_status_cb(uint8_t *data, uint8_t len)
 {
-    if (REGISTER_SUCCESS != register_status)
+    /** master accepts known board again, so repeated register is success too */
+    register_status = (register_status_t) * data;
+}
+#endif
+
+/**
+ * @brief initialize can extended id filter
+ * @param number - filter number
+ * @param fifo - fifo assignment
+ * @param id - extended id
+ * @param mask - extended id mask, 0 means accept all frames
+ */
+static void can_filter_init(uint8_t number, uint8_t fifo, uint32_t id, uint32_t mask)
+{
+    CAN_Filter filter;
+    uint32_t id_reg = (id << 3) | CAN_ID_EXT | CAN_RTR_DATA;
+    uint32_t mask_reg = (0 == mask) ? 0 : ((mask << 3) | CAN_ID_EXT | CAN_RTR_DATA);
+    if (0 == mask)
     {
-        /** only process failed issue, in case of multi message send,
-            first is success, second is faild */
-        register_status = (register_status_t) * data;
+        id_reg = 0;
     }
+
+    filter.number = number;
+    filter.mode = CAN_FilterMode_IdMask;
+    filter.scale = CAN_FilterScale_32bit;
+    filter.id_high = (uint16_t)(id_reg >> 16);
+    filter.id_low = (uint16_t)(id_reg & 0xffff);
+    filter.mask_id_high = (uint16_t)(mask_reg >> 16);
+    filter.mask_id_low = (uint16_t)(mask_reg & 0xffff);
+    filter.fifo_assignment = fifo;
+    filter.activation = TRUE;
+    CAN_FilterInit(&filter);
 }
+
+/**
+ * @brief initialize can filters, only frames addressed to this board and
+ *        broadcast frames reach receive interrupt, lower filter number
+ *        matches first, so high priority frames go to fifo1
+ */
+static void can_filters_init(void)
+{
+#if LOOP_BACK_TEST
+    can_filter_init(0, CAN_Filter_FIFO0, 0, 0);
+#else
+#ifdef __MASTER
+    uint32_t self = (uint32_t)ID_BOARD_MASTER << EXPAND_DST_SHIFT;
+#else
+    uint32_t self = (uint32_t)board_parameter.id_board << EXPAND_DST_SHIFT;
 #endif
+    uint32_t all = (uint32_t)ID_BOARD_BROADCAST << EXPAND_DST_SHIFT;
+    uint32_t high = (uint32_t)EXPAND_PRIO_HIGH << EXPAND_PRIO_SHIFT;
+
+    can_filter_init(0, CAN_Filter_FIFO1, high | self, EXPAND_PRIO_MASK | EXPAND_DST_MASK);
+    can_filter_init(1, CAN_Filter_FIFO1, high | all, EXPAND_PRIO_MASK | EXPAND_DST_MASK);
+    can_filter_init(2, CAN_Filter_FIFO0, self, EXPAND_DST_MASK);
+    can_filter_init(3, CAN_Filter_FIFO0, all, EXPAND_DST_MASK);
+#endif
+}
 
 /**
- * @brief initialize can
+ * @brief set can bitrate and mode, filters and interrupts are kept
+ * @param bitrate - bitrate
+ * @param mode - can mode
+ * @return set status
  */
-static void can_init(void)
+static bool can_set_bitrate(can_bitrate_t bitrate, uint8_t mode)
 {
     CAN_Config config;
-    CAN_Filter filter;
 
     CAN_StructInit(&config);
     config.ttcm = FALSE;
-    config.abom = FALSE;
+    /** leave bus-off automatically */
+    config.abom = TRUE;
     config.awum = FALSE;
     config.nart = FALSE;
     config.rflm = FALSE;
-    config.txfp = FALSE;
+    /** send mailboxes in request order, transmit queue is sorted already,
+        frames with the same id must not be reordered */
+    config.txfp = TRUE;
 #if LOOP_BACK_TEST
     config.mode = CAN_Mode_LoopBack;
 #else
-    config.mode = CAN_Mode_Normal;
+    config.mode = mode;
 #endif
+    config.sjw = can_timings[bitrate].sjw;
+    config.bs1 = can_timings[bitrate].bs1;
+    config.bs2 = can_timings[bitrate].bs2;
+    config.prescaler = can_timings[bitrate].prescaler;
 
-#if USE_SPEED_100K
-    /* 100k */
-    config.sjw = CAN_SJW_1tq;
-    config.bs1 = CAN_BS1_7tq;
-    config.bs2 = CAN_BS2_2tq;
-    config.prescaler = 36;
-#else
-    /** 20k */
-    config.sjw = CAN_SJW_1tq;
-    config.bs1 = CAN_BS1_14tq;
-    config.bs2 = CAN_BS2_3tq;
-    config.prescaler = 100;
-#endif
+    can_bitrate = bitrate;
+    return CAN_Init(CAN1, &config);
+}
 
-    bool ret = CAN_Init(CAN1, &config);
+#ifdef __EXPAND
+/**
+ * @brief start or stop counting bus errors for bitrate detection
+ * @param enable - enable or disable
+ */
+static void can_detect_errors(bool enable)
+{
+    detect_form_err = 0;
+    detect_other_err = 0;
+    CAN_ClearITPendingBit(CAN1, CAN_IT_LEC);
+    CAN_ITEnable(CAN1, CAN_IT_LEC, enable);
+    CAN_ITEnable(CAN1, CAN_IT_ERR, enable);
+}
 
+/**
+ * @brief start new bitrate detection cycle
+ */
+static void detect_cycle_reset(void)
+{
+    detect_listened = 0;
+    detect_form_num = 0;
+    detect_form_bitrate = CAN_BITRATE_COUNT;
+}
+#endif
 
-    filter.number = 0;
-    filter.mode = CAN_FilterMode_IdMask;
-    filter.scale = CAN_FilterScale_32bit;
-#ifdef __MASTER
-    filter.id_high = 0;
-    filter.id_low = 0;
-    filter.mask_id_high = 0;
-    filter.mask_id_low = 0;
+/**
+ * @brief initialize can
+ */
+static void can_init(void)
+{
+    if (board_parameter.can_bitrate < CAN_BITRATE_COUNT)
+    {
+        can_bitrate = (can_bitrate_t)board_parameter.can_bitrate;
+    }
+
+#ifdef __EXPAND
+    /** listen only until bitrate detected */
+    bitrate_detecting = TRUE;
+    detect_cycle_reset();
+    can_set_bitrate(can_bitrate, CAN_Mode_Silent);
+    /* error interrupt, only enabled when detecting */
+    NVIC_Config errConfig = {CAN_SCE_IRQChannel, CAN1_PRIORITY, 0, TRUE};
+    NVIC_Init(&errConfig);
+    can_detect_errors(TRUE);
 #else
-    filter.id_high = 0;
-    filter.id_low = (((uint32_t)ID_BOARD_MASTER << 3) | CAN_ID_EXT | CAN_RTR_DATA) & 0xffff;
-    filter.mask_id_high = 0xffff;
-    filter.mask_id_low = 0xffff;
+    can_set_bitrate(can_bitrate, CAN_Mode_Normal);
 #endif
 
-    filter.fifo_assignment = CAN_Filter_FIFO0;
-    filter.activation = TRUE;
-    CAN_FilterInit(&filter);
+    can_filters_init();
 
     /* setup interrupt */
     NVIC_Config nvicConfig = {USB_LP_CAN_RX0_IRQChannel, CAN1_PRIORITY, 0, TRUE};
     NVIC_Init(&nvicConfig);
-    /* receive interrupt */
+    nvicConfig.channel = CAN_RX1_IRQChannel;
+    NVIC_Init(&nvicConfig);
+    nvicConfig.channel = USB_HP_CAN_TX_IRQChannel;
+    NVIC_Init(&nvicConfig);
+    /* receive and overrun interrupt */
     CAN_ITEnable(CAN1, CAN_IT_FMP0, TRUE);
+    CAN_ITEnable(CAN1, CAN_IT_FOV0, TRUE);
+    CAN_ITEnable(CAN1, CAN_IT_FMP1, TRUE);
+    CAN_ITEnable(CAN1, CAN_IT_FOV1, TRUE);
+    /* transmit mailbox empty interrupt */
+    CAN_ITEnable(CAN1, CAN_IT_TME, TRUE);
 }
 
 /**
- * @brief send message
- * @param data - data to send
- * @param len - data length
- * @retval success sended length
+ * @brief move queued frames to free transmit mailboxes, hardware sends
+ *        mailboxes by can id, so higher priority frame always goes first
+ * @note must be called with interrupt masked
  */
-static uint8_t can_send_msg(const uint8_t *data, uint8_t len)
+static void can_tx_fill(void)
 {
     uint8_t mbox;
-    uint16_t count = 0;
     CAN_TxMsg msg;
     msg.std_id = 0;
+    msg.ide = CAN_ID_EXT;
+    msg.rtr = CAN_RTR_DATA;
+
+    while (tx_count > 0)
+    {
+        msg.ext_id = tx_frames[0].id;
+        msg.dlc = tx_frames[0].len;
+        memcpy(msg.data, tx_frames[0].data, tx_frames[0].len);
+
+        mbox = CAN_Transmit(CAN1, &msg);
+        if (CAN_TxStatus_NoMailBox == mbox)
+        {
+            /** all mailbox busy, continue in transmit interrupt */
+            break;
+        }
+        tx_mailbox_waiter[mbox] = tx_frames[0].waiter;
+        tx_mailbox_stamp[mbox] = tx_frames[0].stamp;
+#ifdef __MASTER
+        tx_mailbox_dst[mbox] = (uint8_t)(tx_frames[0].id >> EXPAND_DST_SHIFT);
+#endif
+
+        tx_count --;
+        memmove(tx_frames, tx_frames + 1, tx_count * sizeof(expand_frame_t));
+    }
+}
+
+/**
+ * @brief get free transmit waiter
+ * @return waiter, NULL if all waiters used
+ */
+static expand_tx_waiter_t *can_tx_waiter_get(void)
+{
+    expand_tx_waiter_t *waiter = NULL;
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < EXPAND_TX_WAITER_NUM; ++i)
+    {
+        if (!tx_waiters[i].used)
+        {
+            waiter = &tx_waiters[i];
+            waiter->used = TRUE;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return waiter;
+}
+
+/**
+ * @brief release transmit waiter, frame still queued or in mailbox after
+ *        timeout no longer reports to it
+ * @param waiter - waiter to release
+ */
+static void can_tx_waiter_put(expand_tx_waiter_t *waiter)
+{
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < tx_count; ++i)
+    {
+        if (waiter == tx_frames[i].waiter)
+        {
+            tx_frames[i].waiter = NULL;
+        }
+    }
+    for (uint8_t i = 0; i < CAN_TX_MAILBOX_NUM; ++i)
+    {
+        if (waiter == tx_mailbox_waiter[i])
+        {
+            tx_mailbox_waiter[i] = NULL;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    /** drop completion given after timeout */
+    xSemaphoreTake(waiter->xDone, 0);
+    waiter->used = FALSE;
+}
+
+/**
+ * @brief put frame to transmit queue
+ * @param frame - frame to send
+ * @return enqueue status
+ */
+static bool can_tx_enqueue(const expand_frame_t *frame)
+{
+    bool ret = FALSE;
+    taskENTER_CRITICAL();
+    if (tx_count < EXPAND_TX_QUEUE_LEN)
+    {
+        /** keep sending order of frames with the same id */
+        uint8_t pos = tx_count;
+        while ((pos > 0) && (tx_frames[pos - 1].id > frame->id))
+        {
+            tx_frames[pos] = tx_frames[pos - 1];
+            pos --;
+        }
+        tx_frames[pos] = *frame;
+        tx_count ++;
+        can_tx_fill();
+        ret = TRUE;
+    }
+    else
+    {
+        expand_stats.tx_drop ++;
+    }
+    taskEXIT_CRITICAL();
+
+    return ret;
+}
+
+/**
+ * @brief build transmit frame
+ * @param prio - frame priority
+ * @param id_dst - destination board id
+ * @param buf - data to send
+ * @param len - data length
+ * @param frame - frame built
+ */
+static void can_frame_build(expand_prio_t prio, uint8_t id_dst, const uint8_t *buf,
+                            uint8_t len, expand_frame_t *frame)
+{
 #if LOOP_BACK_TEST
-    msg.ext_id = ID_BOARD_MASTER;
+    frame->id = ID_BOARD_MASTER;
 #else
-    msg.ext_id = board_parameter.id_board;
+    frame->id = board_parameter.id_board;
 #endif
-    msg.ide = CAN_ID_EXT;
-    msg.rtr = CAN_RTR_DATA;
-    msg.dlc = len;
+    frame->id |= ((uint32_t)prio << EXPAND_PRIO_SHIFT);
+    frame->id |= ((uint32_t)id_dst << EXPAND_DST_SHIFT);
+    frame->len = len;
+    if (frame->len > 8)
+    {
+        frame->len = 8;
+    }
+    memcpy(frame->data, buf, frame->len);
+    frame->waiter = NULL;
+    frame->stamp = FALSE;
+}
+
+/**
+ * @brief get expand bus bitrate
+ * @return current bitrate
+ */
+can_bitrate_t expand_bitrate(void)
+{
+    return can_bitrate;
+}
+
+/**
+ * @brief switch to pending bitrate
+ * @param pvParameters - timer parameter
+ */
+static void vSwitchBitrate(void *pvParameters)
+{
+    TRACE("switch bitrate: %d\r\n", pending_bitrate);
+    can_set_bitrate(pending_bitrate, CAN_Mode_Normal);
+    if (board_parameter.can_bitrate != pending_bitrate)
+    {
+        board_parameter.can_bitrate = pending_bitrate;
+        param_store_can_bitrate(pending_bitrate);
+    }
+}
+
+/**
+ * @brief change expand bus bitrate, master notifies all expand boards to
+ *        switch at the same time
+ * @param bitrate - new bitrate
+ * @return TRUE if bitrate valid
+ */
+bool expand_change_bitrate(uint8_t bitrate)
+{
+    if (bitrate >= CAN_BITRATE_COUNT)
+    {
+        return FALSE;
+    }
+
+    pending_bitrate = (can_bitrate_t)bitrate;
+#ifdef __MASTER
+    for (uint8_t i = 0; i < BITRATE_NOTIFY_REPEAT; ++i)
+    {
+        notify_bitrate(bitrate, BITRATE_SWITCH_DELAY);
+    }
+    timewheel_start_once(&switch_timer, BITRATE_SWITCH_DELAY * 100 / portTICK_PERIOD_MS);
+#else
+    timewheel_start_once(&switch_timer, 1);
+#endif
+    return TRUE;
+}
 
-    for (uint8_t i = 0; i < len; ++i)
+#ifdef __MASTER
+/**
+ * @brief notify expand boards current bitrate
+ * @param pvParameters - timer parameter
+ */
+static void vNotifyBitrate(void *pvParameters)
+{
+    if (!timewheel_is_active(&switch_timer))
+    {
+        notify_bitrate(can_bitrate, 0);
+    }
+}
+#endif
+
+#ifdef __EXPAND
+/**
+ * @brief process bitrate notified by master
+ * @param bitrate - master bitrate
+ * @param delay - switch delay, unit is 100ms, 0 means current bitrate
+ */
+void expand_bitrate_notified(uint8_t bitrate, uint8_t delay)
+{
+    if (bitrate >= CAN_BITRATE_COUNT)
     {
-        msg.data[i] = data[i];
+        return ;
     }
 
-    /** send message */
-    mbox = CAN_Transmit(CAN1, &msg);
-    if (CAN_TxStatus_NoMailBox == mbox)
+    if (0 == delay)
     {
-        return 0;
+        if ((!bitrate_detecting) && (board_parameter.can_bitrate != bitrate))
+        {
+            board_parameter.can_bitrate = bitrate;
+            param_store_can_bitrate(bitrate);
+        }
     }
     else
     {
-        while ((CAN_TxStatus_Failed == CAN_TransmitStatus(CAN1, mbox)) &&
-               (count < 0xfff))
+        pending_bitrate = (can_bitrate_t)bitrate;
+        timewheel_start_once(&switch_timer, delay * 100 / portTICK_PERIOD_MS);
+    }
+}
+
+/**
+ * @brief leave detecting and join bus at current bitrate
+ */
+static void bitrate_detected(void)
+{
+    TRACE("bitrate detected: %d\r\n", can_bitrate);
+    bitrate_detecting = FALSE;
+    can_detect_errors(FALSE);
+    can_set_bitrate(can_bitrate, CAN_Mode_Normal);
+    if (board_parameter.can_bitrate != can_bitrate)
+    {
+        board_parameter.can_bitrate = can_bitrate;
+        param_store_can_bitrate(can_bitrate);
+    }
+}
+
+/**
+ * @brief detect bitrate, listen each bitrate until frame received, or join
+ *        the only bitrate seeing unacknowledged frames in a full cycle,
+ *        bitrate without master frame received is detected again after
+ *        master lost timeout
+ * @param pvParameters - timer parameter
+ */
+static void vDetectBitrate(void *pvParameters)
+{
+    expand_stats_t stats;
+    expand_get_stats(&stats);
+    if (stats.rx_ok != detect_rx_cnt)
+    {
+        detect_rx_cnt = stats.rx_ok;
+        master_tick = xTaskGetTickCount();
+        if (bitrate_detecting)
+        {
+            bitrate_detected();
+        }
+    }
+    else if (bitrate_detecting)
+    {
+        if ((detect_form_err >= DETECT_FORM_ERR_MIN) && (0 == detect_other_err))
         {
-            /** wait message send finish */
-            count++;
+            detect_form_num ++;
+            detect_form_bitrate = can_bitrate;
         }
 
-        if (count > 0xfff)
+        detect_listened ++;
+        if (detect_listened >= CAN_BITRATE_COUNT)
         {
-            return 0;
+            bool unique = (1 == detect_form_num);
+            can_bitrate_t found = detect_form_bitrate;
+            detect_cycle_reset();
+            if (unique)
+            {
+                /** no node acknowledges, join bus to acknowledge master */
+                TRACE("bus not acknowledged\r\n");
+                can_bitrate = found;
+                master_tick = xTaskGetTickCount();
+                bitrate_detected();
+                return ;
+            }
         }
 
-        return len;
+        can_set_bitrate((can_bitrate_t)((can_bitrate + 1) % CAN_BITRATE_COUNT),
+                        CAN_Mode_Silent);
+        can_detect_errors(TRUE);
+    }
+    else if (xTaskGetTickCount() - master_tick > MASTER_LOST_TIMEOUT)
+    {
+        TRACE("master lost, detect bitrate\r\n");
+        bitrate_detecting = TRUE;
+        detect_cycle_reset();
+        can_set_bitrate(can_bitrate, CAN_Mode_Silent);
+        can_detect_errors(TRUE);
+    }
+}
+
+/**
+ * @brief master restarted, register again without waiting register timer
+ */
+void expand_resume_notified(void)
+{
+    if (!bitrate_detecting)
+    {
+        register_board(board_parameter.id_board, board_parameter.start_floor);
     }
 }
 
-#ifdef __EXPAND
 /**
  * @brief can receive message task
  * @param pvParameters - task parameter
  */
 static void vRegisterBoard(void *pvParameters)
 {
-    if (REGISTER_SUCCESS != register_status)
+    if ((!bitrate_detecting) && (REGISTER_SUCCESS != register_status))
     {
         register_board(board_parameter.id_board, board_parameter.start_floor);
     }
@@ -227,67 +699,132 @@ static void vRegisterBoard(void *pvParameters)
  */
 static void vExpandRecv(void *pvParameters)
 {
-    expand_data data;
+    uint8_t index;
+    CAN_RxMsg *msg;
     for (;;)
     {
-        if (xQueueReceive(xExpandRecvQueue, &data, portMAX_DELAY))
+        if (xQueueReceive(xExpandRecvQueue, &index, portMAX_DELAY))
         {
-            process_expand_data(data.data, data.len);
+            msg = &rx_pool[index];
+            rx_cur_stamp = rx_stamps[index];
+            expand_tp_recv((uint8_t)(msg->ext_id & EXPAND_ID_BOARD_MASK), msg->data, msg->dlc);
+#ifdef __MASTER
+            /** after processing, so register sees liveness before this frame */
+            expand_health_node_rx((uint8_t)(msg->ext_id & EXPAND_ID_BOARD_MASK));
+#endif
 #if DUMP_EXPAND
-            dump_message(0, data.data, data.len);
+            dump_message(0, msg->data, msg->dlc);
 #endif
+            /** release pool slot */
+            rx_tail ++;
         }
     }
 }
 
 /**
- * @brief can send message task
- * @param pvParameters - task parameter
+ * @brief send data to can
+ * @param prio - frame priority
+ * @param id_dst - destination board id
+ * @param data - data to send
+ * @param len - data length
+ * @return TRUE if data queued, FALSE if transmit queue full
  */
-static void vExpandSend(void *pvParameters)
+bool expand_send_data(expand_prio_t prio, uint8_t id_dst, const uint8_t *buf, uint8_t len)
 {
-    expand_data data;
-    for (;;)
-    {
-        if (xQueueReceive(xExpandSendQueue, &data, portMAX_DELAY))
-        {
-            can_send_msg(data.data, data.len);
+    expand_frame_t frame;
+    can_frame_build(prio, id_dst, buf, len, &frame);
 #if DUMP_EXPAND
-            dump_message(1, data.data, data.len);
+    dump_message(1, frame.data, frame.len);
 #endif
-        }
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-    }
+    return can_tx_enqueue(&frame);
 }
 
 /**
- * @brief send data to can
+ * @brief send data to can imeediately and wait until data sent
+ * @param id_dst - destination board id
  * @param data - data to send
  * @param len - data length
+ * @return send status
  */
-void expand_send_data(const uint8_t *buf, uint8_t len)
+bool expand_send_data_immediately(uint8_t id_dst, const uint8_t *buf, uint8_t len)
 {
-    expand_data data;
-    data.len = len;
-    if (data.len > 8)
+    expand_tx_waiter_t *waiter = can_tx_waiter_get();
+    if (NULL == waiter)
+    {
+        return FALSE;
+    }
+
+    expand_frame_t frame;
+    can_frame_build(EXPAND_PRIO_HIGH, id_dst, buf, len, &frame);
+    frame.waiter = waiter;
+#if DUMP_EXPAND
+    dump_message(1, frame.data, frame.len);
+#endif
+
+    bool ret = FALSE;
+    if (can_tx_enqueue(&frame) &&
+        (pdTRUE == xSemaphoreTake(waiter->xDone, EXPAND_TX_TIMEOUT)))
     {
-        data.len = 8;
+        ret = (EXPAND_TX_OK == waiter->status);
     }
-    memcpy(data.data, buf, data.len);
-    xQueueSend(xExpandSendQueue, &data, 50 / portTICK_PERIOD_MS);
+    can_tx_waiter_put(waiter);
+
+    return ret;
 }
 
 /**
- * @brief send data to can imeediately
+ * @brief send data to can, local time is got when data sent
+ * @param id_dst - destination board id
  * @param data - data to send
  * @param len - data length
+ * @return TRUE if data queued, FALSE if transmit queue full
  */
-void expand_send_data_immediately(const uint8_t *buf, uint8_t len)
+bool expand_send_data_stamped(uint8_t id_dst, const uint8_t *buf, uint8_t len)
 {
-    can_send_msg(buf, len);
-#if DUMP_EXPAND
-    dump_message(1, buf, len);
-#endif
+    expand_frame_t frame;
+    can_frame_build(EXPAND_PRIO_HIGH, id_dst, buf, len, &frame);
+    frame.stamp = TRUE;
+    taskENTER_CRITICAL();
+    tx_stamp_valid = FALSE;
+    taskEXIT_CRITICAL();
+    return can_tx_enqueue(&frame);
+}
+
+/**
+ * @brief get local time when last stamped frame sent
+ * @param[out] stamp - local time, unit is us
+ * @return TRUE if stamped frame sent
+ */
+bool expand_tx_stamp(uint64_t *stamp)
+{
+    bool ret;
+    taskENTER_CRITICAL();
+    ret = tx_stamp_valid;
+    *stamp = tx_stamp;
+    tx_stamp_valid = FALSE;
+    taskEXIT_CRITICAL();
+    return ret;
+}
+
+/**
+ * @brief get local time when frame in process received, called in
+ *        expand receive task
+ * @return local time, unit is us
+ */
+uint64_t expand_rx_stamp(void)
+{
+    return rx_cur_stamp;
+}
+
+/**
+ * @brief get expand bus statistics
+ * @param[out] stats: statistics
+ */
+void expand_get_stats(expand_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = expand_stats;
+    taskEXIT_CRITICAL();
 }
 
 #ifdef __EXPAND
@@ -302,6 +839,20 @@ bool is_expand_board_registered(void)
 }
 #endif
 
+/* expand task, queue, semaphore and timer memory */
+static StaticTask_t recv_task;
+static StackType_t recv_stack[EXPAND_STACK_SIZE];
+static StaticQueue_t recv_queue;
+static uint8_t recv_queue_buf[EXPAND_RX_POOL_LEN];
+static StaticSemaphore_t tx_waiter_semaphore[EXPAND_TX_WAITER_NUM];
+#ifdef __MASTER
+static timewheel_timer_t bitrate_timer;
+#endif
+#ifdef __EXPAND
+static timewheel_timer_t register_timer;
+static timewheel_timer_t detect_timer;
+#endif
+
 /**
  * @brief expand initialize
  * @return initialize status
@@ -309,43 +860,188 @@ bool is_expand_board_registered(void)
 bool expand_init(void)
 {
     TRACE("initialize expand module...\r\n");
+    for (uint8_t i = 0; i < EXPAND_TX_WAITER_NUM; ++i)
+    {
+        tx_waiters[i].used = FALSE;
+        tx_waiters[i].xDone = xSemaphoreCreateBinaryStatic(&tx_waiter_semaphore[i]);
+    }
     can_init();
-    xExpandRecvQueue = xQueueCreate(EXPAND_QUEUE_LEN, sizeof(expand_data));
-    xExpandSendQueue = xQueueCreate(EXPAND_QUEUE_LEN, sizeof(expand_data));
-    xTaskCreate(vExpandRecv, "expand_recv", EXPAND_STACK_SIZE, NULL,
-                EXPAND_PRIORITY, NULL);
-    xTaskCreate(vExpandSend, "expand_send", EXPAND_STACK_SIZE, NULL,
-                EXPAND_PRIORITY, NULL);
-#ifdef __EXPAND
-    set_register_cb(register_status_cb);
-    TimerHandle_t expand_tmr = xTimerCreate("expand_tmr", REGISTER_INTERVAL, TRUE, NULL,
-                                            vRegisterBoard);
-    if (NULL == expand_tmr)
+    expand_tp_init();
+    expand_health_init();
+    timesync_init();
+    expand_fw_init();
+    xExpandRecvQueue = xQueueCreateStatic(EXPAND_RX_POOL_LEN, sizeof(uint8_t), recv_queue_buf,
+                                          &recv_queue);
+    xTaskCreateStatic(vExpandRecv, "expand_recv", EXPAND_STACK_SIZE, NULL,
+                      EXPAND_PRIORITY, recv_stack, &recv_task);
+    timewheel_timer_init(&switch_timer, vSwitchBitrate, NULL);
+#ifdef __MASTER
+    timewheel_timer_init(&bitrate_timer, vNotifyBitrate, NULL);
+    timewheel_start_periodic(&bitrate_timer, BITRATE_NOTIFY_INTERVAL);
+    /** known boards are restored, alive before heard and rejoin at once */
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
     {
-        TRACE("initialise expand module failed!\r\n");
-        return FALSE;
+        uint8_t id_board = boardmaps[i].id_board;
+        if ((0 != id_board) && (board_parameter.id_board != id_board))
+        {
+            expand_health_node_restored(id_board);
+        }
     }
-    xTimerStart(expand_tmr, 0);
+    notify_resume();
+#endif
+#ifdef __EXPAND
+    set_register_cb(register_status_cb);
+    timewheel_timer_init(&register_timer, vRegisterBoard, NULL);
+    timewheel_timer_init(&detect_timer, vDetectBitrate, NULL);
+    timewheel_start_periodic(&register_timer, REGISTER_INTERVAL);
+    timewheel_start_periodic(&detect_timer, DETECT_INTERVAL);
 #endif
     return TRUE;
 }
 
 /**
- * @brief can rx interrupt
+ * @brief read all pending frames in fifo to receive pool
+ * @param fifo - fifo number
+ * @param pxHigherPriorityTaskWoken - task woken flag
+ */
+static void can_rx_drain(uint8_t fifo, portBASE_TYPE *pxHigherPriorityTaskWoken)
+{
+    uint8_t index;
+
+    if (CAN_IsFlagSet(CAN1, (CAN_FIFO0 == fifo) ? CAN_FLAG_FOV0 : CAN_FLAG_FOV1))
+    {
+        expand_stats.rx_overrun[fifo] ++;
+        CAN_ClearFlag(CAN1, (CAN_FIFO0 == fifo) ? CAN_FLAG_FOV0 : CAN_FLAG_FOV1);
+    }
+
+    while (CAN_MessagePending(CAN1, fifo) > 0)
+    {
+        if ((uint8_t)(rx_head - rx_tail) >= EXPAND_RX_POOL_LEN)
+        {
+            /** pool full, release fifo anyway */
+            CAN_FIFORelease(CAN1, fifo);
+            expand_stats.rx_drop ++;
+            continue;
+        }
+
+        index = rx_head & (EXPAND_RX_POOL_LEN - 1);
+        rx_stamps[index] = timesync_local_us();
+        CAN_Receive(CAN1, fifo, &rx_pool[index]);
+        rx_head ++;
+        expand_stats.rx_ok ++;
+        xQueueSendFromISR(xExpandRecvQueue, &index, pxHigherPriorityTaskWoken);
+    }
+}
+
+/**
+ * @brief can rx0 interrupt
  */
 void USB_LP_CAN_RX0_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-
-    CAN_RxMsg rx_msg;
-    expand_data data;
+    uint32_t start = stats_isr_begin();
 
     /* receive data */
-    CAN_Receive(CAN1, CAN_FIFO0, &rx_msg);
-    data.len = rx_msg.dlc;
-    memcpy(data.data, rx_msg.data, rx_msg.dlc);
-    xQueueSendFromISR(xExpandRecvQueue, &data, &xHigherPriorityTaskWoken);
+    can_rx_drain(CAN_FIFO0, &xHigherPriorityTaskWoken);
+
+    stats_isr_end(STATS_ISR_CAN_RX0, start);
 
     /* check if there is any higher priority task need to wakeup */
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
+
+/**
+ * @brief can rx1 interrupt
+ */
+void CAN_RX1_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t start = stats_isr_begin();
+
+    /* high priority fifo first, then normal fifo */
+    can_rx_drain(CAN_FIFO1, &xHigherPriorityTaskWoken);
+    can_rx_drain(CAN_FIFO0, &xHigherPriorityTaskWoken);
+
+    stats_isr_end(STATS_ISR_CAN_RX1, start);
+
+    /* check if there is any higher priority task need to wakeup */
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * @brief can tx interrupt
+ */
+void USB_HP_CAN_TX_IRQHandler(void)
+{
+    static const uint32_t rqcp_flags[CAN_TX_MAILBOX_NUM] =
+    {CAN_FLAG_RQCP0, CAN_FLAG_RQCP1, CAN_FLAG_RQCP2};
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    bool ok = FALSE;
+    uint32_t start = stats_isr_begin();
+
+    for (uint8_t i = 0; i < CAN_TX_MAILBOX_NUM; ++i)
+    {
+        if (CAN_IsFlagSet(CAN1, rqcp_flags[i]))
+        {
+            ok = (CAN_TxStatus_Ok == CAN_TransmitStatus(CAN1, i));
+            CAN_ClearFlag(CAN1, rqcp_flags[i]);
+            if (ok && tx_mailbox_stamp[i])
+            {
+                tx_stamp = timesync_local_us();
+                tx_stamp_valid = TRUE;
+            }
+            tx_mailbox_stamp[i] = FALSE;
+            if (ok)
+            {
+                expand_stats.tx_ok ++;
+            }
+            else
+            {
+                expand_stats.tx_fail ++;
+            }
+#ifdef __MASTER
+            expand_health_node_tx(tx_mailbox_dst[i], ok);
+#endif
+
+            /** report completion */
+            if (NULL != tx_mailbox_waiter[i])
+            {
+                tx_mailbox_waiter[i]->status = ok ? EXPAND_TX_OK : EXPAND_TX_FAIL;
+                xSemaphoreGiveFromISR(tx_mailbox_waiter[i]->xDone, &xHigherPriorityTaskWoken);
+                tx_mailbox_waiter[i] = NULL;
+            }
+        }
+    }
+
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    can_tx_fill();
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    stats_isr_end(STATS_ISR_CAN_TX, start);
+
+    /* check if there is any higher priority task need to wakeup */
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+#ifdef __EXPAND
+/**
+ * @brief can error interrupt, count bus errors when detecting bitrate
+ */
+void CAN_SCE_IRQHandler(void)
+{
+    uint32_t start = stats_isr_begin();
+
+    uint8_t code = CAN_GetLastErrorCode(CAN1);
+    if (CAN_ErrorCode_FormErr == code)
+    {
+        detect_form_err ++;
+    }
+    else if (CAN_ErrorCode_NoErr != code)
+    {
+        detect_other_err ++;
+    }
+    CAN_ClearITPendingBit(CAN1, CAN_IT_LEC);
+
+    stats_isr_end(STATS_ISR_CAN_SCE, start);
+}
+#endif
@@ -9,12 +9,61 @@
 #define _EXPAND_H_
 
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
+/** frame priority, encoded in can id, lower value wins bus arbitration */
+typedef enum
+{
+    EXPAND_PRIO_HIGH,
+    EXPAND_PRIO_NORMAL,
+    EXPAND_PRIO_LOW,
+} expand_prio_t;
+
+/** expand bus bitrate, stored in parameter */
+typedef enum
+{
+    CAN_BITRATE_20K,
+    CAN_BITRATE_100K,
+    CAN_BITRATE_125K,
+    CAN_BITRATE_250K,
+    CAN_BITRATE_500K,
+    CAN_BITRATE_1M,
+    CAN_BITRATE_COUNT,
+} can_bitrate_t;
+
+#if USE_SPEED_100K
+#define CAN_BITRATE_DEFAULT       CAN_BITRATE_100K
+#else
+#define CAN_BITRATE_DEFAULT       CAN_BITRATE_20K
+#endif
+
+typedef struct
+{
+    uint32_t tx_ok;
+    uint32_t tx_fail;
+    uint32_t tx_drop;
+    uint32_t rx_ok;
+    /** frames lost in hardware fifo */
+    uint32_t rx_overrun[2];
+    /** frames dropped because receive pool full */
+    uint32_t rx_drop;
+} expand_stats_t;
+
 bool expand_init(void);
-void expand_send_data(const uint8_t *buf, uint8_t len);
-void expand_send_data_immediately(const uint8_t *buf, uint8_t len);
+bool expand_send_data(expand_prio_t prio, uint8_t id_dst, const uint8_t *buf, uint8_t len);
+bool expand_send_data_immediately(uint8_t id_dst, const uint8_t *buf, uint8_t len);
+bool expand_send_data_stamped(uint8_t id_dst, const uint8_t *buf, uint8_t len);
+bool expand_tx_stamp(uint64_t *stamp);
+uint64_t expand_rx_stamp(void);
+void expand_get_stats(expand_stats_t *stats);
+can_bitrate_t expand_bitrate(void);
+bool expand_change_bitrate(uint8_t bitrate);
+#ifdef __EXPAND
+void expand_bitrate_notified(uint8_t bitrate, uint8_t delay);
+void expand_resume_notified(void);
+#endif
 
 #ifdef __EXPAND
 bool is_expand_board_registered(void);
@@ -0,0 +1,905 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "queue.h"
+#include "expand_fw.h"
+#include "protocol_expand.h"
+#include "expand_health.h"
+#include "elevator.h"
+#include "boardmap.h"
+#include "parameter.h"
+#include "stm32f10x_cfg.h"
+#include "crc.h"
+#include "global.h"
+#include "trace.h"
+#include "trace_level.h"
+#include "config.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[EXPAND_FW]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_EXPAND_FW
+
+/**
+ * firmware distribution:
+ * 1. master receives expand firmware from parameter protocol, and stores it
+ *    in download bank, erased page by page as data arrives
+ * 2. master broadcasts begin, expand boards reset receive state
+ * 3. master broadcasts blocks, every block is crc checked, expand boards
+ *    write blocks in firmware task and erase a page when its first block
+ *    arrives
+ * 4. master queries boards one by one, boards reply missing block bitmap,
+ *    blocks missed by any board are broadcasted in next round
+ * 5. boards verify image crc when all blocks received, master broadcasts
+ *    commit when all boards verified
+ * 6. boards mark swap pending, copy download bank to running firmware in
+ *    ram, then reset
+ * 7. master queries boards again, update is done when every board replies
+ *    running image crc, commit is sent again to boards still verified
+ *
+ * flash layout, running firmware is limited by ROM region in AutoElevator.icf,
+ * so image overlapping download bank fails at link time:
+ * 0x08000000 - 0x0801ffff: running firmware
+ * 0x08020000 - 0x0803f7ff: download bank
+ * 0x0803f800 - 0x0803ffff: image record
+ *
+ * flash is single bank, instruction fetch stalls while a page is erased, so
+ * all tasks and interrupts stop for about 20-40ms per page, update is only
+ * started when elevator is idle
+ */
+#define FW_APP_ADDR           0x08000000
+#define FW_APP_SIZE           0x20000
+#define FW_BANK_ADDR          0x08020000
+#define FW_RECORD_ADDR        0x0803f800
+#define FW_MAX_SIZE           (FW_RECORD_ADDR - FW_BANK_ADDR)
+#define FW_MAX_BLOCK_NUM      (FW_MAX_SIZE / EXPAND_FW_BLOCK_SIZE)
+#define FW_BITMAP_LEN         ((FW_MAX_BLOCK_NUM + 7) / 8)
+#define FW_PAGE_NUM           (FW_MAX_SIZE / FLASH_PAGE_SIZE)
+#define FW_PAGE_BITMAP_LEN    ((FW_PAGE_NUM + 7) / 8)
+
+/** block never spans pages, so it is written after one page erase */
+typedef char fw_block_check_t[(0 == FLASH_PAGE_SIZE % EXPAND_FW_BLOCK_SIZE) ? 1 : -1];
+
+/** must match __ICFEDIT_region_ROM_end__ + 1 in AutoElevator.icf */
+typedef char fw_bank_check_t[(FW_BANK_ADDR == FW_APP_ADDR + FW_APP_SIZE) ? 1 : -1];
+
+/** image record state */
+#define FW_RECORD_STORED      0x5354
+#define FW_RECORD_PENDING     0x5057
+
+#ifdef __MASTER
+/** distribution rounds, blocks missed by any board are sent again */
+#define FW_MAX_ROUND          8
+/** expand boards reset receive state in this time */
+#define FW_BEGIN_TIME         (200 / portTICK_PERIOD_MS)
+/** expand boards write one block in this time */
+#define FW_BLOCK_GAP          (10 / portTICK_PERIOD_MS)
+#define FW_QUERY_TIMEOUT      (500 / portTICK_PERIOD_MS)
+#define FW_QUERY_RETRY        3
+/** commit is broadcasted repeatedly, boards already swapped ignore it */
+#define FW_COMMIT_REPEAT      3
+#define FW_COMMIT_GAP         (100 / portTICK_PERIOD_MS)
+/** expand boards copy image and restart in this time */
+#define FW_SWAP_TIME          (5000 / portTICK_PERIOD_MS)
+#define FW_COMMIT_ROUND       3
+#endif
+
+#ifdef __EXPAND
+/** firmware job type, jobs are done in firmware task in received order */
+#define FW_JOB_BEGIN          0
+#define FW_JOB_BLOCK          1
+#define FW_JOB_QUERY          2
+#define FW_JOB_COMMIT         3
+/** blocks received while a page is erased wait here, dropped ones are sent again */
+#define FW_JOB_QUEUE_SIZE     6
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t len;
+    uint16_t block;
+    uint32_t size;
+    uint16_t crc;
+    uint8_t data[EXPAND_FW_BLOCK_SIZE];
+} fw_job_t;
+#endif
+
+#pragma pack(1)
+typedef struct
+{
+    uint8_t flag[4];
+    uint32_t size;
+    uint16_t crc;
+    uint16_t state;
+} fw_record_t;
+#pragma pack()
+
+static const uint8_t record_flag[4] = {'F', 'W', 'R', '0'};
+
+extern parameters_t board_parameter;
+
+static uint8_t fw_state = EXPAND_FW_IDLE;
+static uint32_t fw_size = 0;
+static uint16_t fw_crc = 0;
+
+#ifdef __MASTER
+/** firmware task event, task notification is left to expand_tp flow control */
+static xSemaphoreHandle xFwSemaphore = NULL;
+static uint32_t fw_received = 0;
+/** download bank size erased */
+static uint32_t fw_erased = 0;
+static uint8_t fw_round = 0;
+static expand_fw_target_t targets[MAX_BOARD_NUM];
+static uint8_t target_num = 0;
+/** blocks to send in next round */
+static uint8_t pending[FW_BITMAP_LEN];
+/** board being queried */
+static uint8_t query_id = ID_BOARD_INVALID;
+static xSemaphoreHandle xReplySemaphore = NULL;
+#endif
+
+#ifdef __EXPAND
+static xQueueHandle xFwQueue = NULL;
+static uint8_t missing[FW_BITMAP_LEN];
+static uint16_t missing_cnt = 0;
+/** download bank pages erased in this receive */
+static uint8_t erased[FW_PAGE_BITMAP_LEN];
+#endif
+
+/**
+ * @brief get block number of image
+ * @param size - image size
+ * @return block number
+ */
+static uint16_t fw_block_num(uint32_t size)
+{
+    return (uint16_t)((size + EXPAND_FW_BLOCK_SIZE - 1) / EXPAND_FW_BLOCK_SIZE);
+}
+
+/**
+ * @brief set first num bits of bitmap
+ * @param bitmap - bitmap to set
+ * @param num - bit number
+ */
+static void fw_bitmap_fill(uint8_t *bitmap, uint16_t num)
+{
+    memset(bitmap, 0, FW_BITMAP_LEN);
+    memset(bitmap, 0xff, num / 8);
+    if (0 != (num % 8))
+    {
+        bitmap[num / 8] = (uint8_t)((1 << (num % 8)) - 1);
+    }
+}
+
+/**
+ * @brief check if bit set in bitmap
+ * @param bitmap - bitmap to check
+ * @param bit - bit to check
+ * @return TRUE if set
+ */
+static __INLINE bool fw_bitmap_test(const uint8_t *bitmap, uint16_t bit)
+{
+    return (0 != (bitmap[bit / 8] & (1 << (bit % 8))));
+}
+
+/**
+ * @brief calculate crc of image in flash
+ * @param addr - image address
+ * @param size - image size
+ * @return image crc
+ */
+static uint16_t fw_image_crc(uint32_t addr, uint32_t size)
+{
+    return crc16_update(0xffff, (const uint8_t *)addr, size);
+}
+
+/**
+ * @brief read image record
+ * @param[out] record - image record
+ * @return TRUE if record valid
+ */
+static bool fw_record_read(fw_record_t *record)
+{
+    FLASH_Read(FW_RECORD_ADDR, (uint8_t *)record, sizeof(fw_record_t));
+    return ((0 == memcmp(record->flag, record_flag, 4)) &&
+            (0 != record->size) && (record->size <= FW_MAX_SIZE));
+}
+
+/**
+ * @brief write image record of current image
+ * @param state - record state
+ */
+static void fw_record_write(uint16_t state)
+{
+    fw_record_t record;
+    memcpy(record.flag, record_flag, 4);
+    record.size = fw_size;
+    record.crc = fw_crc;
+    record.state = state;
+    FLASH_ErasePage(FW_RECORD_ADDR);
+    FLASH_Write(FW_RECORD_ADDR, (uint8_t *)&record, sizeof(record));
+}
+
+#ifdef __MASTER
+/**
+ * @brief check if elevator is idle, flash erase stalls all tasks
+ * @return TRUE if idle
+ */
+static __INLINE bool fw_elev_idle(void)
+{
+    return ((work_idle == elev_state_work()) && (run_stop == elev_state_run()));
+}
+
+/**
+ * @brief start receiving firmware image, download bank is erased while
+ *        data is written
+ * @param size - image size
+ * @param crc - image crc
+ * @return TRUE if image accepted
+ */
+bool expand_fw_begin(uint32_t size, uint16_t crc)
+{
+    if ((0 == size) || (size > FW_MAX_SIZE) || (EXPAND_FW_DISTRIBUTING == fw_state))
+    {
+        return FALSE;
+    }
+
+    if (!fw_elev_idle())
+    {
+        TRACE("elevator busy, firmware refused\r\n");
+        return FALSE;
+    }
+
+    TRACE("receive firmware: %d-0x%04x\r\n", size, crc);
+    FLASH_ErasePage(FW_RECORD_ADDR);
+    fw_size = size;
+    fw_crc = crc;
+    fw_received = 0;
+    fw_erased = 0;
+    fw_state = EXPAND_FW_RECEIVING;
+    return TRUE;
+}
+
+/**
+ * @brief write firmware data, data must be written in order
+ * @param offset - data offset in image
+ * @param data - firmware data
+ * @param len - data length, must be even except the last one
+ * @return TRUE if data written
+ */
+bool expand_fw_write(uint32_t offset, const uint8_t *data, uint8_t len)
+{
+    if ((EXPAND_FW_RECEIVING != fw_state) || (offset != fw_received) ||
+        (0 == len) || (offset + len > fw_size) ||
+        ((0 != (len % 2)) && (offset + len != fw_size)))
+    {
+        return FALSE;
+    }
+
+    /** data is written in order, erase pages it reaches */
+    while (fw_erased < offset + len)
+    {
+        FLASH_ErasePage(FW_BANK_ADDR + fw_erased);
+        fw_erased += FLASH_PAGE_SIZE;
+    }
+
+    FLASH_Write(FW_BANK_ADDR + offset, (uint8_t *)data, len);
+    if (0 != memcmp((const void *)(FW_BANK_ADDR + offset), data, len))
+    {
+        TRACE("write firmware failed: %d\r\n", offset);
+        return FALSE;
+    }
+
+    fw_received += len;
+    return TRUE;
+}
+
+/**
+ * @brief finish receiving firmware image and distribute it, stored image
+ *        is distributed again if called when no image receiving
+ * @return TRUE if distribution started
+ */
+bool expand_fw_end(void)
+{
+    if (EXPAND_FW_RECEIVING == fw_state)
+    {
+        if ((fw_received != fw_size) ||
+            (fw_image_crc(FW_BANK_ADDR, fw_size) != fw_crc))
+        {
+            TRACE("firmware crc error\r\n");
+            fw_state = EXPAND_FW_IDLE;
+            return FALSE;
+        }
+        fw_record_write(FW_RECORD_STORED);
+        fw_state = EXPAND_FW_VERIFIED;
+    }
+
+    if ((EXPAND_FW_IDLE == fw_state) || (EXPAND_FW_DISTRIBUTING == fw_state))
+    {
+        return FALSE;
+    }
+
+    /** expand boards erase pages while receiving, verified image can be
+        distributed later */
+    if (!fw_elev_idle())
+    {
+        TRACE("elevator busy, distribution refused\r\n");
+        return FALSE;
+    }
+
+    fw_state = EXPAND_FW_DISTRIBUTING;
+    xSemaphoreGive(xFwSemaphore);
+    return TRUE;
+}
+
+/**
+ * @brief get firmware distribution status
+ * @param[out] status - distribution status
+ */
+void expand_fw_status(expand_fw_status_t *status)
+{
+    status->state = fw_state;
+    status->round = fw_round;
+    status->size = fw_size;
+    status->received = fw_received;
+}
+
+/**
+ * @brief get expand board update progress
+ * @param[out] target_list - update progress
+ * @param max - max board number to get
+ * @return board number
+ */
+uint8_t expand_fw_targets(expand_fw_target_t *target_list, uint8_t max)
+{
+    uint8_t count = (target_num < max) ? target_num : max;
+    taskENTER_CRITICAL();
+    memcpy(target_list, targets, count * sizeof(expand_fw_target_t));
+    taskEXIT_CRITICAL();
+    return count;
+}
+
+/**
+ * @brief process board query reply, called in expand receive task
+ * @param id_board - board id
+ * @param state - board update state
+ * @param crc - crc of board image
+ * @param bitmap - missing block bitmap
+ * @param len - bitmap length
+ */
+void expand_fw_query_replied(uint8_t id_board, uint8_t state, uint16_t crc,
+                             const uint8_t *bitmap, uint16_t len)
+{
+    if ((ID_BOARD_INVALID == query_id) || (id_board != query_id))
+    {
+        return ;
+    }
+
+    expand_fw_target_t *target = NULL;
+    for (uint8_t i = 0; i < target_num; ++i)
+    {
+        if (id_board == targets[i].id_board)
+        {
+            target = &targets[i];
+            break;
+        }
+    }
+
+    if (NULL != target)
+    {
+        uint16_t cnt = 0;
+        if (len > FW_BITMAP_LEN)
+        {
+            len = FW_BITMAP_LEN;
+        }
+        for (uint8_t i = 0; i < len; ++i)
+        {
+            pending[i] |= bitmap[i];
+            for (uint8_t bits = bitmap[i]; 0 != bits; bits &= (bits - 1))
+            {
+                cnt ++;
+            }
+        }
+        target->state = state;
+        target->crc = crc;
+        target->missing = cnt;
+    }
+
+    query_id = ID_BOARD_INVALID;
+    xSemaphoreGive(xReplySemaphore);
+}
+
+/**
+ * @brief collect alive expand boards to update
+ */
+static void fw_collect_targets(void)
+{
+    target_num = 0;
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        uint8_t id_board = boardmaps[i].id_board;
+        if ((0 != id_board) && (board_parameter.id_board != id_board) &&
+            expand_health_is_alive(id_board))
+        {
+            targets[target_num].id_board = id_board;
+            targets[target_num].state = EXPAND_FW_IDLE;
+            targets[target_num].crc = 0;
+            targets[target_num].missing = fw_block_num(fw_size);
+            target_num ++;
+        }
+    }
+}
+
+/**
+ * @brief broadcast pending blocks
+ */
+static void fw_send_pending(void)
+{
+    uint16_t block_num = fw_block_num(fw_size);
+    for (uint16_t block = 0; block < block_num; ++block)
+    {
+        if (fw_bitmap_test(pending, block))
+        {
+            uint32_t offset = (uint32_t)block * EXPAND_FW_BLOCK_SIZE;
+            uint32_t len = fw_size - offset;
+            if (len > EXPAND_FW_BLOCK_SIZE)
+            {
+                len = EXPAND_FW_BLOCK_SIZE;
+            }
+            notify_fw_block(block, (const uint8_t *)(FW_BANK_ADDR + offset), (uint8_t)len);
+            vTaskDelay(FW_BLOCK_GAP);
+        }
+    }
+}
+
+/**
+ * @brief query board update state, missing blocks are added to pending
+ * @param target - board to query
+ * @return TRUE if board replied
+ */
+static bool fw_query(expand_fw_target_t *target)
+{
+    target->state = EXPAND_FW_FAILED;
+    for (uint8_t i = 0; i < FW_QUERY_RETRY; ++i)
+    {
+        /** drop late reply of previous query */
+        xSemaphoreTake(xReplySemaphore, 0);
+        query_id = target->id_board;
+        notify_fw_query(target->id_board);
+        if (pdTRUE == xSemaphoreTake(xReplySemaphore, FW_QUERY_TIMEOUT))
+        {
+            return TRUE;
+        }
+    }
+
+    query_id = ID_BOARD_INVALID;
+    TRACE("board not replied: %d\r\n", target->id_board);
+    return FALSE;
+}
+
+/**
+ * @brief check if board runs distributed image
+ * @param target - board to check
+ * @return TRUE if board updated
+ */
+static __INLINE bool fw_target_updated(const expand_fw_target_t *target)
+{
+    return ((EXPAND_FW_DONE == target->state) && (fw_crc == target->crc));
+}
+
+/**
+ * @brief commit verified image, boards are queried after swap until every
+ *        board runs the new image
+ * @return TRUE if all boards updated
+ */
+static bool fw_commit(void)
+{
+    for (uint8_t round = 0; round < FW_COMMIT_ROUND; ++round)
+    {
+        for (uint8_t i = 0; i < FW_COMMIT_REPEAT; ++i)
+        {
+            notify_fw_commit(fw_size, fw_crc);
+            vTaskDelay(FW_COMMIT_GAP);
+        }
+        vTaskDelay(FW_SWAP_TIME);
+
+        bool done = TRUE;
+        for (uint8_t i = 0; i < target_num; ++i)
+        {
+            if (!fw_target_updated(&targets[i]))
+            {
+                fw_query(&targets[i]);
+            }
+            done = done && fw_target_updated(&targets[i]);
+        }
+
+        if (done)
+        {
+            return TRUE;
+        }
+    }
+
+    for (uint8_t i = 0; i < target_num; ++i)
+    {
+        if (!fw_target_updated(&targets[i]))
+        {
+            TRACE("board not updated: %d-%d\r\n", targets[i].id_board, targets[i].state);
+            targets[i].state = EXPAND_FW_FAILED;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief distribute firmware to all alive expand boards, boards swap only
+ *        if all boards verified the image
+ * @return TRUE if all boards updated
+ */
+static bool fw_distribute(void)
+{
+    fw_collect_targets();
+    if (0 == target_num)
+    {
+        TRACE("no board to update\r\n");
+        return FALSE;
+    }
+
+    bool begin = TRUE;
+    fw_bitmap_fill(pending, fw_block_num(fw_size));
+    for (fw_round = 1; fw_round <= FW_MAX_ROUND; ++fw_round)
+    {
+        TRACE("distribute round: %d\r\n", fw_round);
+        if (begin)
+        {
+            notify_fw_begin(fw_size, fw_crc);
+            vTaskDelay(FW_BEGIN_TIME);
+            begin = FALSE;
+        }
+        fw_send_pending();
+
+        bool done = TRUE;
+        memset(pending, 0, sizeof(pending));
+        for (uint8_t i = 0; i < target_num; ++i)
+        {
+            fw_query(&targets[i]);
+            if ((EXPAND_FW_IDLE == targets[i].state) ||
+                (EXPAND_FW_DONE == targets[i].state))
+            {
+                /** board restarted or missed begin, erase and send all again */
+                begin = TRUE;
+                fw_bitmap_fill(pending, fw_block_num(fw_size));
+            }
+            done = done && (EXPAND_FW_VERIFIED == targets[i].state);
+        }
+
+        if (done)
+        {
+            return fw_commit();
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief firmware distribution task
+ * @param pvParameters - task parameter
+ */
+static void vExpandFw(void *pvParameters)
+{
+    for (;;)
+    {
+        xSemaphoreTake(xFwSemaphore, portMAX_DELAY);
+        bool ret = fw_distribute();
+        TRACE("distribute firmware %s\r\n", ret ? "done" : "failed");
+        fw_state = ret ? EXPAND_FW_DONE : EXPAND_FW_FAILED;
+    }
+}
+#endif
+
+#ifdef __EXPAND
+/* job being queued by expand receive task */
+static fw_job_t rx_job;
+
+/**
+ * @brief queue job to firmware task, job dropped when queue is full is
+ *        recovered by master retry
+ * @param job - job to queue
+ */
+static void fw_job_post(const fw_job_t *job)
+{
+    if (!xQueueSend(xFwQueue, job, 0))
+    {
+        TRACE("firmware job dropped: %d\r\n", job->type);
+    }
+}
+
+/**
+ * @brief process firmware begin
+ * @param size - image size
+ * @param crc - image crc
+ */
+void expand_fw_begin_notified(uint32_t size, uint16_t crc)
+{
+    rx_job.type = FW_JOB_BEGIN;
+    rx_job.size = size;
+    rx_job.crc = crc;
+    fw_job_post(&rx_job);
+}
+
+/**
+ * @brief process firmware block, block crc checked by protocol
+ * @param block - block index
+ * @param data - block data
+ * @param len - block length
+ */
+void expand_fw_block_notified(uint16_t block, const uint8_t *data, uint8_t len)
+{
+    /** blocks already written are broadcasted again for other boards */
+    if ((EXPAND_FW_RECEIVING != fw_state) || (block >= fw_block_num(fw_size)) ||
+        (!fw_bitmap_test(missing, block)) || (len > EXPAND_FW_BLOCK_SIZE))
+    {
+        return ;
+    }
+
+    rx_job.type = FW_JOB_BLOCK;
+    rx_job.block = block;
+    rx_job.len = len;
+    memcpy(rx_job.data, data, len);
+    fw_job_post(&rx_job);
+}
+
+/**
+ * @brief process master query, reply in firmware task
+ */
+void expand_fw_query_notified(void)
+{
+    rx_job.type = FW_JOB_QUERY;
+    fw_job_post(&rx_job);
+}
+
+/**
+ * @brief process firmware commit
+ * @param size - image size
+ * @param crc - image crc
+ */
+void expand_fw_commit_notified(uint32_t size, uint16_t crc)
+{
+    rx_job.type = FW_JOB_COMMIT;
+    rx_job.size = size;
+    rx_job.crc = crc;
+    fw_job_post(&rx_job);
+}
+
+/**
+ * @brief receive all blocks, pages are erased again when blocks arrive
+ */
+static void fw_receive_start(void)
+{
+    memset(erased, 0, sizeof(erased));
+    missing_cnt = fw_block_num(fw_size);
+    fw_bitmap_fill(missing, missing_cnt);
+    fw_state = EXPAND_FW_RECEIVING;
+}
+
+/**
+ * @brief start receiving image, image being received is kept if same
+ * @param size - image size
+ * @param crc - image crc
+ */
+static void fw_begin(uint32_t size, uint16_t crc)
+{
+    if ((size == fw_size) && (crc == fw_crc) &&
+        ((EXPAND_FW_RECEIVING == fw_state) || (EXPAND_FW_VERIFIED == fw_state)))
+    {
+        return ;
+    }
+
+    if ((0 == size) || (size > FW_MAX_SIZE))
+    {
+        fw_state = EXPAND_FW_IDLE;
+        return ;
+    }
+
+    TRACE("receive firmware: %d-0x%04x\r\n", size, crc);
+    fw_size = size;
+    fw_crc = crc;
+    fw_receive_start();
+}
+
+/**
+ * @brief write firmware block, its page is erased by first block arrived
+ * @param block - block index
+ * @param data - block data
+ * @param len - block length
+ */
+static void fw_write_block(uint16_t block, const uint8_t *data, uint8_t len)
+{
+    if ((EXPAND_FW_RECEIVING != fw_state) || (block >= fw_block_num(fw_size)) ||
+        (!fw_bitmap_test(missing, block)))
+    {
+        return ;
+    }
+
+    uint32_t offset = (uint32_t)block * EXPAND_FW_BLOCK_SIZE;
+    uint32_t expect = fw_size - offset;
+    if (expect > EXPAND_FW_BLOCK_SIZE)
+    {
+        expect = EXPAND_FW_BLOCK_SIZE;
+    }
+    if (len != expect)
+    {
+        return ;
+    }
+
+    uint16_t page = (uint16_t)(offset / FLASH_PAGE_SIZE);
+    if (!fw_bitmap_test(erased, page))
+    {
+        FLASH_ErasePage(FW_BANK_ADDR + (uint32_t)page * FLASH_PAGE_SIZE);
+        erased[page / 8] |= (1 << (page % 8));
+    }
+
+    FLASH_Write(FW_BANK_ADDR + offset, (uint8_t *)data, len);
+    if (0 != memcmp((const void *)(FW_BANK_ADDR + offset), data, len))
+    {
+        /** written flash can not be written again */
+        TRACE("write block failed: %d\r\n", block);
+        fw_receive_start();
+        return ;
+    }
+
+    missing[block / 8] &= ~(1 << (block % 8));
+    missing_cnt --;
+    if (0 == missing_cnt)
+    {
+        if (fw_image_crc(FW_BANK_ADDR, fw_size) == fw_crc)
+        {
+            TRACE("firmware verified\r\n");
+            fw_state = EXPAND_FW_VERIFIED;
+        }
+        else
+        {
+            TRACE("firmware crc error\r\n");
+            fw_receive_start();
+        }
+    }
+}
+
+/**
+ * @brief swap firmware if image verified
+ * @param size - image size
+ * @param crc - image crc
+ */
+static void fw_commit(uint32_t size, uint16_t crc)
+{
+    if ((EXPAND_FW_VERIFIED != fw_state) || (size != fw_size) || (crc != fw_crc))
+    {
+        return ;
+    }
+
+    TRACE("swap firmware...\r\n");
+    fw_record_write(FW_RECORD_PENDING);
+    FLASH_CopyAndReset(FW_APP_ADDR, FW_BANK_ADDR, fw_size);
+}
+
+/**
+ * @brief finish firmware swap, swap again if it was interrupted
+ */
+static void fw_swap_check(void)
+{
+    fw_record_t record;
+    if ((!fw_record_read(&record)) || (FW_RECORD_PENDING != record.state))
+    {
+        return ;
+    }
+
+    if (fw_image_crc(FW_APP_ADDR, record.size) == record.crc)
+    {
+        /** master checks running image crc after commit */
+        TRACE("firmware updated: 0x%04x\r\n", record.crc);
+        fw_size = record.size;
+        fw_crc = record.crc;
+        fw_state = EXPAND_FW_DONE;
+    }
+    else if (fw_image_crc(FW_BANK_ADDR, record.size) == record.crc)
+    {
+        TRACE("firmware swap interrupted, swap again\r\n");
+        FLASH_CopyAndReset(FW_APP_ADDR, FW_BANK_ADDR, record.size);
+    }
+    FLASH_ErasePage(FW_RECORD_ADDR);
+}
+
+/**
+ * @brief firmware task, write blocks and reply master query
+ * @param pvParameters - task parameter
+ */
+static void vExpandFw(void *pvParameters)
+{
+    static fw_job_t job;
+    for (;;)
+    {
+        xQueueReceive(xFwQueue, &job, portMAX_DELAY);
+        switch (job.type)
+        {
+        case FW_JOB_BEGIN:
+            fw_begin(job.size, job.crc);
+            break;
+        case FW_JOB_BLOCK:
+            fw_write_block(job.block, job.data, job.len);
+            break;
+        case FW_JOB_QUERY:
+        {
+            uint8_t len = 0;
+            if (EXPAND_FW_RECEIVING == fw_state)
+            {
+                len = (fw_block_num(fw_size) + 7) / 8;
+            }
+            reply_fw_query(board_parameter.id_board, fw_state, fw_crc, missing, len);
+            break;
+        }
+        case FW_JOB_COMMIT:
+            fw_commit(job.size, job.crc);
+            break;
+        default:
+            break;
+        }
+    }
+}
+#endif
+
+/* firmware task, semaphore and queue memory */
+static StaticTask_t fw_task_buf;
+static StackType_t fw_stack[EXPAND_FW_STACK_SIZE];
+#ifdef __MASTER
+static StaticSemaphore_t fw_semaphore;
+static StaticSemaphore_t reply_semaphore;
+#endif
+#ifdef __EXPAND
+static StaticQueue_t fw_queue;
+static uint8_t fw_queue_buf[FW_JOB_QUEUE_SIZE * sizeof(fw_job_t)];
+#endif
+
+/**
+ * @brief initialize firmware update module
+ * @return init status
+ */
+bool expand_fw_init(void)
+{
+#ifdef __MASTER
+    fw_record_t record;
+    if (fw_record_read(&record) && (FW_RECORD_STORED == record.state) &&
+        (fw_image_crc(FW_BANK_ADDR, record.size) == record.crc))
+    {
+        /** stored image can be distributed again */
+        fw_size = record.size;
+        fw_crc = record.crc;
+        fw_received = record.size;
+        fw_state = EXPAND_FW_VERIFIED;
+    }
+#endif
+#ifdef __EXPAND
+    fw_swap_check();
+#endif
+
+#ifdef __MASTER
+    xFwSemaphore = xSemaphoreCreateBinaryStatic(&fw_semaphore);
+    xReplySemaphore = xSemaphoreCreateBinaryStatic(&reply_semaphore);
+#endif
+#ifdef __EXPAND
+    xFwQueue = xQueueCreateStatic(FW_JOB_QUEUE_SIZE, sizeof(fw_job_t), fw_queue_buf,
+                                  &fw_queue);
+#endif
+    xTaskCreateStatic(vExpandFw, "expand_fw", EXPAND_FW_STACK_SIZE, NULL,
+                      EXPAND_FW_PRIORITY, fw_stack, &fw_task_buf);
+
+    return TRUE;
+}
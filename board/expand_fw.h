@@ -0,0 +1,71 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _EXPAND_FW_H_
+#define _EXPAND_FW_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/** firmware block size in one expand message */
+#define EXPAND_FW_BLOCK_SIZE        128
+
+/** firmware update state */
+typedef enum
+{
+    EXPAND_FW_IDLE,
+    EXPAND_FW_RECEIVING,
+    EXPAND_FW_VERIFIED,
+    EXPAND_FW_DISTRIBUTING,
+    EXPAND_FW_DONE,
+    /** distribution failed, or board not replied */
+    EXPAND_FW_FAILED,
+} expand_fw_state_t;
+
+#ifdef __MASTER
+typedef struct
+{
+    uint8_t state;
+    /** distribution round */
+    uint8_t round;
+    uint32_t size;
+    uint32_t received;
+} expand_fw_status_t;
+
+/** expand board update progress */
+typedef struct
+{
+    uint8_t id_board;
+    uint8_t state;
+    /** crc of board image, running image crc if state is done */
+    uint16_t crc;
+    /** missing block number */
+    uint16_t missing;
+} expand_fw_target_t;
+#endif
+
+bool expand_fw_init(void);
+#ifdef __MASTER
+bool expand_fw_begin(uint32_t size, uint16_t crc);
+bool expand_fw_write(uint32_t offset, const uint8_t *data, uint8_t len);
+bool expand_fw_end(void);
+void expand_fw_status(expand_fw_status_t *status);
+uint8_t expand_fw_targets(expand_fw_target_t *target_list, uint8_t max);
+void expand_fw_query_replied(uint8_t id_board, uint8_t state, uint16_t crc,
+                             const uint8_t *bitmap, uint16_t len);
+#endif
+#ifdef __EXPAND
+void expand_fw_begin_notified(uint32_t size, uint16_t crc);
+void expand_fw_block_notified(uint16_t block, const uint8_t *data, uint8_t len);
+void expand_fw_query_notified(void);
+void expand_fw_commit_notified(uint32_t size, uint16_t crc);
+#endif
+
+END_DECLS
+
+#endif /* _EXPAND_FW_H_ */
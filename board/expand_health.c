@@ -0,0 +1,415 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timewheel.h"
+#include "expand_health.h"
+#include "expand.h"
+#include "protocol_expand.h"
+#include "stm32f10x_cfg.h"
+#include "parameter.h"
+#include "trace.h"
+#include "trace_level.h"
+#include "config.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[EXPAND_HEALTH]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_EXPAND_HEALTH
+
+/** controller error state sample interval */
+#define HEALTH_INTERVAL             (100 / portTICK_PERIOD_MS)
+
+#ifdef __MASTER
+/** board is dead if nothing received in this time */
+#define NODE_DEAD_TIMEOUT           (2000 / portTICK_PERIOD_MS)
+/** board restored from registry is alive in this time before heard, it
+    boots and detects bitrate when powered on with master */
+#define NODE_RESTORE_GRACE          (10000 / portTICK_PERIOD_MS)
+#endif
+
+#ifdef __EXPAND
+#define HEARTBEAT_INTERVAL          (500 / portTICK_PERIOD_MS)
+#endif
+
+static expand_health_t health;
+
+#ifdef __MASTER
+typedef struct
+{
+    expand_node_t node;
+    TickType_t tick;
+    /** dead if nothing received in this time after tick */
+    TickType_t timeout;
+} node_entry_t;
+
+static node_entry_t nodes[MAX_BOARD_NUM];
+#endif
+
+#ifdef __EXPAND
+extern parameters_t board_parameter;
+static uint16_t heartbeat_stamp = 0;
+static bool heartbeat_acked = TRUE;
+static uint8_t heartbeat_latency = EXPAND_LATENCY_INVALID;
+#endif
+
+/**
+ * @brief get current time in ms
+ * @return current time
+ */
+static uint32_t health_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief sample can controller error state, bus-off is recovered by
+ *        hardware automatically
+ */
+static void health_sample(void)
+{
+    uint8_t state = EXPAND_BUS_ACTIVE;
+    if (CAN_IsFlagSet(CAN1, CAN_FLAG_BOF))
+    {
+        state = EXPAND_BUS_OFF;
+    }
+    else if (CAN_IsFlagSet(CAN1, CAN_FLAG_EPV))
+    {
+        state = EXPAND_BUS_PASSIVE;
+    }
+    else if (CAN_IsFlagSet(CAN1, CAN_FLAG_EWG))
+    {
+        state = EXPAND_BUS_WARNING;
+    }
+
+    if (state != health.state)
+    {
+        TRACE("bus state: %d -> %d\r\n", health.state, state);
+        if (EXPAND_BUS_OFF == state)
+        {
+            health.bus_off_cnt ++;
+        }
+        else if ((EXPAND_BUS_PASSIVE == state) && (health.state < EXPAND_BUS_PASSIVE))
+        {
+            health.passive_cnt ++;
+        }
+        health.state = state;
+    }
+
+    health.tec = CAN_GetLSBTransmitErrorCounter(CAN1);
+    health.rec = CAN_GetReceiveErrorCounter(CAN1);
+    uint8_t lec = CAN_GetLastErrorCode(CAN1);
+    if (CAN_ErrorCode_NoErr != lec)
+    {
+        /** clear error code, so every sample gets new error only */
+        health.lec = lec;
+        health.error_cnt ++;
+        CAN_ClearFlag(CAN1, CAN_FLAG_LEC);
+    }
+}
+
+#ifdef __MASTER
+/**
+ * @brief find node entry
+ * @param id_board - board id
+ * @return node entry, NULL means not found
+ */
+static node_entry_t *node_find(uint8_t id_board)
+{
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        if (id_board == nodes[i].node.id_board)
+        {
+            return &nodes[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief find node entry, allocate one if not found
+ * @param id_board - board id
+ * @return node entry, NULL means table full
+ */
+static node_entry_t *node_get(uint8_t id_board)
+{
+    if ((ID_BOARD_INVALID == id_board) || (ID_BOARD_MASTER == id_board))
+    {
+        return NULL;
+    }
+
+    node_entry_t *entry = node_find(id_board);
+    if (NULL == entry)
+    {
+        entry = node_find(ID_BOARD_INVALID);
+        if (NULL != entry)
+        {
+            entry->tick = xTaskGetTickCount();
+            entry->timeout = NODE_DEAD_TIMEOUT;
+            entry->node.alive = TRUE;
+            entry->node.latency = EXPAND_LATENCY_INVALID;
+            /** id last, transmit interrupt looks up node by id */
+            entry->node.id_board = id_board;
+        }
+    }
+
+    return entry;
+}
+
+/**
+ * @brief check node liveness
+ */
+static void health_check_nodes(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        if (ID_BOARD_INVALID == nodes[i].node.id_board)
+        {
+            continue;
+        }
+
+        bool alive = (now - nodes[i].tick < nodes[i].timeout);
+        if (alive != nodes[i].node.alive)
+        {
+            TRACE("board %d %s\r\n", nodes[i].node.id_board, alive ? "alive" : "dead");
+            if (!alive)
+            {
+                nodes[i].node.lost_cnt ++;
+            }
+            nodes[i].node.alive = alive;
+        }
+    }
+}
+
+/**
+ * @brief frame received from board, called in expand receive task
+ * @param id_board - sender board id
+ */
+void expand_health_node_rx(uint8_t id_board)
+{
+    node_entry_t *entry = node_get(id_board);
+    if (NULL != entry)
+    {
+        entry->node.rx ++;
+        entry->tick = xTaskGetTickCount();
+        entry->timeout = NODE_DEAD_TIMEOUT;
+    }
+}
+
+/**
+ * @brief frame sent to board, called in transmit interrupt
+ * @param id_board - receiver board id
+ * @param ok - transmit status
+ */
+void expand_health_node_tx(uint8_t id_board, bool ok)
+{
+    if (ID_BOARD_INVALID == id_board)
+    {
+        return ;
+    }
+
+    node_entry_t *entry = node_find(id_board);
+    if (NULL != entry)
+    {
+        if (ok)
+        {
+            entry->node.tx_ok ++;
+        }
+        else
+        {
+            entry->node.tx_fail ++;
+        }
+    }
+}
+
+/**
+ * @brief process board heartbeat
+ * @param id_board - board id
+ * @param tec - board transmit error counter
+ * @param rec - board receive error counter
+ * @param latency - board heartbeat round trip time
+ */
+void expand_health_heartbeat(uint8_t id_board, uint8_t tec, uint8_t rec, uint8_t latency)
+{
+    node_entry_t *entry = node_get(id_board);
+    if (NULL != entry)
+    {
+        entry->node.tec = tec;
+        entry->node.rec = rec;
+        entry->node.latency = latency;
+        entry->tick = xTaskGetTickCount();
+        entry->timeout = NODE_DEAD_TIMEOUT;
+    }
+}
+
+/**
+ * @brief board restored from registry, it is alive until grace time passed
+ *        without anything received
+ * @param id_board - board id
+ */
+void expand_health_node_restored(uint8_t id_board)
+{
+    node_entry_t *entry = node_get(id_board);
+    if (NULL != entry)
+    {
+        entry->tick = xTaskGetTickCount();
+        entry->timeout = NODE_RESTORE_GRACE;
+    }
+}
+
+/**
+ * @brief check if board is alive
+ * @param id_board - board id
+ * @return TRUE if board heard recently
+ */
+bool expand_health_is_alive(uint8_t id_board)
+{
+    if (ID_BOARD_INVALID == id_board)
+    {
+        return FALSE;
+    }
+
+    node_entry_t *entry = node_find(id_board);
+    if (NULL == entry)
+    {
+        return FALSE;
+    }
+
+    return (xTaskGetTickCount() - entry->tick < entry->timeout);
+}
+
+/**
+ * @brief check if board is heard recently, restored board not heard yet is
+ *        not counted
+ * @param id_board - board id
+ * @return TRUE if board heard recently
+ */
+bool expand_health_is_heard(uint8_t id_board)
+{
+    node_entry_t *entry = node_find(id_board);
+    return ((NULL != entry) && (NODE_DEAD_TIMEOUT == entry->timeout) &&
+            expand_health_is_alive(id_board));
+}
+
+/**
+ * @brief get board health table
+ * @param[out] node_list - board health
+ * @param max - max board number to get
+ * @return board number
+ */
+uint8_t expand_health_nodes(expand_node_t *node_list, uint8_t max)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; (i < MAX_BOARD_NUM) && (count < max); ++i)
+    {
+        if (ID_BOARD_INVALID != nodes[i].node.id_board)
+        {
+            taskENTER_CRITICAL();
+            node_list[count] = nodes[i].node;
+            taskEXIT_CRITICAL();
+            node_list[count].alive = expand_health_is_alive(node_list[count].id_board);
+            count ++;
+        }
+    }
+
+    return count;
+}
+#endif
+
+#ifdef __EXPAND
+/**
+ * @brief send heartbeat to master
+ */
+static void health_heartbeat(void)
+{
+    if (!is_expand_board_registered())
+    {
+        return ;
+    }
+
+    if (!heartbeat_acked)
+    {
+        heartbeat_latency = EXPAND_LATENCY_INVALID;
+    }
+    heartbeat_stamp = (uint16_t)health_ms();
+    heartbeat_acked = FALSE;
+    notify_heartbeat(board_parameter.id_board, heartbeat_stamp, health.tec, health.rec,
+                     heartbeat_latency);
+}
+
+/**
+ * @brief process heartbeat acknowledge from master
+ * @param stamp - heartbeat time stamp
+ */
+void expand_health_heartbeat_ack(uint16_t stamp)
+{
+    if ((!heartbeat_acked) && (stamp == heartbeat_stamp))
+    {
+        uint16_t latency = (uint16_t)health_ms() - stamp;
+        heartbeat_latency = (latency >= EXPAND_LATENCY_INVALID) ?
+                            (EXPAND_LATENCY_INVALID - 1) : (uint8_t)latency;
+        heartbeat_acked = TRUE;
+    }
+}
+#endif
+
+/**
+ * @brief health timer
+ * @param pvParameters - timer parameter
+ */
+static void vHealthCheck(void *pvParameters)
+{
+    health_sample();
+#ifdef __MASTER
+    health_check_nodes();
+#endif
+#ifdef __EXPAND
+    static TickType_t heartbeat_tick = 0;
+    if (xTaskGetTickCount() - heartbeat_tick >= HEARTBEAT_INTERVAL)
+    {
+        heartbeat_tick = xTaskGetTickCount();
+        health_heartbeat();
+    }
+#endif
+}
+
+/**
+ * @brief get local can controller health
+ * @param[out] local - controller health
+ */
+void expand_health_get(expand_health_t *local)
+{
+    *local = health;
+}
+
+/* health check timer memory */
+static timewheel_timer_t health_timer;
+
+/**
+ * @brief initialize expand health module
+ * @return init status
+ */
+bool expand_health_init(void)
+{
+    memset(&health, 0, sizeof(health));
+#ifdef __MASTER
+    memset(nodes, 0, sizeof(nodes));
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        nodes[i].node.id_board = ID_BOARD_INVALID;
+    }
+#endif
+
+    timewheel_timer_init(&health_timer, vHealthCheck, NULL);
+    timewheel_start_periodic(&health_timer, HEALTH_INTERVAL);
+
+    return TRUE;
+}
@@ -0,0 +1,74 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _EXPAND_HEALTH_H_
+#define _EXPAND_HEALTH_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+/** can controller error state */
+typedef enum
+{
+    EXPAND_BUS_ACTIVE,
+    EXPAND_BUS_WARNING,
+    EXPAND_BUS_PASSIVE,
+    EXPAND_BUS_OFF,
+} expand_bus_state_t;
+
+/** local can controller health */
+typedef struct
+{
+    uint8_t state;
+    uint8_t tec;
+    uint8_t rec;
+    /** last error code */
+    uint8_t lec;
+    uint16_t error_cnt;
+    uint16_t passive_cnt;
+    uint16_t bus_off_cnt;
+} expand_health_t;
+
+/** latency value when heartbeat not acknowledged */
+#define EXPAND_LATENCY_INVALID      0xff
+
+#ifdef __MASTER
+/** expand board health seen by master */
+typedef struct
+{
+    uint8_t id_board;
+    bool alive;
+    uint8_t tec;
+    uint8_t rec;
+    /** heartbeat round trip time, unit is ms */
+    uint8_t latency;
+    uint16_t lost_cnt;
+    uint32_t rx;
+    uint32_t tx_ok;
+    uint32_t tx_fail;
+} expand_node_t;
+#endif
+
+bool expand_health_init(void);
+void expand_health_get(expand_health_t *health);
+#ifdef __MASTER
+void expand_health_node_rx(uint8_t id_board);
+void expand_health_node_tx(uint8_t id_board, bool ok);
+void expand_health_heartbeat(uint8_t id_board, uint8_t tec, uint8_t rec, uint8_t latency);
+void expand_health_node_restored(uint8_t id_board);
+bool expand_health_is_alive(uint8_t id_board);
+bool expand_health_is_heard(uint8_t id_board);
+uint8_t expand_health_nodes(expand_node_t *node_list, uint8_t max);
+#endif
+#ifdef __EXPAND
+void expand_health_heartbeat_ack(uint16_t stamp);
+#endif
+
+END_DECLS
+
+#endif /* _EXPAND_HEALTH_H_ */
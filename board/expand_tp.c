@@ -0,0 +1,535 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "expand_tp.h"
+#include "protocol_expand.h"
+#include "parameter.h"
+#include "trace.h"
+#include "trace_level.h"
+#include "config.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[EXPAND_TP]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_EXPAND_TP
+
+/**
+ * segmented transport, iso-tp like:
+ * single frame:      0x0N + N bytes data(N <= 7)
+ * first frame:       0x1L + L + destination board id + 5 bytes data, 12-bit length
+ * consecutive frame: 0x2S + 7 bytes data, S is sequence number start from 1
+ * flow control:      0x3F + block size + separation time(ms) + destination board id
+ * segmented broadcast is not flow controlled, sender paces frames and
+ * receivers drop message with lost segment
+ */
+#define PCI_SINGLE          0x00
+#define PCI_FIRST           0x10
+#define PCI_CONSECUTIVE     0x20
+#define PCI_FLOW_CONTROL    0x30
+#define PCI_TYPE_MASK       0xf0
+#define PCI_VALUE_MASK      0x0f
+
+/** flow status */
+#define FS_CONTINUE         0x00
+#define FS_WAIT             0x01
+#define FS_OVERFLOW         0x02
+
+#define CAN_FRAME_LEN       8
+#define SF_DATA_LEN         7
+#define FF_DATA_LEN         5
+#define CF_DATA_LEN         7
+
+/** receiver block size and separation time(ms), 0 means no limit */
+#define TP_BLOCK_SIZE       8
+#define TP_STMIN            0
+
+#define TP_TIMEOUT          (1000 / portTICK_PERIOD_MS)
+#define TP_MAX_WAIT         8
+#define TP_SEND_RETRY       20
+#define TP_SESSION_FREE     0
+
+/** broadcast sender waits TP_BROADCAST_GAP after every TP_BLOCK_SIZE frames */
+#define TP_BROADCAST_GAP    (2 / portTICK_PERIOD_MS)
+
+#ifdef __MASTER
+#define TP_RX_SESSION_NUM   4
+#else
+/** expand board only receive from master */
+#define TP_RX_SESSION_NUM   1
+#endif
+
+typedef struct
+{
+    uint8_t id_src;
+    uint8_t seq;
+    uint8_t block_cnt;
+    uint16_t len;
+    uint16_t offset;
+    bool broadcast;
+    TickType_t tick;
+    uint8_t data[EXPAND_TP_MAX_LEN];
+} tp_rx_session_t;
+
+typedef struct
+{
+    uint8_t id_dst;
+    uint8_t status;
+    uint8_t block_size;
+    uint8_t stmin;
+    /** sending task, NULL means no segmented sending */
+    TaskHandle_t task;
+} tp_tx_session_t;
+
+extern parameters_t board_parameter;
+
+static tp_rx_session_t rx_sessions[TP_RX_SESSION_NUM];
+static tp_tx_session_t tx_session;
+static xSemaphoreHandle xTxMutex = NULL;
+static StaticSemaphore_t tx_mutex;
+static TaskHandle_t recv_task = NULL;
+
+/**
+ * @brief initialize expand transport layer
+ * @return init status
+ */
+bool expand_tp_init(void)
+{
+    memset(rx_sessions, 0, sizeof(rx_sessions));
+    memset(&tx_session, 0, sizeof(tx_session));
+    xTxMutex = xSemaphoreCreateMutexStatic(&tx_mutex);
+    return (NULL != xTxMutex);
+}
+
+/**
+ * @brief copy message data, message is composed of head and data
+ * @param head - message head
+ * @param head_len - message head length
+ * @param data - message data
+ * @param offset - message offset to copy from
+ * @param dst - copy destination
+ * @param len - copy length
+ */
+static void tp_copy(const uint8_t *head, uint8_t head_len, const uint8_t *data,
+                    uint16_t offset, uint8_t *dst, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; ++i, ++offset)
+    {
+        dst[i] = (offset < head_len) ? head[offset] : data[offset - head_len];
+    }
+}
+
+/**
+ * @brief send one frame, wait if transmit queue is full
+ * @param prio - frame priority
+ * @param id_dst - destination board id
+ * @param frame - frame to send
+ * @param len - frame length
+ * @return send status
+ */
+static bool tp_send_frame(expand_prio_t prio, uint8_t id_dst, const uint8_t *frame,
+                          uint8_t len)
+{
+    for (uint8_t i = 0; i < TP_SEND_RETRY; ++i)
+    {
+        if (expand_send_data(prio, id_dst, frame, len))
+        {
+            return TRUE;
+        }
+        /** wait mailbox drain */
+        vTaskDelay(1);
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief send flow control frame
+ * @param id_dst - segmented message sender
+ * @param status - flow status
+ */
+static void tp_send_flow_control(uint8_t id_dst, uint8_t status)
+{
+    uint8_t frame[4];
+    frame[0] = PCI_FLOW_CONTROL | status;
+    frame[1] = TP_BLOCK_SIZE;
+    frame[2] = TP_STMIN;
+    frame[3] = id_dst;
+    tp_send_frame(EXPAND_PRIO_HIGH, id_dst, frame, 4);
+}
+
+/**
+ * @brief send segmented message
+ * @return send status
+ */
+static bool tp_send_segmented(expand_prio_t prio, uint8_t id_dst, const uint8_t *head,
+                              uint8_t head_len, const uint8_t *data, uint16_t total)
+{
+    uint8_t frame[CAN_FRAME_LEN];
+    uint16_t offset = 0;
+    uint8_t seq = 1;
+    uint8_t wait_cnt = 0;
+    uint8_t block_remain = 0;
+    bool broadcast = (ID_BOARD_BROADCAST == id_dst);
+    bool wait_fc = !broadcast;
+    bool ret = FALSE;
+    uint8_t len;
+
+    if (!broadcast)
+    {
+        tx_session.id_dst = id_dst;
+        tx_session.task = xTaskGetCurrentTaskHandle();
+        xTaskNotifyStateClear(NULL);
+    }
+
+    frame[0] = PCI_FIRST | ((total >> 8) & PCI_VALUE_MASK);
+    frame[1] = (uint8_t)(total & 0xff);
+    frame[2] = id_dst;
+    tp_copy(head, head_len, data, 0, frame + 3, FF_DATA_LEN);
+    offset = FF_DATA_LEN;
+    if (!tp_send_frame(prio, id_dst, frame, CAN_FRAME_LEN))
+    {
+        goto END;
+    }
+
+    while (offset < total)
+    {
+        if (wait_fc)
+        {
+            if (0 == ulTaskNotifyTake(pdTRUE, TP_TIMEOUT))
+            {
+                TRACE("flow control timeout: %d\r\n", id_dst);
+                goto END;
+            }
+
+            if (FS_WAIT == tx_session.status)
+            {
+                wait_cnt ++;
+                if (wait_cnt > TP_MAX_WAIT)
+                {
+                    goto END;
+                }
+                continue;
+            }
+            else if (FS_CONTINUE != tx_session.status)
+            {
+                TRACE("receiver overflow: %d\r\n", id_dst);
+                goto END;
+            }
+            wait_cnt = 0;
+            wait_fc = FALSE;
+            block_remain = tx_session.block_size;
+        }
+
+        len = (total - offset > CF_DATA_LEN) ? CF_DATA_LEN : (uint8_t)(total - offset);
+        frame[0] = PCI_CONSECUTIVE | (seq & PCI_VALUE_MASK);
+        tp_copy(head, head_len, data, offset, frame + 1, len);
+        if (!tp_send_frame(prio, id_dst, frame, len + 1))
+        {
+            goto END;
+        }
+        offset += len;
+        seq ++;
+
+        if (broadcast)
+        {
+            /** give receivers time to drain receive pool */
+            if (0 == (seq % TP_BLOCK_SIZE))
+            {
+                vTaskDelay((TP_BROADCAST_GAP > 0) ? TP_BROADCAST_GAP : 1);
+            }
+            continue;
+        }
+
+        if (0 != block_remain)
+        {
+            block_remain --;
+            wait_fc = (0 == block_remain);
+        }
+
+        if (0 != tx_session.stmin)
+        {
+            TickType_t delay = tx_session.stmin / portTICK_PERIOD_MS;
+            vTaskDelay((delay > 0) ? delay : 1);
+        }
+    }
+    ret = TRUE;
+
+END:
+    tx_session.task = NULL;
+    return ret;
+}
+
+/**
+ * @brief send expand message, message is composed of head and data
+ * @param prio - message priority
+ * @param id_dst - destination board id
+ * @param head - message head
+ * @param head_len - message head length
+ * @param data - message data
+ * @param len - message data length
+ * @return send status
+ * @note segmented message can not be sent in receive task
+ */
+bool expand_tp_send(expand_prio_t prio, uint8_t id_dst, const uint8_t *head,
+                    uint8_t head_len, const uint8_t *data, uint16_t len)
+{
+    uint16_t total = head_len + len;
+    if (total <= SF_DATA_LEN)
+    {
+        uint8_t frame[CAN_FRAME_LEN];
+        frame[0] = PCI_SINGLE | total;
+        tp_copy(head, head_len, data, 0, frame + 1, total);
+        return expand_send_data(prio, id_dst, frame, total + 1);
+    }
+
+    if ((total > EXPAND_TP_MAX_LEN) ||
+        (xTaskGetCurrentTaskHandle() == recv_task))
+    {
+        TRACE("can not send segmented message: %d\r\n", total);
+        return FALSE;
+    }
+
+    /** one segmented message at a time, flow control carries no session */
+    xSemaphoreTake(xTxMutex, portMAX_DELAY);
+    bool ret = tp_send_segmented(prio, id_dst, head, head_len, data, total);
+    xSemaphoreGive(xTxMutex);
+
+    return ret;
+}
+
+/**
+ * @brief send single frame message immediately
+ * @param id_dst - destination board id
+ * @param data - message data
+ * @param len - message length
+ * @return send status
+ */
+bool expand_tp_send_immediately(uint8_t id_dst, const uint8_t *data, uint8_t len)
+{
+    uint8_t frame[CAN_FRAME_LEN];
+    if (len > SF_DATA_LEN)
+    {
+        return FALSE;
+    }
+
+    frame[0] = PCI_SINGLE | len;
+    memcpy(frame + 1, data, len);
+    return expand_send_data_immediately(id_dst, frame, len + 1);
+}
+
+/**
+ * @brief send single frame message, local time is got when message sent
+ * @param id_dst - destination board id
+ * @param data - message data
+ * @param len - message length
+ * @return send status
+ */
+bool expand_tp_send_stamped(uint8_t id_dst, const uint8_t *data, uint8_t len)
+{
+    uint8_t frame[CAN_FRAME_LEN];
+    if (len > SF_DATA_LEN)
+    {
+        return FALSE;
+    }
+
+    frame[0] = PCI_SINGLE | len;
+    memcpy(frame + 1, data, len);
+    return expand_send_data_stamped(id_dst, frame, len + 1);
+}
+
+/**
+ * @brief get receive session
+ * @param id_src - sender board id
+ * @param alloc - allocate new session if not found
+ * @return receive session, NULL means no session available
+ */
+static tp_rx_session_t *tp_rx_session_get(uint8_t id_src, bool alloc)
+{
+    for (uint8_t i = 0; i < TP_RX_SESSION_NUM; ++i)
+    {
+        if (id_src == rx_sessions[i].id_src)
+        {
+            return &rx_sessions[i];
+        }
+    }
+
+    if (alloc)
+    {
+        TickType_t now = xTaskGetTickCount();
+        for (uint8_t i = 0; i < TP_RX_SESSION_NUM; ++i)
+        {
+            if ((TP_SESSION_FREE == rx_sessions[i].id_src) ||
+                (now - rx_sessions[i].tick > TP_TIMEOUT))
+            {
+                return &rx_sessions[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief process first frame
+ * @param id_src - sender board id
+ * @param data - frame data
+ * @param len - frame length
+ */
+static void tp_process_first(uint8_t id_src, const uint8_t *data, uint8_t len)
+{
+    if (CAN_FRAME_LEN != len)
+    {
+        return ;
+    }
+
+    bool broadcast = (ID_BOARD_BROADCAST == data[2]);
+    if ((!broadcast) && (board_parameter.id_board != data[2]))
+    {
+        return ;
+    }
+
+    uint16_t total = ((uint16_t)(data[0] & PCI_VALUE_MASK) << 8) | data[1];
+    tp_rx_session_t *session = tp_rx_session_get(id_src, TRUE);
+    if ((NULL == session) || (total > EXPAND_TP_MAX_LEN) || (total <= SF_DATA_LEN))
+    {
+        if (!broadcast)
+        {
+            tp_send_flow_control(id_src, FS_OVERFLOW);
+        }
+        return ;
+    }
+
+    session->id_src = id_src;
+    session->broadcast = broadcast;
+    session->len = total;
+    session->offset = FF_DATA_LEN;
+    session->seq = 1;
+    session->block_cnt = 0;
+    session->tick = xTaskGetTickCount();
+    memcpy(session->data, data + 3, FF_DATA_LEN);
+
+    if (!broadcast)
+    {
+        tp_send_flow_control(id_src, FS_CONTINUE);
+    }
+}
+
+/**
+ * @brief process consecutive frame
+ * @param id_src - sender board id
+ * @param data - frame data
+ * @param len - frame length
+ */
+static void tp_process_consecutive(uint8_t id_src, const uint8_t *data, uint8_t len)
+{
+    tp_rx_session_t *session = tp_rx_session_get(id_src, FALSE);
+    if (NULL == session)
+    {
+        return ;
+    }
+
+    if ((xTaskGetTickCount() - session->tick > TP_TIMEOUT) ||
+        ((data[0] & PCI_VALUE_MASK) != (session->seq & PCI_VALUE_MASK)))
+    {
+        TRACE("segment lost: %d\r\n", id_src);
+        session->id_src = TP_SESSION_FREE;
+        return ;
+    }
+
+    uint16_t remain = session->len - session->offset;
+    uint8_t copy_len = len - 1;
+    if (copy_len > remain)
+    {
+        copy_len = (uint8_t)remain;
+    }
+    memcpy(session->data + session->offset, data + 1, copy_len);
+    session->offset += copy_len;
+    session->seq ++;
+    session->tick = xTaskGetTickCount();
+
+    if (session->offset >= session->len)
+    {
+        process_expand_data(session->data, session->len);
+        session->id_src = TP_SESSION_FREE;
+        return ;
+    }
+
+    session->block_cnt ++;
+    if ((!session->broadcast) && (0 != TP_BLOCK_SIZE) &&
+        (session->block_cnt >= TP_BLOCK_SIZE))
+    {
+        session->block_cnt = 0;
+        tp_send_flow_control(id_src, FS_CONTINUE);
+    }
+}
+
+/**
+ * @brief process flow control frame
+ * @param id_src - receiver board id
+ * @param data - frame data
+ * @param len - frame length
+ */
+static void tp_process_flow_control(uint8_t id_src, const uint8_t *data, uint8_t len)
+{
+    if ((len < 4) || (board_parameter.id_board != data[3]))
+    {
+        return ;
+    }
+
+    if ((NULL == tx_session.task) || (id_src != tx_session.id_dst))
+    {
+        return ;
+    }
+
+    tx_session.status = data[0] & PCI_VALUE_MASK;
+    tx_session.block_size = data[1];
+    tx_session.stmin = data[2];
+    xTaskNotifyGive(tx_session.task);
+}
+
+/**
+ * @brief process received frame, called in expand receive task
+ * @param id_src - sender board id
+ * @param data - frame data
+ * @param len - frame length
+ */
+void expand_tp_recv(uint8_t id_src, const uint8_t *data, uint8_t len)
+{
+    recv_task = xTaskGetCurrentTaskHandle();
+    if (0 == len)
+    {
+        return ;
+    }
+
+    switch (data[0] & PCI_TYPE_MASK)
+    {
+    case PCI_SINGLE:
+    {
+        uint8_t msg_len = data[0] & PCI_VALUE_MASK;
+        if ((msg_len > 0) && (msg_len < len))
+        {
+            process_expand_data(data + 1, msg_len);
+        }
+        break;
+    }
+    case PCI_FIRST:
+        tp_process_first(id_src, data, len);
+        break;
+    case PCI_CONSECUTIVE:
+        tp_process_consecutive(id_src, data, len);
+        break;
+    case PCI_FLOW_CONTROL:
+        tp_process_flow_control(id_src, data, len);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,31 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _EXPAND_TP_H_
+#define _EXPAND_TP_H_
+
+#include "types.h"
+#include "expand.h"
+
+BEGIN_DECLS
+
+/**
+ * max length of one expand message, first frame carries up to 4095,
+ * every receive session reserves a buffer of this size
+ */
+#define EXPAND_TP_MAX_LEN       1024
+
+bool expand_tp_init(void);
+void expand_tp_recv(uint8_t id_src, const uint8_t *data, uint8_t len);
+bool expand_tp_send(expand_prio_t prio, uint8_t id_dst, const uint8_t *head,
+                    uint8_t head_len, const uint8_t *data, uint16_t len);
+bool expand_tp_send_immediately(uint8_t id_dst, const uint8_t *data, uint8_t len);
+bool expand_tp_send_stamped(uint8_t id_dst, const uint8_t *data, uint8_t len);
+
+END_DECLS
+
+#endif /* _EXPAND_TP_H_ */
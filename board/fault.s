@@ -0,0 +1,39 @@
+;**
+; This file is part of the auto-elevator project.
+;
+; Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+;
+; See the COPYING file for the terms of usage and distribution.
+;/
+  SECTION .text:CODE(2)
+  THUMB
+
+  ;Imported functions
+  EXTERN diagnosis_fault
+
+  ;Exported functions
+  EXPORT HardFaultException
+  EXPORT MemManageException
+  EXPORT BusFaultException
+  EXPORT UsageFaultException
+
+
+;*******************************************************************************
+; @brief fault exception entry, no register is pushed before stack is chosen
+; @note EXC_RETURN[2] tells the stack where the frame is stacked
+;       0: MSP(handler or thread mode before scheduler start)
+;       1: PSP(task)
+;       diagnosis_fault(frame, EXC_RETURN) never returns
+;*******************************************************************************
+HardFaultException
+MemManageException
+BusFaultException
+UsageFaultException
+    tst lr, #4
+    ite eq
+    mrseq r0, msp
+    mrsne r0, psp
+    mov r1, lr
+    b diagnosis_fault
+
+  END
@@ -10,6 +10,7 @@
 #include "floormap.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "expand.h"
 #include "parameter.h"
 #include "boardmap.h"
@@ -18,10 +19,12 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[FLOORMAP]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_FLOORMAP
 
 extern parameters_t board_parameter;
 
-static uint8_t floormap[MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1)];
+static floor_t floormap[MAX_TOTAL_FLOOR_NUM];
 
 #if DUMP_FLOORMAP
 /**
@@ -29,14 +32,21 @@ static uint8_t floormap[MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM -
  * @param data - message to dump
  * @param len - data length
  */
-static void dump_message(const uint8_t *data, uint8_t len)
+static void dump_message(const floor_t *data, uint16_t len)
 {
+    if (!TRACE_ON(TRACE_LEVEL_DUMP))
+    {
+        return ;
+    }
+
     TRACE("floormap: ");
 
-    for (int i = 0; i < len; ++i)
+    for (uint16_t i = 0; i < len; ++i)
     {
-        dbg_putchar("0123456789abcdef"[data[i] >> 4]);
-        dbg_putchar("0123456789abcdef"[data[i] & 0x0f]);
+        dbg_putchar("0123456789abcdef"[((uint16_t)data[i] >> 12) & 0x0f]);
+        dbg_putchar("0123456789abcdef"[((uint16_t)data[i] >> 8) & 0x0f]);
+        dbg_putchar("0123456789abcdef"[((uint16_t)data[i] >> 4) & 0x0f]);
+        dbg_putchar("0123456789abcdef"[(uint16_t)data[i] & 0x0f]);
         dbg_putchar(' ');
     }
     dbg_putchar('\r');
@@ -45,46 +55,79 @@ static void dump_message(const uint8_t *data, uint8_t len)
 #endif
 
 /**
- * @brief update phy-dis floormap
+ * @brief build phy-dis floormap from boardmap
+ * @param maps - boardmap to build from
+ * @param[out] shadow - floormap built, MAX_TOTAL_FLOOR_NUM floors
  */
-void floormap_update(void)
+void floormap_build(const boardmap_t *maps, floor_t *shadow)
 {
-    TRACE("updating floormap...\r\n");
-
-    /** fill floormap */
-    uint8_t *pfloor = floormap;
+    floor_t *pfloor = shadow;
+    memset(shadow, 0, MAX_TOTAL_FLOOR_NUM * sizeof(floor_t));
     for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
     {
-        if (0 != boardmaps[i].start_floor)
+        if (0 != maps[i].id_board)
         {
-            for (uint8_t j = 0; j < boardmaps[i].floor_num; ++j)
+            for (uint8_t j = 0; j < maps[i].floor_num; ++j)
             {
-                *pfloor = boardmaps[i].start_floor + j;
+                if (pfloor >= shadow + MAX_TOTAL_FLOOR_NUM)
+                {
+                    break;
+                }
+                *pfloor = floor_offset(maps[i].start_floor, j);
                 pfloor ++;
             }
         }
     }
+}
 
+/**
+ * @brief replace floormap with shadow, called with scheduler suspended
+ * @param shadow - floormap built by floormap_build
+ */
+void floormap_commit(const floor_t *shadow)
+{
+    memcpy(floormap, shadow, sizeof(floormap));
+}
+
+/**
+ * @brief dump floormap
+ */
+void floormap_dump(void)
+{
 #if DUMP_FLOORMAP
-    dump_message((uint8_t *)floormap, MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1));
+    dump_message(floormap, MAX_TOTAL_FLOOR_NUM);
 #endif
 }
 
+/**
+ * @brief update phy-dis floormap
+ */
+void floormap_update(void)
+{
+    TRACE("updating floormap...\r\n");
+    floormap_build(boardmaps, floormap);
+    floormap_dump();
+}
+
 /**
  * @brief check whether contains specified floor
  * @param[in] floor: floor to check
  * @return check status
  */
-bool floormap_contains_floor(uint8_t floor)
+bool floormap_contains_floor(floor_t floor)
 {
-    for (uint16_t i = 0; i < MAX_FLOOR_NUM +
-         MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1); ++i)
+    if (INVALID_FLOOR == floor)
+    {
+        return FALSE;
+    }
+
+    for (uint16_t i = 0; i < MAX_TOTAL_FLOOR_NUM; ++i)
     {
         if (floor == floormap[i])
         {
-            return i + 1;
+            return TRUE;
         }
     }
-    return 0;
+    return FALSE;
 }
 #endif
@@ -10,11 +10,16 @@
 
 #ifdef __MASTER
 #include "types.h"
+#include "config.h"
+#include "boardmap.h"
 
 BEGIN_DECLS
 
+void floormap_build(const boardmap_t *maps, floor_t *shadow);
+void floormap_commit(const floor_t *shadow);
+void floormap_dump(void);
 void floormap_update(void);
-bool floormap_contains_floor(uint8_t floor);
+bool floormap_contains_floor(floor_t floor);
 
 END_DECLS
 #endif
@@ -9,10 +9,13 @@
 #include "i2c_software.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "pinconfig.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[FM]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_FM
 
 /* FM24CL64 i2c address */
 #define FM24CL64_ADDRESS 0x50
@@ -84,10 +87,5 @@ bool fm_read(uint16_t addr, uint8_t *data, uint16_t len)
     uint8_t addr_data[2];
     addr_data[0] = (uint8_t)((addr >> 8) & 0xff);
     addr_data[1] = (uint8_t)(addr & 0xff);
-    if (i2c_write(fm_i2c, addr_data, 2))
-    {
-        return i2c_read(fm_i2c, data, len);
-    }
-
-    return FALSE;
+    return i2c_addr_read(fm_i2c, addr_data, 2, data, len);
 }
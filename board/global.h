@@ -12,32 +12,36 @@
 
 /* task priority definition */
 #ifdef __MASTER
-#define SWITCH_MONITOR_PRIORITY      (tskIDLE_PRIORITY + 3)
 #define ALTIMETER_PRIORITY           (tskIDLE_PRIORITY + 4)
 #define ALTIMETER_CALC_PRIORITY      (tskIDLE_PRIORITY + 2)
 #define BLUETOOTH_PRIORITY           (tskIDLE_PRIORITY + 4)
 #define LED_PROCESS_PRIORITY         (tskIDLE_PRIORITY + 3)
 #endif
 #define PROTOCOL_PRIORITY            (tskIDLE_PRIORITY + 4)
-#define ELEV_PRIORITY                (tskIDLE_PRIORITY + 1)
 #define EXPAND_PRIORITY              (tskIDLE_PRIORITY + 2)
+#define EXPAND_FW_PRIORITY           (tskIDLE_PRIORITY + 1)
+#define TRACE_PRIORITY               (tskIDLE_PRIORITY + 1)
+#define TIMEWHEEL_PRIORITY           (tskIDLE_PRIORITY + 3)
 
 /* task stack definition */
 #ifdef __MASTER
-#define SWITCH_MONITOR_STACK_SIZE    (configMINIMAL_STACK_SIZE)
 #define ALTIMETER_STACK_SIZE         (configMINIMAL_STACK_SIZE * 2)
 #define ALTIMETER_CALC_STACK_SIZE    (configMINIMAL_STACK_SIZE)
 #define BLUETOOTH_STACK_SIZE         (configMINIMAL_STACK_SIZE * 2)
 #define LED_PROCESS_STACK_SIZE       (configMINIMAL_STACK_SIZE)
 #endif
 #define PROTOCOL_STACK_SIZE          (configMINIMAL_STACK_SIZE * 2)
-#define ELEV_STACK_SIZE              (configMINIMAL_STACK_SIZE)
 #define EXPAND_STACK_SIZE            (configMINIMAL_STACK_SIZE)
+#define EXPAND_FW_STACK_SIZE         (configMINIMAL_STACK_SIZE * 2)
+#define TRACE_STACK_SIZE             (configMINIMAL_STACK_SIZE * 2)
+#define TIMEWHEEL_STACK_SIZE         (configMINIMAL_STACK_SIZE * 2)
 
 /* interrupt priority */
 #define CAN1_PRIORITY          (11)
 #define USART1_PRIORITY        (12)
 #define TIM2_PRIORITY          (9)
+#define I2C1_PRIORITY          (11)
+#define USART3_DMA_PRIORITY    (13)
 
 #ifdef __MASTER
 #define ARRIVE_JUDGE    (0)
@@ -0,0 +1,657 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "i2c_hardware.h"
+#include "stm32f10x_cfg.h"
+#include "pinconfig.h"
+#include "delay.h"
+#include "global.h"
+#include "trace.h"
+#include "trace_level.h"
+#include "stats.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[I2C_HW]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_I2C
+
+/* bus clock, fast mode is the highest speed supported by stm32f10x */
+#define I2C_HW_SPEED          400000
+
+/* i2c1 dma request channels */
+#define I2C_HW_TX_CHANNEL     DMA1_Channel6
+#define I2C_HW_RX_CHANNEL     DMA1_Channel7
+
+/* transfer timeout, ms */
+#define I2C_HW_TIMEOUT        20
+/* bus idle wait, us */
+#define I2C_HW_IDLE_WAIT      1000
+
+/* transfer stage */
+typedef enum
+{
+    STAGE_IDLE,
+    STAGE_START,
+    STAGE_ADDRESS,
+    STAGE_HEAD,
+    STAGE_DATA,
+    STAGE_LAST,
+    STAGE_DONE,
+    STAGE_NACK,
+    STAGE_FAULT,
+} i2c_hw_stage;
+
+/* transfer context, read transfer with head writes head first then reads
+   after repeated start */
+typedef struct
+{
+    uint8_t slave;
+    bool read;
+    /* current direction */
+    bool receiving;
+    const uint8_t *head;
+    uint8_t head_len;
+    const uint8_t *tx;
+    uint8_t *rx;
+    uint16_t length;
+    volatile i2c_hw_stage stage;
+    /* task is waiting for completion semaphore */
+    bool waiting;
+} i2c_hw_xfer;
+
+static i2c_hw_xfer xfer;
+static xSemaphoreHandle xI2cMutex = NULL;
+static StaticSemaphore_t i2c_mutex;
+static xSemaphoreHandle xI2cDone = NULL;
+static StaticSemaphore_t i2c_done;
+/* interrupt completion when scheduler running, otherwise polling */
+static bool interrupt_mode = FALSE;
+
+/**
+ * @brief check if transfer is still in progress
+ */
+static __INLINE bool i2c_hw_busy(void)
+{
+    return (xfer.stage > STAGE_IDLE) && (xfer.stage < STAGE_DONE);
+}
+
+/**
+ * @brief setup i2c peripheral
+ */
+static void i2c_hw_setup(void)
+{
+    I2C_Config config;
+    I2C_StructInit(&config);
+    config.clockSpeed = I2C_HW_SPEED;
+    config.dutyCycle = I2C_DutyCycle_2;
+    I2C_Enable(I2C1, FALSE);
+    I2C_SoftwareReset(I2C1);
+    I2C_Setup(I2C1, &config);
+    I2C_Enable(I2C1, TRUE);
+}
+
+/**
+ * @brief wait bus idle
+ * @return TRUE: bus idle FALSE: bus stuck
+ */
+static bool i2c_hw_wait_idle(void)
+{
+    for (uint16_t i = 0; i < I2C_HW_IDLE_WAIT; ++i)
+    {
+        if (!I2C_IsBusy(I2C1))
+        {
+            return TRUE;
+        }
+        delay_us(1);
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief release a slave holding sda low by clocking out remaining bits,
+ *        pins must be in gpio mode
+ */
+static void i2c_hw_bus_clear(void)
+{
+    pin_set("I2C1_SDA");
+    pin_set("I2C1_SCL");
+    delay_us(5);
+    for (uint8_t i = 0; (i < 9) && !is_pinset("I2C1_SDA"); ++i)
+    {
+        pin_reset("I2C1_SCL");
+        delay_us(5);
+        pin_set("I2C1_SCL");
+        delay_us(5);
+    }
+
+    /* stop condition */
+    pin_reset("I2C1_SCL");
+    pin_reset("I2C1_SDA");
+    delay_us(5);
+    pin_set("I2C1_SCL");
+    delay_us(5);
+    pin_set("I2C1_SDA");
+    delay_us(5);
+}
+
+/**
+ * @brief start dma transfer
+ * @param channel - dma channel
+ * @param mem - memory address
+ * @param count - transfer count
+ */
+static void i2c_hw_dma_start(DMA_Channel channel, uint32_t mem, uint16_t count)
+{
+    DMA_Config config;
+    DMA_StructInit(&config);
+    config.periphAddr = I2C_DataAddress(I2C1);
+    config.memAddr = mem;
+    config.count = count;
+    config.direction = (I2C_HW_TX_CHANNEL == channel) ? DMA_DIR_PeriphDst :
+                       DMA_DIR_PeriphSrc;
+    config.priority = DMA_Priority_High;
+
+    DMA_Enable(channel, FALSE);
+    DMA_ClearFlag(channel, DMA_FLAG_GL);
+    DMA_Setup(channel, &config);
+    DMA_EnableInt(channel, DMA_IT_TC, interrupt_mode);
+    DMA_EnableInt(channel, DMA_IT_TE, interrupt_mode);
+    DMA_Enable(channel, TRUE);
+}
+
+/**
+ * @brief finish transfer
+ * @param stage - finish stage
+ */
+static void i2c_hw_finish(i2c_hw_stage stage)
+{
+    I2C_EnableInt(I2C1, I2C_IT_EVT | I2C_IT_ERR | I2C_IT_BUF, FALSE);
+    I2C_EnableDMA(I2C1, FALSE);
+    I2C_EnableDMALast(I2C1, FALSE);
+    DMA_Enable(I2C_HW_TX_CHANNEL, FALSE);
+    DMA_Enable(I2C_HW_RX_CHANNEL, FALSE);
+    xfer.stage = stage;
+}
+
+/**
+ * @brief slave address acknowledged in write direction
+ */
+static void i2c_hw_address_write(void)
+{
+    if (xfer.head_len > 0)
+    {
+        xfer.stage = STAGE_HEAD;
+        i2c_hw_dma_start(I2C_HW_TX_CHANNEL, (uint32_t)xfer.head, xfer.head_len);
+    }
+    else if (xfer.length > 0)
+    {
+        xfer.stage = STAGE_DATA;
+        i2c_hw_dma_start(I2C_HW_TX_CHANNEL, (uint32_t)xfer.tx, xfer.length);
+    }
+    else
+    {
+        /* nothing to send, only address */
+        I2C_ClearAddrFlag(I2C1);
+        I2C_GenerateStop(I2C1);
+        i2c_hw_finish(STAGE_DONE);
+        return;
+    }
+
+    /* dma must be ready before address flag cleared */
+    I2C_EnableDMA(I2C1, TRUE);
+    I2C_ClearAddrFlag(I2C1);
+}
+
+/**
+ * @brief slave address acknowledged in read direction
+ */
+static void i2c_hw_address_read(void)
+{
+    if (1 == xfer.length)
+    {
+        /* nack must be programmed before address flag cleared */
+        I2C_EnableAck(I2C1, FALSE);
+        I2C_ClearAddrFlag(I2C1);
+        I2C_GenerateStop(I2C1);
+        xfer.stage = STAGE_LAST;
+        if (interrupt_mode)
+        {
+            I2C_EnableInt(I2C1, I2C_IT_BUF, TRUE);
+        }
+    }
+    else
+    {
+        /* last dma transfer nacks the final byte */
+        I2C_EnableAck(I2C1, TRUE);
+        xfer.stage = STAGE_DATA;
+        i2c_hw_dma_start(I2C_HW_RX_CHANNEL, (uint32_t)xfer.rx, xfer.length);
+        I2C_EnableDMALast(I2C1, TRUE);
+        I2C_EnableDMA(I2C1, TRUE);
+        I2C_ClearAddrFlag(I2C1);
+    }
+}
+
+/**
+ * @brief process i2c event
+ */
+static void i2c_hw_event(void)
+{
+    uint16_t flags = I2C_GetFlags(I2C1);
+    if (0 != (flags & I2C_FLAG_SB))
+    {
+        /* reading SR1 then writing DR clears start bit */
+        xfer.stage = STAGE_ADDRESS;
+        I2C_SendAddress(I2C1, xfer.slave, xfer.receiving);
+    }
+    else if (0 != (flags & I2C_FLAG_ADDR))
+    {
+        if (xfer.receiving)
+        {
+            i2c_hw_address_read();
+        }
+        else
+        {
+            i2c_hw_address_write();
+        }
+    }
+    else if (STAGE_LAST == xfer.stage)
+    {
+        if (xfer.receiving)
+        {
+            if (0 != (flags & I2C_FLAG_RXNE))
+            {
+                *xfer.rx = I2C_ReadData(I2C1);
+                i2c_hw_finish(STAGE_DONE);
+            }
+        }
+        else if (0 != (flags & I2C_FLAG_BTF))
+        {
+            /* last byte shifted out */
+            if (xfer.read)
+            {
+                /* head sent, repeated start to read */
+                xfer.receiving = TRUE;
+                xfer.stage = STAGE_START;
+                I2C_GenerateStart(I2C1);
+            }
+            else
+            {
+                I2C_GenerateStop(I2C1);
+                i2c_hw_finish(STAGE_DONE);
+            }
+        }
+    }
+}
+
+/**
+ * @brief process i2c error
+ */
+static void i2c_hw_error(void)
+{
+    uint16_t flags = I2C_GetFlags(I2C1) & I2C_FLAG_ERROR;
+    I2C_ClearFlag(I2C1, flags);
+    if (I2C_FLAG_AF == flags)
+    {
+        I2C_GenerateStop(I2C1);
+        i2c_hw_finish(STAGE_NACK);
+    }
+    else
+    {
+        i2c_hw_finish(STAGE_FAULT);
+    }
+}
+
+/**
+ * @brief process dma transmit complete
+ */
+static void i2c_hw_dma_tx(void)
+{
+    if (DMA_IsFlagOn(I2C_HW_TX_CHANNEL, DMA_FLAG_TE))
+    {
+        DMA_ClearFlag(I2C_HW_TX_CHANNEL, DMA_FLAG_GL);
+        i2c_hw_finish(STAGE_FAULT);
+        return;
+    }
+
+    DMA_ClearFlag(I2C_HW_TX_CHANNEL, DMA_FLAG_GL);
+    if ((STAGE_HEAD == xfer.stage) && !xfer.read && (xfer.length > 0))
+    {
+        xfer.stage = STAGE_DATA;
+        i2c_hw_dma_start(I2C_HW_TX_CHANNEL, (uint32_t)xfer.tx, xfer.length);
+    }
+    else
+    {
+        /* wait byte transfer finished to send stop */
+        DMA_Enable(I2C_HW_TX_CHANNEL, FALSE);
+        I2C_EnableDMA(I2C1, FALSE);
+        xfer.stage = STAGE_LAST;
+    }
+}
+
+/**
+ * @brief process dma receive complete
+ */
+static void i2c_hw_dma_rx(void)
+{
+    bool error = DMA_IsFlagOn(I2C_HW_RX_CHANNEL, DMA_FLAG_TE);
+    DMA_ClearFlag(I2C_HW_RX_CHANNEL, DMA_FLAG_GL);
+    I2C_GenerateStop(I2C1);
+    i2c_hw_finish(error ? STAGE_FAULT : STAGE_DONE);
+}
+
+/**
+ * @brief poll transfer state, used before scheduler started
+ */
+static void i2c_hw_poll(void)
+{
+    if (DMA_IsFlagOn(I2C_HW_TX_CHANNEL, DMA_FLAG_TC) ||
+        DMA_IsFlagOn(I2C_HW_TX_CHANNEL, DMA_FLAG_TE))
+    {
+        i2c_hw_dma_tx();
+    }
+    if (DMA_IsFlagOn(I2C_HW_RX_CHANNEL, DMA_FLAG_TC) ||
+        DMA_IsFlagOn(I2C_HW_RX_CHANNEL, DMA_FLAG_TE))
+    {
+        i2c_hw_dma_rx();
+    }
+    if (!i2c_hw_busy())
+    {
+        return;
+    }
+
+    if (0 != (I2C_GetFlags(I2C1) & I2C_FLAG_ERROR))
+    {
+        i2c_hw_error();
+    }
+    else
+    {
+        i2c_hw_event();
+    }
+}
+
+/**
+ * @brief wake waiting task when transfer finished
+ * @param pxHigherPriorityTaskWoken - higher priority task woken flag
+ */
+static void i2c_hw_notify(portBASE_TYPE *pxHigherPriorityTaskWoken)
+{
+    if (!i2c_hw_busy() && xfer.waiting)
+    {
+        xfer.waiting = FALSE;
+        xSemaphoreGiveFromISR(xI2cDone, pxHigherPriorityTaskWoken);
+    }
+}
+
+/**
+ * @brief run transfer
+ * @param request - transfer request
+ * @return transfer status
+ */
+static i2c_hw_status i2c_hw_transfer(const i2c_hw_xfer *request)
+{
+    bool running = (taskSCHEDULER_RUNNING == xTaskGetSchedulerState());
+    if (running)
+    {
+        xSemaphoreTake(xI2cMutex, portMAX_DELAY);
+    }
+    interrupt_mode = running;
+    xfer.slave = request->slave;
+    xfer.read = request->read;
+    xfer.receiving = request->read && (0 == request->head_len);
+    xfer.head = request->head;
+    xfer.head_len = request->head_len;
+    xfer.tx = request->tx;
+    xfer.rx = request->rx;
+    xfer.length = request->length;
+
+    i2c_hw_status status = I2C_HW_FAULT;
+    if (i2c_hw_wait_idle())
+    {
+        xfer.stage = STAGE_START;
+        if (interrupt_mode)
+        {
+            /* drop completion given after previous timeout */
+            xSemaphoreTake(xI2cDone, 0);
+            xfer.waiting = TRUE;
+            I2C_EnableInt(I2C1, I2C_IT_EVT | I2C_IT_ERR, TRUE);
+            I2C_GenerateStart(I2C1);
+            xSemaphoreTake(xI2cDone, I2C_HW_TIMEOUT / portTICK_PERIOD_MS);
+            taskENTER_CRITICAL();
+            if (i2c_hw_busy())
+            {
+                i2c_hw_finish(STAGE_FAULT);
+            }
+            xfer.waiting = FALSE;
+            taskEXIT_CRITICAL();
+        }
+        else
+        {
+            xfer.waiting = FALSE;
+            I2C_GenerateStart(I2C1);
+            uint32_t wait = I2C_HW_TIMEOUT * 1000;
+            while (i2c_hw_busy() && (wait > 0))
+            {
+                i2c_hw_poll();
+                delay_us(1);
+                wait --;
+            }
+            if (i2c_hw_busy())
+            {
+                i2c_hw_finish(STAGE_FAULT);
+            }
+        }
+
+        if (STAGE_DONE == xfer.stage)
+        {
+            status = I2C_HW_OK;
+        }
+        else if (STAGE_NACK == xfer.stage)
+        {
+            status = I2C_HW_NACK;
+        }
+    }
+
+    if (I2C_HW_FAULT == status)
+    {
+        TRACE("transfer fault, stage %d\r\n", xfer.stage);
+        i2c_hw_setup();
+    }
+    xfer.stage = STAGE_IDLE;
+
+    if (running)
+    {
+        xSemaphoreGive(xI2cMutex);
+    }
+
+    return status;
+}
+
+/**
+ * @brief initialize hardware i2c1, pins switch to alternate function
+ * @return TRUE: bus ready FALSE: hardware unusable, pins left in gpio mode
+ */
+bool i2c_hw_init(void)
+{
+    TRACE("initialize hardware i2c...\r\n");
+    if (NULL == xI2cMutex)
+    {
+        xI2cMutex = xSemaphoreCreateMutexStatic(&i2c_mutex);
+        xI2cDone = xSemaphoreCreateBinaryStatic(&i2c_done);
+    }
+
+    i2c_hw_bus_clear();
+    pin_set_mode("I2C1_SCL", GPIO_Mode_AF_OD);
+    pin_set_mode("I2C1_SDA", GPIO_Mode_AF_OD);
+    i2c_hw_setup();
+    if (!i2c_hw_wait_idle())
+    {
+        TRACE("initialize hardware i2c failed: bus busy!\r\n");
+        i2c_hw_deinit();
+        return FALSE;
+    }
+
+    xfer.stage = STAGE_IDLE;
+    xfer.waiting = FALSE;
+
+    /* setup interrupt */
+    NVIC_Config nvicConfig = {I2C1_EV_IRQChannel, I2C1_PRIORITY, 0, TRUE};
+    NVIC_Init(&nvicConfig);
+    nvicConfig.channel = I2C1_ER_IRQChannel;
+    NVIC_Init(&nvicConfig);
+    nvicConfig.channel = DMAChannel6_IRQChannel;
+    NVIC_Init(&nvicConfig);
+    nvicConfig.channel = DMAChannel7_IRQChannel;
+    NVIC_Init(&nvicConfig);
+
+    return TRUE;
+}
+
+/**
+ * @brief lock i2c1 bus, bit-bang transfer on the same pins takes it too
+ */
+void i2c_hw_lock(void)
+{
+    if ((NULL != xI2cMutex) && (taskSCHEDULER_RUNNING == xTaskGetSchedulerState()))
+    {
+        xSemaphoreTake(xI2cMutex, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief unlock i2c1 bus
+ */
+void i2c_hw_unlock(void)
+{
+    if ((NULL != xI2cMutex) && (taskSCHEDULER_RUNNING == xTaskGetSchedulerState()))
+    {
+        xSemaphoreGive(xI2cMutex);
+    }
+}
+
+/**
+ * @brief stop hardware i2c1 and give pins back to gpio
+ */
+void i2c_hw_deinit(void)
+{
+    i2c_hw_finish(STAGE_IDLE);
+    I2C_Enable(I2C1, FALSE);
+    pin_set_mode("I2C1_SCL", GPIO_Mode_Out_OD);
+    pin_set_mode("I2C1_SDA", GPIO_Mode_Out_OD);
+    pin_set("I2C1_SCL");
+    pin_set("I2C1_SDA");
+}
+
+/**
+ * @brief write data to slave
+ * @param slave - slave address
+ * @param head - data send before, can be NULL
+ * @param head_len - head length
+ * @param data - data to write
+ * @param length - data length
+ * @return transfer status
+ */
+i2c_hw_status i2c_hw_write(uint8_t slave, const uint8_t *head, uint8_t head_len,
+                           const uint8_t *data, uint32_t length)
+{
+    assert_param(length <= 0xffff);
+    i2c_hw_xfer request;
+    request.slave = slave;
+    request.read = FALSE;
+    request.head = head;
+    request.head_len = (NULL == head) ? 0 : head_len;
+    request.tx = data;
+    request.rx = NULL;
+    request.length = (uint16_t)length;
+
+    return i2c_hw_transfer(&request);
+}
+
+/**
+ * @brief read data from slave, head is written first in the same transfer
+ * @param slave - slave address
+ * @param head - data send before repeated start, can be NULL
+ * @param head_len - head length
+ * @param data - data buffer
+ * @param length - data length
+ * @return transfer status
+ */
+i2c_hw_status i2c_hw_read(uint8_t slave, const uint8_t *head, uint8_t head_len,
+                          uint8_t *data, uint32_t length)
+{
+    assert_param(length <= 0xffff);
+    if (0 == length)
+    {
+        return I2C_HW_OK;
+    }
+
+    i2c_hw_xfer request;
+    request.slave = slave;
+    request.read = TRUE;
+    request.head = head;
+    request.head_len = (NULL == head) ? 0 : head_len;
+    request.tx = NULL;
+    request.rx = data;
+    request.length = (uint16_t)length;
+
+    return i2c_hw_transfer(&request);
+}
+
+/**
+ * @brief i2c1 event interrupt
+ */
+void I2C1_EV_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t start = stats_isr_begin();
+    i2c_hw_event();
+    i2c_hw_notify(&xHigherPriorityTaskWoken);
+    stats_isr_end(STATS_ISR_I2C1_EV, start);
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * @brief i2c1 error interrupt
+ */
+void I2C1_ER_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t start = stats_isr_begin();
+    i2c_hw_error();
+    i2c_hw_notify(&xHigherPriorityTaskWoken);
+    stats_isr_end(STATS_ISR_I2C1_ER, start);
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * @brief i2c1 transmit dma interrupt
+ */
+void DMAChannel6_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t start = stats_isr_begin();
+    i2c_hw_dma_tx();
+    i2c_hw_notify(&xHigherPriorityTaskWoken);
+    stats_isr_end(STATS_ISR_I2C1_DMA_TX, start);
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * @brief i2c1 receive dma interrupt
+ */
+void DMAChannel7_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t start = stats_isr_begin();
+    i2c_hw_dma_rx();
+    i2c_hw_notify(&xHigherPriorityTaskWoken);
+    stats_isr_end(STATS_ISR_I2C1_DMA_RX, start);
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
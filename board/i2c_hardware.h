@@ -0,0 +1,33 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _I2C_HARDWARE_H_
+  #define _I2C_HARDWARE_H_
+#include "types.h"
+
+BEGIN_DECLS
+
+/** hardware transfer result */
+typedef enum
+{
+    I2C_HW_OK,
+    I2C_HW_NACK,  /* slave not acknowledged, bus still healthy */
+    I2C_HW_FAULT, /* bus error or timeout, peripheral unusable */
+}i2c_hw_status;
+
+bool i2c_hw_init(void);
+void i2c_hw_deinit(void);
+void i2c_hw_lock(void);
+void i2c_hw_unlock(void);
+i2c_hw_status i2c_hw_write(uint8_t slave, const uint8_t *head, uint8_t head_len,
+                           const uint8_t *data, uint32_t length);
+i2c_hw_status i2c_hw_read(uint8_t slave, const uint8_t *head, uint8_t head_len,
+                          uint8_t *data, uint32_t length);
+
+END_DECLS
+
+#endif
@@ -10,7 +10,17 @@
 #include "i2c_software.h"
 #include "delay.h"
 #include "stm32f10x_cfg.h"
+#include "config.h"
+#include "trace.h"
+#include "trace_level.h"
+#if USE_I2C_HARDWARE
+#include "i2c_hardware.h"
+#endif
 
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[I2C]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_I2C
 
 /* i2c handle definition */
 struct _i2c_t
@@ -21,8 +31,99 @@ struct _i2c_t
     GPIO_Group sclpin_group;
     uint8_t sdapin_port;
     uint8_t sclpin_port;
+    bool hardware;
 };
 
+/* i2c handles, one for each port */
+static i2c i2cs[port_count];
+
+#if USE_I2C_HARDWARE
+/* consecutive hardware faults before falling back to bit-bang */
+#define I2C_HW_FAULT_MAX      3
+
+/* hardware i2c1 state */
+static bool hw_ready = FALSE;
+static bool hw_failed = FALSE;
+static uint8_t hw_faults = 0;
+
+/**
+ * @brief check if handle transfers through hardware i2c
+ * @param pi2c - i2c handle
+ */
+static __INLINE bool i2c_use_hardware(const i2c *pi2c)
+{
+    return pi2c->hardware && hw_ready;
+}
+
+/**
+ * @brief check hardware transfer status, peripheral is reinitialized after
+ *        fault, fall back to bit-bang after consecutive faults
+ * @param pi2c - i2c handle
+ * @param status - hardware transfer status
+ * @return TRUE: status is final FALSE: retry
+ */
+static bool i2c_hw_result(i2c *pi2c, i2c_hw_status status)
+{
+    if (I2C_HW_FAULT != status)
+    {
+        hw_faults = 0;
+        return TRUE;
+    }
+
+    hw_faults ++;
+    if (hw_faults < I2C_HW_FAULT_MAX)
+    {
+        TRACE("hardware i2c fault: %d\r\n", hw_faults);
+        return FALSE;
+    }
+
+    TRACE("hardware i2c fault, fall back to software i2c\r\n");
+    i2c_hw_lock();
+    if (hw_ready)
+    {
+        i2c_hw_deinit();
+        hw_ready = FALSE;
+        hw_failed = TRUE;
+    }
+    i2c_hw_unlock();
+    pi2c->hardware = FALSE;
+    return FALSE;
+}
+#endif
+
+/**
+ * @brief lock bus for bit-bang transfer, i2c1 is shared with hardware
+ *        transfer
+ * @param pi2c - i2c handle
+ */
+static __INLINE void i2c_lock(const i2c *pi2c)
+{
+#if USE_I2C_HARDWARE
+    if (i2c1 == pi2c->port)
+    {
+        i2c_hw_lock();
+    }
+#else
+    UNUSED(pi2c);
+#endif
+}
+
+/**
+ * @brief unlock bus after bit-bang transfer
+ * @param pi2c - i2c handle
+ */
+static __INLINE void i2c_unlock(const i2c *pi2c)
+{
+#if USE_I2C_HARDWARE
+    if (i2c1 == pi2c->port)
+    {
+        i2c_hw_unlock();
+    }
+#else
+    UNUSED(pi2c);
+#endif
+}
+
 /* pin operation */
 static __INLINE void SDA_H(i2c *pi2c)
 {
@@ -170,19 +271,24 @@ static uint8_t _i2c_read(i2c *pi2c, bool ack)
 i2c *i2c_request(i2c_port port)
 {
     assert_param(port < port_count);
-    i2c *pi2c = pvPortMalloc(sizeof(i2c) / sizeof(char));
-    if(pi2c == NULL)
-    {
-        return NULL;
-    }
+    i2c *pi2c = &i2cs[port];
     pi2c->port = port;
     pi2c->slave_addr = 0xff;
+    pi2c->hardware = FALSE;
     if(port == i2c1)
     {
         pi2c->sclpin_group = GPIOB;
         pi2c->sdapin_group = GPIOB;
         pi2c->sclpin_port = 6;
         pi2c->sdapin_port = 7;
+#if USE_I2C_HARDWARE
+        if (!hw_ready && !hw_failed)
+        {
+            hw_ready = i2c_hw_init();
+            hw_failed = !hw_ready;
+        }
+        pi2c->hardware = hw_ready;
+#endif
     }
     else
     {
@@ -197,8 +303,8 @@ i2c *i2c_request(i2c_port port)
 
 void i2c_release(i2c *pi2c)
 {
-    assert_param(pi2c != NULL);  
-    vPortFree(pi2c);
+    assert_param(pi2c != NULL);
+    UNUSED(pi2c);
 }
 
 /**
@@ -218,7 +324,7 @@ void i2c_set_slaveaddr(i2c *pi2c, uint8_t address)
 * @param datra - data to write
 * @param length - data length
 */
-bool i2c_write(i2c *pi2c, const uint8_t *data, uint32_t length)
+static bool i2c_sw_write(i2c *pi2c, const uint8_t *data, uint32_t length)
 {
     assert_param(pi2c != NULL);
     /* start transfer */
@@ -257,8 +363,8 @@ bool i2c_write(i2c *pi2c, const uint8_t *data, uint32_t length)
 * @param data_len - data length
 */
 
-bool i2c_addr_write(i2c *pi2c, const uint8_t *addr, uint8_t addr_len,
-        const uint8_t *data, uint32_t data_len)
+static bool i2c_sw_addr_write(i2c *pi2c, const uint8_t *addr, uint8_t addr_len,
+                              const uint8_t *data, uint32_t data_len)
 {
     assert_param(pi2c != NULL);
     /* start transfer */
@@ -307,7 +413,7 @@ bool i2c_addr_write(i2c *pi2c, const uint8_t *addr, uint8_t addr_len,
  * @param data buffer
  * @param data length
  */
-bool i2c_read(i2c *pi2c, uint8_t *data, uint32_t length)
+static bool i2c_sw_read(i2c *pi2c, uint8_t *data, uint32_t length)
 {
     assert_param(pi2c != NULL);
     /* start transfer */
@@ -339,3 +445,172 @@ bool i2c_read(i2c *pi2c, uint8_t *data, uint32_t length)
     
     return TRUE;
 }
+
+/**
+ * @brief write address then read data in one transfer with repeated start,
+ *        so no other transfer can change slave address pointer in between
+ * @param pi2c - i2c handler
+ * @param addr - address to read
+ * @param addr_len - address length
+ * @param data - data buffer
+ * @param data_len - data length
+ */
+static bool i2c_sw_addr_read(i2c *pi2c, const uint8_t *addr, uint8_t addr_len,
+                             uint8_t *data, uint32_t data_len)
+{
+    assert_param(pi2c != NULL);
+    /* start transfer */
+    i2c_start(pi2c);
+    /* send address */
+    _i2c_write(pi2c, pi2c->slave_addr << 1);
+    if (0 != i2c_waitack(pi2c))
+    {
+        i2c_stop(pi2c);
+        return FALSE;
+    }
+    /* send address */
+    const uint8_t *pAddr = addr;
+    while (addr_len --)
+    {
+        _i2c_write(pi2c, *pAddr);
+        if (0 != i2c_waitack(pi2c))
+        {
+            i2c_stop(pi2c);
+            return FALSE;
+        }
+        pAddr++;
+    }
+    /* repeated start */
+    i2c_start(pi2c);
+    _i2c_write(pi2c, (pi2c->slave_addr << 1) | 0x01);
+    if (0 != i2c_waitack(pi2c))
+    {
+        i2c_stop(pi2c);
+        return FALSE;
+    }
+    /* read data */
+    uint8_t *pData = data;
+    if (0 != data_len)
+    {
+        data_len -= 1;
+        while (data_len--)
+        {
+            *pData++ = _i2c_read(pi2c, TRUE);
+        }
+        *pData++ = _i2c_read(pi2c, FALSE);
+    }
+    /* stop transfer */
+    i2c_stop(pi2c);
+
+    return TRUE;
+}
+
+/**
+* @brief write data to iic bus
+* @param pi2c - i2c handler
+* @param datra - data to write
+* @param length - data length
+*/
+bool i2c_write(i2c *pi2c, const uint8_t *data, uint32_t length)
+{
+    assert_param(pi2c != NULL);
+#if USE_I2C_HARDWARE
+    while (i2c_use_hardware(pi2c))
+    {
+        i2c_hw_status status = i2c_hw_write(pi2c->slave_addr, NULL, 0,
+                                            data, length);
+        if (i2c_hw_result(pi2c, status))
+        {
+            return (I2C_HW_OK == status);
+        }
+    }
+#endif
+    i2c_lock(pi2c);
+    bool ret = i2c_sw_write(pi2c, data, length);
+    i2c_unlock(pi2c);
+    return ret;
+}
+
+/**
+* @brief write data to iic bus, support address write
+* @param pi2c - i2c handler
+* @param addr - address to write
+* @param addr_len - address length
+* @param data - data to write
+* @param data_len - data length
+*/
+bool i2c_addr_write(i2c *pi2c, const uint8_t *addr, uint8_t addr_len,
+        const uint8_t *data, uint32_t data_len)
+{
+    assert_param(pi2c != NULL);
+#if USE_I2C_HARDWARE
+    while (i2c_use_hardware(pi2c))
+    {
+        i2c_hw_status status = i2c_hw_write(pi2c->slave_addr, addr, addr_len,
+                                            data, data_len);
+        if (i2c_hw_result(pi2c, status))
+        {
+            return (I2C_HW_OK == status);
+        }
+    }
+#endif
+    i2c_lock(pi2c);
+    bool ret = i2c_sw_addr_write(pi2c, addr, addr_len, data, data_len);
+    i2c_unlock(pi2c);
+    return ret;
+}
+
+/**
+ * @brief read data from i2c bus
+ * @param i2c handle
+ * @param data buffer
+ * @param data length
+ */
+bool i2c_read(i2c *pi2c, uint8_t *data, uint32_t length)
+{
+    assert_param(pi2c != NULL);
+#if USE_I2C_HARDWARE
+    while (i2c_use_hardware(pi2c))
+    {
+        i2c_hw_status status = i2c_hw_read(pi2c->slave_addr, NULL, 0, data, length);
+        if (i2c_hw_result(pi2c, status))
+        {
+            return (I2C_HW_OK == status);
+        }
+    }
+#endif
+    i2c_lock(pi2c);
+    bool ret = i2c_sw_read(pi2c, data, length);
+    i2c_unlock(pi2c);
+    return ret;
+}
+
+/**
+ * @brief write address then read data in one transfer with repeated start,
+ *        so no other transfer can change slave address pointer in between
+ * @param pi2c - i2c handler
+ * @param addr - address to read
+ * @param addr_len - address length
+ * @param data - data buffer
+ * @param data_len - data length
+ */
+bool i2c_addr_read(i2c *pi2c, const uint8_t *addr, uint8_t addr_len,
+        uint8_t *data, uint32_t data_len)
+{
+    assert_param(pi2c != NULL);
+#if USE_I2C_HARDWARE
+    while (i2c_use_hardware(pi2c))
+    {
+        i2c_hw_status status = i2c_hw_read(pi2c->slave_addr, addr, addr_len,
+                                           data, data_len);
+        if (i2c_hw_result(pi2c, status))
+        {
+            return (I2C_HW_OK == status);
+        }
+    }
+#endif
+    i2c_lock(pi2c);
+    bool ret = i2c_sw_addr_read(pi2c, addr, addr_len, data, data_len);
+    i2c_unlock(pi2c);
+    return ret;
+}
@@ -8,12 +8,15 @@
 #include "keyctl.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "cm3_core.h"
 #include "pinconfig.h"
 #include "relay.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[keyctl]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_KEYCTL
 
 #ifdef __MASTER
 #define KEY_NUM 18
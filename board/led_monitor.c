@@ -9,9 +9,10 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
-#include "timers.h"
+#include "timewheel.h"
 #include "queue.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "led_status.h"
 #include "elevator.h"
 #include "parameter.h"
@@ -21,6 +22,7 @@
 #include "elevator.h"
 #include "expand.h"
 #include "protocol_expand.h"
+#include "timesync.h"
 #ifdef __MASTER
 #include "robot.h"
 #include "altimeter.h"
@@ -30,10 +32,19 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[ledmtl]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_LED
 
 extern parameters_t board_parameter;
 
+#ifdef __MASTER
 #define LED_INTERVAL                 (200)
+#else
+/** expand board scans faster and debounces locally */
+#define LED_INTERVAL                 (10)
+/** raw led status sync interval */
+#define LED_SYNC_INTERVAL            (1000 / portTICK_PERIOD_MS)
+#endif
 #define LED_MONITOR_INTERVAL         (LED_INTERVAL / portTICK_PERIOD_MS)
 
 #ifdef __MASTER
@@ -42,9 +53,18 @@ typedef struct
     uint8_t id_board;
     uint16_t prev_status;
     uint16_t cur_status;
+    /** detect building time, unit is ms */
+    uint32_t stamp;
 } led_status_t;
 static xQueueHandle xQueueLed = NULL;
 #define LED_QUEUE_SIZE       10
+/**
+ * changes are processed in detect time order, a change is held for reorder
+ * window to wait for earlier changes delayed on can bus, unit is ms
+ */
+#define LED_REORDER_WINDOW   (50)
+static led_status_t led_pending[LED_QUEUE_SIZE];
+static uint8_t led_pending_num = 0;
 #define LED_WORK_MONITOR_INTERVAL    (2000 / portTICK_PERIOD_MS)
 
 typedef struct
@@ -72,20 +92,17 @@ static uint8_t floor_err_cnt = 0;
 static floor_phase_t floor_phase = NORMAL_PHASE;
 #define RESET_FLOOR_COUNT_PHASE1    5
 #define RESET_FLOOR_COUNT_PHASE2    60
-static uint8_t floor_in_phase[RESET_FLOOR_COUNT_PHASE2];
+static floor_t floor_in_phase[RESET_FLOOR_COUNT_PHASE2];
 #endif
 
 #endif
 
-#ifdef __MASTER
-/**
- * @brief check if floor arrived, 0->1means arrive
- * @return check result
- */
-static bool __INLINE is_floor_arrive(uint16_t origin_val, uint16_t new_val)
-{
-    return (0 == (origin_val & new_val));
-}
+#ifdef __EXPAND
+/** debounced led status */
+static uint16_t led_stable = 0xffff;
+static uint8_t led_seq = 0;
+static bool led_synced = FALSE;
+#endif
 
 /**
  * @brief get 1 bit position
@@ -103,6 +120,16 @@ static uint8_t bit_to_pos(uint16_t data)
     return pos;
 }
 
+#ifdef __MASTER
+/**
+ * @brief check if floor arrived, 0->1means arrive
+ * @return check result
+ */
+static bool __INLINE is_floor_arrive(uint16_t origin_val, uint16_t new_val)
+{
+    return (0 == (origin_val & new_val));
+}
+
 /**
  * @brief push password node to array
  * @param node - password node
@@ -143,7 +170,7 @@ static void push_pwd_node(const pwd_node *node)
 #if AUTO_ADJUST
 static bool is_all_floor_same(void)
 {
-    uint8_t floor = floor_in_phase[0];
+    floor_t floor = floor_in_phase[0];
     for (uint8_t i = 0; i < RESET_FLOOR_COUNT_PHASE2; ++i)
     {
         if (floor_in_phase[i] != floor)
@@ -160,7 +187,7 @@ static bool is_all_floor_same(void)
  * @brief led monitor task
  * @param pvParameters - task parameter
  */
-static void elev_pwd_go(uint8_t floor)
+static void elev_pwd_go(floor_t floor)
 {
 #if AUTO_ADJUST
     switch (floor_phase)
@@ -209,7 +236,7 @@ static void vLedWorkMonitor(void *pvParameters)
     /** check elevator status */
     if (work_robot == elev_state_work())
     {
-        uint8_t floor = robot_checkin_get();
+        floor_t floor = robot_checkin_get();
         if (DEFAULT_CHECKIN != floor)
         {
             if (!is_led_on(floor) && (floor != elev_floor()))
@@ -235,70 +262,133 @@ static void vLedWorkMonitor(void *pvParameters)
 }
 
 /**
- * @brief led process task
- * @param pvParameters - task parameter
+ * @brief process changed leds of one board
+ * @param led_status - led status change
+ * @param timestamp - password key time
  */
-static void vLedProcess(void *pvParameters)
+static void led_process_changed(const led_status_t *led_status, uint32_t timestamp)
 {
-    led_status_t led_status;
-    uint16_t changed_status = 0;
+    uint16_t changed_status = led_status->prev_status ^ led_status->cur_status;
     uint16_t per_changed_bit = 0;
-    char floor = 0;
-    uint32_t timestamp = 0;
-    for (;;)
+    floor_t floor = 0;
+    if (0 != changed_status)
     {
-        if (xQueueReceive(xQueueLed, &led_status, portMAX_DELAY))
+        /* led status changed */
+        do
         {
-            changed_status = led_status.prev_status ^ led_status.cur_status;
-            if (0 != changed_status)
+            per_changed_bit = changed_status & ~(changed_status - 1);
+            floor = boardmap_key_to_floor(led_status->id_board, bit_to_pos(per_changed_bit));
+            if (INVALID_FLOOR != floor)
             {
-                /* led status changed */
-                do
+                if (is_floor_arrive(led_status->prev_status, per_changed_bit))
                 {
-                    per_changed_bit = changed_status & ~(changed_status - 1);
-                    floor = boardmap_key_to_floor(led_status.id_board, bit_to_pos(per_changed_bit));
-                    if (INVALID_FLOOR != floor)
+                    TRACE("floor led off: %d\r\n", floor);
+
+                    /** check altimter calculation */
+                    if (altimeter_is_calculating())
                     {
-                        if (is_floor_arrive(led_status.prev_status, per_changed_bit))
+                        altimeter_calc_once(floor);
+                        vTaskDelay(2000 / portTICK_PERIOD_MS);
+                        if (floor_distance(board_parameter.start_floor, floor) <
+                            (int16_t)board_parameter.total_floor - 1)
                         {
-                            TRACE("floor led off: %d\r\n", floor);
-
-                            /** check altimter calculation */
-                            if (altimeter_is_calculating())
-                            {
-                                altimeter_calc_once(floor);
-                                vTaskDelay(2000 / portTICK_PERIOD_MS);
-                                if (floor < board_parameter.total_floor)
-                                {
-                                    elev_go(floor + 1);
-                                }
-                                else
-                                {
-                                    elev_go(1);
-                                }
-                            }
-                            else
-                            {
-                                /* notify floor arrived */
-                                elev_arrived(floor);
-                            }
+                            elev_go(floor_offset(floor, 1));
                         }
                         else
                         {
-                            TRACE("floor led on: %d\r\n", floor);
-                            if (CALC_PWD == board_parameter.calc_type)
-                            {
-                                /* push password */
-                                pwd_node node = {(uint8_t)floor, timestamp};
-                                push_pwd_node(&node);
-                            }
+                            elev_go(board_parameter.start_floor);
                         }
                     }
-                    changed_status &= changed_status - 1;
+                    else
+                    {
+                        /* notify floor arrived */
+                        elev_arrived(floor);
+                    }
+                }
+                else
+                {
+                    TRACE("floor led on: %d\r\n", floor);
+                    if (CALC_PWD == board_parameter.calc_type)
+                    {
+                        /* push password */
+                        pwd_node node = {(uint8_t)floor, timestamp};
+                        push_pwd_node(&node);
+                    }
                 }
-                while (0 != changed_status);
             }
+            changed_status &= changed_status - 1;
+        }
+        while (0 != changed_status);
+    }
+}
+
+/**
+ * @brief hold led status change in detect time order, same time keeps arrival
+ *        order
+ * @param led_status - led status change
+ */
+static void led_pending_insert(const led_status_t *led_status)
+{
+    uint8_t pos = led_pending_num;
+    while ((pos > 0) && ((int32_t)(led_pending[pos - 1].stamp - led_status->stamp) > 0))
+    {
+        led_pending[pos] = led_pending[pos - 1];
+        pos --;
+    }
+    led_pending[pos] = *led_status;
+    led_pending_num ++;
+}
+
+/**
+ * @brief take earliest held led status change
+ * @param[out] led_status - led status change
+ */
+static void led_pending_pop(led_status_t *led_status)
+{
+    *led_status = led_pending[0];
+    led_pending_num --;
+    for (uint8_t i = 0; i < led_pending_num; ++i)
+    {
+        led_pending[i] = led_pending[i + 1];
+    }
+}
+
+/**
+ * @brief led process task
+ * @param pvParameters - task parameter
+ */
+static void vLedProcess(void *pvParameters)
+{
+    led_status_t led_status;
+    uint32_t timestamp = 0;
+    for (;;)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (led_pending_num > 0)
+        {
+            int32_t left = (int32_t)(led_pending[0].stamp + LED_REORDER_WINDOW -
+                                     (uint32_t)(now_us() / 1000));
+            wait = (left > 0) ? (left / portTICK_PERIOD_MS) : 0;
+        }
+
+        bool full = FALSE;
+        if (xQueueReceive(xQueueLed, &led_status, wait))
+        {
+            led_pending_insert(&led_status);
+            full = (LED_QUEUE_SIZE == led_pending_num);
+        }
+
+        while (led_pending_num > 0)
+        {
+            int32_t age = (int32_t)((uint32_t)(now_us() / 1000) - led_pending[0].stamp);
+            if (!full && (age < LED_REORDER_WINDOW))
+            {
+                break;
+            }
+            full = FALSE;
 
+            led_pending_pop(&led_status);
+            led_process_changed(&led_status, timestamp);
             if (CALC_PWD == board_parameter.calc_type)
             {
                 timestamp ++;
@@ -312,14 +402,37 @@ static void vLedProcess(void *pvParameters)
  * @param[in] id_board: board id
  * @param[in] prev_status: previous led status
  * @param[in] cur_status: current led status
+ * @param[in] stamp: detect building time, unit is ms
  */
-void led_monitor_process(uint8_t id_board, uint16_t prev_status, uint16_t cur_status)
+void led_monitor_process(uint8_t id_board, uint16_t prev_status, uint16_t cur_status,
+                         uint32_t stamp)
 {
-    led_status_t status = {id_board, prev_status, cur_status};
+    led_status_t status = {id_board, prev_status, cur_status, stamp};
     xQueueSend(xQueueLed, &status, 20 / portTICK_PERIOD_MS);
 }
 #endif
 
+#ifdef __EXPAND
+/**
+ * @brief debounce led status, a led changes after 4 same samples
+ * @param sample - led status sampled
+ * @return changed leds
+ */
+static uint16_t led_debounce(uint16_t sample)
+{
+    /** 2-bit vertical counter per led, cleared when sample equals stable */
+    static uint16_t cnt0 = 0;
+    static uint16_t cnt1 = 0;
+    uint16_t delta = sample ^ led_stable;
+    cnt1 = (cnt1 ^ cnt0) & delta;
+    cnt0 = ~cnt0 & delta;
+
+    uint16_t toggle = delta & ~(cnt0 | cnt1);
+    led_stable ^= toggle;
+    return toggle;
+}
+#endif
+
 /**
  * @brief led monitor task
  * @param pvParameters - task parameter
@@ -329,7 +442,7 @@ static void vLedMonitor(void *pvParameters)
     uint16_t cur_status = led_status_get();
     static bool first_time = TRUE;
 #ifdef __MASTER
-    static led_status_t status = {0, 0, 0};
+    static led_status_t status = {0, 0, 0, 0};
     if (first_time)
     {
         status.id_board = board_parameter.id_board;
@@ -339,39 +452,70 @@ static void vLedMonitor(void *pvParameters)
         first_time = FALSE;
     }
 #else
-    static uint16_t prev_status = 0;
+    static TickType_t sync_tick = 0;
+    if (first_time)
+    {
+        led_stable = cur_status;
+        first_time = FALSE;
+    }
 #endif
 
 #ifdef __MASTER
     status.cur_status = cur_status;
     if (status.cur_status != status.prev_status)
     {
+        status.stamp = (uint32_t)(now_us() / 1000);
         xQueueSend(xQueueLed, &status, 20 / portTICK_PERIOD_MS);
         boardmap_update_led_status(board_parameter.id_board, cur_status);
         status.prev_status = status.cur_status;
     }
 #else
-    if (is_expand_board_registered())
+    uint16_t toggle = led_debounce(cur_status);
+    if (!is_expand_board_registered())
     {
-        if (first_time)
-        {
-            vTaskDelay(LED_MONITOR_INTERVAL);
-            notify_led_status(board_parameter.id_board, cur_status);
-            prev_status = cur_status;
-            first_time = FALSE;
-        }
-        else
-        {
-            if (cur_status != prev_status)
-            {
-                notify_led_status(board_parameter.id_board, cur_status);
-                prev_status = cur_status;
-            }
-        }
+        /** master gets whole status again after registered */
+        led_synced = FALSE;
+        return ;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if (!led_synced)
+    {
+        notify_led_status(board_parameter.id_board, led_stable, led_seq);
+        sync_tick = now;
+        led_synced = TRUE;
+        return ;
+    }
+
+    /** one event per changed led, in bit order, stamped with building time */
+    uint16_t stamp = (uint16_t)(now_us() / 1000);
+    while (0 != toggle)
+    {
+        uint16_t bit = toggle & ~(toggle - 1);
+        led_seq ++;
+        notify_led_event(board_parameter.id_board, led_seq, bit_to_pos(bit),
+                         (0 == (led_stable & bit)), stamp);
+        toggle &= toggle - 1;
+    }
+
+    if (now - sync_tick >= LED_SYNC_INTERVAL)
+    {
+        notify_led_status(board_parameter.id_board, led_stable, led_seq);
+        sync_tick = now;
     }
 #endif
 }
 
+/* led timer, task and queue memory */
+static timewheel_timer_t led_timer;
+#ifdef __MASTER
+static timewheel_timer_t ledwork_timer;
+static StaticTask_t led_task;
+static StackType_t led_stack[LED_PROCESS_STACK_SIZE];
+static StaticQueue_t led_queue;
+static uint8_t led_queue_buf[LED_QUEUE_SIZE * sizeof(led_status_t)];
+#endif
+
 /**
  * @brief initialize led monitor
  * @return init status
@@ -380,26 +524,16 @@ bool led_monitor_init(void)
 {
     TRACE("initialize led monitor...\r\n");
 
-    TimerHandle_t led_tmr = xTimerCreate("led_tmr", LED_MONITOR_INTERVAL, TRUE, NULL, vLedMonitor);
-    if (NULL == led_tmr)
-    {
-        TRACE("initialise led monitor failed!\r\n");
-        return FALSE;
-    }
-    xTimerStart(led_tmr, 0);
+    timewheel_timer_init(&led_timer, vLedMonitor, NULL);
+    timewheel_start_periodic(&led_timer, LED_MONITOR_INTERVAL);
 #ifdef __MASTER
-    TimerHandle_t ledwork_tmr = xTimerCreate("ledwork_tmr", LED_WORK_MONITOR_INTERVAL, TRUE, NULL,
-                                             vLedWorkMonitor);
-    if (NULL == ledwork_tmr)
-    {
-        TRACE("initialise led monitor failed!\r\n");
-        return FALSE;
-    }
-    xTimerStart(ledwork_tmr, 0);
+    timewheel_timer_init(&ledwork_timer, vLedWorkMonitor, NULL);
+    timewheel_start_periodic(&ledwork_timer, LED_WORK_MONITOR_INTERVAL);
 
-    xQueueLed = xQueueCreate(LED_QUEUE_SIZE, sizeof(led_status_t));
-    xTaskCreate(vLedProcess, "ledprocess", LED_PROCESS_STACK_SIZE, NULL,
-                LED_PROCESS_PRIORITY, NULL);
+    xQueueLed = xQueueCreateStatic(LED_QUEUE_SIZE, sizeof(led_status_t), led_queue_buf,
+                                   &led_queue);
+    xTaskCreateStatic(vLedProcess, "ledprocess", LED_PROCESS_STACK_SIZE, NULL,
+                      LED_PROCESS_PRIORITY, led_stack, &led_task);
 #endif
 
     return TRUE;
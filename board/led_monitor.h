@@ -14,7 +14,8 @@ BEGIN_DECLS
 
 bool led_monitor_init(void);
 #ifdef __MASTER
-void led_monitor_process(uint8_t id_board, uint16_t prev_status, uint16_t cur_status);
+void led_monitor_process(uint8_t id_board, uint16_t prev_status, uint16_t cur_status,
+                         uint32_t stamp);
 #endif
 
 END_DECLS
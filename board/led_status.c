@@ -9,6 +9,7 @@
 #include "led_status.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "cm3_core.h"
 #include "pinconfig.h"
 #include "boardmap.h"
@@ -17,6 +18,8 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[ledstatus]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_LED
 
 /** 0 means led on, 1 means led off */
 
@@ -109,7 +112,7 @@ uint16_t led_status_get(void)
  * @param floor - specified floor
  * @return floor led on/off status
  */
-bool is_led_on(uint8_t floor)
+bool is_led_on(floor_t floor)
 {
     uint8_t key = INVALID_KEY;
     uint16_t status = 0;
@@ -139,18 +142,16 @@ bool is_led_on(uint8_t floor)
  * @param[in] floor: floor to process
  * @return floot in boardmap index
  */
-static uint8_t get_floor_map_index(uint8_t floor)
+static uint8_t get_floor_map_index(floor_t floor)
 {
-    uint8_t start_floor, end_floor;
+    int16_t steps;
     uint8_t i = 0;
     for (; i < MAX_BOARD_NUM; ++i)
     {
-        if (0 != boardmaps[i].start_floor)
+        if (0 != boardmaps[i].id_board)
         {
-            start_floor = boardmaps[i].start_floor;
-            end_floor = boardmaps[i].start_floor + boardmaps[i].floor_num;
-
-            if ((floor >= start_floor) && (floor <= end_floor))
+            steps = floor_distance(boardmaps[i].start_floor, floor);
+            if ((steps >= 0) && (steps < boardmaps[i].floor_num))
             {
                 break;
             }
@@ -164,7 +165,7 @@ static uint8_t get_floor_map_index(uint8_t floor)
  * @param floor - specified floor
  * @return floor led on/off status
  */
-bool is_down_led_on(uint8_t floor)
+bool is_down_led_on(floor_t floor)
 {
     uint8_t index = get_floor_map_index(floor);
     if (index >= MAX_BOARD_NUM)
@@ -213,7 +214,7 @@ bool is_down_led_on(uint8_t floor)
  * @param floor - specified floor
  * @return floor led on/off status
  */
-bool is_up_led_on(uint8_t floor)
+bool is_up_led_on(floor_t floor)
 {
     uint8_t index = get_floor_map_index(floor);
     if (index >= MAX_BOARD_NUM)
@@ -225,6 +226,11 @@ bool is_up_led_on(uint8_t floor)
     uint16_t *pdata = led_status;
     for (uint8_t i = index; i < MAX_BOARD_NUM; ++i)
     {
+        if (0 == boardmaps[i].id_board)
+        {
+            /** empty board placed at end */
+            break;
+        }
         *pdata = boardmaps[i].led_status;
         if (ID_BOARD_MASTER == boardmaps[i].id_board)
         {
@@ -9,14 +9,15 @@
 #define _LED_STATUS_H_
 
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
 uint16_t led_status_get(void);
 #ifdef __MASTER
-bool is_led_on(uint8_t floor);
-bool is_down_led_on(uint8_t floor);
-bool is_up_led_on(uint8_t floor);
+bool is_led_on(floor_t floor);
+bool is_down_led_on(floor_t floor);
+bool is_up_led_on(floor_t floor);
 #endif
 
 END_DECLS
@@ -7,9 +7,11 @@
 */
 #include <string.h>
 #include "FreeRTOS.h"
-#include "timers.h"
+#include "task.h"
+#include "timewheel.h"
 #include "global.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "serial.h"
 #include "parameter.h"
 #include "stm32f10x_cfg.h"
@@ -20,9 +22,15 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[license]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_LICENSE
 
 #define LICENSE_MONITOR_INTERVAL     (60000 / portTICK_PERIOD_MS)
 #define DEFAULT_LICENSE_TIME         (30 * 24 * 60)
+/** encrypted run time snapshot interval, minutes, must be less than log size */
+#define LICENSE_SNAPSHOT_INTERVAL    60
+/** run time records loaded once at startup */
+#define LOG_READ_NUM                 8
 
 
 #if USE_SIMPLE_LICENSE
@@ -41,6 +49,10 @@ static uint8_t default_random[] = {0xde, 0xad, 0xbe, 0xef};
 static uint8_t random_key = 0xae;
 static uint8_t key[KEY_LEN];
 static uint8_t serial_number[KEY_LEN];
+/** run time log check seed, bound to serial number and license time */
+static uint16_t log_seed = 0;
+
+typedef char snapshot_interval_check_t[(LICENSE_SNAPSHOT_INTERVAL < RUN_TIME_LOG_NUM) ? 1 : -1];
 
 /**
  * @brief reorder data
@@ -263,6 +275,72 @@ bool decrypt_time(const uint8_t *pencrypt_time, const uint8_t *pserial, uint32_t
     return TRUE;
 }
 
+/**
+ * @brief update run time log seed, records of old license become invalid
+ */
+static void update_log_seed(void)
+{
+    uint16_t crc = crc16(serial_number, KEY_LEN);
+    log_seed = crc16_update(crc, (const uint8_t *)&total_time, sizeof(total_time));
+}
+
+/**
+ * @brief calculate run time record check value
+ * @param time - run time
+ * @return check value
+ */
+static uint16_t log_check(uint32_t time)
+{
+    return crc16_update(log_seed, (const uint8_t *)&time, sizeof(time));
+}
+
+/**
+ * @brief append current run time to log
+ */
+static void log_run_time(void)
+{
+    run_time_record_t record;
+    record.run_time = run_time;
+    record.check = log_check(run_time);
+    param_log_run_time(&record);
+}
+
+/**
+ * @brief restore run time from log, only records not older than snapshot and
+ *        within one log ring are accepted
+ */
+static void load_run_time_log(void)
+{
+    run_time_record_t records[LOG_READ_NUM];
+    uint32_t snapshot = run_time;
+    for (uint8_t index = 0; index < RUN_TIME_LOG_NUM; index += LOG_READ_NUM)
+    {
+        if (!param_load_run_time_log(index, LOG_READ_NUM, records))
+        {
+            break;
+        }
+
+        for (uint8_t i = 0; i < LOG_READ_NUM; ++i)
+        {
+            if ((records[i].run_time > run_time) &&
+                (records[i].run_time - snapshot < RUN_TIME_LOG_NUM) &&
+                (records[i].check == log_check(records[i].run_time)))
+            {
+                run_time = records[i].run_time;
+            }
+        }
+    }
+}
+
+/**
+ * @brief store encrypted run time snapshot
+ */
+static void license_snapshot(void)
+{
+    encrypt_time(run_time, serial_number, license.run_time);
+    param_set_license(&license);
+}
+
 /**
  * @brief set license
  * @param license - license number
@@ -283,6 +361,12 @@ bool license_set(const uint8_t *plicense)
             memcpy(license.license, plicense, KEY_LEN);
             encrypt_time(0, serial_number, license.run_time);
             param_set_license(&license);
+            /** take effect without reboot */
+            taskENTER_CRITICAL();
+            total_time = time;
+            run_time = 0;
+            update_log_seed();
+            taskEXIT_CRITICAL();
             ret = TRUE;
         }
     }
@@ -294,7 +378,13 @@ bool license_set(const uint8_t *plicense)
     return ret;
 }
 
-
+/**
+ * @brief store run time snapshot before shutdown
+ */
+void license_commit(void)
+{
+    license_snapshot();
+}
 
 void generate_serial_and_key(void)
 {
@@ -325,8 +415,11 @@ static void vLicense(void *pvParameters)
     }
 #else
     run_time ++;
-    encrypt_time(run_time, serial_number, license.run_time);
-    param_set_license(&license);
+    log_run_time();
+    if (0 == (run_time % LICENSE_SNAPSHOT_INTERVAL))
+    {
+        license_snapshot();
+    }
 
     if (run_time > total_time)
     {
@@ -343,12 +436,16 @@ static void vLicense(void *pvParameters)
         encrypt_time(run_time, serial_number, license.run_time);
 
         param_set_license(&license);
+        param_sync();
         vTaskDelay(1000 / portTICK_PERIOD_MS);
         SCB_SystemReset();
     }
 #endif
 }
 
+/* license monitor timer memory */
+static timewheel_timer_t license_timer;
+
 /**
  * @brief init license check
  */
@@ -380,6 +477,7 @@ bool license_init(void)
         encrypt_time(total_time, serial_number, license.license);
         encrypt_time(run_time, serial_number, license.run_time);
         param_set_license(&license);
+        update_log_seed();
         TRACE("time = %d-%d\r\n", run_time, total_time);
     }
     else
@@ -396,6 +494,8 @@ bool license_init(void)
             return FALSE;
         }
 
+        update_log_seed();
+        load_run_time_log();
         TRACE("time = %d-%d\r\n", run_time, total_time);
         if (run_time > total_time)
         {
@@ -405,13 +505,7 @@ bool license_init(void)
     }
 #endif
 
-    TimerHandle_t license_tmr = xTimerCreate("license_tmr", LICENSE_MONITOR_INTERVAL, TRUE, NULL,
-                                             vLicense);
-    if (NULL == license_tmr)
-    {
-        TRACE("initialise license system failed!\r\n");
-        return FALSE;
-    }
-    xTimerStart(license_tmr, 0);
+    timewheel_timer_init(&license_timer, vLicense, NULL);
+    timewheel_start_periodic(&license_timer, LICENSE_MONITOR_INTERVAL);
     return TRUE;
 }
@@ -14,6 +14,7 @@ BEGIN_DECLS
 
 bool license_init(void);
 bool license_set(const uint8_t *plicense);
+void license_commit(void);
 
 END_DECLS
 
@@ -0,0 +1,37 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "mailbox.h"
+
+/**
+ * @brief post value to task mailbox, unread value is overwritten
+ * @param task - receiving task
+ * @param value - value to post
+ * @return FALSE if receiving task is not created yet
+ */
+bool mailbox_post(TaskHandle_t task, uint32_t value)
+{
+    if (NULL == task)
+    {
+        return FALSE;
+    }
+
+    xTaskNotify(task, value, eSetValueWithOverwrite);
+    return TRUE;
+}
+
+/**
+ * @brief wait value posted to current task, value posted before waiting is
+ *        received immediately
+ * @param[out] value - value received
+ * @param timeout - wait timeout in ticks
+ * @return TRUE if value received
+ */
+bool mailbox_wait(uint32_t *value, TickType_t timeout)
+{
+    return (pdTRUE == xTaskNotifyWait(0, 0xffffffff, value, timeout));
+}
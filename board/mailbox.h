@@ -0,0 +1,31 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _MAILBOX_H_
+#define _MAILBOX_H_
+
+#include "types.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+BEGIN_DECLS
+
+/**
+ * single value mailbox built on task notification, newer value overwrites
+ * the unread one, so a mailbox carries one kind of value only. event which
+ * must not be lost, like an ack, needs its own semaphore instead of sharing
+ * the mailbox with a value.
+ * notification of receiving task is owned by mailbox, the task must not
+ * send segmented expand message, which waits flow control on its own
+ * notification. i2c and expand single frame send use their own semaphores.
+ */
+bool mailbox_post(TaskHandle_t task, uint32_t value);
+bool mailbox_wait(uint32_t *value, TickType_t timeout);
+
+END_DECLS
+
+#endif /* _MAILBOX_H_ */
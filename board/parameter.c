@@ -6,26 +6,75 @@
 * See the COPYING file for the terms of usage and distribution.
 */
 #include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timewheel.h"
 #include "parameter.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "fm24cl64.h"
 #include "dbgserial.h"
+#include "crc.h"
 
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[PARAM]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_PARAM
 
 #define FLAG_LEN                 4
+#define FM_CAPACITY              8192
 /* address and length */
 #define PARAM_START_ADDRESS      0
-#define PARAM_SETTED_FLAG        "AUTO"
+/** parameter stored without crc at start address */
+#define PARAM_SETTED_FLAG        "AUT1"
+/** parameter stored with 8-bit floor number */
+#define PARAM_LEGACY_FLAG        "AUTO"
 
 #if !USE_SIMPLE_LICENSE
 #define LICENSE_FLAG             "LIC0"
 #define LICENSE_START_ADDRESS    896
+/** run time log ring, record of minute n is stored at n % RUN_TIME_LOG_NUM */
+#define RUN_TIME_LOG_ADDRESS     4096
 #endif
 
+/** module trace levels */
+#define TRACE_LEVEL_FLAG         "TRC0"
+#define TRACE_LEVEL_ADDRESS      1536
+#define TRACE_LEVEL_MAX          64
+
+typedef struct
+{
+    uint8_t flag[FLAG_LEN];
+    uint8_t num;
+    uint8_t levels[TRACE_LEVEL_MAX];
+} trace_level_map_t;
+
+/** last fault record and fault count */
+#define FAULT_FLAG               "FLT0"
+#define FAULT_ADDRESS            1664
+
+typedef struct
+{
+    uint8_t flag[FLAG_LEN];
+    uint32_t count;
+    fault_record_t record;
+} fault_map_t;
+
+/** crc protected parameter slots, written alternately */
+#define PARAM_SLOT_FLAG          "PAR0"
+#define PARAM_SLOT_ADDRESS       2048
+#define PARAM_SLOT_NUM           2
+
+/** write behind delay, changes in this window are coalesced, ms */
+#define PARAM_WRITE_DELAY        500
+/** dirty spans tracked per region */
+#define DIRTY_SPAN_NUM           4
+/** spans closer than one write overhead(device and memory address) are merged */
+#define DIRTY_MERGE_GAP          3
+
 typedef struct
 {
     uint8_t flag[FLAG_LEN];
@@ -38,20 +87,510 @@ typedef struct
     license_t license;
 } license_map_t;
 
-static flash_map_t flash_map;
+/** slot header, both headers are stored together and read at once */
+typedef struct
+{
+    uint8_t flag[FLAG_LEN];
+    uint32_t generation;
+    uint16_t length;
+    uint8_t setted;
+    uint8_t reserved;
+    /** crc of header fields above and slot parameters */
+    uint16_t crc;
+} slot_header_t;
+
+#define SLOT_HEADER_ADDRESS(slot) (PARAM_SLOT_ADDRESS + (slot) * sizeof(slot_header_t))
+#define SLOT_DATA_ADDRESS(slot)   (PARAM_SLOT_ADDRESS + PARAM_SLOT_NUM * sizeof(slot_header_t) + \
+                                   (slot) * sizeof(parameters_t))
+
+/** slots must fit in fram, reduce board or floor capacity if failed */
+typedef char slot_size_check_t[(SLOT_DATA_ADDRESS(PARAM_SLOT_NUM) <= FM_CAPACITY) ? 1 : -1];
+
+#ifdef __MASTER
+typedef struct
+{
+    uint8_t floor;
+    uint16_t height;
+} legacy_floor_height_t;
+
+typedef struct
+{
+    uint8_t flag[FLAG_LEN];
+    uint8_t id_ctl;
+    uint8_t id_elev;
+    uint8_t id_board;
+    uint8_t start_floor;
+    uint8_t total_floor;
+    uint16_t threshold;
+    uint8_t calc_type;
+    uint8_t opendoor_polar;
+    uint8_t bt_name[BT_NAME_MAX_LEN + 1];
+    uint8_t pwd_window;
+    uint8_t pwd[PARAM_PWD_LEN];
+    /** only used to locate floor height table */
+    legacy_floor_height_t floor_height[1];
+} legacy_flash_map_t;
+#define LEGACY_FLOOR_NUM         96
+#define LEGACY_READ_NUM          8
+#else
+typedef struct
+{
+    uint8_t flag[FLAG_LEN];
+    uint8_t id_board;
+    uint8_t start_floor;
+} legacy_flash_map_t;
+#endif
+
+#ifdef __MASTER
+#define REGISTRY_FLAG            "REG0"
+#define REGISTRY_START_ADDRESS   1024
+
+typedef struct
+{
+    uint8_t flag[FLAG_LEN];
+    uint8_t num;
+    board_record_t records[MAX_BOARD_NUM];
+} registry_map_t;
+
+/** registry must not overlap parameter */
+typedef char registry_size_check_t[(sizeof(flash_map_t) <= REGISTRY_START_ADDRESS) ? 1 : -1];
+typedef char registry_slot_check_t[(REGISTRY_START_ADDRESS + sizeof(registry_map_t) <=
+                                    TRACE_LEVEL_ADDRESS) ? 1 : -1];
+#endif
+
+#if !USE_SIMPLE_LICENSE
+/** parameter must not overlap license, reduce board or floor capacity if failed */
+typedef char param_size_check_t[(sizeof(flash_map_t) <= LICENSE_START_ADDRESS) ? 1 : -1];
+/** run time log must not overlap parameter slots */
+typedef char run_time_log_check_t[((SLOT_DATA_ADDRESS(PARAM_SLOT_NUM) <= RUN_TIME_LOG_ADDRESS) &&
+                                   (RUN_TIME_LOG_ADDRESS + RUN_TIME_LOG_NUM * sizeof(run_time_record_t)
+                                    <= FM_CAPACITY)) ? 1 : -1];
+#endif
+
+/** trace levels must not overlap fault record */
+typedef char trace_level_check_t[(TRACE_LEVEL_ADDRESS + sizeof(trace_level_map_t) <=
+                                  FAULT_ADDRESS) ? 1 : -1];
+/** fault record must not overlap parameter slots */
+typedef char fault_check_t[(FAULT_ADDRESS + sizeof(fault_map_t) <= PARAM_SLOT_ADDRESS) ? 1 : -1];
+
+/* dirty byte span, [start, end) */
+typedef struct
+{
+    uint16_t start;
+    uint16_t end;
+} dirty_span_t;
+
+/* fram copy of a cached area */
+typedef struct
+{
+    uint16_t address;
+    uint8_t span_num;
+    dirty_span_t spans[DIRTY_SPAN_NUM];
+} param_copy_t;
+
+/* fram area cached in ram */
+typedef struct
+{
+    uint8_t *cache;
+    uint8_t copy_num;
+    param_copy_t *copies;
+    /** changed since last commit */
+    bool pending;
+} param_region_t;
+
+static parameters_t parameters;
 static license_map_t license_map;
 
+static param_copy_t param_copies[PARAM_SLOT_NUM] =
+{
+    {.address = SLOT_DATA_ADDRESS(0)},
+    {.address = SLOT_DATA_ADDRESS(1)},
+};
+static param_region_t param_region = {(uint8_t *)&parameters, PARAM_SLOT_NUM, param_copies, FALSE};
+#if !USE_SIMPLE_LICENSE
+static param_copy_t license_copy = {.address = LICENSE_START_ADDRESS};
+static param_region_t license_region = {(uint8_t *)&license_map, 1, &license_copy, FALSE};
+#endif
+
+/** slot holding the newest parameters */
+static uint8_t active_slot = 0;
+static uint32_t generation = 0;
+
+static xSemaphoreHandle xParamMutex = NULL;
+static StaticSemaphore_t param_mutex;
+static timewheel_timer_t write_timer;
+
 static bool param_setted = FALSE;
 static bool license_setted = FALSE;
 
+/**
+ * @brief lock parameter cache, no lock needed before scheduler started
+ */
+static void param_lock(void)
+{
+    if (taskSCHEDULER_RUNNING == xTaskGetSchedulerState())
+    {
+        xSemaphoreTake(xParamMutex, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief unlock parameter cache
+ */
+static void param_unlock(void)
+{
+    if (taskSCHEDULER_RUNNING == xTaskGetSchedulerState())
+    {
+        xSemaphoreGive(xParamMutex);
+    }
+}
+
+/**
+ * @brief mark copy bytes dirty, nearby spans are coalesced
+ * @param copy - fram copy
+ * @param start - start offset
+ * @param end - end offset, not included
+ */
+static void param_mark_dirty(param_copy_t *copy, uint16_t start, uint16_t end)
+{
+    for (uint8_t i = 0; i < copy->span_num;)
+    {
+        dirty_span_t *span = &copy->spans[i];
+        if ((start <= span->end + DIRTY_MERGE_GAP) &&
+            (span->start <= end + DIRTY_MERGE_GAP))
+        {
+            start = MIN(start, span->start);
+            end = MAX(end, span->end);
+            copy->span_num --;
+            copy->spans[i] = copy->spans[copy->span_num];
+        }
+        else
+        {
+            i ++;
+        }
+    }
+
+    if (DIRTY_SPAN_NUM == copy->span_num)
+    {
+        /** span table full, merge with the nearest span */
+        uint8_t nearest = 0;
+        uint16_t min_gap = 0xffff;
+        for (uint8_t i = 0; i < copy->span_num; ++i)
+        {
+            const dirty_span_t *span = &copy->spans[i];
+            uint16_t gap = (span->start >= end) ? (span->start - end) :
+                           (start - span->end);
+            if (gap < min_gap)
+            {
+                min_gap = gap;
+                nearest = i;
+            }
+        }
+        start = MIN(start, copy->spans[nearest].start);
+        end = MAX(end, copy->spans[nearest].end);
+        copy->span_num --;
+        copy->spans[nearest] = copy->spans[copy->span_num];
+        /** merged span may cover other spans */
+        param_mark_dirty(copy, start, end);
+        return;
+    }
+
+    copy->spans[copy->span_num].start = start;
+    copy->spans[copy->span_num].end = end;
+    copy->span_num ++;
+}
+
+/**
+ * @brief update region cache, only changed bytes are marked dirty
+ * @param region - cached region
+ * @param offset - offset in region
+ * @param data - new data
+ * @param len - data length
+ */
+static void param_update(param_region_t *region, uint16_t offset,
+                         const void *data, uint16_t len)
+{
+    const uint8_t *pdata = (const uint8_t *)data;
+    uint8_t *cache = region->cache + offset;
+    uint16_t i = 0;
+
+    param_lock();
+    while (i < len)
+    {
+        if (cache[i] == pdata[i])
+        {
+            i ++;
+            continue;
+        }
+
+        uint16_t start = i;
+        while ((i < len) && (cache[i] != pdata[i]))
+        {
+            cache[i] = pdata[i];
+            i ++;
+        }
+        for (uint8_t j = 0; j < region->copy_num; ++j)
+        {
+            param_mark_dirty(&region->copies[j], offset + start, offset + i);
+        }
+        region->pending = TRUE;
+    }
+    bool pending = region->pending;
+    param_unlock();
+
+    if (pending)
+    {
+        timewheel_start_once(&write_timer, PARAM_WRITE_DELAY / portTICK_PERIOD_MS);
+    }
+}
+
+/**
+ * @brief write dirty spans of copy to fram
+ * @param copy - fram copy
+ * @param cache - cached data
+ * @return write status, failed spans are kept for retry
+ */
+static bool param_flush(param_copy_t *copy, const uint8_t *cache)
+{
+    while (copy->span_num > 0)
+    {
+        const dirty_span_t *span = &copy->spans[copy->span_num - 1];
+        if (!fm_write(copy->address + span->start, cache + span->start,
+                      span->end - span->start))
+        {
+            return FALSE;
+        }
+        copy->span_num --;
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief calculate slot crc
+ * @param header - slot header
+ * @param param - slot parameters
+ * @return crc value
+ */
+static uint16_t param_slot_crc(const slot_header_t *header, const parameters_t *param)
+{
+    uint16_t crc = crc16_update(0xffff, (const uint8_t *)header,
+                                OFFSET_OF(slot_header_t, crc));
+    return crc16_update(crc, (const uint8_t *)param, sizeof(parameters_t));
+}
+
+/**
+ * @brief commit parameters to inactive slot, header is written last so an
+ *        interrupted commit leaves the active slot untouched
+ * @return commit status
+ */
+static bool param_commit(void)
+{
+    if (!param_region.pending)
+    {
+        return TRUE;
+    }
+
+    uint8_t slot = (active_slot + 1) % PARAM_SLOT_NUM;
+    if (!param_flush(&param_copies[slot], param_region.cache))
+    {
+        return FALSE;
+    }
+
+    slot_header_t header;
+    memcpy(header.flag, PARAM_SLOT_FLAG, FLAG_LEN);
+    header.generation = generation + 1;
+    header.length = sizeof(parameters_t);
+    header.setted = param_setted;
+    header.reserved = 0;
+    header.crc = param_slot_crc(&header, &parameters);
+    if (!fm_write(SLOT_HEADER_ADDRESS(slot), (uint8_t *)&header, sizeof(slot_header_t)))
+    {
+        return FALSE;
+    }
+
+    TRACE("commit slot %d, generation %d\r\n", slot, header.generation);
+    active_slot = slot;
+    generation = header.generation;
+    param_region.pending = FALSE;
+    return TRUE;
+}
+
+/**
+ * @brief write behind timer
+ * @param pvParameters - timer parameter
+ */
+static void vParamWrite(void *pvParameters)
+{
+    if (!param_sync())
+    {
+        TRACE("write behind failed, retry later\r\n");
+        timewheel_start_once(&write_timer, PARAM_WRITE_DELAY / portTICK_PERIOD_MS);
+    }
+}
+
+/**
+ * @brief write all pending parameter changes to fram
+ * @return write status
+ */
+bool param_sync(void)
+{
+    param_lock();
+    bool ret = param_commit();
+#if !USE_SIMPLE_LICENSE
+    ret = param_flush(&license_copy, license_region.cache) && ret;
+#endif
+    param_unlock();
+
+    return ret;
+}
+
+/**
+ * @brief mark whole copy dirty, used when fram content is unknown
+ * @param copy - fram copy
+ */
+static __INLINE void param_invalidate_copy(param_copy_t *copy)
+{
+    copy->span_num = 0;
+    param_mark_dirty(copy, 0, sizeof(parameters_t));
+}
+
 /**
  * @brief reset parameter
  */
 void reset_param(void)
 {
-    uint8_t status[FLAG_LEN];
-    memset(status, 0xff, FLAG_LEN);
-    fm_write(PARAM_START_ADDRESS, status, FLAG_LEN);
+    uint8_t status[PARAM_SLOT_NUM * sizeof(slot_header_t)];
+    memset(status, 0xff, sizeof(status));
+    param_lock();
+    param_setted = FALSE;
+    fm_write(SLOT_HEADER_ADDRESS(0), status, sizeof(status));
+    param_unlock();
+}
+
+/**
+ * @brief convert parameter stored with 8-bit floor number
+ * @return convert status
+ */
+static bool param_migrate_legacy(void)
+{
+    legacy_flash_map_t legacy;
+    parameters_t *param = &parameters;
+    TRACE("migrate legacy parameter...\r\n");
+    if (!fm_read(PARAM_START_ADDRESS, (uint8_t *)&legacy, sizeof(legacy_flash_map_t)))
+    {
+        return FALSE;
+    }
+
+    memset(param, 0, sizeof(parameters_t));
+    param->id_board = legacy.id_board;
+    /** start floor was signed in expand protocol */
+    param->start_floor = (int8_t)legacy.start_floor;
+    /** not set, default bitrate used */
+    param->can_bitrate = 0xff;
+#ifdef __MASTER
+    param->id_ctl = legacy.id_ctl;
+    param->id_elev = legacy.id_elev;
+    param->total_floor = legacy.total_floor;
+    param->threshold = legacy.threshold;
+    param->calc_type = legacy.calc_type;
+    param->opendoor_polar = legacy.opendoor_polar;
+    memcpy(param->bt_name, legacy.bt_name, BT_NAME_MAX_LEN + 1);
+    param->pwd_window = legacy.pwd_window;
+    memcpy(param->pwd, legacy.pwd, PARAM_PWD_LEN);
+
+    legacy_floor_height_t floor_height[LEGACY_READ_NUM];
+    uint16_t addr = PARAM_START_ADDRESS + OFFSET_OF(legacy_flash_map_t, floor_height);
+    for (uint16_t i = 0; i < LEGACY_FLOOR_NUM; i += LEGACY_READ_NUM)
+    {
+        if (!fm_read(addr, (uint8_t *)floor_height, sizeof(floor_height)))
+        {
+            return FALSE;
+        }
+        addr += sizeof(floor_height);
+
+        for (uint16_t j = 0; (j < LEGACY_READ_NUM) && (i + j < MAX_TOTAL_FLOOR_NUM); ++j)
+        {
+            param->floor_height[i + j].floor = floor_height[j].floor;
+            param->floor_height[i + j].height = floor_height[j].height;
+        }
+    }
+#endif
+
+    return TRUE;
+}
+
+/**
+ * @brief load newest valid slot
+ * @param headers - slot headers
+ * @return TRUE if valid slot found
+ */
+static bool param_load_slot(const slot_header_t *headers)
+{
+    bool valid[PARAM_SLOT_NUM];
+    for (uint8_t i = 0; i < PARAM_SLOT_NUM; ++i)
+    {
+        valid[i] = (0 == memcmp(headers[i].flag, PARAM_SLOT_FLAG, FLAG_LEN)) &&
+                   (sizeof(parameters_t) == headers[i].length);
+    }
+
+    /** newest first, fall back to the other if crc mismatch */
+    uint8_t first = 0;
+    if (valid[0] && valid[1])
+    {
+        first = ((int32_t)(headers[1].generation - headers[0].generation) > 0) ? 1 : 0;
+    }
+    else if (valid[1])
+    {
+        first = 1;
+    }
+
+    for (uint8_t i = 0; i < PARAM_SLOT_NUM; ++i)
+    {
+        uint8_t slot = (first + i) % PARAM_SLOT_NUM;
+        if (!valid[slot] ||
+            !fm_read(SLOT_DATA_ADDRESS(slot), (uint8_t *)&parameters, sizeof(parameters_t)))
+        {
+            continue;
+        }
+
+        if (param_slot_crc(&headers[slot], &parameters) == headers[slot].crc)
+        {
+            TRACE("load slot %d, generation %d\r\n", slot, headers[slot].generation);
+            active_slot = slot;
+            generation = headers[slot].generation;
+            param_setted = (0 != headers[slot].setted);
+            return TRUE;
+        }
+        TRACE("slot %d crc mismatch\r\n", slot);
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief load parameter stored before slots existed
+ * @return TRUE if parameter found
+ */
+static bool param_load_legacy(void)
+{
+    uint8_t flag[FLAG_LEN];
+    if (!fm_read(PARAM_START_ADDRESS, flag, FLAG_LEN))
+    {
+        return FALSE;
+    }
+
+    if (0 == memcmp(flag, PARAM_SETTED_FLAG, FLAG_LEN))
+    {
+        return fm_read(PARAM_START_ADDRESS + OFFSET_OF(flash_map_t, parameters),
+                       (uint8_t *)&parameters, sizeof(parameters_t));
+    }
+    else if (0 == memcmp(flag, PARAM_LEGACY_FLAG, FLAG_LEN))
+    {
+        return param_migrate_legacy();
+    }
+
+    return FALSE;
 }
 
 /**
@@ -61,13 +600,47 @@ void reset_param(void)
 bool param_init(void)
 {
     TRACE("initialize parameter...\r\n");
+    xParamMutex = xSemaphoreCreateMutexStatic(&param_mutex);
+    timewheel_timer_init(&write_timer, vParamWrite, NULL);
+    if (NULL == xParamMutex)
+    {
+        return FALSE;
+    }
+
     if (fm_init())
     {
-        if (!fm_read(PARAM_START_ADDRESS, (uint8_t *)&flash_map, sizeof(flash_map_t)))
+        slot_header_t headers[PARAM_SLOT_NUM];
+        if (!fm_read(SLOT_HEADER_ADDRESS(0), (uint8_t *)headers, sizeof(headers)))
         {
             return FALSE;
         }
-        param_setted = (0 == memcmp(flash_map.flag, PARAM_SETTED_FLAG, FLAG_LEN));
+
+        if (param_load_slot(headers))
+        {
+            /** inactive slot content is older, rewrite it on first commit */
+            param_invalidate_copy(&param_copies[(active_slot + 1) % PARAM_SLOT_NUM]);
+        }
+        else
+        {
+            param_invalidate_copy(&param_copies[0]);
+            param_invalidate_copy(&param_copies[1]);
+            if (param_load_legacy())
+            {
+                /** move to slot then drop legacy flag */
+                param_setted = TRUE;
+                param_region.pending = TRUE;
+                if (param_sync())
+                {
+                    uint8_t status[FLAG_LEN];
+                    memset(status, 0xff, FLAG_LEN);
+                    fm_write(PARAM_START_ADDRESS, status, FLAG_LEN);
+                }
+            }
+            else
+            {
+                memset(&parameters, 0xff, sizeof(parameters_t));
+            }
+        }
 
         if (!fm_read(LICENSE_START_ADDRESS, (uint8_t *)&license_map, sizeof(license_map_t)))
         {
@@ -75,7 +648,7 @@ bool param_init(void)
         }
         license_setted = (0 == memcmp(license_map.flag, LICENSE_FLAG, FLAG_LEN));
 #ifdef __MASTER
-        flash_map.parameters.bt_name[BT_NAME_MAX_LEN] = '\0';
+        parameters.bt_name[BT_NAME_MAX_LEN] = '\0';
 #endif
         TRACE("parameter status(%d)\r\n", param_setted);
         return TRUE;
@@ -94,15 +667,33 @@ bool is_param_setted(void)
 }
 
 /**
- * @brief sotr parameter
+ * @brief store parameter, only changed bytes are written after write behind
+ *        delay, use param_sync to write immediately
  * @param param - parameter to store
  * @return store status
  */
 bool param_store(const parameters_t *param)
 {
-    memcpy(flash_map.flag, PARAM_SETTED_FLAG, FLAG_LEN);
-    flash_map.parameters = *param;
-    return fm_write(PARAM_START_ADDRESS, (uint8_t *)&flash_map, sizeof(flash_map_t));
+    param_lock();
+    if (!param_setted)
+    {
+        param_setted = TRUE;
+        param_region.pending = TRUE;
+    }
+    param_unlock();
+    param_update(&param_region, 0, param, sizeof(parameters_t));
+    return TRUE;
+}
+
+/**
+ * @brief store expand bus bitrate
+ * @param bitrate - bitrate index
+ * @return store status
+ */
+bool param_store_can_bitrate(uint8_t bitrate)
+{
+    param_update(&param_region, OFFSET_OF(parameters_t, can_bitrate), &bitrate, 1);
+    return TRUE;
 }
 
 #ifdef __MASTER
@@ -115,31 +706,190 @@ bool param_store(const parameters_t *param)
 bool param_store_pwd(uint8_t interval, uint8_t *pwd)
 {
     uint8_t buf[PARAM_PWD_LEN + 1] = {interval, pwd[0], pwd[1], pwd[2], pwd[3]};
-    uint32_t offset = OFFSET_OF(flash_map_t, parameters.pwd_window);
-    return fm_write(PARAM_START_ADDRESS + offset, buf, PARAM_PWD_LEN + 1);
+    param_update(&param_region, OFFSET_OF(parameters_t, pwd_window),
+                 buf, PARAM_PWD_LEN + 1);
+    return TRUE;
 }
 
-bool param_store_floor_height(uint8_t len, const floor_height_t *floor_height)
+/**
+ * @brief store floor height table
+ * @param len - floor number
+ * @param floor_height - floor height table
+ * @return store status
+ */
+bool param_store_floor_height(uint16_t len, const floor_height_t *floor_height)
 {
-    uint32_t offset = OFFSET_OF(flash_map_t, parameters.floor_height);
-    return fm_write(PARAM_START_ADDRESS + offset, (uint8_t *)floor_height,
-                    sizeof(floor_height_t) * len);
+    assert_param(len <= MAX_TOTAL_FLOOR_NUM);
+    param_update(&param_region, OFFSET_OF(parameters_t, floor_height),
+                 floor_height, sizeof(floor_height_t) * len);
+    return TRUE;
 }
 
+/**
+ * @brief store bluetooth name
+ * @param len - name length
+ * @param name - bluetooth name
+ * @return store status
+ */
 bool param_store_bt_name(uint8_t len, const uint8_t *name)
 {
     uint8_t bt_name[BT_NAME_MAX_LEN + 1];
     memset(bt_name, 0, BT_NAME_MAX_LEN + 1);
     memcpy(bt_name, name, len);
-    uint32_t offset = OFFSET_OF(flash_map_t, parameters.bt_name);
-    return fm_write(PARAM_START_ADDRESS + offset, bt_name, len + 1);
+    param_update(&param_region, OFFSET_OF(parameters_t, bt_name),
+                 bt_name, len + 1);
+    return TRUE;
+}
+
+/**
+ * @brief store registered expand boards
+ * @param num - board number
+ * @param records - registered boards
+ * @return store status
+ */
+bool param_store_registry(uint8_t num, const board_record_t *records)
+{
+    registry_map_t registry;
+    if (num > MAX_BOARD_NUM)
+    {
+        num = MAX_BOARD_NUM;
+    }
+
+    memcpy(registry.flag, REGISTRY_FLAG, FLAG_LEN);
+    registry.num = num;
+    memcpy(registry.records, records, num * sizeof(board_record_t));
+    return fm_write(REGISTRY_START_ADDRESS, (uint8_t *)&registry,
+                    OFFSET_OF(registry_map_t, records) + num * sizeof(board_record_t));
+}
+
+/**
+ * @brief load registered expand boards
+ * @param max - max board number to load
+ * @param[out] records - registered boards
+ * @return board number
+ */
+uint8_t param_load_registry(uint8_t max, board_record_t *records)
+{
+    registry_map_t registry;
+    if (!fm_read(REGISTRY_START_ADDRESS, (uint8_t *)&registry, sizeof(registry_map_t)) ||
+        (0 != memcmp(registry.flag, REGISTRY_FLAG, FLAG_LEN)))
+    {
+        return 0;
+    }
+
+    uint8_t num = registry.num;
+    if (num > MAX_BOARD_NUM)
+    {
+        num = 0;
+    }
+    if (num > max)
+    {
+        num = max;
+    }
+    memcpy(records, registry.records, num * sizeof(board_record_t));
+
+    return num;
 }
 
 #endif
 
+/**
+ * @brief store module trace levels
+ * @param num - module number
+ * @param levels - module levels
+ * @return store status
+ */
+bool param_store_trace_levels(uint8_t num, const uint8_t *levels)
+{
+    trace_level_map_t map;
+    if (num > TRACE_LEVEL_MAX)
+    {
+        num = TRACE_LEVEL_MAX;
+    }
+
+    memcpy(map.flag, TRACE_LEVEL_FLAG, FLAG_LEN);
+    map.num = num;
+    memcpy(map.levels, levels, num);
+    return fm_write(TRACE_LEVEL_ADDRESS, (uint8_t *)&map,
+                    OFFSET_OF(trace_level_map_t, levels) + num);
+}
+
+/**
+ * @brief load module trace levels
+ * @param max - max module number to load
+ * @param[out] levels - module levels
+ * @return module number, 0 if not stored
+ */
+uint8_t param_load_trace_levels(uint8_t max, uint8_t *levels)
+{
+    trace_level_map_t map;
+    if (!fm_read(TRACE_LEVEL_ADDRESS, (uint8_t *)&map, sizeof(trace_level_map_t)) ||
+        (0 != memcmp(map.flag, TRACE_LEVEL_FLAG, FLAG_LEN)) ||
+        (map.num > TRACE_LEVEL_MAX))
+    {
+        return 0;
+    }
+
+    uint8_t num = (map.num < max) ? map.num : max;
+    memcpy(levels, map.levels, num);
+    return num;
+}
+
+/**
+ * @brief store fault record, fault count is increased
+ * @param record - fault record
+ * @return store status
+ */
+bool param_store_fault(const fault_record_t *record)
+{
+    fault_map_t map;
+    if (!fm_read(FAULT_ADDRESS, (uint8_t *)&map, OFFSET_OF(fault_map_t, record)) ||
+        (0 != memcmp(map.flag, FAULT_FLAG, FLAG_LEN)))
+    {
+        map.count = 0;
+    }
+
+    memcpy(map.flag, FAULT_FLAG, FLAG_LEN);
+    map.count++;
+    map.record = *record;
+    return fm_write(FAULT_ADDRESS, (uint8_t *)&map, sizeof(fault_map_t));
+}
+
+/**
+ * @brief load last fault record
+ * @param[out] count - fault count since cleared
+ * @param[out] record - last fault record
+ * @return FALSE if no fault stored
+ */
+bool param_load_fault(uint32_t *count, fault_record_t *record)
+{
+    fault_map_t map;
+    if (!fm_read(FAULT_ADDRESS, (uint8_t *)&map, sizeof(fault_map_t)) ||
+        (0 != memcmp(map.flag, FAULT_FLAG, FLAG_LEN)) ||
+        (0 == map.count))
+    {
+        return FALSE;
+    }
+
+    *count = map.count;
+    *record = map.record;
+    return TRUE;
+}
+
+/**
+ * @brief clear fault record and fault count
+ * @return clear status
+ */
+bool param_clear_fault(void)
+{
+    uint8_t status[FLAG_LEN];
+    memset(status, 0xff, FLAG_LEN);
+    return fm_write(FAULT_ADDRESS, status, FLAG_LEN);
+}
+
 parameters_t param_get(void)
 {
-    return flash_map.parameters;
+    return parameters;
 }
 
 #if !USE_SIMPLE_LICENSE
@@ -150,7 +900,8 @@ void reset_license(void)
 {
     uint8_t status[FLAG_LEN];
     memset(status, 0xff, FLAG_LEN);
-    fm_write(LICENSE_START_ADDRESS, status, FLAG_LEN);
+    param_update(&license_region, 0, status, FLAG_LEN);
+    param_sync();
 }
 
 bool param_has_license(void)
@@ -163,11 +914,43 @@ license_t param_get_license(void)
     return license_map.license;
 }
 
+/**
+ * @brief set license, usually only run time changed
+ * @param license - license to store
+ * @return store status
+ */
 bool param_set_license(const license_t *license)
 {
-    memcpy(license_map.flag, LICENSE_FLAG, FLAG_LEN);
-    license_map.license = *license;
-    return fm_write(LICENSE_START_ADDRESS, (uint8_t *)&license_map, sizeof(license_map_t));
+    param_update(&license_region, 0, LICENSE_FLAG, FLAG_LEN);
+    param_update(&license_region, OFFSET_OF(license_map_t, license), license,
+                 sizeof(license_t));
+    return TRUE;
+}
+
+/**
+ * @brief append run time record to log ring, written immediately
+ * @param record - run time record
+ * @return write status
+ */
+bool param_log_run_time(const run_time_record_t *record)
+{
+    uint16_t index = (uint16_t)(record->run_time % RUN_TIME_LOG_NUM);
+    return fm_write(RUN_TIME_LOG_ADDRESS + index * sizeof(run_time_record_t),
+                    (const uint8_t *)record, sizeof(run_time_record_t));
+}
+
+/**
+ * @brief load run time records from log ring
+ * @param index - first record index
+ * @param num - record number
+ * @param[out] records - loaded records
+ * @return read status
+ */
+bool param_load_run_time_log(uint8_t index, uint8_t num, run_time_record_t *records)
+{
+    assert_param(index + num <= RUN_TIME_LOG_NUM);
+    return fm_read(RUN_TIME_LOG_ADDRESS + index * sizeof(run_time_record_t),
+                   (uint8_t *)records, num * sizeof(run_time_record_t));
 }
 #endif
 
@@ -176,14 +959,7 @@ bool param_set_license(const license_t *license)
  */
 void param_dump(void)
 {
-    TRACE("flash data: ");
-    uint8_t *data = (uint8_t *)&flash_map;
-    for (int i = 0; i < sizeof(flash_map_t); ++i)
-    {
-        dbg_putchar("0123456789abcdef"[data[i] >> 4]);
-        dbg_putchar("0123456789abcdef"[data[i] & 0x0f]);
-        dbg_putchar(' ');
-    }
-    dbg_putchar('\r');
-    dbg_putchar('\n');
+    TRACE("slot %d generation %d: ", active_slot, generation);
+    uint8_t *data = (uint8_t *)&parameters;
+    dbg_dump(data, sizeof(parameters_t));
 }
@@ -26,10 +26,58 @@ typedef struct
     uint8_t random[4];
 } license_t;
 
+/** run time log record, value is minutes */
+#pragma pack(1)
+typedef struct
+{
+    uint32_t run_time;
+    uint16_t check;
+} run_time_record_t;
+#pragma pack()
+
+/** run time log ring size */
+#define RUN_TIME_LOG_NUM        64
+
+#define FAULT_TASK_NAME_LEN     16
+#define FAULT_STACK_NUM         8
+
+/** fault captured by exception handler */
+#pragma pack(1)
+typedef struct
+{
+    uint32_t exc_return;
+    uint32_t sp;
+    /* stacked frame */
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r2;
+    uint32_t r3;
+    uint32_t r12;
+    uint32_t lr;
+    uint32_t pc;
+    uint32_t xpsr;
+    /* fault status */
+    uint32_t cfsr;
+    uint32_t hfsr;
+    uint32_t mmfar;
+    uint32_t bfar;
+    /* words above stacked frame */
+    uint32_t stack[FAULT_STACK_NUM];
+    uint8_t exception;
+    uint8_t task[FAULT_TASK_NAME_LEN];
+} fault_record_t;
+#pragma pack()
+
+/**
+ * parameters_t layout version, parameter image is transferred in memory
+ * layout, bump when fields change
+ */
+#define PARAM_LAYOUT_VERSION    1
+
 #ifdef __MASTER
 typedef struct
 {
-    uint8_t floor;
+    floor_t floor;
     uint16_t height;
 } floor_height_t;
 
@@ -38,21 +86,30 @@ typedef struct
     uint8_t id_ctl;
     uint8_t id_elev;
     uint8_t id_board; /** fixed to 0x01 */
-    uint8_t start_floor;
-    uint8_t total_floor;
+    floor_t start_floor;
+    uint16_t total_floor;
     uint16_t threshold;
     uint8_t calc_type;
     uint8_t opendoor_polar;
     uint8_t bt_name[BT_NAME_MAX_LEN + 1];
     uint8_t pwd_window;
     uint8_t pwd[PARAM_PWD_LEN];
-    floor_height_t floor_height[MAX_FLOOR_NUM + MAX_EXPAND_FLOOR_NUM * (MAX_BOARD_NUM - 1)];
+    floor_height_t floor_height[MAX_TOTAL_FLOOR_NUM];
+    uint8_t can_bitrate;
 } parameters_t;
+
+/** registered expand board */
+typedef struct
+{
+    uint8_t id_board;
+    floor_t start_floor;
+} board_record_t;
 #else
 typedef struct
 {
     uint8_t id_board; /** valid range is 0x02-0xff */
-    uint8_t start_floor;
+    floor_t start_floor;
+    uint8_t can_bitrate;
 } parameters_t;
 #endif
 
@@ -60,17 +117,28 @@ bool param_init(void);
 void reset_param(void);
 bool is_param_setted(void);
 bool param_store(const parameters_t *param);
+bool param_sync(void);
+bool param_store_can_bitrate(uint8_t bitrate);
 #ifdef __MASTER
 bool param_store_pwd(uint8_t interval, uint8_t *pwd);
-bool param_store_floor_height(uint8_t len, const floor_height_t *floor_height);
+bool param_store_floor_height(uint16_t len, const floor_height_t *floor_height);
 bool param_store_bt_name(uint8_t len, const uint8_t *name);
+bool param_store_registry(uint8_t num, const board_record_t *records);
+uint8_t param_load_registry(uint8_t max, board_record_t *records);
 #endif
 #if !USE_SIMPLE_LICENSE
 void reset_license(void);
 bool param_has_license(void);
 license_t param_get_license(void);
 bool param_set_license(const license_t *license);
+bool param_log_run_time(const run_time_record_t *record);
+bool param_load_run_time_log(uint8_t index, uint8_t num, run_time_record_t *records);
 #endif
+bool param_store_trace_levels(uint8_t num, const uint8_t *levels);
+uint8_t param_load_trace_levels(uint8_t max, uint8_t *levels);
+bool param_store_fault(const fault_record_t *record);
+bool param_load_fault(uint32_t *count, fault_record_t *record);
+bool param_clear_fault(void);
 parameters_t param_get(void);
 void param_dump(void);
 
@@ -72,6 +72,7 @@ PIN_CONFIG pins[] =
 PIN_CLOCK pin_clocks[] =
 {
     {AHB, RCC_AHB_ENABLE_CRC, RCC_AHB_ENABLE_CRC},
+    {AHB, RCC_AHB_ENABLE_DMA1, RCC_AHB_ENABLE_DMA1},
     {APB2, RCC_APB2_RESET_AFIO, RCC_APB2_ENABLE_AFIO},
     {APB2, RCC_APB2_RESET_IOPA, RCC_APB2_ENABLE_IOPA},
     {APB2, RCC_APB2_RESET_IOPB, RCC_APB2_ENABLE_IOPB},
@@ -84,6 +85,7 @@ PIN_CLOCK pin_clocks[] =
     {APB1, RCC_APB1_RESET_UART5, RCC_APB1_ENABLE_UART5},
     {APB1, RCC_APB1_RESET_TIM2, RCC_APB1_ENABLE_TIM2},
     {APB1, RCC_APB1_RESET_CAN, RCC_APB1_ENABLE_CAN},
+    {APB1, RCC_APB1_RESET_I2C1, RCC_APB1_ENABLE_I2C1},
 };
 
 /**
@@ -195,6 +197,19 @@ bool is_pinset(const char *name)
     return (GPIO_ReadPin(config->group, config->config.pin) != 0);
 }
 
+/**
+ * @brief change pin mode
+ * @param name - pin name
+ * @param mode - gpio mode
+ */
+void pin_set_mode(const char *name, uint8_t mode)
+{
+    PIN_CONFIG *config = (PIN_CONFIG *)get_pinconfig(name);
+    assert_param(config != NULL);
+    config->config.mode = (GPIO_Mode)mode;
+    GPIO_Setup(config->group, &config->config);
+}
+
 /**
  * @brief get pin information
  * @param name - pin name
@@ -17,6 +17,7 @@ void pin_set(const char *name);
 void pin_reset(const char *name);
 void pin_toggle(const char *name);
 bool is_pinset(const char *name);
+void pin_set_mode(const char *name, uint8_t mode);
 void get_pininfo(const char *name, uint8_t *group, uint8_t *num);
 
 END_DECLS
@@ -9,6 +9,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "serial.h"
 #include "global.h"
 #include "dbgserial.h"
@@ -17,6 +18,8 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[ptl]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_PTL
 
 
 typedef bool (*ptl_process)(const uint8_t *data, uint8_t len, void *args);
@@ -40,6 +43,11 @@ static serial *g_serial = NULL;
  */
 static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
 {
+    if (!TRACE_ON(TRACE_LEVEL_DUMP))
+    {
+        return ;
+    }
+
     if (dir)
     {
         TRACE("send data: ");
@@ -48,14 +56,7 @@ static void dump_message(uint8_t dir, const uint8_t *data, uint8_t len)
     {
         TRACE("recv data: ");
     }
-    for (int i = 0; i < len; ++i)
-    {
-        dbg_putchar("0123456789abcdef"[data[i] >> 4]);
-        dbg_putchar("0123456789abcdef"[data[i] & 0x0f]);
-        dbg_putchar(' ');
-    }
-    dbg_putchar('\r');
-    dbg_putchar('\n');
+    dbg_dump(data, len);
 }
 #endif
 
@@ -127,6 +128,10 @@ static void vProtocol(void *pvParameters)
     }
 }
 
+/* protocol task memory */
+static StaticTask_t ptl_task;
+static StackType_t ptl_stack[PROTOCOL_STACK_SIZE];
+
 /**
  * @brief initialize protocol
  * @return init status
@@ -141,8 +146,8 @@ bool ptl_init(void)
         return FALSE;
     }
     serial_open(g_serial);
-    xTaskCreate(vProtocol, "protocol", PROTOCOL_STACK_SIZE, g_serial,
-                PROTOCOL_PRIORITY, NULL);
+    xTaskCreateStatic(vProtocol, "protocol", PROTOCOL_STACK_SIZE, g_serial,
+                      PROTOCOL_PRIORITY, ptl_stack, &ptl_task);
 
     return TRUE;
 }
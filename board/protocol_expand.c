@@ -11,17 +11,25 @@
 #include "queue.h"
 #include "protocol_expand.h"
 #include "expand.h"
+#include "expand_tp.h"
+#include "expand_health.h"
+#include "expand_fw.h"
+#include "timesync.h"
 #include "global.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "parameter.h"
 #include "elevator.h"
 #include "boardmap.h"
 #include "floormap.h"
 #include "led_monitor.h"
+#include "crc.h"
 
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[EXPAND_PTL]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_EXPAND_PTL
 
 typedef enum
 {
@@ -37,32 +45,79 @@ extern parameters_t board_parameter;
 static register_cb_t register_cb_func = NULL;
 #endif
 
-static void process_board_register(const uint8_t *data, uint8_t len);
 #ifdef __MASTER
-static void process_elev_led(const uint8_t *data, uint8_t len);
+/** last led event sequence of each board */
+typedef struct
+{
+    uint8_t id_board;
+    uint8_t seq;
+} led_seq_t;
+static led_seq_t led_seqs[MAX_BOARD_NUM];
+#endif
+
+static void process_board_register(const uint8_t *data, uint16_t len);
+static void process_heartbeat(const uint8_t *data, uint16_t len);
+#ifdef __MASTER
+static void process_elev_led(const uint8_t *data, uint16_t len);
+static void process_led_event(const uint8_t *data, uint16_t len);
 #endif
+static void process_fw_query(const uint8_t *data, uint16_t len);
 #ifdef __EXPAND
-static void process_elev_go(const uint8_t *data, uint8_t len);
-static void process_reboot(const uint8_t *data, uint8_t len);
+static void process_elev_go(const uint8_t *data, uint16_t len);
+static void process_reboot(const uint8_t *data, uint16_t len);
+static void process_bitrate(const uint8_t *data, uint16_t len);
+static void process_resume(const uint8_t *data, uint16_t len);
+static void process_time_sync(const uint8_t *data, uint16_t len);
+static void process_time_follow_up(const uint8_t *data, uint16_t len);
+static void process_fw_begin(const uint8_t *data, uint16_t len);
+static void process_fw_block(const uint8_t *data, uint16_t len);
+static void process_fw_commit(const uint8_t *data, uint16_t len);
 #endif
 
 #pragma pack(1)
 typedef struct
 {
     uint8_t id_board;
-    char start_floor;
+    floor_t start_floor;
 } msg_board_register_t;
 
 typedef struct
 {
     uint8_t id_board;
     uint16_t led_status;
+    /** sequence of last led event included */
+    uint8_t seq;
 } msg_led_status_t;
 
 typedef struct
 {
     uint8_t id_board;
-    char floor;
+    uint8_t seq;
+    /** bit 0-3: led key, bit 6: 1 means stamp valid, bit 7: 1 means led on */
+    uint8_t key;
+    /** detect building time low 16 bits, unit is ms */
+    uint16_t stamp;
+} msg_led_event_t;
+
+typedef struct
+{
+    uint8_t seq;
+    /** master time bit 32-63 when frame built */
+    uint32_t time_hi;
+} msg_time_sync_t;
+
+typedef struct
+{
+    uint8_t seq;
+    /** master time when sync frame sent, bit 0-31 and bit 32-39 */
+    uint32_t time_low;
+    uint8_t time_mid;
+} msg_time_follow_up_t;
+
+typedef struct
+{
+    uint8_t id_board;
+    floor_t floor;
 } msg_elev_go_t;
 
 typedef struct
@@ -76,14 +131,73 @@ typedef struct
     uint8_t id_board;
 } msg_reboot_t;
 
+typedef struct
+{
+    uint8_t bitrate;
+    /** switch delay, unit is 100ms, 0 means current bitrate */
+    uint8_t delay;
+} msg_bitrate_t;
+
+typedef struct
+{
+    uint8_t id_board;
+    /** send time, unit is ms */
+    uint16_t stamp;
+    uint8_t tec;
+    uint8_t rec;
+    /** round trip time of last heartbeat, unit is ms */
+    uint8_t latency;
+} msg_heartbeat_t;
+
+typedef struct
+{
+    uint8_t id_board;
+    uint16_t stamp;
+} msg_heartbeat_ack_t;
+
+/** firmware begin and commit */
+typedef struct
+{
+    uint32_t size;
+    uint16_t crc;
+} msg_fw_image_t;
+
+/** block data and block crc follows */
+typedef struct
+{
+    uint16_t block;
+} msg_fw_block_t;
+
+typedef struct
+{
+    uint8_t id_board;
+} msg_fw_query_t;
+
+/** missing block bitmap follows */
+typedef struct
+{
+    uint8_t id_board;
+    uint8_t state;
+    /** crc of image received, or of running image after swap */
+    uint16_t crc;
+} msg_fw_query_reply_t;
+
 #pragma pack()
 
+/** board id and 16-bit floor */
+#define FLOOR_MSG_LEN          3
+/** board older firmware sends led status without sequence */
+#define LEGACY_LED_MSG_LEN     3
+#define LED_EVENT_ON           0x80
+#define LED_EVENT_SYNCED       0x40
+#define LED_EVENT_KEY_MASK     0x0f
+
 
 /* process handle */
 typedef struct
 {
     uint8_t cmd;
-    void (*process)(const uint8_t *data, uint8_t len);
+    void (*process)(const uint8_t *data, uint16_t len);
 } cmd_handle;
 
 /* protocol command */
@@ -91,21 +205,46 @@ typedef struct
 #define CMD_ELEV_LED           0x02
 #define CMD_ELEV_GO            0x03
 #define CMD_REBOOT             0x04
+#define CMD_BITRATE            0x05
+#define CMD_HEARTBEAT          0x06
+#define CMD_RESUME             0x07
+#define CMD_LED_EVENT          0x08
+#define CMD_TIME_SYNC          0x09
+#define CMD_TIME_FOLLOW_UP     0x0a
+#define CMD_FW_BEGIN           0x0b
+#define CMD_FW_BLOCK           0x0c
+#define CMD_FW_QUERY           0x0d
+#define CMD_FW_COMMIT          0x0e
 
 static cmd_handle cmd_handles[] =
 {
     {CMD_BOARD_REGISTER, process_board_register},
+    {CMD_HEARTBEAT, process_heartbeat},
+    {CMD_FW_QUERY, process_fw_query},
 #ifdef __MASTER
     {CMD_ELEV_LED, process_elev_led},
+    {CMD_LED_EVENT, process_led_event},
 #endif
 #ifdef __EXPAND
     {CMD_ELEV_GO, process_elev_go},
     {CMD_REBOOT, process_reboot},
+    {CMD_BITRATE, process_bitrate},
+    {CMD_RESUME, process_resume},
+    {CMD_TIME_SYNC, process_time_sync},
+    {CMD_TIME_FOLLOW_UP, process_time_follow_up},
+    {CMD_FW_BEGIN, process_fw_begin},
+    {CMD_FW_BLOCK, process_fw_block},
+    {CMD_FW_COMMIT, process_fw_commit},
 #endif
 };
 
-bool process_expand_data(const uint8_t *data, uint8_t len)
+bool process_expand_data(const uint8_t *data, uint16_t len)
 {
+    if (0 == len)
+    {
+        return FALSE;
+    }
+
     for (int i = 0; i < sizeof(cmd_handles) / sizeof(cmd_handles[0]); ++i)
     {
         if (data[0] == cmd_handles[i].cmd)
@@ -119,39 +258,133 @@ bool process_expand_data(const uint8_t *data, uint8_t len)
 
 /**
  * @brief send expand protocol data
+ * @param[in] id_dst: destination board id
  * @param[in] cmd: expand command
  * @param[in] data: command parameter
  * @param[in] len: command parameter length
  */
-static void expand_ptl_send(uint8_t cmd, uint8_t *data, uint8_t len)
+static void expand_ptl_send(uint8_t id_dst, uint8_t cmd, const uint8_t *data, uint8_t len)
 {
-    uint8_t rsp[20];
-    rsp[0] = cmd;
-    for (uint8_t i = 0; i < len; ++i)
+    /** elevator control first, register retried periodically, firmware
+        blocks use spare bandwidth */
+    expand_prio_t prio = EXPAND_PRIO_NORMAL;
+    if ((CMD_ELEV_GO == cmd) || (CMD_BITRATE == cmd))
+    {
+        prio = EXPAND_PRIO_HIGH;
+    }
+    else if ((CMD_BOARD_REGISTER == cmd) || (CMD_FW_BLOCK == cmd))
     {
-        rsp[1 + i] = data[i];
+        prio = EXPAND_PRIO_LOW;
     }
-    expand_send_data(rsp, len + 1);
+
+    expand_tp_send(prio, id_dst, &cmd, 1, data, len);
+}
+
+/**
+ * @brief get 16-bit floor from message
+ * @param[in] data: message data, first byte is board id
+ * @return floor number
+ */
+static floor_t expand_ptl_floor(const uint8_t *data)
+{
+    return (floor_t)(data[1] | (data[2] << 8));
 }
 
 #ifdef __MASTER
 /**
  * @brief reply to expand protocol data
+ * @param[in] id_dst: destination board id
  * @param[in] cmd: expand command
  * @param[in] status: command execute status
  * @param[in] data: command parameter
  * @param[in] len: command parameter length
  */
-static void expand_ptl_reply(uint8_t cmd, uint8_t status, uint8_t *data, uint8_t len)
+static void expand_ptl_reply(uint8_t id_dst, uint8_t cmd, uint8_t status,
+                             const uint8_t *data, uint8_t len)
+{
+    uint8_t head[2] = {cmd, status};
+    expand_tp_send(EXPAND_PRIO_NORMAL, id_dst, head, 2, data, len);
+}
+
+/**
+ * @brief store registered expand boards
+ */
+static void expand_registry_store(void)
+{
+    board_record_t records[MAX_BOARD_NUM];
+    uint8_t num = 0;
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
+    {
+        if ((0 != boardmaps[i].id_board) &&
+            (board_parameter.id_board != boardmaps[i].id_board))
+        {
+            records[num].id_board = boardmaps[i].id_board;
+            records[num].start_floor = boardmaps[i].start_floor;
+            num ++;
+        }
+    }
+
+    if (!param_store_registry(num, records))
+    {
+        TRACE("store registry failed!\r\n");
+    }
+}
+
+/**
+ * @brief add expand board to board map, floors must not overlap
+ * @param[in] id_board: expand board id
+ * @param[in] start_floor: expand board start floor
+ * @return register status
+ */
+static expand_status_t expand_board_add(uint8_t id_board, floor_t start_floor)
+{
+    /** check start */
+    if (floormap_contains_floor(start_floor))
+    {
+        return FLOOR_EXISTS;
+    }
+
+    floor_t end_floor = floor_offset(start_floor, MAX_EXPAND_FLOOR_NUM - 1);
+
+    /** check end, so range checked */
+    if (floormap_contains_floor(end_floor))
+    {
+        return FLOOR_EXISTS;
+    }
+
+    if (boardmap_is_board_id_exists(id_board))
+    {
+        return ID_EXISTS;
+    }
+
+    /** add board */
+    if (!boardmap_add(id_board, EXPAND_START_KEY, start_floor, MAX_EXPAND_FLOOR_NUM, 0))
+    {
+        /** no place for store */
+        return REGISTER_FAIL;
+    }
+
+    floormap_update();
+    return SUCCESS;
+}
+
+/**
+ * @brief restore registered expand boards, called after master board added
+ */
+void expand_registry_restore(void)
 {
-    uint8_t rsp[20];
-    rsp[0] = cmd;
-    rsp[1] = status;
-    for (uint8_t i = 0; i < len; ++i)
+    board_record_t records[MAX_BOARD_NUM];
+    uint8_t num = param_load_registry(MAX_BOARD_NUM, records);
+    for (uint8_t i = 0; i < num; ++i)
     {
-        rsp[2 + i] = data[i];
+        TRACE("restore board: %d-%d\r\n", records[i].id_board, records[i].start_floor);
+        if ((ID_BOARD_MASTER == records[i].id_board) ||
+            (ID_BOARD_INVALID == records[i].id_board) ||
+            (SUCCESS != expand_board_add(records[i].id_board, records[i].start_floor)))
+        {
+            TRACE("drop board: %d\r\n", records[i].id_board);
+        }
     }
-    expand_send_data(rsp, len + 2);
 }
 
 /**
@@ -159,47 +392,91 @@ static void expand_ptl_reply(uint8_t cmd, uint8_t status, uint8_t *data, uint8_t
  * @param[in] data: register data
  * @param[in] len: register data len
  */
-static void process_board_register(const uint8_t *data, uint8_t len)
+static void process_board_register(const uint8_t *data, uint16_t len)
 {
-    msg_board_register_t *pmsg = (msg_board_register_t *)data;
-    TRACE("expand want to register:%d-%d\r\n", pmsg->id_board, pmsg->start_floor);
-    /** check start */
-    if (floormap_contains_floor(pmsg->start_floor))
+    if (len < FLOOR_MSG_LEN)
     {
-        expand_ptl_reply(CMD_BOARD_REGISTER, FLOOR_EXISTS, &pmsg->id_board, 1);
         return ;
     }
 
-    char end_floor = pmsg->start_floor + MAX_FLOOR_NUM;
-    if ((pmsg->start_floor < 0) && (end_floor >= 0))
+    msg_board_register_t msg;
+    msg.id_board = data[0];
+    msg.start_floor = expand_ptl_floor(data);
+    msg_board_register_t *pmsg = &msg;
+    TRACE("expand want to register:%d-%d\r\n", pmsg->id_board, pmsg->start_floor);
+    if (INVALID_FLOOR == pmsg->start_floor)
     {
-        end_floor += 1;
+        /** floor 0 does not exist */
+        expand_ptl_reply(pmsg->id_board, CMD_BOARD_REGISTER, REGISTER_FAIL, &pmsg->id_board, 1);
+        return ;
     }
 
-    /** check end, so range checked */
-    if (floormap_contains_floor(end_floor))
+    floor_t known_floor = boardmap_get_start_floor(pmsg->id_board);
+    if (known_floor == pmsg->start_floor)
     {
-        expand_ptl_reply(CMD_BOARD_REGISTER, FLOOR_EXISTS, &pmsg->id_board, 1);
+        /** known board rejoins, floors checked when first registered */
+        expand_ptl_reply(pmsg->id_board, CMD_BOARD_REGISTER, SUCCESS, &pmsg->id_board, 1);
         return ;
     }
 
-    if (boardmap_is_board_id_exists(pmsg->id_board))
+    if ((INVALID_FLOOR != known_floor) && (!expand_health_is_heard(pmsg->id_board)))
     {
-        expand_ptl_reply(CMD_BOARD_REGISTER, ID_EXISTS, &pmsg->id_board, 1);
-        return ;
+        /** board moved to other floors while offline */
+        TRACE("board %d moved: %d\r\n", pmsg->id_board, known_floor);
+        boardmap_remove(pmsg->id_board);
+        floormap_update();
     }
 
-    /** add board */
-    if (!boardmap_add(pmsg->id_board, EXPAND_START_KEY, pmsg->start_floor,
-                      MAX_EXPAND_FLOOR_NUM, 0))
+    expand_status_t status = expand_board_add(pmsg->id_board, pmsg->start_floor);
+    expand_ptl_reply(pmsg->id_board, CMD_BOARD_REGISTER, status, &pmsg->id_board, 1);
+    if (SUCCESS == status)
     {
-        /** no place for store */
-        expand_ptl_reply(CMD_BOARD_REGISTER, REGISTER_FAIL, &pmsg->id_board, 1);
+        expand_registry_store();
     }
-    else
+}
+
+/**
+ * @brief get led event sequence of board
+ * @param[in] id_board: board id
+ * @return led event sequence, NULL means no place
+ */
+static led_seq_t *led_seq_get(uint8_t id_board)
+{
+    led_seq_t *empty = NULL;
+    for (uint8_t i = 0; i < MAX_BOARD_NUM; ++i)
     {
-        floormap_update();
-        expand_ptl_reply(CMD_BOARD_REGISTER, SUCCESS, &pmsg->id_board, 1);
+        if (id_board == led_seqs[i].id_board)
+        {
+            return &led_seqs[i];
+        }
+        if ((NULL == empty) && (0 == led_seqs[i].id_board))
+        {
+            empty = &led_seqs[i];
+        }
+    }
+
+    if (NULL != empty)
+    {
+        empty->id_board = id_board;
+        empty->seq = 0;
+    }
+
+    return empty;
+}
+
+/**
+ * @brief update board led status, led monitor process changed leds
+ * @param[in] id_board: board id
+ * @param[in] led_status: new led status
+ * @param[in] stamp: detect building time, unit is ms
+ */
+static void led_status_changed(uint8_t id_board, uint16_t led_status, uint32_t stamp)
+{
+    uint16_t prev_led_status = boardmap_get_led_status(id_board);
+    if (prev_led_status != led_status)
+    {
+        led_monitor_process(id_board, prev_led_status, led_status, stamp);
+        boardmap_update_led_status(id_board, led_status);
     }
 }
 
@@ -208,19 +485,103 @@ static void process_board_register(const uint8_t *data, uint8_t len)
  * @param[in] data: led status data
  * @param[in] len: led status data length
  */
-static void process_elev_led(const uint8_t *data, uint8_t len)
+static void process_elev_led(const uint8_t *data, uint16_t len)
 {
+    if (len < LEGACY_LED_MSG_LEN)
+    {
+        return ;
+    }
+
     msg_led_status_t *pmsg = (msg_led_status_t *)data;
     if (boardmap_is_board_id_exists(pmsg->id_board))
     {
         TRACE("led status:%d-0x%04x\r\n", pmsg->id_board, pmsg->led_status);
-        uint16_t prev_led_status = boardmap_get_led_status(pmsg->id_board);
-        if (prev_led_status != pmsg->led_status)
+        if (len >= sizeof(msg_led_status_t))
+        {
+            /** status includes all events before, event lost is recovered here */
+            led_seq_t *seq = led_seq_get(pmsg->id_board);
+            if (NULL != seq)
+            {
+                seq->seq = pmsg->seq;
+            }
+        }
+        /** status carries no detect time, changes are taken at arrival */
+        led_status_changed(pmsg->id_board, pmsg->led_status,
+                           (uint32_t)(now_us() / 1000));
+    }
+}
+
+/**
+ * @brief process board led event
+ * @param[in] data: led event data
+ * @param[in] len: led event data length
+ */
+static void process_led_event(const uint8_t *data, uint16_t len)
+{
+    if (len < sizeof(msg_led_event_t))
+    {
+        return ;
+    }
+
+    msg_led_event_t *pmsg = (msg_led_event_t *)data;
+    if (!boardmap_is_board_id_exists(pmsg->id_board))
+    {
+        return ;
+    }
+
+    led_seq_t *seq = led_seq_get(pmsg->id_board);
+    if (NULL != seq)
+    {
+        if ((uint8_t)(seq->seq + 1) != pmsg->seq)
         {
-            led_monitor_process(pmsg->id_board, prev_led_status, pmsg->led_status);
-            boardmap_update_led_status(pmsg->id_board, pmsg->led_status);
+            TRACE("led event lost: %d, %d-%d\r\n", pmsg->id_board, seq->seq, pmsg->seq);
         }
+        seq->seq = pmsg->seq;
+    }
+
+    uint16_t bit = 1 << (pmsg->key & LED_EVENT_KEY_MASK);
+    uint16_t led_status = boardmap_get_led_status(pmsg->id_board);
+    /** 0 means led on */
+    if (0 != (pmsg->key & LED_EVENT_ON))
+    {
+        led_status &= ~bit;
     }
+    else
+    {
+        led_status |= bit;
+    }
+
+    /** extend stamp around now, board not synchronized yet is taken at arrival */
+    uint32_t now = (uint32_t)(now_us() / 1000);
+    uint32_t stamp = now;
+    if (0 != (pmsg->key & LED_EVENT_SYNCED))
+    {
+        stamp = now - (int16_t)((uint16_t)now - pmsg->stamp);
+    }
+    TRACE("led event:%d-%d-%d@%d\r\n", pmsg->id_board, pmsg->key & LED_EVENT_KEY_MASK,
+          (0 != (pmsg->key & LED_EVENT_ON)), stamp);
+    led_status_changed(pmsg->id_board, led_status, stamp);
+}
+
+/**
+ * @brief process board heartbeat, acknowledge with heartbeat time stamp
+ * @param[in] data: heartbeat data
+ * @param[in] len: heartbeat data length
+ */
+static void process_heartbeat(const uint8_t *data, uint16_t len)
+{
+    if (len < sizeof(msg_heartbeat_t))
+    {
+        return ;
+    }
+
+    msg_heartbeat_t *pmsg = (msg_heartbeat_t *)data;
+    expand_health_heartbeat(pmsg->id_board, pmsg->tec, pmsg->rec, pmsg->latency);
+
+    msg_heartbeat_ack_t ack;
+    ack.id_board = pmsg->id_board;
+    ack.stamp = pmsg->stamp;
+    expand_ptl_send(pmsg->id_board, CMD_HEARTBEAT, (uint8_t *)&ack, sizeof(ack));
 }
 
 /**
@@ -228,22 +589,151 @@ static void process_elev_led(const uint8_t *data, uint8_t len)
  * @param[in] id_board: expand board id
  * @param[in] floor: floot to go
  */
-void expand_elev_go(uint8_t id_board, uint8_t floor)
+void expand_elev_go(uint8_t id_board, floor_t floor)
 {
-    uint8_t data[2] = {id_board, floor};
-    expand_ptl_send(CMD_ELEV_GO, data, 2);
+    msg_elev_go_t msg;
+    msg.id_board = id_board;
+    msg.floor = floor;
+    expand_ptl_send(id_board, CMD_ELEV_GO, (uint8_t *)&msg, sizeof(msg));
 }
 
 /**
  * @brief notify expand board to reboot
- * @param[in] id_board: expand board id, 0xff means all board
+ * @param[in] id_board: expand board id, ID_BOARD_BROADCAST means all board
  */
 void expand_reboot_immediately(uint8_t id_board)
 {
     uint8_t data[3];
     data[0] = CMD_REBOOT;
     data[1] = id_board;
-    expand_send_data_immediately(data, 2);
+    expand_tp_send_immediately(id_board, data, 2);
+}
+
+/**
+ * @brief notify expand boards master restarted, known boards register again
+ */
+void notify_resume(void)
+{
+    expand_ptl_send(ID_BOARD_BROADCAST, CMD_RESUME, NULL, 0);
+}
+
+/**
+ * @brief broadcast time sync, send time is got in transmit interrupt
+ * @param[in] seq: sync sequence
+ * @param[in] time_hi: master time bit 32-63
+ */
+void notify_time_sync(uint8_t seq, uint32_t time_hi)
+{
+    uint8_t data[1 + sizeof(msg_time_sync_t)];
+    msg_time_sync_t *pmsg = (msg_time_sync_t *)(data + 1);
+    data[0] = CMD_TIME_SYNC;
+    pmsg->seq = seq;
+    pmsg->time_hi = time_hi;
+    expand_tp_send_stamped(ID_BOARD_BROADCAST, data, sizeof(data));
+}
+
+/**
+ * @brief broadcast send time of last time sync
+ * @param[in] seq: sync sequence
+ * @param[in] time_mid: master time bit 32-39
+ * @param[in] time_low: master time bit 0-31
+ */
+void notify_time_follow_up(uint8_t seq, uint8_t time_mid, uint32_t time_low)
+{
+    msg_time_follow_up_t msg;
+    msg.seq = seq;
+    msg.time_low = time_low;
+    msg.time_mid = time_mid;
+    expand_ptl_send(ID_BOARD_BROADCAST, CMD_TIME_FOLLOW_UP, (uint8_t *)&msg, sizeof(msg));
+}
+
+/**
+ * @brief process board firmware query reply
+ * @param[in] data: reply data
+ * @param[in] len: reply data length
+ */
+static void process_fw_query(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_fw_query_reply_t))
+    {
+        msg_fw_query_reply_t *pmsg = (msg_fw_query_reply_t *)data;
+        expand_fw_query_replied(pmsg->id_board, pmsg->state, pmsg->crc,
+                                data + sizeof(msg_fw_query_reply_t),
+                                len - sizeof(msg_fw_query_reply_t));
+    }
+}
+
+/**
+ * @brief broadcast firmware begin, expand boards erase download bank
+ * @param[in] size: image size
+ * @param[in] crc: image crc
+ */
+void notify_fw_begin(uint32_t size, uint16_t crc)
+{
+    msg_fw_image_t msg;
+    msg.size = size;
+    msg.crc = crc;
+    expand_ptl_send(ID_BOARD_BROADCAST, CMD_FW_BEGIN, (uint8_t *)&msg, sizeof(msg));
+}
+
+/**
+ * @brief broadcast firmware block, crc covers block index and data
+ * @param[in] block: block index
+ * @param[in] data: block data
+ * @param[in] len: block data length
+ */
+void notify_fw_block(uint16_t block, const uint8_t *data, uint8_t len)
+{
+    uint8_t msg[sizeof(msg_fw_block_t) + EXPAND_FW_BLOCK_SIZE + 2];
+    if (len > EXPAND_FW_BLOCK_SIZE)
+    {
+        return ;
+    }
+
+    ((msg_fw_block_t *)msg)->block = block;
+    memcpy(msg + sizeof(msg_fw_block_t), data, len);
+    uint8_t msg_len = sizeof(msg_fw_block_t) + len;
+    uint16_t crc = crc16(msg, msg_len);
+    msg[msg_len++] = (uint8_t)(crc >> 8);
+    msg[msg_len++] = (uint8_t)(crc & 0xff);
+    expand_ptl_send(ID_BOARD_BROADCAST, CMD_FW_BLOCK, msg, msg_len);
+}
+
+/**
+ * @brief query board firmware receive state
+ * @param[in] id_board: expand board id
+ */
+void notify_fw_query(uint8_t id_board)
+{
+    msg_fw_query_t msg;
+    msg.id_board = id_board;
+    expand_ptl_send(id_board, CMD_FW_QUERY, (uint8_t *)&msg, sizeof(msg));
+}
+
+/**
+ * @brief broadcast firmware commit, verified boards swap firmware
+ * @param[in] size: image size
+ * @param[in] crc: image crc
+ */
+void notify_fw_commit(uint32_t size, uint16_t crc)
+{
+    msg_fw_image_t msg;
+    msg.size = size;
+    msg.crc = crc;
+    expand_ptl_send(ID_BOARD_BROADCAST, CMD_FW_COMMIT, (uint8_t *)&msg, sizeof(msg));
+}
+
+/**
+ * @brief notify expand boards bitrate
+ * @param[in] bitrate: bitrate index
+ * @param[in] delay: switch delay, unit is 100ms, 0 means current bitrate
+ */
+void notify_bitrate(uint8_t bitrate, uint8_t delay)
+{
+    msg_bitrate_t msg;
+    msg.bitrate = bitrate;
+    msg.delay = delay;
+    expand_ptl_send(ID_BOARD_BROADCAST, CMD_BITRATE, (uint8_t *)&msg, sizeof(msg));
 }
 
 #endif
@@ -254,7 +744,7 @@ void expand_reboot_immediately(uint8_t id_board)
  * @param[in] data: register data
  * @param[in] len: register data len
  */
-static void process_board_register(const uint8_t *data, uint8_t len)
+static void process_board_register(const uint8_t *data, uint16_t len)
 {
     msg_board_register_status_t *pmsg = (msg_board_register_status_t *)data;
     if (pmsg->id_board == board_parameter.id_board)
@@ -272,14 +762,13 @@ static void process_board_register(const uint8_t *data, uint8_t len)
  * @param data - data to process
  * @param len - data length
  */
-static void process_elev_go(const uint8_t *data, uint8_t len)
+static void process_elev_go(const uint8_t *data, uint16_t len)
 {
-    if (is_expand_board_registered())
+    if (is_expand_board_registered() && (len >= FLOOR_MSG_LEN))
     {
-        msg_elev_go_t *pmsg = (msg_elev_go_t *)data;
-        if (pmsg->id_board == board_parameter.id_board)
+        if (data[0] == board_parameter.id_board)
         {
-            elev_go(pmsg->floor);
+            elev_go(expand_ptl_floor(data));
         }
     }
 }
@@ -289,46 +778,251 @@ static void process_elev_go(const uint8_t *data, uint8_t len)
  * @param data - data to process
  * @param len - data length
  */
-static void process_reboot(const uint8_t *data, uint8_t len)
+static void process_reboot(const uint8_t *data, uint16_t len)
 {
     msg_reboot_t *pmsg = (msg_reboot_t *)data;
-    if ((0xff == pmsg->id_board) ||
+    if ((ID_BOARD_BROADCAST == pmsg->id_board) ||
         (pmsg->id_board == board_parameter.id_board))
     {
+        param_sync();
         SCB_SystemReset();
     }
 }
 
 
+/**
+ * @brief process bitrate message
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_bitrate(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_bitrate_t))
+    {
+        msg_bitrate_t *pmsg = (msg_bitrate_t *)data;
+        expand_bitrate_notified(pmsg->bitrate, pmsg->delay);
+    }
+}
+
+/**
+ * @brief process heartbeat acknowledge
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_heartbeat(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_heartbeat_ack_t))
+    {
+        msg_heartbeat_ack_t *pmsg = (msg_heartbeat_ack_t *)data;
+        if (pmsg->id_board == board_parameter.id_board)
+        {
+            expand_health_heartbeat_ack(pmsg->stamp);
+        }
+    }
+}
+
+/**
+ * @brief process master resume, register again at once
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_resume(const uint8_t *data, uint16_t len)
+{
+    expand_resume_notified();
+}
+
+/**
+ * @brief process time sync, local time got in receive interrupt
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_time_sync(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_time_sync_t))
+    {
+        msg_time_sync_t *pmsg = (msg_time_sync_t *)data;
+        timesync_sync(pmsg->seq, pmsg->time_hi, expand_rx_stamp());
+    }
+}
+
+/**
+ * @brief process time sync follow up
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_time_follow_up(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_time_follow_up_t))
+    {
+        msg_time_follow_up_t *pmsg = (msg_time_follow_up_t *)data;
+        timesync_follow_up(pmsg->seq, pmsg->time_mid, pmsg->time_low);
+    }
+}
+
+/**
+ * @brief process firmware begin
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_fw_begin(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_fw_image_t))
+    {
+        msg_fw_image_t *pmsg = (msg_fw_image_t *)data;
+        expand_fw_begin_notified(pmsg->size, pmsg->crc);
+    }
+}
+
+/**
+ * @brief process firmware block, block with wrong crc is dropped and
+ *        reported missing later
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_fw_block(const uint8_t *data, uint16_t len)
+{
+    if ((len < sizeof(msg_fw_block_t) + 2) ||
+        (len > sizeof(msg_fw_block_t) + EXPAND_FW_BLOCK_SIZE + 2))
+    {
+        return ;
+    }
+
+    uint16_t crc = ((uint16_t)data[len - 2] << 8) | data[len - 1];
+    if (crc != crc16(data, len - 2))
+    {
+        TRACE("firmware block crc error\r\n");
+        return ;
+    }
+
+    msg_fw_block_t *pmsg = (msg_fw_block_t *)data;
+    expand_fw_block_notified(pmsg->block, data + sizeof(msg_fw_block_t),
+                             len - sizeof(msg_fw_block_t) - 2);
+}
+
+/**
+ * @brief process firmware query
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_fw_query(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_fw_query_t))
+    {
+        msg_fw_query_t *pmsg = (msg_fw_query_t *)data;
+        if (pmsg->id_board == board_parameter.id_board)
+        {
+            expand_fw_query_notified();
+        }
+    }
+}
+
+/**
+ * @brief process firmware commit
+ * @param data - data to process
+ * @param len - data length
+ */
+static void process_fw_commit(const uint8_t *data, uint16_t len)
+{
+    if (len >= sizeof(msg_fw_image_t))
+    {
+        msg_fw_image_t *pmsg = (msg_fw_image_t *)data;
+        expand_fw_commit_notified(pmsg->size, pmsg->crc);
+    }
+}
+
 /**
  * @brief register board to master
  * @param[in] id_board: expand board id
  * @param[in] start_floor: expand board start floor
  */
-void register_board(uint8_t id_board, uint8_t start_floor)
+void register_board(uint8_t id_board, floor_t start_floor)
 {
     msg_board_register_t msg;
     msg.id_board = id_board;
     msg.start_floor = start_floor;
 
-    expand_ptl_send(CMD_BOARD_REGISTER, (uint8_t *)&msg, sizeof(msg));
+    expand_ptl_send(ID_BOARD_MASTER, CMD_BOARD_REGISTER, (uint8_t *)&msg, sizeof(msg));
     TRACE("register board: %d, %d\r\n", id_board, start_floor);
 }
 
 /**
- * @brief notify master board led status
+ * @brief notify master board led status periodically
+ * @param[in] id_board: expand board id
  * @param[in] led_status: expand board led status
+ * @param[in] seq: sequence of last led event
  */
-void notify_led_status(uint8_t id_board, uint16_t led_status)
+void notify_led_status(uint8_t id_board, uint16_t led_status, uint8_t seq)
 {
     msg_led_status_t msg;
     msg.id_board = id_board;
     msg.led_status = led_status;
+    msg.seq = seq;
 
-    expand_ptl_send(CMD_ELEV_LED, (uint8_t *)&msg, sizeof(msg));
+    expand_ptl_send(ID_BOARD_MASTER, CMD_ELEV_LED, (uint8_t *)&msg, sizeof(msg));
     TRACE("send led status: 0x%x\r\n", led_status);
 }
 
+/**
+ * @brief notify master board led changed
+ * @param[in] id_board: expand board id
+ * @param[in] seq: event sequence
+ * @param[in] key: changed led
+ * @param[in] on: led on or off
+ * @param[in] stamp: detect time, unit is ms
+ */
+void notify_led_event(uint8_t id_board, uint8_t seq, uint8_t key, bool on, uint16_t stamp)
+{
+    msg_led_event_t msg;
+    msg.id_board = id_board;
+    msg.seq = seq;
+    msg.key = (key & LED_EVENT_KEY_MASK) | (on ? LED_EVENT_ON : 0) |
+              (timesync_is_synced() ? LED_EVENT_SYNCED : 0);
+    msg.stamp = stamp;
+
+    expand_ptl_send(ID_BOARD_MASTER, CMD_LED_EVENT, (uint8_t *)&msg, sizeof(msg));
+}
+
+/**
+ * @brief notify master board heartbeat
+ * @param[in] id_board: expand board id
+ * @param[in] stamp: send time, unit is ms
+ * @param[in] tec: transmit error counter
+ * @param[in] rec: receive error counter
+ * @param[in] latency: round trip time of last heartbeat
+ */
+void notify_heartbeat(uint8_t id_board, uint16_t stamp, uint8_t tec, uint8_t rec,
+                      uint8_t latency)
+{
+    msg_heartbeat_t msg;
+    msg.id_board = id_board;
+    msg.stamp = stamp;
+    msg.tec = tec;
+    msg.rec = rec;
+    msg.latency = latency;
+
+    expand_ptl_send(ID_BOARD_MASTER, CMD_HEARTBEAT, (uint8_t *)&msg, sizeof(msg));
+}
+
+/**
+ * @brief reply master firmware query
+ * @param[in] id_board: expand board id
+ * @param[in] state: firmware receive state
+ * @param[in] crc: image crc
+ * @param[in] bitmap: missing block bitmap
+ * @param[in] len: bitmap length
+ */
+void reply_fw_query(uint8_t id_board, uint8_t state, uint16_t crc, const uint8_t *bitmap,
+                    uint8_t len)
+{
+    uint8_t head[1 + sizeof(msg_fw_query_reply_t)];
+    msg_fw_query_reply_t *pmsg = (msg_fw_query_reply_t *)(head + 1);
+    head[0] = CMD_FW_QUERY;
+    pmsg->id_board = id_board;
+    pmsg->state = state;
+    pmsg->crc = crc;
+    expand_tp_send(EXPAND_PRIO_NORMAL, ID_BOARD_MASTER, head, sizeof(head), bitmap, len);
+}
+
 /**
  * @brief set register callback function
  * @param[in] register_cb: register callback function
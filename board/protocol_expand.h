@@ -9,19 +9,34 @@
 #define _PROTOCOL_EXPAND_H_
 
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
-bool process_expand_data(const uint8_t *data, uint8_t len);
+bool process_expand_data(const uint8_t *data, uint16_t len);
 #ifdef __MASTER
-void expand_elev_go(uint8_t id_board, uint8_t floor);
+void expand_elev_go(uint8_t id_board, floor_t floor);
 void expand_reboot_immediately(uint8_t id_board);
+void notify_bitrate(uint8_t bitrate, uint8_t delay);
+void notify_resume(void);
+void notify_time_sync(uint8_t seq, uint32_t time_hi);
+void notify_time_follow_up(uint8_t seq, uint8_t time_mid, uint32_t time_low);
+void expand_registry_restore(void);
+void notify_fw_begin(uint32_t size, uint16_t crc);
+void notify_fw_block(uint16_t block, const uint8_t *data, uint8_t len);
+void notify_fw_query(uint8_t id_board);
+void notify_fw_commit(uint32_t size, uint16_t crc);
 #endif
 #ifdef __EXPAND
 typedef void (*register_cb_t)(uint8_t *data, uint8_t len);
 void set_register_cb(register_cb_t register_cb);
-void register_board(uint8_t id_board, uint8_t start_floor);
-void notify_led_status(uint8_t id_board, uint16_t led_status);
+void register_board(uint8_t id_board, floor_t start_floor);
+void notify_led_status(uint8_t id_board, uint16_t led_status, uint8_t seq);
+void notify_led_event(uint8_t id_board, uint8_t seq, uint8_t key, bool on, uint16_t stamp);
+void notify_heartbeat(uint8_t id_board, uint16_t stamp, uint8_t tec, uint8_t rec,
+                      uint8_t latency);
+void reply_fw_query(uint8_t id_board, uint8_t state, uint16_t crc, const uint8_t *bitmap,
+                    uint8_t len);
 #endif
 
 END_DECLS
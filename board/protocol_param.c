@@ -6,25 +6,51 @@
 * See the COPYING file for the terms of usage and distribution.
 */
 #include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
 #include "protocol.h"
 #include "protocol_param.h"
+#include "protocol_robot.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "stm32f10x_cfg.h"
 #include "parameter.h"
+#include "boardmap.h"
 #include "crc.h"
 #include "altimeter.h"
 #include "altimeter_calc.h"
 #include "protocol_expand.h"
+#include "expand.h"
+#include "expand_health.h"
+#include "expand_fw.h"
 #include "bluetooth.h"
 #include "delay.h"
 #include "license.h"
+#include "application.h"
+#include "stats.h"
+#include "timewheel.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[ptl_param]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_PTL_PARAM
 
 extern parameters_t board_parameter;
 extern license_t license;
 
+/** parameter being applied, too large for protocol task stack */
+static parameters_t new_param;
+
+/** bulk transfer state */
+typedef struct
+{
+    bool active;
+    uint16_t crc;
+    parameters_t param;
+} bulk_state_t;
+
+static bulk_state_t bulk;
+
 /* protocol head and tail */
 #define PARAM_HEAD    0x55
 #define PARAM_TAIL    0xaa
@@ -34,9 +60,24 @@ static void process_param_set(const uint8_t *data, uint8_t len);
 static void process_param_pwd(const uint8_t *data, uint8_t len);
 static void process_param_calc(const uint8_t *data, uint8_t len);
 static void process_param_bt_name(const uint8_t *data, uint8_t len);
+static void process_fw_begin(const uint8_t *data, uint8_t len);
+static void process_fw_data(const uint8_t *data, uint8_t len);
+static void process_fw_end(const uint8_t *data, uint8_t len);
+static void process_fw_status(const uint8_t *data, uint8_t len);
 #endif
 static void process_reboot(const uint8_t *data, uint8_t len);
 static void process_license(const uint8_t *data, uint8_t len);
+static void process_bitrate(const uint8_t *data, uint8_t len);
+static void process_health(const uint8_t *data, uint8_t len);
+static void process_bulk_read(const uint8_t *data, uint8_t len);
+static void process_bulk_begin(const uint8_t *data, uint8_t len);
+static void process_bulk_write(const uint8_t *data, uint8_t len);
+static void process_bulk_commit(const uint8_t *data, uint8_t len);
+static void process_trace_level(const uint8_t *data, uint8_t len);
+static void process_fault(const uint8_t *data, uint8_t len);
+#if USE_RUN_STATS
+static void process_stats(const uint8_t *data, uint8_t len);
+#endif
 
 typedef enum
 {
@@ -63,6 +104,21 @@ typedef struct
 #endif
 #define CMD_REBOOT         0x05
 #define CMD_LICENSE        0x06
+#define CMD_BITRATE        0x07
+#define CMD_HEALTH         0x08
+#ifdef __MASTER
+#define CMD_FW_BEGIN       0x09
+#define CMD_FW_DATA        0x0a
+#define CMD_FW_END         0x0b
+#define CMD_FW_STATUS      0x0c
+#endif
+#define CMD_BULK_READ      0x0d
+#define CMD_BULK_BEGIN     0x0e
+#define CMD_BULK_WRITE     0x0f
+#define CMD_BULK_COMMIT    0x10
+#define CMD_TRACE_LEVEL    0x11
+#define CMD_FAULT          0x12
+#define CMD_STATS          0x13
 
 static cmd_handle_t cmd_handles[] =
 {
@@ -74,6 +130,23 @@ static cmd_handle_t cmd_handles[] =
 #endif
     {CMD_REBOOT, process_reboot},
     {CMD_LICENSE, process_license},
+    {CMD_BITRATE, process_bitrate},
+    {CMD_HEALTH, process_health},
+#ifdef __MASTER
+    {CMD_FW_BEGIN, process_fw_begin},
+    {CMD_FW_DATA, process_fw_data},
+    {CMD_FW_END, process_fw_end},
+    {CMD_FW_STATUS, process_fw_status},
+#endif
+    {CMD_BULK_READ, process_bulk_read},
+    {CMD_BULK_BEGIN, process_bulk_begin},
+    {CMD_BULK_WRITE, process_bulk_write},
+    {CMD_BULK_COMMIT, process_bulk_commit},
+    {CMD_TRACE_LEVEL, process_trace_level},
+    {CMD_FAULT, process_fault},
+#if USE_RUN_STATS
+    {CMD_STATS, process_stats},
+#endif
 };
 
 typedef struct
@@ -89,7 +162,78 @@ typedef struct
     uint8_t license[16];
 } msg_license_t;
 
-#define IS_FLOOR_VALID(floor)               (floor > 0)
+typedef struct
+{
+    /** 0: 20k 1: 100k 2: 125k 3: 250k 4: 500k 5: 1M */
+    uint8_t bitrate;
+} msg_bitrate_t;
+
+/**
+ * bulk command fields are big endian as replies, the parameter image is
+ * parameters_t in memory layout, identified by layout version and size
+ */
+#pragma pack(1)
+typedef struct
+{
+    uint8_t offset[2];
+    uint8_t length;
+} msg_bulk_read_t;
+
+typedef struct
+{
+    /** parameter layout version, must match this firmware */
+    uint8_t version;
+    /** parameter image size, must match this firmware */
+    uint8_t size[2];
+    /** crc of the whole image after all chunks written */
+    uint8_t crc[2];
+} msg_bulk_begin_t;
+
+typedef struct
+{
+    uint8_t offset[2];
+    uint8_t data[0];
+} msg_bulk_write_t;
+
+typedef struct
+{
+    /** module id, 0xff: all modules */
+    uint8_t module;
+    /** bit0: trace bit1: data dump */
+    uint8_t level;
+    /** 0x01: restore after reboot */
+    uint8_t persist;
+} msg_trace_level_t;
+
+typedef struct
+{
+    /** 0x00: tasks and heap 0x01: interrupts 0x02: timewheel */
+    uint8_t type;
+    /** first task to report */
+    uint8_t start;
+} msg_stats_t;
+#pragma pack()
+
+/** statistics type */
+#define STATS_TASK                          0x00
+#define STATS_ISR                           0x01
+#define STATS_TIMER                         0x02
+/** max tasks returned by one statistics read */
+#define STATS_TASK_MAX                      6
+
+/** max bytes returned by one bulk read */
+#define BULK_READ_MAX_LEN                   64
+
+#define IS_FLOOR_VALID(floor)               (0 != (floor))
+
+#define PARAM_REPLY_MAX_LEN                 255
+/** reply data follows head, length, command and status */
+#define PARAM_REPLY_DATA_OFFSET             4
+#define PARAM_REPLY_DATA_MAX_LEN            (PARAM_REPLY_MAX_LEN - 7)
+/** local health report length */
+#define HEALTH_LOCAL_LEN                    22
+/** board health report length */
+#define HEALTH_NODE_LEN                     19
 
 #ifdef __MASTER
 
@@ -102,6 +246,18 @@ typedef struct
 
 #pragma pack(1)
 typedef struct
+{
+    uint8_t id_ctl;
+    uint8_t id_elev;
+    floor_t start_floor;
+    uint16_t total_floor;
+    uint16_t threshold;
+    calc_type_t calc_type;
+    uint8_t opendoor_polar;
+} msg_param_t;
+
+/** parameter with 8-bit floor */
+typedef struct
 {
     uint8_t id_ctl;
     uint8_t id_elev;
@@ -110,7 +266,7 @@ typedef struct
     uint16_t threshold;
     calc_type_t calc_type;
     uint8_t opendoor_polar;
-} msg_param_t;
+} msg_param_legacy_t;
 
 typedef struct
 {
@@ -130,11 +286,15 @@ typedef struct
 
 typedef struct
 {
-    uint8_t opcode;
-    uint8_t floor;
-    uint16_t floor_height;
-    uint16_t distance;
-} msg_calc_data;
+    uint32_t size;
+    uint16_t crc;
+} msg_fw_begin_t;
+
+typedef struct
+{
+    uint32_t offset;
+    uint8_t data[0];
+} msg_fw_data_t;
 #pragma pack()
 
 #else
@@ -144,8 +304,15 @@ typedef struct
 {
     /** valid range id 0x02-0xfe */
     uint8_t id_board;
-    uint8_t start_floor;
+    floor_t start_floor;
 } msg_param_t;
+
+/** parameter with 8-bit floor */
+typedef struct
+{
+    uint8_t id_board;
+    uint8_t start_floor;
+} msg_param_legacy_t;
 #pragma pack()
 
 #define IS_BOARD_ID_VALID(id) (((id) >= 0x02) && ((id) <= 0xfe))
@@ -173,6 +340,87 @@ static void param_reply(uint8_t cmd, uint8_t status)
     ptl_send_data(rsp, 7);
 }
 
+/**
+ * @brief reply with data built in place, crc covers status and data
+ * @param cmd - reply command
+ * @param status - command status
+ * @param rsp - reply buffer of PARAM_REPLY_MAX_LEN, data starts at
+ *              PARAM_REPLY_DATA_OFFSET
+ * @param len - reply data length
+ */
+static void param_reply_framed(uint8_t cmd, uint8_t status, uint8_t *rsp, uint8_t len)
+{
+    if (len > PARAM_REPLY_DATA_MAX_LEN)
+    {
+        len = PARAM_REPLY_DATA_MAX_LEN;
+    }
+
+    rsp[0] = PARAM_HEAD;
+    rsp[1] = 7 + len;
+    rsp[2] = cmd;
+    rsp[3] = status;
+    uint16_t crc = crc16(rsp + 3, len + 1);
+    rsp[4 + len] = (uint8_t)((crc >> 8) & 0xff);
+    rsp[5 + len] = (uint8_t)(crc & 0xff);
+    rsp[6 + len] = PARAM_TAIL;
+
+    ptl_send_data(rsp, 7 + len);
+}
+
+/**
+ * @brief reply with data, crc covers status and data
+ * @param cmd - reply command
+ * @param status - command status
+ * @param data - reply data
+ * @param len - reply data length
+ */
+static void param_reply_data(uint8_t cmd, uint8_t status, const uint8_t *data, uint8_t len)
+{
+    uint8_t rsp[PARAM_REPLY_MAX_LEN];
+    if (len > PARAM_REPLY_DATA_MAX_LEN)
+    {
+        len = PARAM_REPLY_DATA_MAX_LEN;
+    }
+
+    memcpy(rsp + PARAM_REPLY_DATA_OFFSET, data, len);
+    param_reply_framed(cmd, status, rsp, len);
+}
+
+/**
+ * @brief put 16-bit value in big endian
+ * @param buf - buffer to put
+ * @param val - value to put
+ * @return next position
+ */
+static uint8_t *put_u16(uint8_t *buf, uint16_t val)
+{
+    *buf++ = (uint8_t)(val >> 8);
+    *buf++ = (uint8_t)(val & 0xff);
+    return buf;
+}
+
+/**
+ * @brief get 16-bit value in big endian
+ * @param buf - buffer to get
+ * @return value
+ */
+static uint16_t get_u16(const uint8_t *buf)
+{
+    return (uint16_t)(((uint16_t)buf[0] << 8) | buf[1]);
+}
+
+/**
+ * @brief put 32-bit value in big endian
+ * @param buf - buffer to put
+ * @param val - value to put
+ * @return next position
+ */
+static uint8_t *put_u32(uint8_t *buf, uint32_t val)
+{
+    buf = put_u16(buf, (uint16_t)(val >> 16));
+    return put_u16(buf, (uint16_t)(val & 0xffff));
+}
+
 /**
  * @brief analyze protocol data
  * @param data - data to analyze
@@ -216,6 +464,26 @@ bool process_param_data(const uint8_t *data, uint8_t len, void *args)
     return TRUE;
 }
 
+/**
+ * @brief convert parameter with 8-bit floor
+ * @param legacy - parameter with 8-bit floor
+ * @param msg - converted parameter
+ */
+static void param_convert_legacy(const msg_param_legacy_t *legacy, msg_param_t *msg)
+{
+#ifdef __MASTER
+    msg->id_ctl = legacy->id_ctl;
+    msg->id_elev = legacy->id_elev;
+    msg->total_floor = legacy->total_floor;
+    msg->threshold = legacy->threshold;
+    msg->calc_type = legacy->calc_type;
+    msg->opendoor_polar = legacy->opendoor_polar;
+#else
+    msg->id_board = legacy->id_board;
+#endif
+    msg->start_floor = (int8_t)legacy->start_floor;
+}
+
 /**
  * @brief process parameter set
  * @param data - parameter
@@ -224,16 +492,26 @@ bool process_param_data(const uint8_t *data, uint8_t len, void *args)
 static void process_param_set(const uint8_t *data, uint8_t len)
 {
     param_status_t status = SUCCESS;
-    if (len == sizeof(msg_param_t))
+    if ((len == sizeof(msg_param_t)) || (len == sizeof(msg_param_legacy_t)))
     {
-        msg_param_t *msg = (msg_param_t *)data;
+        msg_param_t param;
+        msg_param_t *msg = &param;
+        if (len == sizeof(msg_param_legacy_t))
+        {
+            param_convert_legacy((const msg_param_legacy_t *)data, msg);
+        }
+        else
+        {
+            memcpy(msg, data, sizeof(msg_param_t));
+        }
 
+        new_param = board_parameter;
         if (!IS_FLOOR_VALID(msg->start_floor))
         {
             status = INVALID_PARAM;
             goto END;
         }
-        board_parameter.start_floor = msg->start_floor;
+        new_param.start_floor = msg->start_floor;
 #ifdef __MASTER
         if ((!IS_TOTAL_FLOOR_VALID(msg->total_floor)) ||
             (!IS_CALC_TYPE_VALID(msg->calc_type)))
@@ -242,13 +520,13 @@ static void process_param_set(const uint8_t *data, uint8_t len)
             goto END;
         }
 
-        board_parameter.id_ctl = msg->id_ctl;
-        board_parameter.id_elev = msg->id_elev;
-        board_parameter.total_floor = msg->total_floor;
-        board_parameter.threshold = msg->threshold;
-        board_parameter.calc_type = msg->calc_type;
-        board_parameter.opendoor_polar = msg->opendoor_polar;
-        board_parameter.id_board = 0x01;
+        new_param.id_ctl = msg->id_ctl;
+        new_param.id_elev = msg->id_elev;
+        new_param.total_floor = msg->total_floor;
+        new_param.threshold = msg->threshold;
+        new_param.calc_type = msg->calc_type;
+        new_param.opendoor_polar = msg->opendoor_polar;
+        new_param.id_board = 0x01;
 #endif
 
 #ifdef __EXPAND
@@ -257,9 +535,13 @@ static void process_param_set(const uint8_t *data, uint8_t len)
             status = INVALID_PARAM;
             goto END;
         }
-        board_parameter.id_board = msg->id_board;
+        new_param.id_board = msg->id_board;
 #endif
-        if (!param_store(&board_parameter))
+        if (!is_param_setted())
+        {
+            new_param.can_bitrate = CAN_BITRATE_DEFAULT;
+        }
+        if (!param_store(&new_param) || !param_sync())
         {
             status = OPERATION_FAIL;
         }
@@ -271,7 +553,7 @@ static void process_param_set(const uint8_t *data, uint8_t len)
 
 END:
     param_reply(CMD_SET, status);
-    if (SUCCESS == status)
+    if ((SUCCESS == status) && !app_apply_param(&new_param))
     {
         TRACE("rebooting...\r\n");
         SCB_SystemReset();
@@ -299,6 +581,8 @@ static void process_reboot(const uint8_t *data, uint8_t len)
         status = OPERATION_FAIL;
     }
     param_reply(CMD_REBOOT, status);
+    license_commit();
+    param_sync();
 #ifdef __MASTER
 
     switch (data[0])
@@ -328,7 +612,7 @@ static void process_license(const uint8_t *data, uint8_t len)
     if (len >= sizeof(msg_license_t))
     {
         msg_license_t *pdata = (msg_license_t *)data;
-        if (!license_set(pdata->license))
+        if (!license_set(pdata->license) || !param_sync())
         {
             status = OPERATION_FAIL;
         }
@@ -338,12 +622,458 @@ static void process_license(const uint8_t *data, uint8_t len)
         status = OPERATION_FAIL;
     }
     param_reply(CMD_LICENSE, status);
-    if (SUCCESS == status)
+    /** license takes effect at once, modules stopped by expired license need reboot */
+    if ((SUCCESS == status) && !app_is_running())
     {
         SCB_SystemReset();
     }
 }
 
+/**
+ * @brief process expand bus bitrate, master switches all expand boards
+ * @param data - bitrate data
+ * @param len - data length
+ */
+static void process_bitrate(const uint8_t *data, uint8_t len)
+{
+    param_status_t status = SUCCESS;
+    if (len == sizeof(msg_bitrate_t))
+    {
+        msg_bitrate_t *pdata = (msg_bitrate_t *)data;
+        if (!expand_change_bitrate(pdata->bitrate))
+        {
+            status = INVALID_PARAM;
+        }
+    }
+    else
+    {
+        status = OPERATION_FAIL;
+    }
+    param_reply(CMD_BITRATE, status);
+}
+
+/**
+ * @brief report expand bus health, master reports every expand board
+ *        health too
+ *        local: state, tec, rec, lec, error count(2), error passive count(2),
+ *               bus-off count(2), tx ok(4), tx fail(4), rx ok(4)
+ *        board: id, alive, tec, rec, latency, lost count(2), rx(4),
+ *               tx ok(4), tx fail(4)
+ * @param data - request data
+ * @param len - data length
+ */
+static void process_health(const uint8_t *data, uint8_t len)
+{
+    UNUSED(data);
+    UNUSED(len);
+#ifdef __MASTER
+    /** reply is built in place, node list is too large for protocol stack */
+    static expand_node_t nodes[MAX_BOARD_NUM];
+#endif
+    uint8_t rsp[PARAM_REPLY_MAX_LEN];
+    uint8_t *pdata = rsp + PARAM_REPLY_DATA_OFFSET;
+    expand_health_t health;
+    expand_stats_t stats;
+
+    expand_health_get(&health);
+    expand_get_stats(&stats);
+    *pdata++ = health.state;
+    *pdata++ = health.tec;
+    *pdata++ = health.rec;
+    *pdata++ = health.lec;
+    pdata = put_u16(pdata, health.error_cnt);
+    pdata = put_u16(pdata, health.passive_cnt);
+    pdata = put_u16(pdata, health.bus_off_cnt);
+    pdata = put_u32(pdata, stats.tx_ok);
+    pdata = put_u32(pdata, stats.tx_fail);
+    pdata = put_u32(pdata, stats.rx_ok);
+
+#ifdef __MASTER
+    uint8_t max = (PARAM_REPLY_DATA_MAX_LEN - HEALTH_LOCAL_LEN - 1) / HEALTH_NODE_LEN;
+    uint8_t count = expand_health_nodes(nodes, (max < MAX_BOARD_NUM) ? max : MAX_BOARD_NUM);
+    *pdata++ = count;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        *pdata++ = nodes[i].id_board;
+        *pdata++ = nodes[i].alive;
+        *pdata++ = nodes[i].tec;
+        *pdata++ = nodes[i].rec;
+        *pdata++ = nodes[i].latency;
+        pdata = put_u16(pdata, nodes[i].lost_cnt);
+        pdata = put_u32(pdata, nodes[i].rx);
+        pdata = put_u32(pdata, nodes[i].tx_ok);
+        pdata = put_u32(pdata, nodes[i].tx_fail);
+    }
+#endif
+
+    param_reply_framed(CMD_HEALTH, SUCCESS, rsp,
+                       (uint8_t)(pdata - rsp - PARAM_REPLY_DATA_OFFSET));
+}
+
+/**
+ * @brief validate parameter image received by bulk transfer
+ * @param param - parameter to validate
+ * @return TRUE if valid
+ */
+static bool bulk_param_valid(const parameters_t *param)
+{
+    if (!IS_FLOOR_VALID(param->start_floor) ||
+        (param->can_bitrate >= CAN_BITRATE_COUNT))
+    {
+        return FALSE;
+    }
+#ifdef __MASTER
+    if ((!IS_TOTAL_FLOOR_VALID(param->total_floor)) ||
+        (param->total_floor > MAX_TOTAL_FLOOR_NUM) ||
+        (!IS_CALC_TYPE_VALID(param->calc_type)) ||
+        (0x01 != param->id_board))
+    {
+        return FALSE;
+    }
+
+    /** calibrated floors are unique and inside building */
+    for (uint16_t i = 0; i < MAX_TOTAL_FLOOR_NUM; ++i)
+    {
+        const floor_height_t *entry = &param->floor_height[i];
+        if (0 == entry->height)
+        {
+            continue;
+        }
+
+        int16_t pos = floor_distance(param->start_floor, entry->floor);
+        if (!IS_FLOOR_VALID(entry->floor) || (pos < 0) ||
+            (pos >= (int16_t)param->total_floor))
+        {
+            return FALSE;
+        }
+        for (uint16_t j = 0; j < i; ++j)
+        {
+            if ((0 != param->floor_height[j].height) &&
+                (entry->floor == param->floor_height[j].floor))
+            {
+                return FALSE;
+            }
+        }
+    }
+#else
+    if (!IS_BOARD_ID_VALID(param->id_board))
+    {
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+/**
+ * @brief read parameter image region
+ *        reply: offset(2), image size(2), layout version(1), data
+ * @param data - region offset and length
+ * @param len - data length
+ */
+static void process_bulk_read(const uint8_t *data, uint8_t len)
+{
+    uint8_t rsp[5 + BULK_READ_MAX_LEN];
+    if (len != sizeof(msg_bulk_read_t))
+    {
+        param_reply(CMD_BULK_READ, OPERATION_FAIL);
+        return ;
+    }
+
+    msg_bulk_read_t *pdata = (msg_bulk_read_t *)data;
+    uint16_t offset = get_u16(pdata->offset);
+    if ((0 == pdata->length) || (pdata->length > BULK_READ_MAX_LEN) ||
+        ((uint32_t)offset + pdata->length > sizeof(parameters_t)))
+    {
+        param_reply(CMD_BULK_READ, INVALID_PARAM);
+        return ;
+    }
+
+    new_param = param_get();
+    uint8_t *prsp = put_u16(rsp, offset);
+    prsp = put_u16(prsp, sizeof(parameters_t));
+    *prsp++ = PARAM_LAYOUT_VERSION;
+    memcpy(prsp, (const uint8_t *)&new_param + offset, pdata->length);
+    param_reply_data(CMD_BULK_READ, SUCCESS, rsp, 5 + pdata->length);
+}
+
+/**
+ * @brief begin bulk parameter write, regions not written keep current value
+ * @param data - image size and crc
+ * @param len - data length
+ */
+static void process_bulk_begin(const uint8_t *data, uint8_t len)
+{
+    param_status_t status = SUCCESS;
+    if (len == sizeof(msg_bulk_begin_t))
+    {
+        msg_bulk_begin_t *pdata = (msg_bulk_begin_t *)data;
+        if ((PARAM_LAYOUT_VERSION == pdata->version) &&
+            (sizeof(parameters_t) == get_u16(pdata->size)))
+        {
+            bulk.param = param_get();
+            bulk.crc = get_u16(pdata->crc);
+            bulk.active = TRUE;
+        }
+        else
+        {
+            status = INVALID_PARAM;
+        }
+    }
+    else
+    {
+        status = OPERATION_FAIL;
+    }
+    param_reply(CMD_BULK_BEGIN, status);
+}
+
+/**
+ * @brief write one parameter image chunk, chunk is protected by frame crc
+ * @param data - chunk offset and data
+ * @param len - data length
+ */
+static void process_bulk_write(const uint8_t *data, uint8_t len)
+{
+    param_status_t status = SUCCESS;
+    if (!bulk.active)
+    {
+        status = OPERATION_FAIL;
+    }
+    else if (len > sizeof(msg_bulk_write_t))
+    {
+        msg_bulk_write_t *pdata = (msg_bulk_write_t *)data;
+        uint8_t size = len - sizeof(msg_bulk_write_t);
+        uint16_t offset = get_u16(pdata->offset);
+        if ((uint32_t)offset + size <= sizeof(parameters_t))
+        {
+            memcpy((uint8_t *)&bulk.param + offset, pdata->data, size);
+        }
+        else
+        {
+            status = INVALID_PARAM;
+        }
+    }
+    else
+    {
+        status = INVALID_PARAM;
+    }
+    param_reply(CMD_BULK_WRITE, status);
+}
+
+/**
+ * @brief commit bulk parameter write, image crc is checked before store
+ * @param data - no data
+ * @param len - data length
+ */
+static void process_bulk_commit(const uint8_t *data, uint8_t len)
+{
+    UNUSED(data);
+    UNUSED(len);
+    param_status_t status = SUCCESS;
+    bool reboot = FALSE;
+    if (!bulk.active)
+    {
+        status = OPERATION_FAIL;
+    }
+    else if (crc16_update(0xffff, (const uint8_t *)&bulk.param, sizeof(parameters_t)) != bulk.crc)
+    {
+        status = CRC_ERROR;
+    }
+    else if (!bulk_param_valid(&bulk.param))
+    {
+        status = INVALID_PARAM;
+    }
+    else
+    {
+        new_param = bulk.param;
+        /** bus bitrate is only taken at startup */
+        reboot = (new_param.can_bitrate != board_parameter.can_bitrate);
+        if (!param_store(&new_param) || !param_sync())
+        {
+            status = OPERATION_FAIL;
+        }
+    }
+    bulk.active = FALSE;
+
+    param_reply(CMD_BULK_COMMIT, status);
+    if ((SUCCESS == status) && (reboot || !app_apply_param(&new_param)))
+    {
+        TRACE("rebooting...\r\n");
+        SCB_SystemReset();
+    }
+}
+
+/**
+ * @brief process trace level, empty request only reads levels
+ *        reply: module number, level of each module
+ * @param data - module, level and persist flag
+ * @param len - data length
+ */
+static void process_trace_level(const uint8_t *data, uint8_t len)
+{
+    param_status_t status = SUCCESS;
+    if (len == sizeof(msg_trace_level_t))
+    {
+        msg_trace_level_t *pdata = (msg_trace_level_t *)data;
+        if (!trace_level_set(pdata->module, pdata->level, 0x01 == pdata->persist))
+        {
+            status = INVALID_PARAM;
+        }
+    }
+    else if (0 != len)
+    {
+        status = OPERATION_FAIL;
+    }
+
+    uint8_t rsp[TRACE_ID_COUNT + 1];
+    rsp[0] = trace_level_get(rsp + 1, TRACE_ID_COUNT);
+    param_reply_data(CMD_TRACE_LEVEL, status, rsp, rsp[0] + 1);
+}
+
+/**
+ * @brief process fault record, empty request reads last fault, 0x01 clears it
+ *        reply: fault count(4), exception, task name(16), exc_return(4),
+ *               sp(4), r0-r3(16), r12(4), lr(4), pc(4), xpsr(4), cfsr(4),
+ *               hfsr(4), mmfar(4), bfar(4), stack words(32)
+ *        only fault count is replied if no fault recorded
+ * @param data - clear flag
+ * @param len - data length
+ */
+static void process_fault(const uint8_t *data, uint8_t len)
+{
+    uint8_t rsp[4 + 1 + FAULT_TASK_NAME_LEN + (14 + FAULT_STACK_NUM) * 4];
+    uint8_t *pdata = rsp;
+    uint32_t count = 0;
+    fault_record_t record;
+
+    if ((1 == len) && (0x01 == data[0]))
+    {
+        param_reply(CMD_FAULT, param_clear_fault() ? SUCCESS : OPERATION_FAIL);
+        return ;
+    }
+    else if (0 != len)
+    {
+        param_reply(CMD_FAULT, OPERATION_FAIL);
+        return ;
+    }
+
+    if (!param_load_fault(&count, &record))
+    {
+        pdata = put_u32(pdata, 0);
+        param_reply_data(CMD_FAULT, SUCCESS, rsp, (uint8_t)(pdata - rsp));
+        return ;
+    }
+
+    pdata = put_u32(pdata, count);
+    *pdata++ = record.exception;
+    memcpy(pdata, record.task, FAULT_TASK_NAME_LEN);
+    pdata += FAULT_TASK_NAME_LEN;
+    pdata = put_u32(pdata, record.exc_return);
+    pdata = put_u32(pdata, record.sp);
+    pdata = put_u32(pdata, record.r0);
+    pdata = put_u32(pdata, record.r1);
+    pdata = put_u32(pdata, record.r2);
+    pdata = put_u32(pdata, record.r3);
+    pdata = put_u32(pdata, record.r12);
+    pdata = put_u32(pdata, record.lr);
+    pdata = put_u32(pdata, record.pc);
+    pdata = put_u32(pdata, record.xpsr);
+    pdata = put_u32(pdata, record.cfsr);
+    pdata = put_u32(pdata, record.hfsr);
+    pdata = put_u32(pdata, record.mmfar);
+    pdata = put_u32(pdata, record.bfar);
+    for (uint8_t i = 0; i < FAULT_STACK_NUM; ++i)
+    {
+        pdata = put_u32(pdata, record.stack[i]);
+    }
+
+    param_reply_data(CMD_FAULT, SUCCESS, rsp, (uint8_t)(pdata - rsp));
+}
+
+#if USE_RUN_STATS
+/**
+ * @brief process run time statistics, run time unit is cycle counter / 1024,
+ *        cpu usage is run time delta divided by total run time delta
+ *        task reply: total run time(4), free heap(4), min free heap(4),
+ *                    task number(1), start(1), tasks of name length(1),
+ *                    name, priority(1), min free stack words(2), run time(4)
+ *        isr reply: isr number(1), isrs of count(4), run time(4),
+ *                   max cycles(4)
+ * @param data - statistics type and first task
+ * @param len - data length
+ */
+static void process_stats(const uint8_t *data, uint8_t len)
+{
+    /** reply is built in place, lists are too large for protocol stack */
+    static task_stats_t tasks[STATS_TASK_MAX];
+    static isr_stats_t isrs[STATS_ISR_COUNT];
+    uint8_t rsp[PARAM_REPLY_MAX_LEN];
+    uint8_t *pdata = rsp + PARAM_REPLY_DATA_OFFSET;
+    if (len != sizeof(msg_stats_t))
+    {
+        param_reply(CMD_STATS, OPERATION_FAIL);
+        return ;
+    }
+
+    msg_stats_t *pmsg = (msg_stats_t *)data;
+    if (STATS_TASK == pmsg->type)
+    {
+        uint8_t total = 0;
+        uint32_t run_time = 0;
+        uint32_t heap_free = 0;
+        uint32_t heap_min = 0;
+        uint8_t count = stats_get_tasks(pmsg->start, STATS_TASK_MAX, tasks, &total, &run_time);
+        stats_get_heap(&heap_free, &heap_min);
+
+        pdata = put_u32(pdata, run_time);
+        pdata = put_u32(pdata, heap_free);
+        pdata = put_u32(pdata, heap_min);
+        *pdata++ = total;
+        *pdata++ = pmsg->start;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            uint8_t name_len = 0;
+            while ((name_len < configMAX_TASK_NAME_LEN) && ('\0' != tasks[i].name[name_len]))
+            {
+                name_len++;
+            }
+            *pdata++ = name_len;
+            memcpy(pdata, tasks[i].name, name_len);
+            pdata += name_len;
+            *pdata++ = tasks[i].priority;
+            pdata = put_u16(pdata, tasks[i].stack);
+            pdata = put_u32(pdata, tasks[i].run_time);
+        }
+    }
+    else if (STATS_ISR == pmsg->type)
+    {
+        stats_get_isr(isrs);
+        *pdata++ = STATS_ISR_COUNT;
+        for (uint8_t i = 0; i < STATS_ISR_COUNT; ++i)
+        {
+            pdata = put_u32(pdata, isrs[i].count);
+            pdata = put_u32(pdata, isrs[i].run_time);
+            pdata = put_u32(pdata, isrs[i].max_cycles);
+        }
+    }
+    else if (STATS_TIMER == pmsg->type)
+    {
+        timewheel_stats_t timer;
+        timewheel_get_stats(&timer);
+        pdata = put_u32(pdata, timer.wakeups);
+        pdata = put_u32(pdata, timer.fired);
+        pdata = put_u32(pdata, timer.max_late);
+    }
+    else
+    {
+        param_reply(CMD_STATS, INVALID_PARAM);
+        return ;
+    }
+
+    param_reply_framed(CMD_STATS, SUCCESS, rsp,
+                       (uint8_t)(pdata - rsp - PARAM_REPLY_DATA_OFFSET));
+}
+#endif
+
 #ifdef __MASTER
 /**
  * @brief process password set
@@ -360,7 +1090,18 @@ static void process_param_pwd(const uint8_t *data, uint8_t len)
             msg_pwd_t *msg = (msg_pwd_t *)data;
             if (IS_PWD_SCAN_WINDOW_VALID(msg->scan_window))
             {
-                if (!param_store_pwd(msg->scan_window, msg->pwd))
+                if (param_store_pwd(msg->scan_window, msg->pwd) && param_sync())
+                {
+                    /**
+                     * only changed fields are applied, floor heights being
+                     * calibrated in ram are kept
+                     */
+                    vTaskSuspendAll();
+                    board_parameter.pwd_window = msg->scan_window;
+                    memcpy(board_parameter.pwd, msg->pwd, PARAM_PWD_LEN);
+                    xTaskResumeAll();
+                }
+                else
                 {
                     status = OPERATION_FAIL;
                 }
@@ -381,11 +1122,6 @@ static void process_param_pwd(const uint8_t *data, uint8_t len)
     }
 
     param_reply(CMD_PWD, status);
-    if (SUCCESS == status)
-    {
-        TRACE("rebooting...\r\n");
-        SCB_SystemReset();
-    }
 }
 
 /**
@@ -438,7 +1174,7 @@ static void process_param_bt_name(const uint8_t *data, uint8_t len)
     {
         memset(bt_name, 0, BT_NAME_MAX_LEN + 1);
         memcpy(bt_name, data, len);
-        if (!param_store_bt_name(len, bt_name))
+        if (!param_store_bt_name(len, bt_name) || !param_sync())
         {
             status = OPERATION_FAIL;
         }
@@ -451,33 +1187,134 @@ static void process_param_bt_name(const uint8_t *data, uint8_t len)
     param_reply(CMD_BT_NAME, status);
     if (SUCCESS == status)
     {
+        /** only name is applied, floor heights being calibrated are kept */
+        vTaskSuspendAll();
+        memcpy(board_parameter.bt_name, bt_name, BT_NAME_MAX_LEN + 1);
+        xTaskResumeAll();
         bt_set_name((const char *)bt_name);
     }
 }
 
+/**
+ * @brief process expand firmware begin, master stores image in download bank
+ * @param data - image size and crc
+ * @param len - data length
+ */
+static void process_fw_begin(const uint8_t *data, uint8_t len)
+{
+    param_status_t status = SUCCESS;
+    if (len == sizeof(msg_fw_begin_t))
+    {
+        msg_fw_begin_t *pdata = (msg_fw_begin_t *)data;
+        if (!expand_fw_begin(pdata->size, pdata->crc))
+        {
+            status = INVALID_PARAM;
+        }
+    }
+    else
+    {
+        status = OPERATION_FAIL;
+    }
+    param_reply(CMD_FW_BEGIN, status);
+}
+
+/**
+ * @brief process expand firmware data
+ * @param data - data offset and firmware data
+ * @param len - data length
+ */
+static void process_fw_data(const uint8_t *data, uint8_t len)
+{
+    param_status_t status = SUCCESS;
+    if (len > sizeof(msg_fw_data_t))
+    {
+        msg_fw_data_t *pdata = (msg_fw_data_t *)data;
+        if (!expand_fw_write(pdata->offset, pdata->data, len - sizeof(msg_fw_data_t)))
+        {
+            status = OPERATION_FAIL;
+        }
+    }
+    else
+    {
+        status = INVALID_PARAM;
+    }
+    param_reply(CMD_FW_DATA, status);
+}
+
+/**
+ * @brief process expand firmware end, image is distributed to all expand
+ *        boards, stored image is distributed again if no image receiving
+ * @param data - no data
+ * @param len - data length
+ */
+static void process_fw_end(const uint8_t *data, uint8_t len)
+{
+    UNUSED(data);
+    UNUSED(len);
+    param_reply(CMD_FW_END, expand_fw_end() ? SUCCESS : OPERATION_FAIL);
+}
+
+/**
+ * @brief report expand firmware distribution status
+ *        state, round, size(4), received(4), board number,
+ *        board: id, state, missing block number(2)
+ * @param data - request data
+ * @param len - data length
+ */
+static void process_fw_status(const uint8_t *data, uint8_t len)
+{
+    UNUSED(data);
+    UNUSED(len);
+    uint8_t rsp[11 + MAX_BOARD_NUM * 4];
+    uint8_t *pdata = rsp;
+    expand_fw_status_t status;
+    expand_fw_target_t targets[MAX_BOARD_NUM];
+
+    expand_fw_status(&status);
+    *pdata++ = status.state;
+    *pdata++ = status.round;
+    pdata = put_u32(pdata, status.size);
+    pdata = put_u32(pdata, status.received);
+    uint8_t count = expand_fw_targets(targets, MAX_BOARD_NUM);
+    *pdata++ = count;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        *pdata++ = targets[i].id_board;
+        *pdata++ = targets[i].state;
+        pdata = put_u16(pdata, targets[i].missing);
+    }
+
+    param_reply_data(CMD_FW_STATUS, SUCCESS, rsp, (uint8_t)(pdata - rsp));
+}
+
 /**
  * @brief notify calculation data to user
  */
-void notify_calc(uint8_t floor, uint16_t floor_height, uint16_t distance)
-{
-    msg_calc_data msg;
-    msg.opcode = CMD_CALC_NOTIFY;
-    msg.floor_height = floor_height;
-    msg.distance = distance;
-    uint8_t rsp[13];
-    uint16_t crc = crc16((uint8_t *)&msg, sizeof(msg));
-    rsp[0] = PARAM_HEAD;
-    rsp[1] = 5 + sizeof(msg);
-    rsp[2] = msg.opcode;
-    rsp[3] = floor;
-    rsp[4] = (uint8_t)(msg.floor_height >> 8);
-    rsp[5] = (uint8_t)(msg.floor_height & 0xff);
-    rsp[6] = (uint8_t)(msg.distance >> 8);
-    rsp[7] = (uint8_t)(msg.distance & 0xff);
-    rsp[8] = (uint8_t)((crc >> 8) & 0xff);
-    rsp[9] = (uint8_t)(crc & 0xff);
-    rsp[10] = PARAM_TAIL;
-
-    ptl_send_data(rsp, 5 + sizeof(msg));
+void notify_calc(floor_t floor, uint16_t floor_height, uint16_t distance)
+{
+    /** crc covers opcode, floor and height and distance in native order */
+    uint8_t msg[5 + FLOOR_MAX_LEN];
+    uint8_t *pmsg = msg;
+    *pmsg++ = CMD_CALC_NOTIFY;
+    pmsg += floor_encode(floor, pmsg);
+    memcpy(pmsg, &floor_height, sizeof(floor_height));
+    pmsg += sizeof(floor_height);
+    memcpy(pmsg, &distance, sizeof(distance));
+    pmsg += sizeof(distance);
+    uint8_t msg_len = (uint8_t)(pmsg - msg);
+    uint16_t crc = crc16(msg, msg_len);
+
+    uint8_t rsp[5 + sizeof(msg)];
+    uint8_t *pdata = rsp;
+    *pdata++ = PARAM_HEAD;
+    *pdata++ = 5 + msg_len;
+    *pdata++ = CMD_CALC_NOTIFY;
+    pdata += floor_encode(floor, pdata);
+    pdata = put_u16(pdata, floor_height);
+    pdata = put_u16(pdata, distance);
+    pdata = put_u16(pdata, crc);
+    *pdata++ = PARAM_TAIL;
+
+    ptl_send_data(rsp, (uint8_t)(pdata - rsp));
 }
 #endif
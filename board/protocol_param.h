@@ -9,12 +9,13 @@
 #define _PROTOCOL_PARAM_H_
 
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
 bool process_param_data(const uint8_t *data, uint8_t len, void *args);
 #ifdef __MASTER
-void notify_calc(uint8_t floor, uint16_t floor_height, uint16_t distance);
+void notify_calc(floor_t floor, uint16_t floor_height, uint16_t distance);
 #endif
 
 END_DECLS
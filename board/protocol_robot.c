@@ -10,6 +10,7 @@
 #include "protocol.h"
 #include "protocol_robot.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "global.h"
 #include "parameter.h"
 #include "led_status.h"
@@ -20,6 +21,8 @@
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[ptl_robot]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_PTL_ROBOT
 
 extern parameters_t board_parameter;
 /* protocol head and tail */
@@ -35,6 +38,8 @@ extern parameters_t board_parameter;
 #define CONVERT_3_ORIGIN   0x03
 
 #define DEFAULT_FLOOR   0xf7
+/** extended floor: prefix followed by 16-bit signed floor, big endian */
+#define FLOOR_EXTENDED  0xf8
 #define LED_ON          0x02
 #define LED_OFF         0x01
 #define DOOR_ON         0x01
@@ -136,6 +141,56 @@ static bool sum_check(const uint8_t *data, uint8_t len)
             (recv_check[1] == calc_check[1]));
 }
 
+/**
+ * @brief encode floor, one byte form is used when possible, also used by
+ *        parameter protocol
+ * @param floor - floor to encode
+ * @param data - encoded data, FLOOR_MAX_LEN at most
+ * @return encoded data length
+ */
+uint8_t floor_encode(floor_t floor, uint8_t *data)
+{
+    if ((floor >= 0) && (floor < DEFAULT_FLOOR))
+    {
+        data[0] = (uint8_t)floor;
+        return 1;
+    }
+
+    data[0] = FLOOR_EXTENDED;
+    data[1] = (uint8_t)((uint16_t)floor >> 8);
+    data[2] = (uint8_t)floor;
+    return FLOOR_MAX_LEN;
+}
+
+/**
+ * @brief decode floor, both one byte form and extended form are supported
+ * @param data - data to decode
+ * @param len - data length
+ * @param floor - decoded floor
+ * @return decoded data length, 0 means data invalid
+ */
+static uint8_t floor_decode(const uint8_t *data, uint8_t len, floor_t *floor)
+{
+    if (len < 1)
+    {
+        return 0;
+    }
+
+    if (FLOOR_EXTENDED != data[0])
+    {
+        *floor = data[0];
+        return 1;
+    }
+
+    if (len < FLOOR_MAX_LEN)
+    {
+        return 0;
+    }
+
+    *floor = (floor_t)(((uint16_t)data[1] << 8) | data[2]);
+    return FLOOR_MAX_LEN;
+}
+
 /**
  * @brief analyze protocol data
  * @param data - data to analyze
@@ -305,30 +360,38 @@ static void send_data(const uint8_t *data, uint8_t len, void *pargs)
  */
 static void process_elev_apply(const uint8_t *data, uint8_t len, void *pargs)
 {
+    if (len < 6)
+    {
+        return ;
+    }
+
     uint8_t payload[20];
+    uint8_t *pdata = payload + 4;
     payload[0] = board_parameter.id_ctl;
     payload[1] = board_parameter.id_elev;
     payload[2] = data[1];
     payload[3] = CMD_APPLY_REPLY;
-    payload[4] = elev_floor();
-    payload[5] = data[4];
+    pdata += floor_encode(elev_floor(), pdata);
+    *pdata ++ = data[4];
 
+    floor_t floor = DEFAULT_FLOOR;
     elev_status status;
     status._status.dir = elev_state_run();
-    if (DEFAULT_FLOOR == data[5])
+    if ((DEFAULT_FLOOR == data[5]) ||
+        (0 == floor_decode(data + 5, len - 5, &floor)))
     {
         status._status.led = LED_OFF;
     }
     else
     {
-        status._status.led = (is_led_on(data[5]) ? LED_ON : LED_OFF);
+        status._status.led = (is_led_on(floor) ? LED_ON : LED_OFF);
     }
     status._status.door = DOOR_ON;
     status._status.reserve = 0x00;
     status._status.state = elev_state_work();
-    payload[6] = status.status;
+    *pdata ++ = status.status;
 
-    send_data(payload, 7, pargs);
+    send_data(payload, (uint8_t)(pdata - payload), pargs);
     robot_id_set(data[1]);
     elevator_set_state_work(work_robot);
     robot_monitor_start();
@@ -364,19 +427,20 @@ static void process_elev_release(const uint8_t *data, uint8_t len, void *pargs)
  */
 static void process_elev_checkin(const uint8_t *data, uint8_t len, void *pargs)
 {
-    uint8_t floor = data[4];
-    if ((floor > 0) && (floor <= board_parameter.total_floor))
+    floor_t floor = INVALID_FLOOR;
+    uint8_t floor_len = (len > 4) ? floor_decode(data + 4, len - 4, &floor) : 0;
+    if ((0 != floor_len) && (len > 4 + floor_len) &&
+        floormap_contains_floor(floor))
     {
-        /** checkin invalid floor */
-        uint8_t payload[7];
+        /** reply with floor in the form robot sent */
+        uint8_t payload[6 + FLOOR_MAX_LEN];
         payload[0] = board_parameter.id_ctl;
         payload[1] = board_parameter.id_elev;
         payload[2] = data[1];
         payload[3] = CMD_CHECKIN_REPLY;
-        payload[4] = data[4];
-        payload[5] = data[5];
+        memcpy(payload + 4, data + 4, floor_len + 1);
 
-        send_data(payload, 6, pargs);
+        send_data(payload, 4 + floor_len + 1, pargs);
 
         robot_checkin_set(floor);
         /* goto specified floor */
@@ -391,30 +455,32 @@ static void process_elev_checkin(const uint8_t *data, uint8_t len, void *pargs)
  */
 static void process_elev_inquire(const uint8_t *data, uint8_t len, void *pargs)
 {
-    uint8_t payload[8];
+    uint8_t payload[5 + FLOOR_MAX_LEN * 2];
+    uint8_t *pdata = payload + 4;
     payload[0] = board_parameter.id_ctl;
     payload[1] = board_parameter.id_elev;
     payload[2] = data[1];
     payload[3] = CMD_INQUIRE_REPLY;
-    payload[4] = elev_floor();
-    payload[5] = robot_checkin_get();
+    floor_t checkin_floor = robot_checkin_get();
+    pdata += floor_encode(elev_floor(), pdata);
+    pdata += floor_encode(checkin_floor, pdata);
 
     elev_status status;
     status._status.dir = elev_state_run();
-    if (DEFAULT_FLOOR == payload[5])
+    if (DEFAULT_FLOOR == checkin_floor)
     {
         status._status.led = LED_OFF;
     }
     else
     {
-        status._status.led = (is_led_on(payload[5]) ? LED_ON : LED_OFF);
+        status._status.led = (is_led_on(checkin_floor) ? LED_ON : LED_OFF);
     }
     status._status.door = DOOR_ON;
     status._status.reserve = 0x00;
     status._status.state = elev_state_work();
-    payload[6] = status.status;
+    *pdata ++ = status.status;
 
-    send_data(payload, 7, pargs);
+    send_data(payload, (uint8_t)(pdata - payload), pargs);
 }
 
 /**
@@ -494,23 +560,24 @@ static void process_elev_bt_name(const uint8_t *data, uint8_t len, void *pargs)
  * @brief process elevator arrive
  * @param floor - arrive floor
  */
-void notify_arrive(uint8_t floor, void *pargs)
+void notify_arrive(floor_t floor, void *pargs)
 {
-    uint8_t payload[7];
+    uint8_t payload[5 + FLOOR_MAX_LEN];
+    uint8_t *pdata = payload + 4;
     payload[0] = board_parameter.id_ctl;
     payload[1] = board_parameter.id_elev;
     payload[2] = robot_id_get();
     payload[3] = CMD_NOTIFY_ARRIVE;
-    payload[4] = elev_floor();
+    pdata += floor_encode(elev_floor(), pdata);
     elev_status status;
     status._status.dir = elev_state_run();
     status._status.led = (is_led_on(floor) ? LED_ON : LED_OFF);
     status._status.door = DOOR_ON;
     status._status.reserve = 0x00;
     status._status.state = elev_state_work();
-    payload[5] = status.status;
+    *pdata ++ = status.status;
 
-    send_data(payload, 6, pargs);
+    send_data(payload, (uint8_t)(pdata - payload), pargs);
 }
 
 /**
@@ -518,13 +585,14 @@ void notify_arrive(uint8_t floor, void *pargs)
  */
 static void notify_busy(uint8_t id, void *pargs)
 {
-    uint8_t payload[8];
+    uint8_t payload[6 + FLOOR_MAX_LEN];
+    uint8_t *pdata = payload + 4;
     payload[0] = board_parameter.id_ctl;
     payload[1] = board_parameter.id_elev;
     payload[2] = id;
     payload[3] = CMD_BUSY;
-    payload[4] = elev_floor();
-    payload[5] = robot_id_get();
+    pdata += floor_encode(elev_floor(), pdata);
+    *pdata ++ = robot_id_get();
 
     elev_status status;
     status._status.dir = elev_state_run();
@@ -539,9 +607,9 @@ static void notify_busy(uint8_t id, void *pargs)
     status._status.door = DOOR_ON;
     status._status.reserve = 0x00;
     status._status.state = elev_state_work();
-    payload[6] = status.status;
+    *pdata ++ = status.status;
 
-    send_data(payload, 7, pargs);
+    send_data(payload, (uint8_t)(pdata - payload), pargs);
 }
 
 /**
@@ -10,9 +10,13 @@
 
 #ifdef __MASTER
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
+/** max length of encoded floor */
+#define FLOOR_MAX_LEN   3
+
 typedef enum
 {
     ROBOT_WN,
@@ -21,8 +25,9 @@ typedef enum
 
 typedef void (*process_robot_cb)(const uint8_t *data, uint8_t len);
 bool process_robot_data(const uint8_t *data, uint8_t len, void *pargs);
-void notify_arrive(uint8_t floor, void *pargs);
+void notify_arrive(floor_t floor, void *pargs);
 void register_arrive_cb(process_robot_cb cb);
+uint8_t floor_encode(floor_t floor, uint8_t *data);
 
 END_DECLS
 #endif
@@ -8,11 +8,14 @@
 #include "keyctl.h"
 #include "assert.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "cm3_core.h"
 #include "pinconfig.h"
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[relay]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_RELAY
 
 #define RELAY_NUM   2
 
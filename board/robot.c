@@ -8,19 +8,22 @@
 #ifdef __MASTER
 #include "robot.h"
 #include "FreeRTOS.h"
-#include "timers.h"
+#include "timewheel.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "global.h"
 #include "elevator.h"
 
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[robot]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_ROBOT
 
 typedef struct
 {
     uint8_t id;
-    uint8_t floor;
+    floor_t floor;
 } robot_info;
 
 #define DEFAULT_ID    0xff
@@ -58,6 +61,9 @@ static void vRobotMonitor(void *pvParameters)
     }
 }
 
+/* robot monitor timer memory */
+static timewheel_timer_t robot_timer;
+
 /**
  * @brief initialize robot
  */
@@ -66,14 +72,8 @@ bool robot_init(void)
     TRACE("initialize robot...\r\n");
     robot.id = DEFAULT_ID;
     robot.floor = DEFAULT_CHECKIN;
-    TimerHandle_t robot_tmr = xTimerCreate("robot_tmr", ROBOT_MONITOR_INTERVAL, TRUE, NULL,
-                                           vRobotMonitor);
-    if (NULL == robot_tmr)
-    {
-        TRACE("initialise robot failed!\r\n");
-        return FALSE;
-    }
-    xTimerStart(robot_tmr, 0);
+    timewheel_timer_init(&robot_timer, vRobotMonitor, NULL);
+    timewheel_start_periodic(&robot_timer, ROBOT_MONITOR_INTERVAL);
 
     return TRUE;
 }
@@ -109,7 +109,7 @@ void robot_id_reset(void)
  * @brief set robot checkin floor
  * @param floor - check in floor
  */
-void robot_checkin_set(uint8_t floor)
+void robot_checkin_set(floor_t floor)
 {
     robot.floor = floor;
 }
@@ -126,7 +126,7 @@ void robot_checkin_reset(void)
  * @brief get robot checkin floor
  * @return checkin floor
  */
-uint8_t robot_checkin_get(void)
+floor_t robot_checkin_get(void)
 {
     return robot.floor;
 }
@@ -136,7 +136,7 @@ uint8_t robot_checkin_get(void)
  * @param floor - specified floor
  * @return check status
  */
-bool robot_is_checkin(uint8_t floor)
+bool robot_is_checkin(floor_t floor)
 {
     return (floor == robot.floor);
 }
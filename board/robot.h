@@ -10,6 +10,7 @@
 
 #ifdef __MASTER
 #include "types.h"
+#include "config.h"
 
 BEGIN_DECLS
 
@@ -19,10 +20,10 @@ bool robot_init(void);
 void robot_id_set(uint8_t id);
 void robot_id_reset(void);
 uint8_t robot_id_get(void);
-void robot_checkin_set(uint8_t floor);
+void robot_checkin_set(floor_t floor);
 void robot_checkin_reset(void);
-uint8_t robot_checkin_get(void);
-bool robot_is_checkin(uint8_t floor);
+floor_t robot_checkin_get(void);
+bool robot_is_checkin(floor_t floor);
 void robot_monitor_start(void);
 void robot_monitor_stop(void);
 void robot_monitor_reset(void);
@@ -12,15 +12,30 @@
 #include "serial.h"
 #include "global.h"
 #include "dbgserial.h"
+#include "stats.h"
+
+/** rx queue storage of each handle */
+#define SERIAL_RX_BUF_LEN                   128
+/** serial handles used at the same time */
+#ifdef __MASTER
+#define SERIAL_HANDLE_NUM                   3
+#else
+#define SERIAL_HANDLE_NUM                   1
+#endif
 
 /* serial handle definition */
 struct _serial_t
 {
     Port port;
+    bool used;
     UBaseType_t rxBufLen;
     USART_Config config;
+    StaticQueue_t rxQueue;
+    uint8_t rxBuf[SERIAL_RX_BUF_LEN];
 };
 
+static serial serials[SERIAL_HANDLE_NUM];
+
 /* The queue used to hold received characters. */
 static xQueueHandle xRxedChars[Port_Count];
 
@@ -34,13 +49,22 @@ static xQueueHandle xRxedChars[Port_Count];
 serial *serial_request(Port port)
 {
     assert_param(port < Port_Count);
-    serial *pserial = pvPortMalloc(sizeof(serial) / sizeof(char));
+    serial *pserial = NULL;
+    for (uint8_t i = 0; i < SERIAL_HANDLE_NUM; ++i)
+    {
+        if (!serials[i].used)
+        {
+            pserial = &serials[i];
+            break;
+        }
+    }
     if (NULL == pserial)
     {
         return NULL;
     }
     pserial->port = port;
-    pserial->rxBufLen = 128;
+    pserial->used = TRUE;
+    pserial->rxBufLen = SERIAL_RX_BUF_LEN;
     USART_StructInit(&pserial->config);
 
     return pserial;
@@ -52,7 +76,8 @@ serial *serial_request(Port port)
  */
 void serial_release(serial *pserial)
 {
-    vPortFree(pserial);
+    assert_param(pserial != NULL);
+    pserial->used = FALSE;
 }
 
 /**
@@ -67,8 +92,9 @@ bool serial_open(serial *handle)
     NVIC_Config nvicConfig = {USART1_IRQChannel, USART1_PRIORITY, 0, TRUE};
 
     /* Create the queues used to hold Rx/Tx characters */
-    xRxedChars[handle->port] = xQueueCreate(handle->rxBufLen,
-                                            (UBaseType_t)sizeof(portCHAR));
+    xRxedChars[handle->port] = xQueueCreateStatic(handle->rxBufLen,
+                                                  (UBaseType_t)sizeof(portCHAR),
+                                                  handle->rxBuf, &handle->rxQueue);
 
     if (NULL != xRxedChars[handle->port])
     {
@@ -157,7 +183,8 @@ void serial_close(serial *handle)
         break;
     }
     vQueueDelete(xRxedChars[pserial->port]);
-    vPortFree(handle);
+    xRxedChars[pserial->port] = NULL;
+    serial_release(handle);
 }
 
 /**
@@ -244,7 +271,7 @@ void serial_set_databits(serial *handle, DataBits dataBits)
 /**
  * @brief set rx and tx buffer length
  * @param handle: serial handle
- * @param rxLen: rx buffer length
+ * @param rxLen: rx buffer length, limited to handle storage
  * @param txLen: tx buffer length
  */
 void serial_set_bufferlength(serial *handle, UBaseType_t rxLen,
@@ -252,7 +279,7 @@ void serial_set_bufferlength(serial *handle, UBaseType_t rxLen,
 {
     assert_param(handle != NULL);
     serial *pserial = (serial *)handle;
-    pserial->rxBufLen = rxLen;
+    pserial->rxBufLen = (rxLen < SERIAL_RX_BUF_LEN) ? rxLen : SERIAL_RX_BUF_LEN;
 }
 
 /**
@@ -330,6 +357,7 @@ void USART1_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     portCHAR cChar;
+    uint32_t start = stats_isr_begin();
 
     /* The interrupt was caused by the RX not empty. */
     if (USART_IsFlagOn(USART1, USART_FLAG_RXNE))
@@ -338,6 +366,8 @@ void USART1_IRQHandler(void)
         xQueueSendFromISR(xRxedChars[0], &cChar, &xHigherPriorityTaskWoken);
     }
 
+    stats_isr_end(STATS_ISR_USART1, start);
+
     /* check if there is any higher priority task need to wakeup */
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
@@ -349,6 +379,7 @@ void USART2_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     portCHAR cChar;
+    uint32_t start = stats_isr_begin();
 
     /* The interrupt was caused by the RX not empty. */
     if (USART_IsFlagOn(USART2, USART_FLAG_RXNE))
@@ -357,6 +388,8 @@ void USART2_IRQHandler(void)
         xQueueSendFromISR(xRxedChars[1], &cChar, &xHigherPriorityTaskWoken);
     }
 
+    stats_isr_end(STATS_ISR_USART2, start);
+
     /* check if there is any higher priority task need to wakeup */
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
@@ -368,6 +401,7 @@ void USART3_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     portCHAR cChar;
+    uint32_t start = stats_isr_begin();
 
     /* The interrupt was caused by the RX not empty. */
     if (USART_IsFlagOn(USART3, USART_FLAG_RXNE))
@@ -376,6 +410,8 @@ void USART3_IRQHandler(void)
         xQueueSendFromISR(xRxedChars[2], &cChar, &xHigherPriorityTaskWoken);
     }
 
+    stats_isr_end(STATS_ISR_USART3, start);
+
     /* check if there is any higher priority task need to wakeup */
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
@@ -387,6 +423,7 @@ void UART4_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     portCHAR cChar;
+    uint32_t start = stats_isr_begin();
 
     /* The interrupt was caused by the RX not empty. */
     if (USART_IsFlagOn(UART4, USART_FLAG_RXNE))
@@ -395,6 +432,8 @@ void UART4_IRQHandler(void)
         xQueueSendFromISR(xRxedChars[3], &cChar, &xHigherPriorityTaskWoken);
     }
 
+    stats_isr_end(STATS_ISR_UART4, start);
+
     /* check if there is any higher priority task need to wakeup */
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
@@ -406,6 +445,7 @@ void UART5_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     portCHAR cChar;
+    uint32_t start = stats_isr_begin();
 
     /* The interrupt was caused by the RX not empty. */
     if (USART_IsFlagOn(UART5, USART_FLAG_RXNE))
@@ -414,6 +454,8 @@ void UART5_IRQHandler(void)
         xQueueSendFromISR(xRxedChars[4], &cChar, &xHigherPriorityTaskWoken);
     }
 
+    stats_isr_end(STATS_ISR_UART5, start);
+
     /* check if there is any higher priority task need to wakeup */
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
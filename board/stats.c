@@ -0,0 +1,198 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "stats.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32f10x_cfg.h"
+
+#if USE_RUN_STATS
+/**
+ * run time counter is core cycle counter divided by 2^shift,
+ * 72MHz / 1024 = 70kHz, 32-bit counter wraps after about 17 hours
+ */
+#define STATS_COUNTER_SHIFT     10
+/** max task number reported */
+#define STATS_TASK_NUM          16
+
+typedef struct
+{
+    uint64_t cycles;
+    uint32_t count;
+    uint32_t max_cycles;
+} isr_record_t;
+
+/* cycle counter extension */
+static uint32_t cycle_last = 0;
+static uint32_t cycle_wrap = 0;
+
+#if configSUPPORT_DYNAMIC_ALLOCATION
+static size_t heap_min = configTOTAL_HEAP_SIZE;
+#endif
+static volatile isr_record_t isr_records[STATS_ISR_COUNT];
+static TaskStatus_t task_status[STATS_TASK_NUM];
+
+/**
+ * @brief start cycle counter, called when scheduler starts
+ */
+void stats_timer_init(void)
+{
+    cycle_last = 0;
+    cycle_wrap = 0;
+    DWT_EnableCycleCounter(TRUE);
+}
+
+/**
+ * @brief get run time counter, cycle counter wraps every 60s and must be read
+ *        more often than that, tick hook guarantees it
+ * @return run time counter
+ */
+uint32_t stats_counter(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t cycle = DWT_GetCycleCounter();
+    if (cycle < cycle_last)
+    {
+        cycle_wrap++;
+    }
+    cycle_last = cycle;
+    uint32_t counter = (cycle_wrap << (32 - STATS_COUNTER_SHIFT)) |
+                       (cycle >> STATS_COUNTER_SHIFT);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    return counter;
+}
+
+/**
+ * @brief tick hook, keep cycle counter extension up to date
+ */
+void vApplicationTickHook(void)
+{
+    stats_counter();
+}
+
+#if configSUPPORT_DYNAMIC_ALLOCATION
+/**
+ * @brief record minimum free heap, called by heap allocator with scheduler
+ *        suspended
+ * @param free - free heap size
+ */
+void stats_heap_update(size_t free)
+{
+    if (free < heap_min)
+    {
+        heap_min = free;
+    }
+}
+#endif
+
+/**
+ * @brief interrupt handler start
+ * @return start cycle
+ */
+uint32_t stats_isr_begin(void)
+{
+    return DWT_GetCycleCounter();
+}
+
+/**
+ * @brief interrupt handler end, nested interrupt time is also counted
+ * @param isr - interrupt
+ * @param start - start cycle
+ */
+void stats_isr_end(stats_isr_t isr, uint32_t start)
+{
+    uint32_t cycles = DWT_GetCycleCounter() - start;
+    volatile isr_record_t *record = &isr_records[isr];
+    record->cycles += cycles;
+    if (cycles > record->max_cycles)
+    {
+        record->max_cycles = cycles;
+    }
+    record->count++;
+}
+
+/**
+ * @brief get task statistics sorted by creation order
+ * @param start - first task to get
+ * @param max - max task number to get
+ * @param[out] stats - task statistics
+ * @param[out] total - total task number
+ * @param[out] run_time - total run time
+ * @return task number got
+ */
+uint8_t stats_get_tasks(uint8_t start, uint8_t max, task_stats_t *stats,
+                        uint8_t *total, uint32_t *run_time)
+{
+    TaskStatus_t *status = task_status;
+    *run_time = 0;
+    UBaseType_t num = uxTaskGetSystemState(status, STATS_TASK_NUM, run_time);
+
+    /* state list order changes, sort by task number */
+    for (UBaseType_t i = 1; i < num; ++i)
+    {
+        TaskStatus_t cur = status[i];
+        UBaseType_t j = i;
+        for (; (j > 0) && (status[j - 1].xTaskNumber > cur.xTaskNumber); --j)
+        {
+            status[j] = status[j - 1];
+        }
+        status[j] = cur;
+    }
+
+    uint8_t count = 0;
+    for (UBaseType_t i = start; (i < num) && (count < max); ++i)
+    {
+        strncpy((char *)stats[count].name, status[i].pcTaskName, configMAX_TASK_NAME_LEN);
+        stats[count].run_time = status[i].ulRunTimeCounter;
+        stats[count].stack = status[i].usStackHighWaterMark;
+        stats[count].priority = (uint8_t)status[i].uxCurrentPriority;
+        count++;
+    }
+    *total = (uint8_t)num;
+
+    return count;
+}
+
+/**
+ * @brief get heap statistics, both are 0 if heap is not used
+ * @param[out] free - current free heap
+ * @param[out] min_free - minimum free heap ever
+ */
+void stats_get_heap(uint32_t *free, uint32_t *min_free)
+{
+#if configSUPPORT_DYNAMIC_ALLOCATION
+    *free = xPortGetFreeHeapSize();
+    *min_free = heap_min;
+#else
+    *free = 0;
+    *min_free = 0;
+#endif
+}
+
+/**
+ * @brief get interrupt statistics, run time is in run time counter unit
+ * @param[out] stats - statistics of each interrupt
+ */
+void stats_get_isr(isr_stats_t *stats)
+{
+    isr_record_t record;
+    for (uint8_t i = 0; i < STATS_ISR_COUNT; ++i)
+    {
+        /* interrupts above syscall priority can not be masked, retry on update */
+        do
+        {
+            record = isr_records[i];
+        } while (record.count != isr_records[i].count);
+
+        stats[i].count = record.count;
+        stats[i].run_time = (uint32_t)(record.cycles >> STATS_COUNTER_SHIFT);
+        stats[i].max_cycles = record.max_cycles;
+    }
+}
+#endif
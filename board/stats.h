@@ -0,0 +1,74 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "types.h"
+#include "config.h"
+#include "FreeRTOS.h"
+
+BEGIN_DECLS
+
+/** measured interrupt, order is protocol visible */
+typedef enum
+{
+    STATS_ISR_USART1,
+    STATS_ISR_USART2,
+    STATS_ISR_USART3,
+    STATS_ISR_UART4,
+    STATS_ISR_UART5,
+    STATS_ISR_CAN_RX0,
+    STATS_ISR_CAN_RX1,
+    STATS_ISR_CAN_TX,
+    STATS_ISR_I2C1_EV,
+    STATS_ISR_I2C1_ER,
+    STATS_ISR_I2C1_DMA_TX,
+    STATS_ISR_I2C1_DMA_RX,
+    STATS_ISR_TRACE_DMA,
+    STATS_ISR_TIM2,
+    STATS_ISR_CAN_SCE,
+    STATS_ISR_COUNT,
+} stats_isr_t;
+
+/** task statistics */
+typedef struct
+{
+    uint8_t name[configMAX_TASK_NAME_LEN];
+    uint32_t run_time;
+    uint16_t stack;  /* minimum free stack ever, words */
+    uint8_t priority;
+} task_stats_t;
+
+/** interrupt statistics */
+typedef struct
+{
+    uint32_t count;
+    uint32_t run_time;
+    uint32_t max_cycles;
+} isr_stats_t;
+
+#if USE_RUN_STATS
+void stats_timer_init(void);
+uint32_t stats_counter(void);
+#if configSUPPORT_DYNAMIC_ALLOCATION
+void stats_heap_update(size_t free);
+#endif
+uint32_t stats_isr_begin(void);
+void stats_isr_end(stats_isr_t isr, uint32_t start);
+uint8_t stats_get_tasks(uint8_t start, uint8_t max, task_stats_t *stats,
+                        uint8_t *total, uint32_t *run_time);
+void stats_get_heap(uint32_t *free, uint32_t *min_free);
+void stats_get_isr(isr_stats_t *stats);
+#else
+#define stats_isr_begin()            0
+#define stats_isr_end(isr, start)    UNUSED(start)
+#endif
+
+END_DECLS
+
+#endif /* _STATS_H_ */
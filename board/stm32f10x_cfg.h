@@ -25,6 +25,9 @@
 #define _MODULE_TIM
 #define _MODULE_CAN
 #define _MODULE_SIG
+#define _MODULE_DMA
+#define _MODULE_I2C
+#define _MODULE_DWT
 
 /**********************************************************/
 #ifdef _MODULE_FLASH
@@ -67,4 +70,16 @@
 #include "stm32f10x_sig.h"
 #endif
 
+#ifdef _MODULE_DMA
+#include "stm32f10x_dma.h"
+#endif
+
+#ifdef _MODULE_I2C
+#include "stm32f10x_i2c.h"
+#endif
+
+#ifdef _MODULE_DWT
+#include "stm32f10x_dwt.h"
+#endif
+
 #endif /* _STM32F10x_CFG_H_ */
@@ -10,16 +10,21 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "trace.h"
+#include "trace_level.h"
 #include "global.h"
 #include "pinconfig.h"
 #include "elevator.h"
 #include "led_status.h"
 #include "stm32f10x_cfg.h"
 #include "config.h"
+#include "stats.h"
+#include "timewheel.h"
 
 
 #undef __TRACE_MODULE
 #define __TRACE_MODULE  "[switchmtl]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_SWITCH
 
 /* switch 0->1 means arrive，1->0 means leave */
 #define UPPER_SWITCH     "SWITCH1"
@@ -32,6 +37,7 @@ static uint8_t filter_cur = 0;
 #endif
 
 static char cur_floor = 0;
+static char prev_floor = 0;
 static bool sequence_start = FALSE;
 static uint8_t switch_cur = 0x03;
 static uint8_t switch_prev = 0x03;
@@ -98,6 +104,7 @@ uint8_t filter_switch_val(void)
  */
 void TIM2_IRQHandler(void)
 {
+    uint32_t start = stats_isr_begin();
     switch (filter_step)
     {
     case 0:
@@ -153,6 +160,7 @@ void TIM2_IRQHandler(void)
     }
 
     TIM_ClearIntFlag(TIM2, TIM_INT_FLAG_UPDATE);
+    stats_isr_end(STATS_ISR_TIM2, start);
 }
 #else
 /**
@@ -160,6 +168,7 @@ void TIM2_IRQHandler(void)
  */
 void TIM2_IRQHandler(void)
 {
+    uint32_t start = stats_isr_begin();
     /**
      * 0-1-3: floor increase
      * 0-2-3: floor decrese
@@ -198,31 +207,26 @@ void TIM2_IRQHandler(void)
     }
 
     TIM_ClearIntFlag(TIM2, TIM_INT_FLAG_UPDATE);
+    stats_isr_end(STATS_ISR_TIM2, start);
 }
 #endif
 
 
 /**
- * @brief switch monitor task
- * @param pvParameters - task parameter
+ * @brief switch monitor timer
+ * @param pvParameters - timer parameter
  */
 static void vSwitchMonitor(void *pvParameters)
 {
-    char prev_floor = cur_floor;
-    char delta = 0;
-    for (;;)
+    char delta = cur_floor - prev_floor;
+    prev_floor = cur_floor;
+    if (delta > 0)
     {
-        delta = cur_floor - prev_floor;
-        prev_floor = cur_floor;
-        if (delta > 0)
-        {
-            elev_increase();
-        }
-        else if (delta < 0)
-        {
-            elev_decrease();
-        }
-        vTaskDelay(SWITCH_MONITOR_INTERVAL);
+        elev_increase();
+    }
+    else if (delta < 0)
+    {
+        elev_decrease();
     }
 }
 
@@ -243,6 +247,9 @@ void init_filter(void)
     NVIC_Init(&nvicConfig);
     TIM_Enable(TIM2, TRUE);
 }
+/* switch monitor timer memory */
+static timewheel_timer_t switch_timer;
+
 /**
  * @brief initialize switch monitor
  * @return init status
@@ -250,8 +257,9 @@ void init_filter(void)
 bool switch_monitor_init(void)
 {
     TRACE("initialize switch monitor...\r\n");
-    xTaskCreate(vSwitchMonitor, "switchmonitor", SWITCH_MONITOR_STACK_SIZE, NULL,
-                SWITCH_MONITOR_PRIORITY, NULL);
+    prev_floor = cur_floor;
+    timewheel_timer_init(&switch_timer, vSwitchMonitor, NULL);
+    timewheel_start_periodic(&switch_timer, SWITCH_MONITOR_INTERVAL);
     init_filter();
     return TRUE;
 }
@@ -0,0 +1,250 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timewheel.h"
+#include "timesync.h"
+#include "expand.h"
+#include "protocol_expand.h"
+#include "stm32f10x_cfg.h"
+#include "trace.h"
+#include "trace_level.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[TIMESYNC]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_TIMESYNC
+
+/**
+ * building time is master local time in us:
+ * 1. master broadcasts sync frame with time high 32 bits, and gets local
+ *    time when frame sent in transmit interrupt
+ * 2. master broadcasts follow up with send time of the sync frame
+ * 3. expand board gets local time when sync frame received in receive
+ *    interrupt, pairs it with follow up to estimate offset and drift
+ */
+#ifdef __MASTER
+#define SYNC_INTERVAL            (1000 / portTICK_PERIOD_MS)
+static uint8_t sync_seq = 0;
+#endif
+
+#ifdef __EXPAND
+/** drift is estimated only if syncs are close enough, unit is us */
+#define DRIFT_MAX_GAP            (10000000ULL)
+/** crystal tolerance, larger drift means bad sample, unit is ppb */
+#define DRIFT_LIMIT              (500000)
+/** drift filter, new drift weight is 1 / DRIFT_FILTER */
+#define DRIFT_FILTER             8
+
+static bool synced = FALSE;
+static bool sync_pending = FALSE;
+static uint8_t sync_seq = 0;
+static uint32_t sync_hi = 0;
+static uint64_t sync_rx = 0;
+
+/**
+ * last sync point, local time and master time, written by expand receive
+ * task and read by higher priority timers, accessed in critical section
+ */
+static uint64_t ref_local = 0;
+static uint64_t ref_master = 0;
+/** master clock rate compared with local clock, unit is ppb */
+static int32_t drift = 0;
+#endif
+
+/** tick count extended to 64 bits */
+static uint32_t tick_hi = 0;
+static TickType_t tick_last = 0;
+
+/**
+ * @brief get local time, can be called in task and interrupt
+ * @return local time since power on, unit is us
+ */
+uint64_t timesync_local_us(void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    TickType_t tick = xTaskGetTickCountFromISR();
+    uint32_t val = SYSTICK_GetCounter();
+    if (SCB_IsSysTickPending())
+    {
+        /** counter reloaded, but tick not increased yet */
+        val = SYSTICK_GetCounter();
+        tick ++;
+    }
+
+    if (tick < tick_last)
+    {
+        tick_hi ++;
+    }
+    tick_last = tick;
+    uint32_t hi = tick_hi;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    uint32_t reload = SYSTICK_GetReload();
+    uint32_t tick_us = 1000 * portTICK_PERIOD_MS;
+    uint64_t us = (((uint64_t)hi << 32) | tick) * tick_us;
+    if ((0 != reload) && (val <= reload))
+    {
+        us += (uint64_t)(reload - val) * tick_us / reload;
+    }
+
+    return us;
+}
+
+#ifdef __MASTER
+/**
+ * @brief get building time
+ * @return building time, unit is us
+ */
+uint64_t now_us(void)
+{
+    return timesync_local_us();
+}
+
+/**
+ * @brief send follow up of last sync, then send new sync
+ * @param pvParameters - timer parameter
+ */
+static void vTimeSync(void *pvParameters)
+{
+    uint64_t stamp;
+    if (expand_tx_stamp(&stamp))
+    {
+        notify_time_follow_up(sync_seq, (uint8_t)(stamp >> 32), (uint32_t)stamp);
+    }
+
+    sync_seq ++;
+    notify_time_sync(sync_seq, (uint32_t)(timesync_local_us() >> 32));
+}
+#endif
+
+#ifdef __EXPAND
+/**
+ * @brief convert local time to building time
+ * @param local - local time
+ * @return building time
+ */
+static uint64_t local_to_master(uint64_t local)
+{
+    taskENTER_CRITICAL();
+    bool valid = synced;
+    uint64_t base_local = ref_local;
+    uint64_t base_master = ref_master;
+    int32_t rate = drift;
+    taskEXIT_CRITICAL();
+
+    if (!valid)
+    {
+        return local;
+    }
+
+    int64_t elapsed = (int64_t)(local - base_local);
+    return base_master + elapsed + elapsed * rate / 1000000000LL;
+}
+
+/**
+ * @brief get building time
+ * @return building time, unit is us
+ */
+uint64_t now_us(void)
+{
+    return local_to_master(timesync_local_us());
+}
+
+/**
+ * @brief check if time synchronized with master
+ * @return TRUE if synchronized
+ */
+bool timesync_is_synced(void)
+{
+    return synced;
+}
+
+/**
+ * @brief process sync frame
+ * @param seq - sync sequence
+ * @param master_hi - master time high 32 bits when frame built
+ * @param rx_stamp - local time when frame received
+ */
+void timesync_sync(uint8_t seq, uint32_t master_hi, uint64_t rx_stamp)
+{
+    sync_seq = seq;
+    sync_hi = master_hi;
+    sync_rx = rx_stamp;
+    sync_pending = TRUE;
+}
+
+/**
+ * @brief process follow up frame
+ * @param seq - sync sequence
+ * @param master_mid - master time bit 32-39 when sync frame sent
+ * @param master_low - master time low 32 bits when sync frame sent
+ */
+void timesync_follow_up(uint8_t seq, uint8_t master_mid, uint32_t master_low)
+{
+    if ((!sync_pending) || (seq != sync_seq))
+    {
+        return ;
+    }
+    sync_pending = FALSE;
+
+    /** sync frame may be sent after bit 32-39 changed */
+    uint64_t master = ((uint64_t)(sync_hi & 0xffffff00) << 32) |
+                      ((uint64_t)master_mid << 32) | master_low;
+    if (master_mid < (uint8_t)sync_hi)
+    {
+        master += (1ULL << 40);
+    }
+
+    /** only this task writes sync point, reading it here needs no lock */
+    int32_t rate = drift;
+    if (synced && (sync_rx - ref_local < DRIFT_MAX_GAP))
+    {
+        int64_t local_elapsed = (int64_t)(sync_rx - ref_local);
+        int64_t master_elapsed = (int64_t)(master - ref_master);
+        if (local_elapsed > 0)
+        {
+            int64_t sample = (master_elapsed - local_elapsed) * 1000000000LL / local_elapsed;
+            if ((sample < DRIFT_LIMIT) && (sample > -DRIFT_LIMIT))
+            {
+                rate += ((int32_t)sample - rate) / DRIFT_FILTER;
+            }
+        }
+    }
+    else
+    {
+        TRACE("time synchronized: %d\r\n", seq);
+    }
+
+    taskENTER_CRITICAL();
+    ref_local = sync_rx;
+    ref_master = master;
+    drift = rate;
+    synced = TRUE;
+    taskEXIT_CRITICAL();
+}
+#endif
+
+#ifdef __MASTER
+/* time sync timer memory */
+static timewheel_timer_t sync_timer;
+#endif
+
+/**
+ * @brief initialize time synchronization
+ * @return init status
+ */
+bool timesync_init(void)
+{
+#ifdef __MASTER
+    timewheel_timer_init(&sync_timer, vTimeSync, NULL);
+    timewheel_start_periodic(&sync_timer, SYNC_INTERVAL);
+#endif
+
+    return TRUE;
+}
@@ -0,0 +1,26 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _TIMESYNC_H_
+#define _TIMESYNC_H_
+
+#include "types.h"
+
+BEGIN_DECLS
+
+bool timesync_init(void);
+uint64_t timesync_local_us(void);
+uint64_t now_us(void);
+#ifdef __EXPAND
+bool timesync_is_synced(void);
+void timesync_sync(uint8_t seq, uint32_t master_hi, uint64_t rx_stamp);
+void timesync_follow_up(uint8_t seq, uint8_t master_mid, uint32_t master_low);
+#endif
+
+END_DECLS
+
+#endif /* _TIMESYNC_H_ */
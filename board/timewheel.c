@@ -0,0 +1,406 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "timewheel.h"
+#include "task.h"
+#include "semphr.h"
+#include "global.h"
+#include "trace.h"
+#include "trace_level.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[timewheel]"
+#undef __TRACE_ID
+#define __TRACE_ID      TRACE_ID_TIMEWHEEL
+
+/**
+ * 3 levels of 64 slots, level n slot spans 64^n ticks, covers 262s with 1ms
+ * tick, longer timer is cascaded again from top level
+ */
+#define WHEEL_BITS          6
+#define WHEEL_SLOTS         (1UL << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS        3
+#define WHEEL_RANGE         (1UL << (WHEEL_BITS * WHEEL_LEVELS))
+
+/** timers due within this window after wakeup run in the same wakeup */
+#define WHEEL_COALESCE      (2 / portTICK_PERIOD_MS)
+
+static timewheel_timer_t *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t timer_count = 0;
+/* next tick to process */
+static TickType_t wheel_base = 0;
+/* service task is blocked, until wheel_wake if wheel_deadline is set */
+static bool wheel_waiting = FALSE;
+static bool wheel_deadline = FALSE;
+static TickType_t wheel_wake = 0;
+static timewheel_stats_t wheel_stats;
+static xSemaphoreHandle xWheelSemaphore = NULL;
+
+/**
+ * @brief link timer into its slot, called in critical section
+ * @param timer - timer to link
+ */
+static void wheel_insert(timewheel_timer_t *timer)
+{
+    TickType_t expiry = timer->expiry;
+    TickType_t delta = expiry - wheel_base;
+    if ((int32_t)delta < 0)
+    {
+        /** already due, run at next processed tick */
+        expiry = wheel_base;
+        delta = 0;
+    }
+    else if (delta >= WHEEL_RANGE)
+    {
+        expiry = wheel_base + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+
+    uint8_t level = 0;
+    while (delta >= (1UL << (WHEEL_BITS * (level + 1))))
+    {
+        level ++;
+    }
+
+    timewheel_timer_t **slot = &wheel[level][(expiry >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    timer->next = *slot;
+    if (NULL != timer->next)
+    {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = slot;
+    *slot = timer;
+    timer_count ++;
+}
+
+/**
+ * @brief unlink timer from its slot, called in critical section
+ * @param timer - timer to unlink
+ */
+static void wheel_remove(timewheel_timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (NULL != timer->next)
+    {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer_count --;
+}
+
+/**
+ * @brief find first tick from base which has timer to run or to cascade,
+ *        called in critical section
+ * @param[out] tick - tick found
+ * @return FALSE if no timer is active
+ */
+static bool wheel_next(TickType_t *tick)
+{
+    if (0 == timer_count)
+    {
+        return FALSE;
+    }
+
+    TickType_t distance = WHEEL_RANGE;
+    for (TickType_t i = 0; i < WHEEL_SLOTS; ++i)
+    {
+        if (NULL != wheel[0][(wheel_base + i) & WHEEL_MASK])
+        {
+            distance = i;
+            break;
+        }
+    }
+
+    for (uint8_t level = 1; level < WHEEL_LEVELS; ++level)
+    {
+        uint8_t shift = WHEEL_BITS * level;
+        TickType_t index = wheel_base >> shift;
+        if (0 != (wheel_base & ((1UL << shift) - 1)))
+        {
+            index ++;
+        }
+        for (TickType_t i = 0; i < WHEEL_SLOTS; ++i, ++index)
+        {
+            TickType_t cascade = (index << shift) - wheel_base;
+            if (cascade >= distance)
+            {
+                break;
+            }
+            if (NULL != wheel[level][index & WHEEL_MASK])
+            {
+                distance = cascade;
+                break;
+            }
+        }
+    }
+
+    *tick = wheel_base + distance;
+    return TRUE;
+}
+
+/**
+ * @brief move timers of upper level slots reaching tick down, called in
+ *        critical section with base equals tick
+ * @param tick - tick processed
+ */
+static void wheel_cascade(TickType_t tick)
+{
+    for (uint8_t level = WHEEL_LEVELS - 1; level > 0; --level)
+    {
+        uint8_t shift = WHEEL_BITS * level;
+        if (0 != (tick & ((1UL << shift) - 1)))
+        {
+            continue;
+        }
+
+        timewheel_timer_t **slot = &wheel[level][(tick >> shift) & WHEEL_MASK];
+        timewheel_timer_t *timer = *slot;
+        *slot = NULL;
+        while (NULL != timer)
+        {
+            timewheel_timer_t *next = timer->next;
+            timer_count --;
+            wheel_insert(timer);
+            timer = next;
+        }
+    }
+}
+
+/**
+ * @brief run timers due at tick, periodic timer is linked again before its
+ *        callback runs so callback can stop it
+ * @param tick - tick processed
+ */
+static void wheel_run(TickType_t tick)
+{
+    for (;;)
+    {
+        TickType_t now = xTaskGetTickCount();
+        timewheel_callback_t callback = NULL;
+        void *pvParameters = NULL;
+        TickType_t expiry = 0;
+
+        taskENTER_CRITICAL();
+        timewheel_timer_t *timer = wheel[0][tick & WHEEL_MASK];
+        if (NULL != timer)
+        {
+            wheel_remove(timer);
+            callback = timer->callback;
+            pvParameters = timer->pvParameters;
+            expiry = timer->expiry;
+            if (0 != timer->period)
+            {
+                /** skip missed periods to keep phase */
+                TickType_t ref = ((int32_t)(now - tick) > 0) ? now : tick;
+                timer->expiry += timer->period;
+                if ((int32_t)(timer->expiry - ref) <= 0)
+                {
+                    timer->expiry += ((ref - timer->expiry) / timer->period + 1) *
+                                     timer->period;
+                }
+                wheel_insert(timer);
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if (NULL == timer)
+        {
+            break;
+        }
+
+        wheel_stats.fired ++;
+        if (((int32_t)(now - expiry) > 0) && (now - expiry > wheel_stats.max_late))
+        {
+            wheel_stats.max_late = now - expiry;
+        }
+        callback(pvParameters);
+    }
+}
+
+/**
+ * @brief timewheel service task, sleeps until next due slot
+ * @param pvParameters - task parameter
+ */
+static void vTimewheel(void *pvParameters)
+{
+    TickType_t tick = 0;
+    for (;;)
+    {
+        TickType_t limit = xTaskGetTickCount() + WHEEL_COALESCE;
+        wheel_stats.wakeups ++;
+        for (;;)
+        {
+            taskENTER_CRITICAL();
+            bool due = wheel_next(&tick) && ((int32_t)(limit - tick) >= 0);
+            if (due)
+            {
+                wheel_base = tick;
+                wheel_cascade(tick);
+            }
+            else
+            {
+                wheel_base = limit + 1;
+            }
+            taskEXIT_CRITICAL();
+
+            if (!due)
+            {
+                break;
+            }
+
+            wheel_run(tick);
+            taskENTER_CRITICAL();
+            wheel_base = tick + 1;
+            taskEXIT_CRITICAL();
+        }
+
+        taskENTER_CRITICAL();
+        wheel_deadline = wheel_next(&tick);
+        wheel_wake = tick;
+        wheel_waiting = TRUE;
+        taskEXIT_CRITICAL();
+
+        TickType_t delay = portMAX_DELAY;
+        if (wheel_deadline)
+        {
+            TickType_t now = xTaskGetTickCount();
+            delay = ((int32_t)(tick - now) > 0) ? (tick - now) : 0;
+        }
+        xSemaphoreTake(xWheelSemaphore, delay);
+        wheel_waiting = FALSE;
+    }
+}
+
+/**
+ * @brief link timer and wake service task if timer is due before its wakeup
+ * @param timer - timer to start
+ */
+static void wheel_start(timewheel_timer_t *timer)
+{
+    bool wake = FALSE;
+    taskENTER_CRITICAL();
+    wheel_insert(timer);
+    if (wheel_waiting &&
+        (!wheel_deadline || ((int32_t)(timer->expiry - wheel_wake) < 0)))
+    {
+        wheel_waiting = FALSE;
+        wake = TRUE;
+    }
+    taskEXIT_CRITICAL();
+
+    if (wake)
+    {
+        xSemaphoreGive(xWheelSemaphore);
+    }
+}
+
+/* timewheel task and semaphore memory */
+static StaticTask_t wheel_task;
+static StackType_t wheel_stack[TIMEWHEEL_STACK_SIZE];
+static StaticSemaphore_t wheel_semaphore;
+
+/**
+ * @brief initialize timewheel, must be called before any timer starts
+ * @return init status
+ */
+bool timewheel_init(void)
+{
+    TRACE("initialize timewheel...\r\n");
+    xWheelSemaphore = xSemaphoreCreateBinaryStatic(&wheel_semaphore);
+    xTaskCreateStatic(vTimewheel, "timewheel", TIMEWHEEL_STACK_SIZE, NULL,
+                      TIMEWHEEL_PRIORITY, wheel_stack, &wheel_task);
+    return TRUE;
+}
+
+/**
+ * @brief initialize timer, callback runs in timewheel task and must not block
+ *        for long
+ * @param timer - timer to initialize
+ * @param callback - expiry callback
+ * @param pvParameters - callback parameter
+ */
+void timewheel_timer_init(timewheel_timer_t *timer, timewheel_callback_t callback,
+                          void *pvParameters)
+{
+    memset(timer, 0, sizeof(timewheel_timer_t));
+    timer->callback = callback;
+    timer->pvParameters = pvParameters;
+}
+
+/**
+ * @brief start or restart periodic timer, expiries are aligned to multiples of
+ *        period so timers with harmonic periods share one wakeup
+ * @param timer - timer to start
+ * @param period - timer period in ticks
+ */
+void timewheel_start_periodic(timewheel_timer_t *timer, TickType_t period)
+{
+    timewheel_stop(timer);
+    if (0 == period)
+    {
+        period = 1;
+    }
+    TickType_t now = xTaskGetTickCount();
+    timer->period = period;
+    timer->expiry = now - (now % period) + period;
+    wheel_start(timer);
+}
+
+/**
+ * @brief start or restart one-shot timer
+ * @param timer - timer to start
+ * @param delay - delay in ticks
+ */
+void timewheel_start_once(timewheel_timer_t *timer, TickType_t delay)
+{
+    timewheel_stop(timer);
+    if (0 == delay)
+    {
+        delay = 1;
+    }
+    timer->period = 0;
+    timer->expiry = xTaskGetTickCount() + delay;
+    wheel_start(timer);
+}
+
+/**
+ * @brief stop timer, stopping inactive timer is allowed
+ * @param timer - timer to stop
+ */
+void timewheel_stop(timewheel_timer_t *timer)
+{
+    taskENTER_CRITICAL();
+    if (NULL != timer->pprev)
+    {
+        wheel_remove(timer);
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief check if timer is waiting to expire
+ * @param timer - timer to check
+ * @return TRUE if timer is active
+ */
+bool timewheel_is_active(const timewheel_timer_t *timer)
+{
+    return (NULL != timer->pprev);
+}
+
+/**
+ * @brief get timewheel statistics
+ * @param[out] stats - statistics
+ */
+void timewheel_get_stats(timewheel_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = wheel_stats;
+    taskEXIT_CRITICAL();
+}
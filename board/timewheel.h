@@ -0,0 +1,52 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _TIMEWHEEL_H_
+#define _TIMEWHEEL_H_
+
+#include "types.h"
+#include "FreeRTOS.h"
+
+BEGIN_DECLS
+
+typedef void (*timewheel_callback_t)(void *pvParameters);
+
+/** timer memory is owned by caller, fields are private to timewheel */
+typedef struct _timewheel_timer_t
+{
+    struct _timewheel_timer_t *next;
+    struct _timewheel_timer_t **pprev;
+    TickType_t expiry;
+    /** 0 means one-shot */
+    TickType_t period;
+    timewheel_callback_t callback;
+    void *pvParameters;
+} timewheel_timer_t;
+
+/** timewheel statistics */
+typedef struct
+{
+    /** service task wakeups */
+    uint32_t wakeups;
+    /** callbacks run */
+    uint32_t fired;
+    /** max callback delay after expiry in ticks */
+    uint32_t max_late;
+} timewheel_stats_t;
+
+bool timewheel_init(void);
+void timewheel_timer_init(timewheel_timer_t *timer, timewheel_callback_t callback,
+                          void *pvParameters);
+void timewheel_start_periodic(timewheel_timer_t *timer, TickType_t period);
+void timewheel_start_once(timewheel_timer_t *timer, TickType_t delay);
+void timewheel_stop(timewheel_timer_t *timer);
+bool timewheel_is_active(const timewheel_timer_t *timer);
+void timewheel_get_stats(timewheel_stats_t *stats);
+
+END_DECLS
+
+#endif /* _TIMEWHEEL_H_ */
@@ -0,0 +1,83 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include <string.h>
+#include "trace_level.h"
+#include "parameter.h"
+
+#undef __TRACE_MODULE
+#define __TRACE_MODULE  "[trace]"
+
+/** disabled levels of each module, zero means all levels enabled at startup */
+uint8_t trace_off[TRACE_ID_COUNT];
+
+/**
+ * @brief restore stored trace levels
+ */
+void trace_level_init(void)
+{
+    uint8_t levels[TRACE_ID_COUNT];
+    uint8_t num = param_load_trace_levels(TRACE_ID_COUNT, levels);
+    for (uint8_t i = 0; i < num; ++i)
+    {
+        trace_off[i] = (uint8_t)(~levels[i] & TRACE_LEVEL_ALL);
+    }
+    if (0 != num)
+    {
+        TRACE("restore %d trace levels\r\n", num);
+    }
+}
+
+/**
+ * @brief set module trace level
+ * @param id - module id, TRACE_ID_ALL for all modules
+ * @param level - enabled levels
+ * @param persist - store level and restore after reboot
+ * @return set status
+ */
+bool trace_level_set(uint8_t id, uint8_t level, bool persist)
+{
+    uint8_t off = (uint8_t)(~level & TRACE_LEVEL_ALL);
+    if (TRACE_ID_ALL == id)
+    {
+        memset(trace_off, off, TRACE_ID_COUNT);
+    }
+    else if (id < TRACE_ID_COUNT)
+    {
+        trace_off[id] = off;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    if (persist)
+    {
+        uint8_t levels[TRACE_ID_COUNT];
+        trace_level_get(levels, TRACE_ID_COUNT);
+        return param_store_trace_levels(TRACE_ID_COUNT, levels);
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief get trace level of all modules
+ * @param[out] levels - enabled levels, indexed by module id
+ * @param max - max module number
+ * @return module number
+ */
+uint8_t trace_level_get(uint8_t *levels, uint8_t max)
+{
+    uint8_t num = (max < TRACE_ID_COUNT) ? max : TRACE_ID_COUNT;
+    for (uint8_t i = 0; i < num; ++i)
+    {
+        levels[i] = (uint8_t)(~trace_off[i] & TRACE_LEVEL_ALL);
+    }
+
+    return num;
+}
@@ -0,0 +1,59 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _TRACE_LEVEL_H_
+#define _TRACE_LEVEL_H_
+
+#include "types.h"
+#include "trace.h"
+
+BEGIN_DECLS
+
+/** trace module id, set by __TRACE_ID in each file, order is protocol visible */
+typedef enum
+{
+    TRACE_ID_DEFAULT,
+    TRACE_ID_BOARD,
+    TRACE_ID_APP,
+    TRACE_ID_PARAM,
+    TRACE_ID_LICENSE,
+    TRACE_ID_FM,
+    TRACE_ID_I2C,
+    TRACE_ID_PTL,
+    TRACE_ID_PTL_PARAM,
+    TRACE_ID_PTL_ROBOT,
+    TRACE_ID_ROBOT,
+    TRACE_ID_KEYCTL,
+    TRACE_ID_RELAY,
+    TRACE_ID_ELEV,
+    TRACE_ID_LED,
+    TRACE_ID_BOARDMAP,
+    TRACE_ID_FLOORMAP,
+    TRACE_ID_ALTIMETER,
+    TRACE_ID_SWITCH,
+    TRACE_ID_BT,
+    TRACE_ID_EXPAND,
+    TRACE_ID_EXPAND_PTL,
+    TRACE_ID_EXPAND_TP,
+    TRACE_ID_EXPAND_HEALTH,
+    TRACE_ID_EXPAND_FW,
+    TRACE_ID_TIMESYNC,
+    TRACE_ID_DIAGNOSIS,
+    TRACE_ID_TIMEWHEEL,
+    TRACE_ID_COUNT,
+} trace_id_t;
+
+/** all modules */
+#define TRACE_ID_ALL            0xff
+
+void trace_level_init(void);
+bool trace_level_set(uint8_t id, uint8_t level, bool persist);
+uint8_t trace_level_get(uint8_t *levels, uint8_t max);
+
+END_DECLS
+
+#endif /* _TRACE_LEVEL_H_ */
@@ -20,6 +20,11 @@
 #define __ASM __asm
 #endif
 
+/* function runs from ram */
+#ifndef __RAMFUNC
+#define __RAMFUNC __ramfunc
+#endif
+
 #undef  MAX
 #define MAX(a, b)  (((a) > (b)) ? (a) : (b))
 
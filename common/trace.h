@@ -12,6 +12,18 @@
 
 BEGIN_DECLS
 
+/** trace level, module levels can be changed at runtime */
+#define TRACE_LEVEL_INFO   0x01
+#define TRACE_LEVEL_DUMP   0x02
+#define TRACE_LEVEL_ALL    (TRACE_LEVEL_INFO | TRACE_LEVEL_DUMP)
+
+/** module index of trace levels, overridden by each module */
+#define __TRACE_ID         0
+/** disabled levels of each module, implemented by user */
+extern uint8_t trace_off[];
+/** check level before arguments are evaluated */
+#define TRACE_ON(level)    (0 == (trace_off[__TRACE_ID] & (level)))
+
 #ifdef __ENABLE_TRACE
 #define __TRACE_MODULE   "[trace]"
 /**
@@ -27,7 +39,14 @@ BEGIN_DECLS
   #define TRECE(fmt, ...) trace(__FILE__, STR(__LINE__), fmt, ##__VA_ARGS__)
 */
 extern void trace(const char *module, const char *fmt, ...);
-#define TRACE(fmt, ...) trace(__TRACE_MODULE, fmt, ##__VA_ARGS__)
+#define TRACE(fmt, ...) \
+    do \
+    { \
+        if (TRACE_ON(TRACE_LEVEL_INFO)) \
+        { \
+            trace(__TRACE_MODULE, fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
 #else
 #define TRACE(fmt, ...)
 #endif
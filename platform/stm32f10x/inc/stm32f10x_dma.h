@@ -0,0 +1,102 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _STM32F10X_DMA_H_
+#define _STM32F10X_DMA_H_
+
+#include "types.h"
+
+/* dma channel definition */
+typedef enum
+{
+    DMA1_Channel1,
+    DMA1_Channel2,
+    DMA1_Channel3,
+    DMA1_Channel4,
+    DMA1_Channel5,
+    DMA1_Channel6,
+    DMA1_Channel7,
+    DMA2_Channel1,
+    DMA2_Channel2,
+    DMA2_Channel3,
+    DMA2_Channel4,
+    DMA2_Channel5,
+    DMA_Channel_Count,
+} DMA_Channel;
+
+/* dma transfer direction */
+#define DMA_DIR_PeriphSrc               (0x00)
+#define DMA_DIR_PeriphDst               (1 << 4)
+
+#define IS_DMA_DIR(DIR) ((DIR == DMA_DIR_PeriphSrc) || \
+                         (DIR == DMA_DIR_PeriphDst))
+
+/* dma data size */
+#define DMA_DataSize_Byte               (0x00)
+#define DMA_DataSize_HalfWord           (0x01)
+#define DMA_DataSize_Word               (0x02)
+
+#define IS_DMA_DATA_SIZE(SIZE) ((SIZE == DMA_DataSize_Byte) || \
+                                (SIZE == DMA_DataSize_HalfWord) || \
+                                (SIZE == DMA_DataSize_Word))
+
+/* dma channel priority */
+#define DMA_Priority_Low                (0x00 << 12)
+#define DMA_Priority_Medium             (0x01 << 12)
+#define DMA_Priority_High               (0x02 << 12)
+#define DMA_Priority_VeryHigh           (0x03 << 12)
+
+#define IS_DMA_PRIORITY(PRIORITY) ((PRIORITY == DMA_Priority_Low) || \
+                                   (PRIORITY == DMA_Priority_Medium) || \
+                                   (PRIORITY == DMA_Priority_High) || \
+                                   (PRIORITY == DMA_Priority_VeryHigh))
+
+/* dma interrupt */
+#define DMA_IT_TC                       (1 << 1)
+#define DMA_IT_HT                       (1 << 2)
+#define DMA_IT_TE                       (1 << 3)
+
+#define IS_DMA_IT(IT) ((IT == DMA_IT_TC) || (IT == DMA_IT_HT) || \
+                       (IT == DMA_IT_TE))
+
+/* dma flags */
+#define DMA_FLAG_GL                     (1 << 0)
+#define DMA_FLAG_TC                     (1 << 1)
+#define DMA_FLAG_HT                     (1 << 2)
+#define DMA_FLAG_TE                     (1 << 3)
+
+#define IS_DMA_FLAG(FLAG) ((FLAG == DMA_FLAG_GL) || (FLAG == DMA_FLAG_TC) || \
+                           (FLAG == DMA_FLAG_HT) || (FLAG == DMA_FLAG_TE))
+
+/* dma configuration */
+typedef struct
+{
+    uint32_t periphAddr;
+    uint32_t memAddr;
+    uint16_t count;
+    uint16_t direction;
+    uint16_t priority;
+    uint8_t periphSize;
+    uint8_t memSize;
+    bool periphInc;
+    bool memInc;
+    bool circular;
+    bool mem2mem;
+} DMA_Config;
+
+
+
+/* interface */
+void DMA_Setup(DMA_Channel channel, const DMA_Config *config);
+void DMA_StructInit(DMA_Config *config);
+void DMA_Enable(DMA_Channel channel, bool flag);
+void DMA_EnableInt(DMA_Channel channel, uint8_t intFlag, bool flag);
+bool DMA_IsFlagOn(DMA_Channel channel, uint8_t flag);
+void DMA_ClearFlag(DMA_Channel channel, uint8_t flag);
+uint16_t DMA_GetCount(DMA_Channel channel);
+
+#endif /* _STM32F10X_DMA_H_ */
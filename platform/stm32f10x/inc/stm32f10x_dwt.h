@@ -0,0 +1,17 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _STM32F10X_DWT_H_
+#define _STM32F10X_DWT_H_
+
+#include "types.h"
+
+/* interface */
+void DWT_EnableCycleCounter(bool flag);
+uint32_t DWT_GetCycleCounter(void);
+
+#endif /* _STM32F10X_DWT_H_ */
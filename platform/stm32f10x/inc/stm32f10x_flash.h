@@ -31,6 +31,9 @@
                                     (param == FLAH_FLAG_WRPRTERR) || \
                                     (param == FLAH_FLAG_EOP))
 
+/* flash page size, high density device */
+#define FLASH_PAGE_SIZE       0x800
+
 
 
 
@@ -45,5 +48,6 @@ void FLASH_ClrFlag(uint8_t flag);
 void FLASH_ErasePage(uint32_t addr);
 uint32_t FLASH_Write(uint32_t addr, uint8_t *data, uint32_t len);
 uint32_t FLASH_Read(uint32_t addr, uint8_t *data, uint32_t len);
+void FLASH_CopyAndReset(uint32_t dst, uint32_t src, uint32_t len);
 
 #endif /* _STM32F10X_FLASH_H_ */
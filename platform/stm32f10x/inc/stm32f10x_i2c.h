@@ -0,0 +1,81 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#ifndef _STM32F10X_I2C_H_
+#define _STM32F10X_I2C_H_
+
+#include "types.h"
+
+/* i2c group definition */
+typedef enum
+{
+    I2C1,
+    I2C2,
+    I2C_Count,
+} I2C_Group;
+
+/* i2c fast mode duty cycle, tlow/thigh */
+#define I2C_DutyCycle_2                 (0x0000)
+#define I2C_DutyCycle_16_9              (1 << 14)
+
+#define IS_I2C_DUTY_CYCLE(CYCLE) ((CYCLE == I2C_DutyCycle_2) || \
+                                  (CYCLE == I2C_DutyCycle_16_9))
+
+/* i2c status flags, SR1 */
+#define I2C_FLAG_SB                     (1 << 0)
+#define I2C_FLAG_ADDR                   (1 << 1)
+#define I2C_FLAG_BTF                    (1 << 2)
+#define I2C_FLAG_RXNE                   (1 << 6)
+#define I2C_FLAG_TXE                    (1 << 7)
+#define I2C_FLAG_BERR                   (1 << 8)
+#define I2C_FLAG_ARLO                   (1 << 9)
+#define I2C_FLAG_AF                     (1 << 10)
+#define I2C_FLAG_OVR                    (1 << 11)
+#define I2C_FLAG_TIMEOUT                (1 << 14)
+
+#define I2C_FLAG_ERROR                  (I2C_FLAG_BERR | I2C_FLAG_ARLO | \
+                                         I2C_FLAG_AF | I2C_FLAG_OVR | \
+                                         I2C_FLAG_TIMEOUT)
+
+/* i2c interrupt, CR2 */
+#define I2C_IT_ERR                      (1 << 8)
+#define I2C_IT_EVT                      (1 << 9)
+#define I2C_IT_BUF                      (1 << 10)
+
+#define IS_I2C_IT(IT) ((0 != (IT)) && \
+                       (0 == ((IT) & ~(I2C_IT_ERR | I2C_IT_EVT | I2C_IT_BUF))))
+
+/* i2c configuration */
+typedef struct
+{
+    uint32_t clockSpeed;
+    uint16_t dutyCycle;
+} I2C_Config;
+
+
+
+/* interface */
+void I2C_Setup(I2C_Group group, const I2C_Config *config);
+void I2C_StructInit(I2C_Config *config);
+void I2C_Enable(I2C_Group group, bool flag);
+void I2C_SoftwareReset(I2C_Group group);
+void I2C_GenerateStart(I2C_Group group);
+void I2C_GenerateStop(I2C_Group group);
+void I2C_EnableAck(I2C_Group group, bool flag);
+void I2C_SendAddress(I2C_Group group, uint8_t address, bool read);
+void I2C_WriteData(I2C_Group group, uint8_t data);
+uint8_t I2C_ReadData(I2C_Group group);
+uint32_t I2C_DataAddress(I2C_Group group);
+uint16_t I2C_GetFlags(I2C_Group group);
+void I2C_ClearFlag(I2C_Group group, uint16_t flag);
+void I2C_ClearAddrFlag(I2C_Group group);
+bool I2C_IsBusy(I2C_Group group);
+void I2C_EnableInt(I2C_Group group, uint16_t intFlag, bool flag);
+void I2C_EnableDMA(I2C_Group group, bool flag);
+void I2C_EnableDMALast(I2C_Group group, bool flag);
+
+#endif /* _STM32F10X_I2C_H_ */
@@ -85,5 +85,7 @@
 #define SCB_BASE         (0xE000ED00)
 #define NVIC_BASE        (0xE000E100)
 #define SYSTICK_BASE     (0xE000E010)
+#define DWT_BASE         (0xE0001000)
+#define COREDEBUG_BASE   (0xE000EDF0)
 
 #endif /* _STM32F10X_MAP_H_ */
@@ -137,6 +137,7 @@ bool SCB_IsNMIPending(void);
 void SCB_PendPendSV(bool flag);
 bool SCB_IsPendSVPending(void);
 void SCB_PendSysTick(bool flag);
+bool SCB_IsSysTickPending(void);
 bool SCB_IsIntPending(void);
 uint32_t SCB_GetPendIntVector(void);
 bool SCB_IsIntPreempted(void);
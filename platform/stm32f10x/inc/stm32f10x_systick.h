@@ -24,5 +24,7 @@ void SYSTICK_EnableCounter(bool flag);
 bool SYSTICK_IsCountFlagSet(void);
 void SYSTICK_ClrCountFlag(void);
 void SYSTICK_SetTickInterval(uint32_t time);
+uint32_t SYSTICK_GetCounter(void);
+uint32_t SYSTICK_GetReload(void);
 
 #endif /* _STM32F10X_SYSTICK_H_ */
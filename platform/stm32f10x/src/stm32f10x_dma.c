@@ -0,0 +1,206 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "stm32f10x_dma.h"
+#include "stm32f10x_map.h"
+#include "stm32f10x_cfg.h"
+
+/* dma register structure */
+typedef struct
+{
+    volatile uint32_t ISR;
+    volatile uint32_t IFCR;
+} DMA_T;
+
+/* dma channel register structure */
+typedef struct
+{
+    volatile uint32_t CCR;
+    volatile uint32_t CNDTR;
+    volatile uint32_t CPAR;
+    volatile uint32_t CMAR;
+    uint32_t RESERVED;
+} DMA_CHANNEL_T;
+
+/* dma definition */
+#define EN               (1 << 0)
+#define IT_MASK          (0x07 << 1)
+#define CIRC             (1 << 5)
+#define PINC             (1 << 6)
+#define MINC             (1 << 7)
+#define PSIZE_SHIFT      8
+#define MSIZE_SHIFT      10
+#define MEM2MEM          (1 << 14)
+
+#define DMA1_CHANNEL_NUM 7
+#define CHANNEL_OFFSET   0x08
+#define CHANNEL_SIZE     0x14
+#define FLAG_SHIFT(ch)   (((ch) < DMA1_CHANNEL_NUM) ? ((ch) * 4) : (((ch) - DMA1_CHANNEL_NUM) * 4))
+
+/**
+ * @brief get dma controller of channel
+ * @param channel - dma channel
+ * @return dma controller
+ */
+static DMA_T *DMA_Controller(DMA_Channel channel)
+{
+    return (DMA_T *)((channel < DMA1_CHANNEL_NUM) ? DMA1_BASE : DMA2_BASE);
+}
+
+/**
+ * @brief get dma channel registers
+ * @param channel - dma channel
+ * @return dma channel registers
+ */
+static DMA_CHANNEL_T *DMA_ChannelRegister(DMA_Channel channel)
+{
+    uint32_t base = (channel < DMA1_CHANNEL_NUM) ? DMA1_BASE : DMA2_BASE;
+    uint32_t index = (channel < DMA1_CHANNEL_NUM) ? channel : (channel - DMA1_CHANNEL_NUM);
+    return (DMA_CHANNEL_T *)(base + CHANNEL_OFFSET + index * CHANNEL_SIZE);
+}
+
+/**
+ * @brief setup dma channel, channel must be disabled
+ * @param channel - dma channel
+ * @param config - dma configuration
+ */
+void DMA_Setup(DMA_Channel channel, const DMA_Config *config)
+{
+    assert_param(channel < DMA_Channel_Count);
+    assert_param(config != NULL);
+    assert_param(IS_DMA_DIR(config->direction));
+    assert_param(IS_DMA_PRIORITY(config->priority));
+    assert_param(IS_DMA_DATA_SIZE(config->periphSize));
+    assert_param(IS_DMA_DATA_SIZE(config->memSize));
+
+    DMA_CHANNEL_T *const ChannelX = DMA_ChannelRegister(channel);
+    uint32_t ccr = ChannelX->CCR & IT_MASK;
+    ccr |= config->direction | config->priority;
+    ccr |= ((uint32_t)config->periphSize << PSIZE_SHIFT);
+    ccr |= ((uint32_t)config->memSize << MSIZE_SHIFT);
+    if (config->periphInc)
+    {
+        ccr |= PINC;
+    }
+    if (config->memInc)
+    {
+        ccr |= MINC;
+    }
+    if (config->circular)
+    {
+        ccr |= CIRC;
+    }
+    if (config->mem2mem)
+    {
+        ccr |= MEM2MEM;
+    }
+
+    ChannelX->CCR = ccr;
+    ChannelX->CNDTR = config->count;
+    ChannelX->CPAR = config->periphAddr;
+    ChannelX->CMAR = config->memAddr;
+}
+
+/**
+ * @brief fill dma configuration with default value
+ * @param config - dma configuration
+ */
+void DMA_StructInit(DMA_Config *config)
+{
+    assert_param(config != NULL);
+    config->periphAddr = 0;
+    config->memAddr = 0;
+    config->count = 0;
+    config->direction = DMA_DIR_PeriphSrc;
+    config->priority = DMA_Priority_Low;
+    config->periphSize = DMA_DataSize_Byte;
+    config->memSize = DMA_DataSize_Byte;
+    config->periphInc = FALSE;
+    config->memInc = TRUE;
+    config->circular = FALSE;
+    config->mem2mem = FALSE;
+}
+
+/**
+ * @brief enable or disable dma channel
+ * @param channel - dma channel
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void DMA_Enable(DMA_Channel channel, bool flag)
+{
+    assert_param(channel < DMA_Channel_Count);
+
+    DMA_CHANNEL_T *const ChannelX = DMA_ChannelRegister(channel);
+    if (flag)
+    {
+        ChannelX->CCR |= EN;
+    }
+    else
+    {
+        ChannelX->CCR &= ~EN;
+    }
+}
+
+/**
+ * @brief enable or disable dma channel interrupt
+ * @param channel - dma channel
+ * @param intFlag - interrupt
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void DMA_EnableInt(DMA_Channel channel, uint8_t intFlag, bool flag)
+{
+    assert_param(channel < DMA_Channel_Count);
+    assert_param(IS_DMA_IT(intFlag));
+
+    DMA_CHANNEL_T *const ChannelX = DMA_ChannelRegister(channel);
+    if (flag)
+    {
+        ChannelX->CCR |= intFlag;
+    }
+    else
+    {
+        ChannelX->CCR &= ~intFlag;
+    }
+}
+
+/**
+ * @brief check dma channel flag
+ * @param channel - dma channel
+ * @param flag - dma flag
+ * @return TRUE if flag is set
+ */
+bool DMA_IsFlagOn(DMA_Channel channel, uint8_t flag)
+{
+    assert_param(channel < DMA_Channel_Count);
+    assert_param(IS_DMA_FLAG(flag));
+
+    return (0 != (DMA_Controller(channel)->ISR & ((uint32_t)flag << FLAG_SHIFT(channel))));
+}
+
+/**
+ * @brief clear dma channel flag
+ * @param channel - dma channel
+ * @param flag - dma flag
+ */
+void DMA_ClearFlag(DMA_Channel channel, uint8_t flag)
+{
+    assert_param(channel < DMA_Channel_Count);
+
+    DMA_Controller(channel)->IFCR = ((uint32_t)flag << FLAG_SHIFT(channel));
+}
+
+/**
+ * @brief get remaining transfer count
+ * @param channel - dma channel
+ * @return remaining count
+ */
+uint16_t DMA_GetCount(DMA_Channel channel)
+{
+    assert_param(channel < DMA_Channel_Count);
+
+    return (uint16_t)DMA_ChannelRegister(channel)->CNDTR;
+}
@@ -0,0 +1,60 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "stm32f10x_dwt.h"
+#include "stm32f10x_map.h"
+#include "stm32f10x_cfg.h"
+
+/* dwt register structure */
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_T;
+
+/* core debug register structure */
+typedef struct
+{
+    volatile uint32_t DHCSR;
+    volatile uint32_t DCRSR;
+    volatile uint32_t DCRDR;
+    volatile uint32_t DEMCR;
+} COREDEBUG_T;
+
+static DWT_T *DWT = (DWT_T *)DWT_BASE;
+static COREDEBUG_T *COREDEBUG = (COREDEBUG_T *)COREDEBUG_BASE;
+
+/* dwt register definition */
+#define CTRL_CYCCNTENA    (0x01)
+#define DEMCR_TRCENA      (1 << 24)
+
+/**
+ * @brief start or stop cycle counter, counter runs at core clock
+ * @param flag - TRUE: start FALSE: stop
+ */
+void DWT_EnableCycleCounter(bool flag)
+{
+    if (flag)
+    {
+        COREDEBUG->DEMCR |= DEMCR_TRCENA;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= CTRL_CYCCNTENA;
+    }
+    else
+    {
+        DWT->CTRL &= ~CTRL_CYCCNTENA;
+    }
+}
+
+/**
+ * @brief get cycle counter value
+ * @return cycle counter
+ */
+uint32_t DWT_GetCycleCounter(void)
+{
+    return DWT->CYCCNT;
+}
@@ -224,3 +224,38 @@ uint32_t FLASH_Read(uint32_t addr, uint8_t *data, uint32_t len)
     memcpy(data, (void *)addr, len);
     return len;
 }
+
+/**
+ * @brief copy flash data then reset system, runs from ram with all
+ *        interrupts masked, so the flash it is called from can be overwritten
+ * @param dst - destination address, page aligned
+ * @param src - source address
+ * @param len - data length
+ */
+__RAMFUNC void FLASH_CopyAndReset(uint32_t dst, uint32_t src, uint32_t len)
+{
+    FLASH_T *flash = (FLASH_T *)FLASH_BASE;
+    __ASM("CPSID F");
+    flash->KEYR = KEY1;
+    flash->KEYR = KEY2;
+    for (uint32_t offset = 0; offset < len; offset += FLASH_PAGE_SIZE)
+    {
+        *((volatile uint32_t *)CR_PER) = 0x01;
+        flash->AR = dst + offset;
+        *((volatile uint32_t *)CR_STRT) = 0x01;
+        while (flash->SR & FLAH_FLAG_BSY);
+        *((volatile uint32_t *)CR_PER) = 0x00;
+
+        *((volatile uint32_t *)CR_PG) = 0x01;
+        for (uint32_t i = offset; (i < offset + FLASH_PAGE_SIZE) && (i < len); i += 2)
+        {
+            *(volatile uint16_t *)(dst + i) = *(volatile uint16_t *)(src + i);
+            while (flash->SR & FLAH_FLAG_BSY);
+        }
+        *((volatile uint32_t *)CR_PG) = 0x00;
+    }
+
+    /** reset, AIRCR */
+    *((volatile uint32_t *)(SCB_BASE + 0x0c)) = 0x05FA0004;
+    for (;;);
+}
@@ -0,0 +1,348 @@
+/**
+* This file is part of the auto-elevator project.
+*
+* Copyright 2018, Huang Yang <elious.huang@gmail.com>. All rights reserved.
+*
+* See the COPYING file for the terms of usage and distribution.
+*/
+#include "stm32f10x_i2c.h"
+#include "stm32f10x_map.h"
+#include "stm32f10x_rcc.h"
+#include "stm32f10x_cfg.h"
+
+/* i2c register structure */
+typedef struct
+{
+    volatile uint16_t CR1;
+    uint16_t RESERVED0;
+    volatile uint16_t CR2;
+    uint16_t RESERVED1;
+    volatile uint16_t OAR1;
+    uint16_t RESERVED2;
+    volatile uint16_t OAR2;
+    uint16_t RESERVED3;
+    volatile uint16_t DR;
+    uint16_t RESERVED4;
+    volatile uint16_t SR1;
+    uint16_t RESERVED5;
+    volatile uint16_t SR2;
+    uint16_t RESERVED6;
+    volatile uint16_t CCR;
+    uint16_t RESERVED7;
+    volatile uint16_t TRISE;
+    uint16_t RESERVED8;
+} I2C_T;
+
+/* i2c definition */
+#define PE               (1 << 0)
+#define START            (1 << 8)
+#define STOP             (1 << 9)
+#define ACK              (1 << 10)
+#define SWRST            (1 << 15)
+
+#define FREQ             (0x3f)
+#define DMAEN            (1 << 11)
+#define LAST             (1 << 12)
+
+#define BUSY             (1 << 1)
+
+#define CCR_FS           (1 << 15)
+#define CCR_MASK         (0x0fff)
+
+/* standard mode max clock */
+#define I2C_SPEED_STANDARD   100000
+
+/* I2C group array */
+static I2C_T *const I2Cx[] = {(I2C_T *)I2C1_BASE,
+                              (I2C_T *)I2C2_BASE,
+                             };
+
+/**
+ * @brief setup i2c clock, i2c must be disabled
+ * @param group - i2c group
+ * @param config - i2c configuration
+ */
+void I2C_Setup(I2C_Group group, const I2C_Config *config)
+{
+    assert_param(group < I2C_Count);
+    assert_param(config != NULL);
+    assert_param((config->clockSpeed <= 400000) && (config->clockSpeed != 0));
+    assert_param(IS_I2C_DUTY_CYCLE(config->dutyCycle));
+
+    I2C_T *const I2CX = I2Cx[group];
+    uint32_t pclk = RCC_GetPCLK1();
+    uint16_t freq = (uint16_t)(pclk / 1000000);
+    I2CX->CR2 = (I2CX->CR2 & ~FREQ) | freq;
+
+    uint16_t ccr = 0;
+    if (config->clockSpeed <= I2C_SPEED_STANDARD)
+    {
+        /* thigh = tlow = ccr * tpclk */
+        ccr = (uint16_t)(pclk / (config->clockSpeed * 2));
+        if (ccr < 4)
+        {
+            ccr = 4;
+        }
+        /* max rise time 1000ns */
+        I2CX->TRISE = freq + 1;
+    }
+    else
+    {
+        if (I2C_DutyCycle_2 == config->dutyCycle)
+        {
+            ccr = (uint16_t)(pclk / (config->clockSpeed * 3));
+        }
+        else
+        {
+            ccr = (uint16_t)(pclk / (config->clockSpeed * 25));
+        }
+        if (0 == ccr)
+        {
+            ccr = 1;
+        }
+        ccr |= CCR_FS | config->dutyCycle;
+        /* max rise time 300ns */
+        I2CX->TRISE = (uint16_t)(freq * 300 / 1000 + 1);
+    }
+    I2CX->CCR = ccr;
+}
+
+/**
+ * @brief fill i2c configuration with default value
+ * @param config - i2c configuration
+ */
+void I2C_StructInit(I2C_Config *config)
+{
+    assert_param(config != NULL);
+    config->clockSpeed = I2C_SPEED_STANDARD;
+    config->dutyCycle = I2C_DutyCycle_2;
+}
+
+/**
+ * @brief enable or disable i2c
+ * @param group - i2c group
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void I2C_Enable(I2C_Group group, bool flag)
+{
+    assert_param(group < I2C_Count);
+
+    I2C_T *const I2CX = I2Cx[group];
+    if (flag)
+    {
+        I2CX->CR1 |= PE;
+    }
+    else
+    {
+        I2CX->CR1 &= ~PE;
+    }
+}
+
+/**
+ * @brief reset i2c, clock configuration is lost, used to recover stuck busy
+ *        flag
+ * @param group - i2c group
+ */
+void I2C_SoftwareReset(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+
+    I2C_T *const I2CX = I2Cx[group];
+    I2CX->CR1 |= SWRST;
+    I2CX->CR1 &= ~SWRST;
+}
+
+/**
+ * @brief generate start condition
+ * @param group - i2c group
+ */
+void I2C_GenerateStart(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+    I2Cx[group]->CR1 |= START;
+}
+
+/**
+ * @brief generate stop condition
+ * @param group - i2c group
+ */
+void I2C_GenerateStop(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+    I2Cx[group]->CR1 |= STOP;
+}
+
+/**
+ * @brief enable or disable acknowledge
+ * @param group - i2c group
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void I2C_EnableAck(I2C_Group group, bool flag)
+{
+    assert_param(group < I2C_Count);
+
+    I2C_T *const I2CX = I2Cx[group];
+    if (flag)
+    {
+        I2CX->CR1 |= ACK;
+    }
+    else
+    {
+        I2CX->CR1 &= ~ACK;
+    }
+}
+
+/**
+ * @brief send 7-bit slave address
+ * @param group - i2c group
+ * @param address - slave address
+ * @param read - TRUE: read FALSE: write
+ */
+void I2C_SendAddress(I2C_Group group, uint8_t address, bool read)
+{
+    assert_param(group < I2C_Count);
+    I2Cx[group]->DR = (uint16_t)((address << 1) | (read ? 0x01 : 0x00));
+}
+
+/**
+ * @brief write data register
+ * @param group - i2c group
+ * @param data - data to write
+ */
+void I2C_WriteData(I2C_Group group, uint8_t data)
+{
+    assert_param(group < I2C_Count);
+    I2Cx[group]->DR = data;
+}
+
+/**
+ * @brief read data register
+ * @param group - i2c group
+ * @return data read
+ */
+uint8_t I2C_ReadData(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+    return (uint8_t)I2Cx[group]->DR;
+}
+
+/**
+ * @brief get data register address, used by dma
+ * @param group - i2c group
+ * @return data register address
+ */
+uint32_t I2C_DataAddress(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+    return (uint32_t)&I2Cx[group]->DR;
+}
+
+/**
+ * @brief get status flags, address flag is not cleared
+ * @param group - i2c group
+ * @return SR1 value
+ */
+uint16_t I2C_GetFlags(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+    return I2Cx[group]->SR1;
+}
+
+/**
+ * @brief clear error flags
+ * @param group - i2c group
+ * @param flag - error flags
+ */
+void I2C_ClearFlag(I2C_Group group, uint16_t flag)
+{
+    assert_param(group < I2C_Count);
+    I2Cx[group]->SR1 = (uint16_t)~(flag & I2C_FLAG_ERROR);
+}
+
+/**
+ * @brief clear address flag by reading SR1 then SR2
+ * @param group - i2c group
+ */
+void I2C_ClearAddrFlag(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+
+    I2C_T *const I2CX = I2Cx[group];
+    volatile uint16_t reg = I2CX->SR1;
+    reg = I2CX->SR2;
+    UNUSED(reg);
+}
+
+/**
+ * @brief check if bus is busy
+ * @param group - i2c group
+ * @return TRUE if busy
+ */
+bool I2C_IsBusy(I2C_Group group)
+{
+    assert_param(group < I2C_Count);
+    return (0 != (I2Cx[group]->SR2 & BUSY));
+}
+
+/**
+ * @brief enable or disable i2c interrupt
+ * @param group - i2c group
+ * @param intFlag - interrupts
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void I2C_EnableInt(I2C_Group group, uint16_t intFlag, bool flag)
+{
+    assert_param(group < I2C_Count);
+    assert_param(IS_I2C_IT(intFlag));
+
+    I2C_T *const I2CX = I2Cx[group];
+    if (flag)
+    {
+        I2CX->CR2 |= intFlag;
+    }
+    else
+    {
+        I2CX->CR2 &= ~intFlag;
+    }
+}
+
+/**
+ * @brief enable or disable dma request
+ * @param group - i2c group
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void I2C_EnableDMA(I2C_Group group, bool flag)
+{
+    assert_param(group < I2C_Count);
+
+    I2C_T *const I2CX = I2Cx[group];
+    if (flag)
+    {
+        I2CX->CR2 |= DMAEN;
+    }
+    else
+    {
+        I2CX->CR2 &= ~DMAEN;
+    }
+}
+
+/**
+ * @brief next dma end of transfer is the last transfer, receiver nacks
+ *        last byte
+ * @param group - i2c group
+ * @param flag - TRUE: enable FALSE: disable
+ */
+void I2C_EnableDMALast(I2C_Group group, bool flag)
+{
+    assert_param(group < I2C_Count);
+
+    I2C_T *const I2CX = I2Cx[group];
+    if (flag)
+    {
+        I2CX->CR2 |= LAST;
+    }
+    else
+    {
+        I2CX->CR2 &= ~LAST;
+    }
+}
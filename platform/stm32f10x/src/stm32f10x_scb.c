@@ -173,6 +173,22 @@ void SCB_PendSysTick(bool flag)
     }
 }
 
+/**
+ * @brief check if SysTick is pending
+ * @return TRUE:yes FALSE:no
+ */
+bool SCB_IsSysTickPending(void)
+{
+    if (((SCB->ICSR) & PENDSTSET) == PENDSTSET)
+    {
+        return TRUE;
+    }
+    else
+    {
+        return FALSE;
+    }
+}
+
 /**
  * @brief check if any interrupt is pending, excluding NMI and Faults
  * @return TRUE:yes FALSE:no
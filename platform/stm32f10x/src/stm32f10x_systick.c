@@ -88,6 +88,24 @@ void SYSTICK_ClrCountFlag(void)
     SYSTICK->CTRL &= ~CTRL_COUNTFLAG;
 }
 
+/**
+ * @brief get systick current value, counts down to 0
+ * @return current value
+ */
+uint32_t SYSTICK_GetCounter(void)
+{
+    return SYSTICK->VAL;
+}
+
+/**
+ * @brief get systick reload value
+ * @return reload value
+ */
+uint32_t SYSTICK_GetReload(void)
+{
+    return SYSTICK->LOAD;
+}
+
 /**
  * @brief set systick tick interval
  * @param time intervel, unit is ms
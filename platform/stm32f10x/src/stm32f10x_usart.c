@@ -328,6 +328,18 @@ uint8_t USART_ReadData(USART_Group group)
     return UsartX->DR;
 }
 
+/**
+ * @param get data register address, used by dma
+ * @param group: usart group
+ * @return data register address
+ */
+uint32_t USART_DataAddress(USART_Group group)
+{
+    assert_param(group < UASRT_Count);
+
+    return (uint32_t)&USARTx[group]->DR;
+}
+
 /**
  * @param set usart wakeup mode
  * @param group: usart group
@@ -510,11 +522,11 @@ void USART_EnableDMATX(USART_Group group, bool flag)
 
     if (flag)
     {
-        UsartX->CR3 &= ~(1 << 7);
+        UsartX->CR3 |= (1 << 7);
     }
     else
     {
-        UsartX->CR3 |= (1 << 7);
+        UsartX->CR3 &= ~(1 << 7);
     }
 }
 
@@ -531,11 +543,11 @@ void USART_EnableDMARX(USART_Group group, bool flag)
 
     if (flag)
     {
-        UsartX->CR3 &= ~(1 << 6);
+        UsartX->CR3 |= (1 << 6);
     }
     else
     {
-        UsartX->CR3 |= (1 << 6);
+        UsartX->CR3 &= ~(1 << 6);
     }
 }
 
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * decode token trace frames sent by firmware built with USE_TOKEN_TRACE
+ * usage: logdecode firmware.bin [base address] < log
+ * module and format strings are read from firmware image, text outside
+ * frames is printed as it is
+ */
+
+#define TOKEN_SYNC      0xa0
+#define TOKEN_MASK      0xf8
+#define TOKEN_BASE      0x08000000
+#define TRACE_MAX_ARGS  6
+
+#define RECORD_TRACE    1
+#define RECORD_RAW      2
+#define RECORD_HEX      3
+#define TOKEN_DROP      5
+
+static uint8_t *image = NULL;
+static uint32_t image_size = 0;
+static uint32_t base = TOKEN_BASE;
+static uint32_t tick = 0;
+static uint8_t check = 0;
+
+/**
+ * @brief load firmware image
+ * @param name - image file name
+ * @return load status
+ */
+static bool load_image(const char *name)
+{
+    FILE *file = fopen(name, "rb");
+    if (NULL == file)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    image_size = (uint32_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    image = malloc(image_size + 1);
+    if (NULL == image)
+    {
+        fclose(file);
+        return false;
+    }
+    image_size = (uint32_t)fread(image, 1, image_size, file);
+    image[image_size] = '\0';
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * @brief get string in firmware image
+ * @param offset - offset from token base
+ * @return string
+ */
+static const char *image_string(uint32_t offset)
+{
+    offset -= (base - TOKEN_BASE);
+    if (offset >= image_size)
+    {
+        return "<unknown>";
+    }
+    return (const char *)image + offset;
+}
+
+/**
+ * @brief read one frame byte
+ * @param data - read byte
+ * @return false if input ended
+ */
+static bool read_byte(uint8_t *data)
+{
+    int c = getchar();
+    if (EOF == c)
+    {
+        return false;
+    }
+    *data = (uint8_t)c;
+    check ^= *data;
+    return true;
+}
+
+/**
+ * @brief read varint
+ * @param val - read value
+ * @return false if input ended
+ */
+static bool read_varint(uint32_t *val)
+{
+    uint8_t data = 0;
+    uint8_t shift = 0;
+    *val = 0;
+    do
+    {
+        if (!read_byte(&data))
+        {
+            return false;
+        }
+        *val |= (uint32_t)(data & 0x7f) << shift;
+        shift += 7;
+    } while ((data & 0x80) && (shift < 35));
+
+    return true;
+}
+
+/**
+ * @brief read data with length
+ * @param data - read data
+ * @param len - data length
+ * @return false if input ended
+ */
+static bool read_data(uint8_t *data, uint32_t *len)
+{
+    if (!read_varint(len) || (*len > 255))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < *len; ++i)
+    {
+        if (!read_byte(&data[i]))
+        {
+            return false;
+        }
+    }
+    data[*len] = '\0';
+    return true;
+}
+
+/**
+ * @brief decode trace frame, arguments are collected the same way as firmware
+ * @param out - decoded text
+ * @param size - text buffer size
+ * @return decode status
+ */
+static bool decode_trace(char *out, size_t size)
+{
+    uint32_t delta = 0;
+    uint32_t module = 0;
+    uint32_t fmt = 0;
+    if (!read_varint(&delta) || !read_varint(&fmt) || !read_varint(&module))
+    {
+        return false;
+    }
+    tick += delta;
+    /* module is stored as zigzag distance from format */
+    module = fmt + (uint32_t)((module >> 1) ^ (~(module & 1) + 1));
+
+    const char *p = image_string(fmt);
+    size_t cnt = (size_t)snprintf(out, size, "%10u %s ", tick, image_string(module));
+    uint8_t argc = 0;
+    while (('\0' != *p) && (cnt < size))
+    {
+        if (('%' != *p) || (argc >= TRACE_MAX_ARGS))
+        {
+            out[cnt++] = *p++;
+            continue;
+        }
+
+        /* copy conversion without length modifier */
+        char spec[16];
+        uint8_t len = 0;
+        spec[len++] = *p++;
+        while (('\0' != *p) && (NULL != strchr("-+ #0123456789.lh", *p)))
+        {
+            if ((NULL == strchr("lh", *p)) && (len < sizeof(spec) - 2))
+            {
+                spec[len++] = *p;
+            }
+            p++;
+        }
+        if ('\0' == *p)
+        {
+            break;
+        }
+        spec[len++] = *p;
+        spec[len] = '\0';
+
+        if ('%' == *p)
+        {
+            out[cnt++] = '%';
+        }
+        else if ('s' == *p)
+        {
+            uint8_t str[256];
+            uint32_t str_len = 0;
+            if (!read_data(str, &str_len))
+            {
+                return false;
+            }
+            cnt += (size_t)snprintf(out + cnt, size - cnt, spec, (const char *)str);
+            argc++;
+        }
+        else
+        {
+            uint32_t val = 0;
+            if (!read_varint(&val))
+            {
+                return false;
+            }
+            int32_t arg = (int32_t)((val >> 1) ^ (~(val & 1) + 1));
+            cnt += (size_t)snprintf(out + cnt, size - cnt, spec, arg);
+            argc++;
+        }
+        p++;
+    }
+    if (cnt >= size)
+    {
+        cnt = size - 1;
+    }
+    out[cnt] = '\0';
+
+    return true;
+}
+
+/**
+ * @brief decode one frame after sync byte
+ * @param sync - sync byte with frame type
+ * @return false if input ended
+ */
+static bool decode_frame(uint8_t sync)
+{
+    char out[1024];
+    uint8_t data[256];
+    uint32_t len = 0;
+    uint8_t type = sync & ~TOKEN_MASK;
+    bool ok = true;
+
+    check = sync;
+    out[0] = '\0';
+
+    switch (type)
+    {
+    case RECORD_TRACE:
+        ok = decode_trace(out, sizeof(out));
+        break;
+    case RECORD_RAW:
+        ok = read_data(data, &len);
+        memcpy(out, data, len + 1);
+        break;
+    case RECORD_HEX:
+        ok = read_data(data, &len);
+        for (uint32_t i = 0; i < len; ++i)
+        {
+            sprintf(out + i * 3, "%02x ", data[i]);
+        }
+        break;
+    case TOKEN_DROP:
+        ok = read_varint(&len);
+        sprintf(out, "[trace] %u records dropped\r\n", len);
+        break;
+    default:
+        fprintf(stderr, "unknown frame type %d\n", type);
+        return true;
+    }
+
+    uint8_t sum = check;
+    uint8_t recv = 0;
+    if (!ok || !read_byte(&recv))
+    {
+        return false;
+    }
+    if (sum != recv)
+    {
+        fprintf(stderr, "frame check failed\n");
+        return true;
+    }
+
+    fputs(out, stdout);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: logdecode firmware.bin [base address] < log\r\n");
+        return 1;
+    }
+
+    if (!load_image(argv[1]))
+    {
+        printf("load firmware image %s failed!\r\n", argv[1]);
+        return 1;
+    }
+    if (argc >= 3)
+    {
+        base = (uint32_t)strtoul(argv[2], NULL, 0);
+    }
+
+    int c = 0;
+    while (EOF != (c = getchar()))
+    {
+        if (TOKEN_SYNC == (c & TOKEN_MASK))
+        {
+            if (!decode_frame((uint8_t)c))
+            {
+                break;
+            }
+        }
+        else
+        {
+            putchar(c);
+        }
+    }
+
+    free(image);
+    return 0;
+}
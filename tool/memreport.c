@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+/**
+ * print per module memory usage from iar linker map file
+ * usage: memreport AutoElevator.map [budget file]
+ * budget file lines are "module max_rw_data [max_ro_total]", '#' starts a
+ * comment, exit status is 2 if any module is over budget
+ */
+
+#define FLASH_SIZE      (256 * 1024)
+#define RAM_SIZE        (48 * 1024)
+#define MODULE_MAX      256
+#define NAME_LEN        64
+#define LINE_LEN        512
+
+typedef struct
+{
+    char name[NAME_LEN];
+    uint32_t ro_code;
+    uint32_t ro_data;
+    uint32_t rw_data;
+    int32_t max_rw;
+    int32_t max_ro;
+} module_t;
+
+static module_t modules[MODULE_MAX];
+static uint32_t module_num = 0;
+/* column end position of ro code, ro data and rw data */
+static size_t column_end[3];
+
+/**
+ * @brief parse number with space as thousands separator
+ * @param str - column text
+ * @param len - column length
+ * @return number
+ */
+static uint32_t parse_number(const char *str, size_t len)
+{
+    uint32_t val = 0;
+    for (size_t i = 0; (i < len) && ('\0' != str[i]); ++i)
+    {
+        if (isdigit((unsigned char)str[i]))
+        {
+            val = val * 10 + (uint32_t)(str[i] - '0');
+        }
+    }
+    return val;
+}
+
+/**
+ * @brief find column positions in summary header
+ * @param line - header line
+ * @return TRUE if line is header
+ */
+static bool parse_header(const char *line)
+{
+    static const char *const labels[] = {"ro code", "ro data", "rw data"};
+    if (NULL == strstr(line, "Module"))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        const char *p = strstr(line, labels[i]);
+        if (NULL == p)
+        {
+            return false;
+        }
+        column_end[i] = (size_t)(p - line) + strlen(labels[i]);
+    }
+    return true;
+}
+
+/**
+ * @brief find or add module
+ * @param name - module name
+ * @return module
+ */
+static module_t *get_module(const char *name)
+{
+    for (uint32_t i = 0; i < module_num; ++i)
+    {
+        if (0 == strcmp(modules[i].name, name))
+        {
+            return &modules[i];
+        }
+    }
+    if (module_num >= MODULE_MAX)
+    {
+        return NULL;
+    }
+    module_t *module = &modules[module_num++];
+    memset(module, 0, sizeof(module_t));
+    strncpy(module->name, name, NAME_LEN - 1);
+    module->max_rw = -1;
+    module->max_ro = -1;
+    return module;
+}
+
+/**
+ * @brief parse module line in summary
+ * @param line - module line
+ */
+static void parse_module(const char *line)
+{
+    char name[NAME_LEN];
+    if ((1 != sscanf(line, " %63s", name)) || (NULL == strstr(name, ".o")))
+    {
+        return ;
+    }
+
+    size_t len = strlen(line);
+    size_t start = strlen(line) - strlen(strstr(line, name)) + strlen(name);
+    uint32_t vals[3] = {0, 0, 0};
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        size_t end = (column_end[i] < len) ? column_end[i] : len;
+        if (end > start)
+        {
+            vals[i] = parse_number(line + start, end - start);
+            start = end;
+        }
+    }
+
+    module_t *module = get_module(name);
+    if (NULL != module)
+    {
+        module->ro_code += vals[0];
+        module->ro_data += vals[1];
+        module->rw_data += vals[2];
+    }
+}
+
+/**
+ * @brief load module summary from map file
+ * @param name - map file name
+ * @return load status
+ */
+static bool load_map(const char *name)
+{
+    FILE *file = fopen(name, "r");
+    if (NULL == file)
+    {
+        return false;
+    }
+
+    char line[LINE_LEN];
+    bool summary = false;
+    bool header = false;
+    while (NULL != fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (NULL != strstr(line, "*** MODULE SUMMARY"))
+        {
+            summary = true;
+            continue;
+        }
+        if (!summary)
+        {
+            continue;
+        }
+        if (NULL != strstr(line, "*** ENTRY LIST"))
+        {
+            break;
+        }
+        if (!header)
+        {
+            header = parse_header(line);
+            continue;
+        }
+        parse_module(line);
+    }
+    fclose(file);
+
+    return header;
+}
+
+/**
+ * @brief load module budget
+ * @param name - budget file name
+ * @return load status
+ */
+static bool load_budget(const char *name)
+{
+    FILE *file = fopen(name, "r");
+    if (NULL == file)
+    {
+        return false;
+    }
+
+    char line[LINE_LEN];
+    while (NULL != fgets(line, sizeof(line), file))
+    {
+        char module_name[NAME_LEN];
+        int max_rw = -1;
+        int max_ro = -1;
+        line[strcspn(line, "#")] = '\0';
+        if (sscanf(line, " %63s %d %d", module_name, &max_rw, &max_ro) < 2)
+        {
+            continue;
+        }
+        module_t *module = get_module(module_name);
+        if (NULL != module)
+        {
+            module->max_rw = max_rw;
+            module->max_ro = max_ro;
+        }
+    }
+    fclose(file);
+
+    return true;
+}
+
+static int compare_rw(const void *a, const void *b)
+{
+    const module_t *ma = a;
+    const module_t *mb = b;
+    if (ma->rw_data != mb->rw_data)
+    {
+        return (ma->rw_data < mb->rw_data) ? 1 : -1;
+    }
+    return strcmp(ma->name, mb->name);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: memreport AutoElevator.map [budget file]\r\n");
+        return 1;
+    }
+
+    if (!load_map(argv[1]))
+    {
+        printf("no module summary in %s, enable linker map file\r\n", argv[1]);
+        return 1;
+    }
+    if ((argc >= 3) && !load_budget(argv[2]))
+    {
+        printf("load budget %s failed!\r\n", argv[2]);
+        return 1;
+    }
+
+    qsort(modules, module_num, sizeof(module_t), compare_rw);
+
+    uint32_t ro_total = 0;
+    uint32_t rw_total = 0;
+    uint32_t over = 0;
+    printf("%-32s %10s %10s %10s %8s\n", "module", "ro code", "ro data", "rw data", "ram %");
+    for (uint32_t i = 0; i < module_num; ++i)
+    {
+        const module_t *module = &modules[i];
+        uint32_t ro = module->ro_code + module->ro_data;
+        bool over_rw = (module->max_rw >= 0) && (module->rw_data > (uint32_t)module->max_rw);
+        bool over_ro = (module->max_ro >= 0) && (ro > (uint32_t)module->max_ro);
+        printf("%-32s %10u %10u %10u %7.1f%%", module->name, module->ro_code,
+               module->ro_data, module->rw_data, module->rw_data * 100.0 / RAM_SIZE);
+        if (over_rw || over_ro)
+        {
+            printf("  over budget rw %d ro %d", module->max_rw, module->max_ro);
+            over++;
+        }
+        printf("\n");
+        ro_total += ro;
+        rw_total += module->rw_data;
+    }
+    printf("\nflash %u / %u (%.1f%%), ram %u / %u (%.1f%%)\n", ro_total, FLASH_SIZE,
+           ro_total * 100.0 / FLASH_SIZE, rw_total, RAM_SIZE, rw_total * 100.0 / RAM_SIZE);
+    if (0 != over)
+    {
+        printf("%u modules over budget\n", over);
+        return 2;
+    }
+
+    return 0;
+}